@@ -0,0 +1,95 @@
+// Animation benchmark: sampling a clip and composing joint transforms for
+// 1000 characters of 64 joints, on the calling thread and split over the
+// thread pool, in ms per frame.
+#include "animation.hpp"
+#include "thread_pool.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+static constexpr size_t CHARACTERS = 1000;
+static constexpr size_t JOINTS = 64;
+static constexpr unsigned int FRAMES = 100;
+
+template <class F>
+static double time_ms( F f ) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+// joints in chains of eight
+static Skeleton skeleton() {
+    Skeleton skeleton;
+    for( size_t joint=0; joint<JOINTS; joint++ ) {
+        skeleton.names.push_back( "joint" + std::to_string( joint ) );
+        skeleton.parents.push_back( joint % 8 == 0 ? Skeleton::NO_PARENT : joint - 1 );
+        skeleton.translations.emplace_back( 0.0, 1.0, 0.0 );
+        skeleton.rotations.emplace_back( 1.0, 0.0, 0.0, 0.0 );
+        skeleton.scales.emplace_back( 1.0 );
+    }
+    return skeleton;
+}
+
+// every joint rotating, translations and scales constant
+static AnimationClip clip() {
+    AnimationClip clip;
+    clip.duration = 4.0;
+    clip.frame_count = (uint32_t)( clip.duration * clip.sample_rate ) + 1;
+    for( size_t joint=0; joint<JOINTS; joint++ ) {
+        AnimationClip::Channel channel;
+        channel.translation = AnimationClip::Track{ (uint32_t)clip.translations.size(), 1 };
+        clip.translations.emplace_back( 0.0, 1.0, 0.0 );
+        channel.rotation = AnimationClip::Track{ (uint32_t)clip.rotations.size(), clip.frame_count };
+        for( uint32_t frame=0; frame<clip.frame_count; frame++ ) {
+            float angle = 0.1f * frame + joint;
+            clip.rotations.push_back( PackedQuat::pack( glm::quat{ std::cos( angle ), 0.0f, std::sin( angle ), 0.0f } ) );
+        }
+        clip.channels.push_back( channel );
+    }
+    return clip;
+}
+
+// local pose, composed and multiplied down the chains
+static void pose( const Skeleton& skeleton, const AnimationClip& clip, float time, std::vector<Affine>& joints ) {
+    thread_local std::vector<glm::vec3> translations, scales;
+    thread_local std::vector<glm::quat> rotations;
+    translations.resize( skeleton.size() );
+    rotations.resize( skeleton.size() );
+    scales.resize( skeleton.size() );
+    clip.sample( skeleton, time, translations.data(), rotations.data(), scales.data() );
+    joints.resize( skeleton.size() );
+    affine_op::compose( translations.data(), rotations.data(), scales.data(), joints.data(), skeleton.size() );
+    for( size_t joint=0; joint<skeleton.size(); joint++ ) {
+        if( skeleton.parents[joint] != Skeleton::NO_PARENT ) {
+            joints[joint] = affine_op::multiply( joints[ skeleton.parents[joint] ], joints[joint] );
+        }
+    }
+}
+
+int main() {
+    ThreadPool pool;
+    auto character_skeleton = skeleton();
+    auto character_clip = clip();
+    std::vector<std::vector<Affine>> joints( CHARACTERS );
+
+    double single_ms = time_ms( [&](){
+            for( unsigned int frame=0; frame<FRAMES; frame++ ) {
+                for( size_t i=0; i<CHARACTERS; i++ ) {
+                    pose( character_skeleton, character_clip, 0.013f * frame + 0.001f * i, joints[i] );
+                }
+            }
+    }) / FRAMES;
+    double pool_ms = time_ms( [&](){
+            for( unsigned int frame=0; frame<FRAMES; frame++ ) {
+                pool.parallel_for( 0, CHARACTERS, [&]( size_t begin, size_t end ){
+                        for( size_t i=begin; i<end; i++ ) {
+                            pose( character_skeleton, character_clip, 0.013f * frame + 0.001f * i, joints[i] );
+                        }
+                }, 16 );
+            }
+    }) / FRAMES;
+    std::printf( "%zu characters, %zu joints, clip %zu bytes: %.3f ms, pool %.3f ms\n",
+            CHARACTERS, JOINTS, character_clip.memory(), single_ms, pool_ms );
+}
@@ -0,0 +1,94 @@
+// Box transform benchmark: 100k boxes with random affine transforms.
+// Compares transforming the eight corners of each box through a mat4 with
+// the batched center and extent kernels used by model_system.
+#include "geometry/box_batch.hpp"
+#include "affine.hpp"
+
+#include "glm/glm.hpp"
+#include "glm/gtx/quaternion.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <vector>
+
+static constexpr size_t BOXES = 100000;
+static constexpr int ITERATIONS = 50;
+
+// the corner path model_system used before the batch
+static Box corner_transform( const glm::mat4& transform, const Box& box ) {
+    glm::vec3 p1{ std::numeric_limits<float>::infinity() }, p2{ -std::numeric_limits<float>::infinity() };
+    for( int corner=0; corner<8; corner++ ) {
+        glm::vec4 point = transform * glm::vec4{
+            corner & 1 ? box.max().x : box.min().x,
+            corner & 2 ? box.max().y : box.min().y,
+            corner & 4 ? box.max().z : box.min().z,
+            1.0 };
+        for( int axis=0; axis<3; axis++ ) {
+            p1[axis] = std::min( p1[axis], point[axis] );
+            p2[axis] = std::max( p2[axis], point[axis] );
+        }
+    }
+    return Box{ p1, p2 };
+}
+
+int main() {
+    std::mt19937 random{42};
+    std::uniform_real_distribution<float> value{ -10.0, 10.0 };
+    std::uniform_real_distribution<float> angle{ 0.0, 2.0 * M_PI };
+
+    std::vector<Affine> transforms( BOXES );
+    std::vector<glm::mat4> matrices( BOXES );
+    std::vector<Box> boxes( BOXES );
+    BoxBatch batch;
+    batch.reserve( BOXES );
+    for( size_t i=0; i<BOXES; i++ ) {
+        auto rotation = glm::angleAxis( angle(random), glm::normalize( glm::vec3{ value(random), value(random), value(random) } ) );
+        transforms[i] = affine_op::compose( glm::vec3{ value(random), value(random), value(random) }, rotation, glm::vec3{ 1.0 + value(random) * 0.05 } );
+        matrices[i] = transforms[i].to_mat4();
+        glm::vec3 corner{ value(random), value(random), value(random) };
+        boxes[i] = Box{ corner, corner + glm::vec3{ 1.0, 2.0, 0.5 } };
+        batch.push_back( boxes[i] );
+    }
+
+    std::vector<Box> corner_boxes( BOXES );
+    double corner_ms = 0.0;
+    for( int iteration=0; iteration<ITERATIONS; iteration++ ) {
+        auto start = std::chrono::steady_clock::now();
+        for( size_t i=0; i<BOXES; i++ ) {
+            corner_boxes[i] = corner_transform( matrices[i], boxes[i] );
+        }
+        corner_ms += std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+    }
+
+    BoxBatch out;
+    double batch_ms = 0.0, merge_ms = 0.0;
+    Box merged;
+    for( int iteration=0; iteration<ITERATIONS; iteration++ ) {
+        auto start = std::chrono::steady_clock::now();
+        box_op::transform( transforms.data(), batch, out );
+        auto transformed = std::chrono::steady_clock::now();
+        merged = box_op::merge( out );
+        auto merged_time = std::chrono::steady_clock::now();
+        batch_ms += std::chrono::duration<double, std::milli>( transformed - start ).count();
+        merge_ms += std::chrono::duration<double, std::milli>( merged_time - transformed ).count();
+    }
+
+    float max_error = 0.0;
+    for( size_t i=0; i<BOXES; i++ ) {
+        auto box = out.get( i );
+        for( int axis=0; axis<3; axis++ ) {
+            max_error = std::max( max_error, std::abs( box.min()[axis] - corner_boxes[i].min()[axis] ) );
+            max_error = std::max( max_error, std::abs( box.max()[axis] - corner_boxes[i].max()[axis] ) );
+        }
+    }
+
+    std::printf( "boxes: %zu, max difference %g\n", BOXES, max_error );
+    std::printf( "per box corners: %.3f ms (%.1f ns per box)\n",
+            corner_ms / ITERATIONS, corner_ms / ITERATIONS * 1e6 / BOXES );
+    std::printf( "batched center and extent: %.3f ms (%.1f ns per box), merge %.3f ms\n",
+            batch_ms / ITERATIONS, batch_ms / ITERATIONS * 1e6 / BOXES, merge_ms / ITERATIONS );
+    return 0;
+}
@@ -0,0 +1,87 @@
+// Broad phase benchmark: 100k boxes of 1-2 units through a 800x200x800 world,
+// as broad_phase_system drives the spatial hash with the thread pool. Reports
+// the update (moves and rebuild) and pair collection times per frame with every
+// box moving and with one in ten moving, the others set to unchanged bounds,
+// then query times.
+#include "geometry/spatial_hash.hpp"
+#include "thread_pool.hpp"
+
+#include "glm/glm.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+static constexpr size_t BOXES = 100000;
+static constexpr size_t FRAMES = 60;
+static constexpr size_t QUERIES = 1000;
+
+static double milliseconds_since( std::chrono::steady_clock::time_point start ) {
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+int main() {
+    std::mt19937 random{42};
+    std::uniform_real_distribution<float> position{ -400.0, 400.0 };
+    std::uniform_real_distribution<float> size{ 1.0, 2.0 };
+    std::uniform_real_distribution<float> speed{ -0.5, 0.5 };
+
+    SpatialHash hash{ 4.0 };
+    std::vector<Box> boxes( BOXES );
+    std::vector<glm::vec3> velocities( BOXES );
+    std::vector<uint32_t> ids( BOXES );
+    for( size_t i=0; i<BOXES; i++ ) {
+        glm::vec3 corner{ position(random), position(random) * 0.25f, position(random) };
+        boxes[i] = Box{ corner, corner + glm::vec3{ size(random), size(random), size(random) } };
+        velocities[i] = glm::vec3{ speed(random), speed(random), speed(random) };
+        ids[i] = hash.insert( boxes[i] );
+    }
+
+    ThreadPool pool;
+    std::vector<std::pair<uint32_t, uint32_t>> pairs;
+    std::printf( "boxes: %zu, threads: %u\n", BOXES, pool.size() + 1 );
+    for( size_t moving_every : { 1, 10 } ) {
+        double update_ms = 0.0, pairs_ms = 0.0;
+        size_t pair_count = 0;
+        for( size_t frame=0; frame<FRAMES; frame++ ) {
+            auto start = std::chrono::steady_clock::now();
+            for( size_t i=0; i<BOXES; i++ ) {
+                if( i % moving_every == frame % moving_every ) {
+                    boxes[i] = Box{ boxes[i].min() + velocities[i], boxes[i].max() + velocities[i] };
+                }
+                hash.set( ids[i], boxes[i] );
+            }
+            hash.rebuild( &pool );
+            update_ms += milliseconds_since( start );
+            start = std::chrono::steady_clock::now();
+            hash.pairs( pairs, &pool );
+            pairs_ms += milliseconds_since( start );
+            pair_count += pairs.size();
+        }
+        std::printf( "1 in %zu moving, cell entries: %zu\n", moving_every, hash.entry_count() );
+        std::printf( "  update: %.2f ms/frame\n", update_ms / FRAMES );
+        std::printf( "  pairs: %.2f ms/frame (%zu pairs/frame)\n", pairs_ms / FRAMES, pair_count / FRAMES );
+    }
+
+    std::vector<uint32_t> found;
+    size_t found_count = 0;
+    auto start = std::chrono::steady_clock::now();
+    for( size_t i=0; i<QUERIES; i++ ) {
+        glm::vec3 corner{ position(random), position(random) * 0.25f, position(random) };
+        hash.query( Box{ corner, corner + glm::vec3{ 10.0 } }, found );
+        found_count += found.size();
+    }
+    std::printf( "box queries: %.2f us each (%zu found)\n", milliseconds_since( start ) * 1e3 / QUERIES, found_count );
+
+    std::vector<std::pair<uint32_t, float>> hits;
+    size_t hit_count = 0;
+    start = std::chrono::steady_clock::now();
+    for( size_t i=0; i<QUERIES; i++ ) {
+        glm::vec3 origin{ position(random), position(random) * 0.25f, position(random) };
+        glm::vec3 direction = glm::normalize( glm::vec3{ speed(random), speed(random), speed(random) } );
+        hash.query( Ray{ origin, direction }, hits, 100.0 );
+        hit_count += hits.size();
+    }
+    std::printf( "ray queries: %.2f us each (%zu hits)\n", milliseconds_since( start ) * 1e3 / QUERIES, hit_count );
+}
@@ -0,0 +1,41 @@
+// Icosphere benchmark: MeshBuilder::icosphere at 0 to 9 divisions, on the
+// calling thread and split over the thread pool, in ms per sphere.
+#include "mesh.hpp"
+#include "thread_pool.hpp"
+
+#include <chrono>
+#include <cstdio>
+
+static constexpr unsigned int MAX_DIVISIONS = 9;
+
+template <class F>
+static double time_ms( F f ) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+int main() {
+    ThreadPool pool;
+    for( unsigned int divisions=0; divisions<=MAX_DIVISIONS; divisions++ ) {
+        // small levels are repeated for a measurable time
+        unsigned int repeats = divisions < 6 ? 1u << ( 2 * ( 6 - divisions ) ) : 1u;
+        size_t vertices = 0, triangles = 0;
+        double single_ms = time_ms( [&](){
+                for( unsigned int i=0; i<repeats; i++ ) {
+                    MeshBuilder builder;
+                    builder.icosphere( 1.0, divisions );
+                    vertices = builder.vertex_count();
+                    triangles = builder.triangle_count();
+                }
+        }) / repeats;
+        double pool_ms = time_ms( [&](){
+                for( unsigned int i=0; i<repeats; i++ ) {
+                    MeshBuilder builder;
+                    builder.icosphere( 1.0, divisions, glm::vec3{0.0}, &pool );
+                }
+        }) / repeats;
+        std::printf( "divisions %u: %zu vertices, %zu triangles, %.3f ms, pool %.3f ms\n",
+                divisions, vertices, triangles, single_ms, pool_ms );
+    }
+}
@@ -0,0 +1,86 @@
+// Light culling benchmark: 1k ranged point lights and 10k models spread over
+// a 200x200 area, camera looking over the scene. Measures frustum culling of
+// the lights and the per model light lists built by model_system.
+#include "lights.hpp"
+#include "camera.hpp"
+#include "matrix_op.hpp"
+#include "geometry/frustum.hpp"
+
+#include "glm/glm.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+static constexpr size_t LIGHTS = 1000;
+static constexpr size_t MODELS = 10000;
+static constexpr int ITERATIONS = 20;
+
+int main() {
+    std::mt19937 random{42};
+    std::uniform_real_distribution<float> position{ -100.0, 100.0 };
+    std::uniform_real_distribution<float> size{ 0.5, 2.0 };
+    std::uniform_real_distribution<float> range{ 2.0, 10.0 };
+
+    std::vector<ShaderLight> lights( LIGHTS );
+    for( auto& light : lights ) {
+        light.type = ShaderLight::Type::Point;
+        light.position = glm::vec4{ position(random), 1.0, position(random), 1.0 };
+        light.color = glm::vec3{ 1.0 };
+        light.radius = range(random);
+    }
+    std::vector<Box> boxes;
+    boxes.reserve( MODELS );
+    for( size_t i=0; i<MODELS; i++ ) {
+        glm::vec3 center{ position(random), 0.0, position(random) };
+        glm::vec3 extent{ size(random) };
+        boxes.emplace_back( center - extent, center + extent );
+    }
+
+    // camera above the scene looking at its center
+    Camera camera{ (float)M_PI/3, -0.1, -300.0, 16.0/9.0 };
+    auto view = matrix_op::rotate_x( (float)M_PI/4 ) * matrix_op::translation( 0.0, -60.0, -60.0 );
+    Frustum frustum{ camera.projection_matrix * view };
+
+    FrameLights frame_lights;
+    std::vector<size_t> indices;
+    size_t references = 0, visible_models = 0;
+    double cull_ms = 0.0, list_ms = 0.0;
+    for( int iteration=0; iteration<ITERATIONS; iteration++ ) {
+        auto start = std::chrono::steady_clock::now();
+        frame_lights.clear();
+        for( GLuint i=0; i<lights.size(); i++ ) {
+            auto bounds = light_bounds( lights[i] );
+            if( !frustum.intersects( bounds ) ) {
+                frame_lights.culled++;
+                continue;
+            }
+            frame_lights.ranged.push_back( i );
+            frame_lights.bounds.push_back( bounds );
+        }
+        auto culled = std::chrono::steady_clock::now();
+
+        references = visible_models = 0;
+        for( const auto& box : boxes ) {
+            if( !frustum.intersects( box ) ) {
+                continue;
+            }
+            visible_models++;
+            indices.clear();
+            frame_lights.affecting( box, indices );
+            references += indices.size();
+        }
+        auto listed = std::chrono::steady_clock::now();
+
+        cull_ms += std::chrono::duration<double, std::milli>( culled - start ).count();
+        list_ms += std::chrono::duration<double, std::milli>( listed - culled ).count();
+    }
+
+    std::printf( "lights: %zu, in frustum: %zu, culled: %zu\n", LIGHTS, frame_lights.ranged.size(), frame_lights.culled );
+    std::printf( "models: %zu, in frustum: %zu\n", MODELS, visible_models );
+    std::printf( "light references: %zu (%.2f per visible model, %zu without culling)\n",
+            references, visible_models > 0 ? (double)references / visible_models : 0.0, visible_models * LIGHTS );
+    std::printf( "light frustum culling: %.3f ms, per model lists: %.3f ms\n", cull_ms / ITERATIONS, list_ms / ITERATIONS );
+    return 0;
+}
@@ -0,0 +1,90 @@
+// Ray packet benchmark: a pinhole camera's rays traced through a BVH over
+// 100k random boxes. Compares single rays with 4, 8 and 16 ray packets, and
+// 8 ray packets split over the thread pool as Raycaster does, in rays/second.
+#include "geometry/bvh.hpp"
+#include "geometry/ray_packet.hpp"
+#include "thread_pool.hpp"
+
+#include "glm/glm.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+static constexpr size_t BOXES = 100000;
+static constexpr size_t WIDTH = 1024;
+static constexpr size_t HEIGHT = 1024;
+
+template <size_t N>
+static size_t trace( const BVH& bvh, const std::vector<Box>& boxes, const std::vector<Ray>& rays, size_t begin, size_t end ) {
+    size_t hit_count = 0;
+    for( size_t first=begin; first<end; first+=N ) {
+        size_t count = std::min( N, end - first );
+        RayPacket<N> packet;
+        for( size_t lane=0; lane<count; lane++ ) {
+            packet.set( lane, rays[first + lane] );
+        }
+        BVH::Hit hits[N];
+        bvh.intersect( boxes, packet, hits );
+        for( size_t lane=0; lane<count; lane++ ) {
+            hit_count += hits[lane].primitive != BVH::NO_HIT;
+        }
+    }
+    return hit_count;
+}
+
+template <size_t N>
+static void report( const char* name, const BVH& bvh, const std::vector<Box>& boxes, const std::vector<Ray>& rays ) {
+    auto start = std::chrono::steady_clock::now();
+    size_t hits = trace<N>( bvh, boxes, rays, 0, rays.size() );
+    double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+    std::printf( "%s: %.2f Mrays/s (%zu hits)\n", name, rays.size() / seconds * 1e-6, hits );
+}
+
+int main() {
+    std::mt19937 random{42};
+    std::uniform_real_distribution<float> position{ -100.0, 100.0 };
+    std::uniform_real_distribution<float> size{ 0.2, 3.0 };
+
+    std::vector<Box> boxes( BOXES );
+    for( auto& box : boxes ) {
+        glm::vec3 corner{ position(random), position(random), position(random) };
+        box = Box{ corner, corner + glm::vec3{ size(random), size(random), size(random) } };
+    }
+    auto start = std::chrono::steady_clock::now();
+    BVH bvh{ boxes };
+    double build_ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+    std::printf( "boxes: %zu, BVH nodes: %zu, build %.1f ms\n", BOXES, bvh.nodes().size(), build_ms );
+
+    // rows of pixels from outside the scene, neighbouring rays are coherent
+    std::vector<Ray> rays;
+    rays.reserve( WIDTH * HEIGHT );
+    glm::vec3 eye{ 0.0, 0.0, 250.0 };
+    for( size_t y=0; y<HEIGHT; y++ ) {
+        for( size_t x=0; x<WIDTH; x++ ) {
+            glm::vec3 target{ ( x + 0.5f ) / WIDTH * 2.0f - 1.0f, ( y + 0.5f ) / HEIGHT * 2.0f - 1.0f, -1.0 };
+            rays.emplace_back( eye, glm::normalize( target ) );
+        }
+    }
+
+    report<1>( "single rays", bvh, boxes, rays );
+    report<4>( "4 ray packets", bvh, boxes, rays );
+    report<8>( "8 ray packets", bvh, boxes, rays );
+    report<16>( "16 ray packets", bvh, boxes, rays );
+
+    ThreadPool pool;
+    std::vector<size_t> hits( pool.size() + 1, 0 );
+    start = std::chrono::steady_clock::now();
+    pool.parallel_for( 0, rays.size(), [&]( size_t begin, size_t end ){
+            hits[ begin * hits.size() / rays.size() ] += trace<8>( bvh, boxes, rays, begin, end );
+    }, 1024 );
+    double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+    size_t total = 0;
+    for( auto count : hits ) {
+        total += count;
+    }
+    std::printf( "8 ray packets, %u workers and caller: %.2f Mrays/s (%zu hits)\n",
+            pool.size(), rays.size() / seconds * 1e-6, total );
+    return 0;
+}
@@ -0,0 +1,71 @@
+// Transform kernel benchmark: 100k transforms with random translation,
+// rotation and scale. Compares the per entity glm path (three mat4 and a
+// parent mat4 product) with the batched affine kernels used by transform_system.
+#include "affine.hpp"
+#include "matrix_op.hpp"
+
+#include "glm/glm.hpp"
+#include "glm/gtx/quaternion.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+static constexpr size_t TRANSFORMS = 100000;
+static constexpr int ITERATIONS = 50;
+
+int main() {
+    std::mt19937 random{42};
+    std::uniform_real_distribution<float> value{ -10.0, 10.0 };
+    std::uniform_real_distribution<float> angle{ 0.0, 2.0 * M_PI };
+
+    std::vector<glm::vec3> translations( TRANSFORMS ), scales( TRANSFORMS );
+    std::vector<glm::quat> rotations( TRANSFORMS );
+    for( size_t i=0; i<TRANSFORMS; i++ ) {
+        translations[i] = glm::vec3{ value(random), value(random), value(random) };
+        scales[i] = glm::vec3{ 1.0 + value(random) * 0.05 };
+        rotations[i] = glm::angleAxis( angle(random), glm::normalize( glm::vec3{ value(random), value(random), value(random) } ) );
+    }
+    // each transform's parent is an earlier one, as after sorting the hierarchy
+    std::vector<size_t> parents( TRANSFORMS );
+    for( size_t i=0; i<TRANSFORMS; i++ ) {
+        parents[i] = i == 0 ? 0 : random() % i;
+    }
+
+    std::vector<glm::mat4> matrices( TRANSFORMS );
+    double matrix_ms = 0.0;
+    for( int iteration=0; iteration<ITERATIONS; iteration++ ) {
+        auto start = std::chrono::steady_clock::now();
+        for( size_t i=0; i<TRANSFORMS; i++ ) {
+            auto local = matrix_op::translation( translations[i].x, translations[i].y, translations[i].z )
+                       * glm::mat4_cast( rotations[i] )
+                       * matrix_op::scale( scales[i].x, scales[i].y, scales[i].z );
+            matrices[i] = matrices[ parents[i] ] * local;
+        }
+        matrix_ms += std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+    }
+
+    std::vector<Affine> locals( TRANSFORMS ), parent_globals( TRANSFORMS ), globals( TRANSFORMS );
+    double compose_ms = 0.0, multiply_ms = 0.0;
+    for( int iteration=0; iteration<ITERATIONS; iteration++ ) {
+        auto start = std::chrono::steady_clock::now();
+        affine_op::compose( translations.data(), rotations.data(), scales.data(), locals.data(), TRANSFORMS );
+        auto composed = std::chrono::steady_clock::now();
+        // parents gathered from the previous iteration, as transform_system does per level
+        for( size_t i=0; i<TRANSFORMS; i++ ) {
+            parent_globals[i] = globals[ parents[i] ];
+        }
+        affine_op::multiply( parent_globals.data(), locals.data(), globals.data(), TRANSFORMS );
+        auto multiplied = std::chrono::steady_clock::now();
+        compose_ms += std::chrono::duration<double, std::milli>( composed - start ).count();
+        multiply_ms += std::chrono::duration<double, std::milli>( multiplied - composed ).count();
+    }
+
+    std::printf( "transforms: %zu, kernels: %s\n", TRANSFORMS, affine_op::implementation() );
+    std::printf( "per entity mat4: %.3f ms (%.1f ns per transform)\n",
+            matrix_ms / ITERATIONS, matrix_ms / ITERATIONS * 1e6 / TRANSFORMS );
+    std::printf( "batched affine: compose %.3f ms, gather and multiply %.3f ms (%.1f ns per transform)\n",
+            compose_ms / ITERATIONS, multiply_ms / ITERATIONS, ( compose_ms + multiply_ms ) / ITERATIONS * 1e6 / TRANSFORMS );
+    return 0;
+}
@@ -0,0 +1,67 @@
+#ifndef _REPLICATOR_AFFINE_HPP_
+#define _REPLICATOR_AFFINE_HPP_
+
+#include "glm/vec3.hpp"
+#include "glm/vec4.hpp"
+#include "glm/mat4x4.hpp"
+#include "glm/gtx/quaternion.hpp"
+
+#include <cstddef>
+
+// Affine transform as the top three rows of a 4x4 matrix, the last row is
+// always (0, 0, 0, 1). Each row holds (x axis, y axis, z axis, translation)
+// components, so rows load directly into SIMD registers.
+struct Affine {
+    glm::vec4 rows[3] = {
+        glm::vec4{1.0, 0.0, 0.0, 0.0},
+        glm::vec4{0.0, 1.0, 0.0, 0.0},
+        glm::vec4{0.0, 0.0, 1.0, 0.0},
+    };
+
+    glm::mat4 to_mat4() const;
+    // drops the last row of matrix
+    static Affine from_mat4( const glm::mat4& matrix );
+
+    inline glm::vec3 translation() const { return glm::vec3{ rows[0].w, rows[1].w, rows[2].w }; }
+
+    inline glm::vec3 transform_point( const glm::vec3& p ) const {
+        return glm::vec3{
+            rows[0].x*p.x + rows[0].y*p.y + rows[0].z*p.z + rows[0].w,
+            rows[1].x*p.x + rows[1].y*p.y + rows[1].z*p.z + rows[1].w,
+            rows[2].x*p.x + rows[2].y*p.y + rows[2].z*p.z + rows[2].w,
+        };
+    }
+    inline glm::vec3 transform_vector( const glm::vec3& v ) const {
+        return glm::vec3{
+            rows[0].x*v.x + rows[0].y*v.y + rows[0].z*v.z,
+            rows[1].x*v.x + rows[1].y*v.y + rows[1].z*v.z,
+            rows[2].x*v.x + rows[2].y*v.y + rows[2].z*v.z,
+        };
+    }
+
+    // inverse of the 3x3 part and negated rotated translation, cheaper than a 4x4 inverse
+    Affine inverse() const;
+
+    Affine operator*( const Affine& other ) const;
+};
+
+// Batched affine operations, using AVX2 or SSE when the CPU supports them
+namespace affine_op {
+
+    // out[i] = translation(translations[i]) * rotation(rotations[i]) * scale(scales[i]),
+    // rotations must be unit quaternions
+    void compose( const glm::vec3* translations, const glm::quat* rotations, const glm::vec3* scales, Affine* out, size_t count );
+
+    // out[i] = parents[i] * locals[i], out may alias locals
+    void multiply( const Affine* parents, const Affine* locals, Affine* out, size_t count );
+
+    // single transform versions
+    Affine compose( const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale );
+    Affine multiply( const Affine& parent, const Affine& local );
+
+    // "avx2", "sse" or "scalar"
+    const char* implementation();
+
+}
+
+#endif // _REPLICATOR_AFFINE_HPP_
@@ -0,0 +1,147 @@
+#ifndef _REPLICATOR_ANIMATION_H_
+#define _REPLICATOR_ANIMATION_H_
+
+#include "affine.hpp"
+#include "shaders.hpp"
+#include "geometry/box.hpp"
+
+#include "glm/vec3.hpp"
+#include "glm/gtx/quaternion.hpp"
+#include "glad/glad.h"
+
+#include "entt/entt.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Joints of a skeleton and their local rest pose, parents come before their children
+struct Skeleton {
+    static constexpr uint16_t NO_PARENT = 0xffff;
+
+    std::vector<std::string> names;
+    std::vector<uint16_t> parents;
+    std::vector<glm::vec3> translations;
+    std::vector<glm::quat> rotations;
+    std::vector<glm::vec3> scales;
+
+    inline size_t size() const { return parents.size(); }
+    // Index of the joint named name
+    std::optional<uint16_t> find( const std::string& name ) const;
+};
+
+// Unit quaternion as four snorm16 components
+struct PackedQuat {
+    int16_t x, y, z, w;
+
+    static PackedQuat pack( const glm::quat& rotation );
+    glm::quat unpack() const;
+};
+
+// Keyframes resampled at a fixed rate, so sampling indexes keys instead of
+// searching them. The keys of each joint property are one contiguous run,
+// constant properties keep a single key and properties without keys keep
+// the rest pose of the skeleton.
+struct AnimationClip {
+    // keys of a property, count is 0, 1 or frame_count
+    struct Track {
+        uint32_t first = 0;
+        uint32_t count = 0;
+    };
+    struct Channel {
+        Track translation;
+        Track rotation;
+        Track scale;
+    };
+
+    std::string name;
+    // seconds
+    float duration = 0.0;
+    // frames per second
+    float sample_rate = 30.0;
+    uint32_t frame_count = 0;
+    // of each skeleton joint
+    std::vector<Channel> channels;
+    std::vector<glm::vec3> translations;
+    std::vector<PackedQuat> rotations;
+    std::vector<glm::vec3> scales;
+
+    // Local pose of every joint of skeleton at time in seconds, clamped to the clip
+    void sample( const Skeleton& skeleton, float time, glm::vec3* translations, glm::quat* rotations, glm::vec3* scales ) const;
+
+    // bytes of the keys
+    size_t memory() const;
+};
+
+// Plays a clip on a skeleton, on the root entity of a skinned model
+struct Animator {
+    std::shared_ptr<const Skeleton> skeleton;
+    std::shared_ptr<const AnimationClip> clip;
+    // seconds into the clip
+    float time = 0.0;
+    float speed = 1.0;
+    bool loop = true;
+    // joint transforms relative to the entity, written by animation_system
+    std::vector<Affine> joints;
+};
+
+// Skeleton joints driving the joints of a mesh, shared by every instance of the mesh
+struct SkinBinding {
+    // skeleton joint of each mesh joint
+    std::vector<uint16_t> joints;
+    // from mesh space to each mesh joint's space in the bind pose
+    std::vector<Affine> inverse_binds;
+    // mesh space bind pose bounds of the vertices each mesh joint moves,
+    // without them every joint moves the whole mesh bounds
+    std::vector<Box> bounds;
+};
+
+// Model skinned by the Animator of an entity. The mesh is drawn with world
+// space joint palettes, its own transform only places its bounds.
+struct Skin {
+    // palette of skins not posed this frame
+    static constexpr uint32_t NO_PALETTE = 0xffffffff;
+
+    entt::entity animator = entt::null;
+    std::shared_ptr<const SkinBinding> binding;
+    // first joint of the skin in JointPalettes::palettes(), set by animation_system
+    uint32_t palette = NO_PALETTE;
+    // world bounds of the posed skin, the joint bounds moved by the palette
+    Box bounds;
+};
+
+// World space skinning matrices of all skins. animation_system writes them each
+// frame, model_system packs the drawn ones per instanced draw into a texture
+// buffer of three RGBA32F texels (Affine rows) per joint.
+class JointPalettes {
+    public:
+        // Texture unit of the palette buffer
+        static constexpr GLuint UNIT = 16;
+
+        JointPalettes();
+        ~JointPalettes();
+
+        JointPalettes( const JointPalettes& other ) = delete;
+        JointPalettes& operator=( const JointPalettes& other ) = delete;
+
+        inline std::vector<Affine>& palettes() { return _palettes; }
+        inline const std::vector<Affine>& palettes() const { return _palettes; }
+
+        // Upload joints in draw order and bind the buffer to its unit
+        void upload( const std::vector<Affine>& joints );
+        // Set palette sampler of program
+        static void bind( ShaderProgram& program );
+
+    private:
+        GLuint _buffer = 0;
+        GLuint _texture = 0;
+        std::vector<Affine> _palettes;
+};
+
+// Advance animators by the frame time, sample their clips into joint transforms
+// and write the palettes and bounds of the skins, both in parallel on the registry ThreadPool
+void animation_system( entt::registry& registry );
+
+#endif // _REPLICATOR_ANIMATION_H_
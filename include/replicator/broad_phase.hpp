@@ -0,0 +1,80 @@
+#ifndef _REPLICATOR_BROAD_PHASE_H_
+#define _REPLICATOR_BROAD_PHASE_H_
+
+#include "geometry/box.hpp"
+#include "geometry/ray.hpp"
+#include "geometry/spatial_hash.hpp"
+
+#include "entt/entt.hpp"
+
+#include <limits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Local bounds tested by the broad phase, models without one use their mesh bounds
+struct Collider {
+    Box bounds;
+};
+
+// World bounds of every entity with a transform and a collider or model in a
+// spatial hash. Component signals record changed entities, broad_phase_system
+// only moves those and collects the overlapping pairs once per frame, on the
+// pool when given. Not set by the engine, states calling broad_phase_system
+// set it and connect it. Unlike ShadowMaps, whose signals the engine connects
+// up front, connecting also queues the entities that already exist.
+class BroadPhase {
+    public:
+        BroadPhase( float cell_size = 4.0, ThreadPool* pool = nullptr ) : _hash{cell_size}, _pool{pool} {}
+
+        // Insert or move the world bounds of entity
+        void set( entt::entity entity, const Box& bounds );
+        // Remove entity if present
+        void remove( entt::entity entity );
+
+        // Apply the changes and collect the overlapping pairs
+        void update();
+
+        // Pairs of entities with overlapping bounds as of the last update
+        inline const std::vector<std::pair<entt::entity, entt::entity>>& pairs() const { return _pairs; }
+        // Entities whose bounds intersect box
+        std::vector<entt::entity> query( const Box& box ) const;
+        // Entities whose bounds the ray enters up to max_distance and their
+        // entry distances, closest first
+        std::vector<std::pair<entt::entity, float>> query( const Ray& ray,
+                float max_distance = std::numeric_limits<float>::infinity() ) const;
+
+        inline size_t size() const { return _ids.size(); }
+        inline const SpatialHash& hash() const { return _hash; }
+
+        // Entities whose components changed since the last take_changed, may repeat
+        std::vector<entt::entity> take_changed();
+
+        // Record a change of a component bounds depend on
+        template<class T>
+        static void on_change( entt::entity entity, entt::registry& registry, T& ) {
+            auto broad_phase_ptr = registry.try_ctx<BroadPhase>();
+            if( broad_phase_ptr != nullptr ) {
+                broad_phase_ptr->_changed.push_back( entity );
+            }
+        }
+
+        // Connect change signals of transforms, models and colliders, after
+        // setting the broad phase so existing entities are added
+        static void connect( entt::registry& registry );
+
+    private:
+        SpatialHash _hash;
+        ThreadPool* _pool;
+        std::unordered_map<entt::entity, uint32_t> _ids;
+        // entity of each hash id
+        std::vector<entt::entity> _entities;
+        std::vector<entt::entity> _changed;
+        std::vector<std::pair<entt::entity, entt::entity>> _pairs;
+        std::vector<std::pair<uint32_t, uint32_t>> _id_pairs;
+};
+
+// Move the bounds of changed entities and update the broad phase
+void broad_phase_system( entt::registry& registry );
+
+#endif // _REPLICATOR_BROAD_PHASE_H_
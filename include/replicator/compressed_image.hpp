@@ -0,0 +1,71 @@
+#ifndef _REPLICATOR_COMPRESSED_IMAGE_H_
+#define _REPLICATOR_COMPRESSED_IMAGE_H_
+
+#include "glad/glad.h"
+
+#include <string>
+#include <vector>
+
+// Block compressed formats not exposed by the core 3.3 header
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT         0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT        0x83F1
+#define GL_COMPRESSED_RGBA_S3TC_DXT3_EXT        0x83F2
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT        0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT        0x8C4C
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT  0x8C4D
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT  0x8C4E
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT  0x8C4F
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM           0x8E8C
+#define GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM     0x8E8D
+#define GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT     0x8E8E
+#define GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT   0x8E8F
+#endif
+#ifndef GL_COMPRESSED_RGB8_ETC2
+#define GL_COMPRESSED_R11_EAC                   0x9270
+#define GL_COMPRESSED_SIGNED_R11_EAC            0x9271
+#define GL_COMPRESSED_RG11_EAC                  0x9272
+#define GL_COMPRESSED_SIGNED_RG11_EAC           0x9273
+#define GL_COMPRESSED_RGB8_ETC2                 0x9274
+#define GL_COMPRESSED_SRGB8_ETC2                0x9275
+#define GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2     0x9276
+#define GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2    0x9277
+#define GL_COMPRESSED_RGBA8_ETC2_EAC            0x9278
+#define GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC     0x9279
+#endif
+
+// Block compressed image with its mip chain, as stored in DDS and KTX files
+struct CompressedImage {
+    GLenum format = 0;
+    int width = 0;
+    int height = 0;
+    // one entry per mip level, largest first
+    std::vector<std::vector<unsigned char>> levels;
+
+    // Total size of all levels in bytes
+    size_t size() const;
+};
+
+// Return true if path has a DDS or KTX extension
+bool is_compressed_image( const std::string& path );
+
+// Read DDS, KTX or KTX2 (without supercompression) file
+CompressedImage load_compressed_image( const std::string& path );
+
+// Write image as DDS file
+void save_dds( const CompressedImage& image, const std::string& path );
+
+// Size in bytes of a 4x4 block (0 if format is not block compressed)
+size_t compressed_block_size( GLenum format );
+
+// Size in bytes of a level with given dimensions
+size_t compressed_level_size( GLenum format, int width, int height );
+
+// Return true if the current context can sample the format
+bool compressed_format_supported( GLenum format );
+
+#endif // _REPLICATOR_COMPRESSED_IMAGE_H_
@@ -0,0 +1,51 @@
+#ifndef _REPLICATOR_DEPTH_PREPASS_H_
+#define _REPLICATOR_DEPTH_PREPASS_H_
+
+#include "shaders.hpp"
+
+#include "glad/glad.h"
+
+#include "entt/entt.hpp"
+
+// Depth only pass of the opaque models before shading, so the shading pass
+// runs the fragment shader once per pixel (GL_EQUAL depth test). Also counts
+// the samples shaded by model_system.
+class DepthPrepass {
+    public:
+        // Depth program takes the model, view and projection transforms of
+        // vertex_main.glsl (see shaders/depth_vertex.glsl)
+        DepthPrepass( entt::resource_handle<ShaderProgram> depth_program, bool enabled = true );
+        ~DepthPrepass();
+
+        DepthPrepass( const DepthPrepass& other ) = delete;
+        DepthPrepass& operator=( const DepthPrepass& other ) = delete;
+
+        inline bool enabled() const { return _enabled; }
+        inline void set_enabled( bool enabled ) { _enabled = enabled; }
+
+        inline ShaderProgram& program() { return *_depth_program; }
+
+        // Count samples passing the depth test between begin and end
+        void begin_count();
+        void end_count( unsigned int width, unsigned int height );
+
+        // Shaded samples of the last counted frame and the same per window pixel.
+        // Pixels nothing covers count too and multisampling counts every sample,
+        // so the ratio compares frames of one view rather than measuring overdraw
+        // against 1.0. Results lag one frame behind to avoid waiting on the GPU.
+        inline uint64_t shaded_samples() const { return _shaded_samples; }
+        inline double samples_per_pixel() const { return _samples_per_pixel; }
+
+    private:
+        entt::resource_handle<ShaderProgram> _depth_program;
+        bool _enabled;
+
+        GLuint _queries[2] = {0, 0};
+        bool _pending[2] = {false, false};
+        unsigned int _pixels[2] = {0, 0};
+        unsigned int _current = 0;
+        uint64_t _shaded_samples = 0;
+        double _samples_per_pixel = 0.0;
+};
+
+#endif // _REPLICATOR_DEPTH_PREPASS_H_
@@ -0,0 +1,97 @@
+#ifndef _REPLICATOR_DYNAMIC_MESH_H_
+#define _REPLICATOR_DYNAMIC_MESH_H_
+
+#include "mesh.hpp"
+#include "shaders.hpp"
+#include "geometry/box.hpp"
+
+#include "glm/vec2.hpp"
+#include "glm/vec4.hpp"
+#include "glad/glad.h"
+
+#include <vector>
+
+// Mesh with fixed triangles whose vertex attributes are rewritten every frame,
+// for deforming or procedurally animated geometry. Each attribute buffer holds
+// FRAMES copies of the vertices used round robin, a copy is mapped
+// unsynchronized once the fence placed when it was last replaced signals, so
+// writes don't wait on draws still reading the other copies. Draws select the
+// copy with a base vertex, the vertex arrays never change.
+class DynamicMesh {
+    public:
+        // vertex copies in flight
+        static constexpr unsigned int FRAMES = 3;
+
+        // Attribute arrays of the copy being written, vertex_count() long each,
+        // null for attributes the mesh doesn't have
+        struct Frame {
+            glm::vec4* vertices = nullptr;
+            glm::vec4* colors = nullptr;
+            glm::vec4* normals = nullptr;
+            glm::vec2* texcoords = nullptr;
+        };
+
+        // Create buffers for vertex_count vertices with the given attributes,
+        // indices are uploaded once
+        DynamicMesh(
+            const std::vector<GLuint>& indices,
+            size_t vertex_count,
+            bool colors = false,
+            bool normals = true,
+            bool texcoords = false
+        );
+        ~DynamicMesh();
+
+        DynamicMesh( const DynamicMesh& other ) = delete;
+        DynamicMesh& operator=( const DynamicMesh& other ) = delete;
+
+        // Map the next copy for writing, waits only if the GPU is FRAMES frames behind,
+        // throws MeshCreationException if a buffer can't be mapped
+        Frame map();
+        // Finish writing, following draws use the new copy
+        void unmap();
+        // Write every attribute of the mesh through map and unmap, updates the bounds
+        void update(
+            const std::vector<glm::vec4>& vertices,
+            const std::vector<glm::vec4>& colors = {},
+            const std::vector<glm::vec4>& normals = {},
+            const std::vector<glm::vec2>& texcoords = {}
+        );
+
+        // Draw the last written copy using program, nothing before the first write
+        void draw( const ShaderProgram& program ) const;
+        // Draw only vertex positions (attribute 0), for depth passes
+        void draw_positions( const ShaderProgram& program ) const;
+
+        // Model space bounding box, kept by update, set it when writing through map
+        inline const Box& bounding_box() const { return _bounding_box; }
+        inline void set_bounding_box( const Box& box ) { _bounding_box = box; }
+
+        inline size_t vertex_count() const { return _vertex_count; }
+        inline size_t index_count() const { return _index_count; }
+        // maps that had to wait for the GPU
+        inline size_t stalls() const { return _stalls; }
+
+    private:
+        // buffers of the attributes in location order, 0 if absent
+        GLuint _buffers[4] = {0, 0, 0, 0};
+        GLuint _index_buffer = 0;
+        GLuint _vao = 0;
+        GLuint _position_vao = 0;
+        GLenum _index_type = GL_UNSIGNED_INT;
+        size_t _index_count = 0;
+        size_t _vertex_count = 0;
+        Box _bounding_box;
+
+        // copy drawn and copy being written
+        unsigned int _drawn = 0;
+        unsigned int _writing = 0;
+        bool _mapped = false;
+        // a copy was written, draws before have nothing to show
+        bool _written = false;
+        // fences of the draws reading each copy
+        GLsync _fences[FRAMES] = {};
+        size_t _stalls = 0;
+};
+
+#endif // _REPLICATOR_DYNAMIC_MESH_H_
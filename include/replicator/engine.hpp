@@ -4,6 +4,11 @@
 #include "state.hpp"
 #include "input.hpp"
 #include "window.hpp"
+#include "texture_streamer.hpp"
+#include "texture_residency.hpp"
+#include "mesh_uploader.hpp"
+#include "program_binary_cache.hpp"
+#include "shader_variants.hpp"
 
 #include "spdlog/spdlog.h"
 
@@ -25,6 +30,16 @@ class Engine {
         void set_window_size(unsigned int width, unsigned int height);
         void set_window_title(const std::string& title);
         void set_aa(unsigned int aa) { _aa = aa; };
+        // Maximum texture bytes uploaded per frame by the texture streamer
+        void set_texture_upload_budget(size_t bytes) { _texture_upload_budget = bytes; };
+        // Maximum mesh bytes uploaded per frame by the mesh uploader
+        void set_mesh_upload_budget(size_t bytes) { _mesh_upload_budget = bytes; };
+        // Texture memory kept resident before least recently used textures are reduced
+        void set_texture_memory_budget(size_t bytes) { _texture_memory_budget = bytes; };
+        // Directory of cached program binaries
+        void set_shader_cache_directory(const std::string& directory) { _shader_cache_directory = directory; };
+        // Bin ranged lights per view cluster instead of per model (see LightClusters)
+        void set_clustered_lighting(bool enabled) { _clustered_lighting = enabled; };
 
         ActionId get_action_id( const std::string& name );
         void bind_button( std::variant<Key, MouseButton> button, const std::string& action_name );
@@ -34,6 +49,11 @@ class Engine {
         bool _running;
         unsigned int _width, _height, _aa = 0;
         std::string _title;
+        size_t _texture_upload_budget = TextureStreamer::DEFAULT_UPLOAD_BUDGET;
+        size_t _texture_memory_budget = TextureResidency::DEFAULT_BUDGET;
+        size_t _mesh_upload_budget = MeshUploader::DEFAULT_UPLOAD_BUDGET;
+        std::string _shader_cache_directory = ProgramBinaryCache::DEFAULT_DIRECTORY;
+        bool _clustered_lighting = false;
 
         ActionId _next_action_id = 0;
         std::unordered_map<ActionId, std::string> _actions;
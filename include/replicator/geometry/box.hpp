@@ -50,6 +50,8 @@ class Box {
 };
 
 Box operator*( const glm::mat4& transform, const Box& box ); 
+// Arvo's method, the extent along each axis from the absolute 3x3 part
+Box operator*( const Affine& transform, const Box& box );
 
 
 #endif // _REPLICATOR_BOX_H_
@@ -0,0 +1,37 @@
+#ifndef _REPLICATOR_GEOMETRY_BOX_BATCH_H_
+#define _REPLICATOR_GEOMETRY_BOX_BATCH_H_
+
+#include "geometry/box.hpp"
+#include "affine.hpp"
+
+#include <vector>
+
+// Boxes as structure of arrays, one array per corner component, for
+// transforming and merging many boxes with SIMD
+class BoxBatch {
+    public:
+        inline size_t size() const { return min_x.size(); }
+        void clear();
+        void reserve( size_t count );
+        void resize( size_t count );
+
+        void push_back( const Box& box );
+        Box get( size_t index ) const;
+
+        std::vector<float> min_x, min_y, min_z;
+        std::vector<float> max_x, max_y, max_z;
+};
+
+// Batched box operations, using AVX2 or SSE when the CPU supports them
+namespace box_op {
+
+    // out[i] = transforms[i] * boxes[i] with Arvo's center and extent method,
+    // out is resized to the boxes
+    void transform( const Affine* transforms, const BoxBatch& boxes, BoxBatch& out );
+
+    // smallest box containing every box of the batch, empty for an empty batch
+    Box merge( const BoxBatch& boxes );
+
+}
+
+#endif // _REPLICATOR_GEOMETRY_BOX_BATCH_H_
@@ -0,0 +1,109 @@
+#ifndef _REPLICATOR_GEOMETRY_BVH_H_
+#define _REPLICATOR_GEOMETRY_BVH_H_
+
+#include "geometry/box.hpp"
+#include "geometry/ray_packet.hpp"
+
+#include "glm/vec3.hpp"
+
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// Bounding volume hierarchy over boxes, built top down with binned surface
+// area heuristic splits. The two children of an inner node are stored next
+// to each other, the root is the first node.
+class BVH {
+    public:
+        struct Node {
+            glm::vec3 min;
+            // first primitive of a leaf or left child of an inner node
+            uint32_t first;
+            glm::vec3 max;
+            // primitives of a leaf, 0 for inner nodes
+            uint16_t count;
+            // split axis of an inner node
+            uint16_t axis;
+
+            inline bool leaf() const { return count != 0; }
+        };
+
+        static constexpr uint32_t NO_HIT = std::numeric_limits<uint32_t>::max();
+        // deepest node traversals can handle
+        static constexpr unsigned int MAX_DEPTH = 62;
+
+        // closest primitive along a ray
+        struct Hit {
+            uint32_t primitive = NO_HIT;
+            float distance = std::numeric_limits<float>::infinity();
+        };
+
+        BVH() = default;
+        // builds over boxes, primitive indices refer to positions in boxes
+        BVH( const std::vector<Box>& boxes, unsigned int max_leaf_size = 4 );
+        // previously built nodes and primitive order, as read from cooked data
+        BVH( std::vector<Node> nodes, std::vector<uint32_t> primitives )
+            : _nodes{std::move(nodes)}, _primitives{std::move(primitives)} {}
+
+        inline bool empty() const { return _nodes.empty(); }
+        inline const std::vector<Node>& nodes() const { return _nodes; }
+        // primitive indices in leaf order
+        inline const std::vector<uint32_t>& primitives() const { return _primitives; }
+        Box bounds() const;
+
+        // Visits the leaves the packet's active lanes reach, nearest child first.
+        // leaf( primitive, mask ) is called for each primitive of a reached leaf with
+        // the lanes that hit the leaf and may shorten packet.t_max to prune the rest.
+        template <size_t N, class F>
+        void traverse( RayPacket<N>& packet, F leaf ) const {
+            if( _nodes.empty() ) {
+                return;
+            }
+            alignas(64) float distances[N];
+            uint32_t stack[MAX_DEPTH + 2];
+            size_t stack_size = 0;
+            stack[stack_size++] = 0;
+            while( stack_size > 0 ) {
+                const auto& node = _nodes[ stack[--stack_size] ];
+                uint32_t mask = packet.intersects( node.min, node.max, distances );
+                if( mask == 0 ) {
+                    continue;
+                }
+                if( node.leaf() ) {
+                    for( uint32_t i=node.first; i<node.first + node.count; i++ ) {
+                        leaf( _primitives[i], mask );
+                    }
+                    continue;
+                }
+                // far child below the near one, by the direction of the first hitting lane
+                size_t lane = __builtin_ctz( mask );
+                bool negative = packet.direction[node.axis][lane] < 0.0;
+                stack[stack_size++] = node.first + ( negative ? 0 : 1 );
+                stack[stack_size++] = node.first + ( negative ? 1 : 0 );
+            }
+        }
+
+        // closest box hit by each lane of the packet, boxes must be the ones built
+        // over, rays starting inside a box hit it at distance 0
+        template <size_t N>
+        void intersect( const std::vector<Box>& boxes, const RayPacket<N>& rays, Hit* hits ) const {
+            RayPacket<N> packet = rays;
+            alignas(64) float distances[N];
+            traverse( packet, [&boxes, &packet, &distances, hits]( uint32_t primitive, uint32_t mask ){
+                    mask &= packet.intersects( boxes[primitive], distances );
+                    for( size_t lane=0; lane<N; lane++ ) {
+                        if( mask & ( 1u << lane ) ) {
+                            hits[lane] = Hit{ primitive, distances[lane] };
+                            packet.t_max[lane] = distances[lane];
+                        }
+                    }
+            });
+        }
+
+    private:
+        std::vector<Node> _nodes;
+        std::vector<uint32_t> _primitives;
+};
+
+#endif // _REPLICATOR_GEOMETRY_BVH_H_
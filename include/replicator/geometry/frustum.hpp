@@ -0,0 +1,27 @@
+#ifndef _REPLICATOR_GEOMETRY_FRUSTUM_H_
+#define _REPLICATOR_GEOMETRY_FRUSTUM_H_
+
+#include "geometry/plane.hpp"
+#include "geometry/box.hpp"
+#include "geometry/sphere.hpp"
+
+#include "glm/mat4x4.hpp"
+
+#include <array>
+
+class Frustum {
+    public:
+        // Frustum of a view projection matrix, planes face inwards
+        Frustum( const glm::mat4& view_projection );
+
+        // Conservative tests, false only if fully outside of a plane
+        bool intersects( const Box& box ) const;
+        bool intersects( const Sphere& sphere ) const;
+
+        inline const std::array<Plane, 6>& planes() const { return _planes; }
+
+    private:
+        std::array<Plane, 6> _planes;
+};
+
+#endif // _REPLICATOR_GEOMETRY_FRUSTUM_H_
@@ -11,6 +11,9 @@
 
 #include <optional>
 
+class Mesh;
+struct MeshHit;
+
 class Ray {
     public:
         Ray( const glm::vec3& pos, const glm::vec3& dir ) :
@@ -20,6 +23,9 @@ class Ray {
         std::optional<std::pair<float, glm::vec3>> intersects( const Plane& plane );
         // check intersection with box
         std::optional<std::pair<float, glm::vec3>> intersects( const Box& box );
+        // closest triangle of a mesh placed by transform, hit position in world space,
+        // empty for meshes without retained geometry
+        std::optional<MeshHit> intersects( const Mesh& mesh, const Transform& transform );
 
         inline const glm::vec3& position() const { return _position; }
         inline const glm::vec3& direction() const { return _direction; }
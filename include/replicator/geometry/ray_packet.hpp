@@ -0,0 +1,167 @@
+#ifndef _REPLICATOR_GEOMETRY_RAY_PACKET_H_
+#define _REPLICATOR_GEOMETRY_RAY_PACKET_H_
+
+#include "geometry/ray.hpp"
+#include "geometry/box.hpp"
+
+#include "glm/vec3.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define REPLICATOR_RAY_PACKET_X86
+#include <immintrin.h>
+#endif
+
+#ifdef REPLICATOR_RAY_PACKET_X86
+// True if the running CPU has AVX, checked once
+inline bool ray_packet_avx() {
+    static const bool supported = []{
+        __builtin_cpu_init();
+        return __builtin_cpu_supports( "avx" ) != 0;
+    }();
+    return supported;
+}
+#endif
+
+// N rays as structure of arrays, tested together against boxes with the
+// slab method. The tests have no data dependent branches, packets of 4 or
+// more rays use SSE, 8 and 16 use AVX when the running CPU has it. Unused
+// lanes never hit anything.
+template <size_t N>
+class RayPacket {
+    static_assert( N == 1 || N == 4 || N == 8 || N == 16, "packets hold 1, 4, 8 or 16 rays" );
+
+    public:
+        static constexpr size_t SIZE = N;
+
+        RayPacket() {
+            for( size_t lane=0; lane<N; lane++ ) {
+                for( int axis=0; axis<3; axis++ ) {
+                    origin[axis][lane] = 0.0;
+                    direction[axis][lane] = 0.0;
+                    inverse_direction[axis][lane] = std::numeric_limits<float>::infinity();
+                }
+                t_max[lane] = -std::numeric_limits<float>::infinity();
+            }
+        }
+
+        // set lane to ray, hits farther than max_distance are ignored
+        inline void set( size_t lane, const Ray& ray, float max_distance = std::numeric_limits<float>::infinity() ) {
+            for( int axis=0; axis<3; axis++ ) {
+                origin[axis][lane] = ray.position()[axis];
+                direction[axis][lane] = ray.direction()[axis];
+                inverse_direction[axis][lane] = 1.0f / ray.direction()[axis];
+            }
+            t_max[lane] = max_distance;
+        }
+
+        inline glm::vec3 point( size_t lane, float distance ) const {
+            return glm::vec3{
+                origin[0][lane] + distance * direction[0][lane],
+                origin[1][lane] + distance * direction[1][lane],
+                origin[2][lane] + distance * direction[2][lane],
+            };
+        }
+
+        // bit mask of the lanes hitting the box between 0 and t_max,
+        // distances receives each lane's entry distance
+        inline uint32_t intersects( const glm::vec3& min, const glm::vec3& max, float* distances ) const {
+            // empty boxes would pass the slabs with swapped infinite bounds
+            if( min.x > max.x ) {
+                return 0;
+            }
+#ifdef REPLICATOR_RAY_PACKET_X86
+            if constexpr( N % 8 == 0 ) {
+                if( ray_packet_avx() ) {
+                    return _intersects_avx( min, max, distances );
+                }
+            }
+#endif
+#if defined(__SSE2__)
+            if constexpr( N % 4 == 0 ) {
+                return _intersects_sse( min, max, distances );
+            }
+#endif
+            alignas(64) float far[N];
+            for( size_t lane=0; lane<N; lane++ ) {
+                distances[lane] = 0.0;
+                far[lane] = t_max[lane];
+            }
+            for( int axis=0; axis<3; axis++ ) {
+                for( size_t lane=0; lane<N; lane++ ) {
+                    float t1 = ( min[axis] - origin[axis][lane] ) * inverse_direction[axis][lane];
+                    float t2 = ( max[axis] - origin[axis][lane] ) * inverse_direction[axis][lane];
+                    distances[lane] = std::max( distances[lane], std::min( t1, t2 ) );
+                    far[lane] = std::min( far[lane], std::max( t1, t2 ) );
+                }
+            }
+            uint32_t mask = 0;
+            for( size_t lane=0; lane<N; lane++ ) {
+                mask |= uint32_t( distances[lane] <= far[lane] ) << lane;
+            }
+            return mask;
+        }
+        inline uint32_t intersects( const Box& box, float* distances ) const {
+            return intersects( box.min(), box.max(), distances );
+        }
+
+        alignas(64) float origin[3][N];
+        alignas(64) float direction[3][N];
+        alignas(64) float inverse_direction[3][N];
+        // farthest distance still of interest per lane, closest hit so far during traversal
+        alignas(64) float t_max[N];
+
+    private:
+#if defined(__SSE2__)
+        // four lanes per register, the compiler's baseline on x86-64
+        inline uint32_t _intersects_sse( const glm::vec3& min, const glm::vec3& max, float* distances ) const {
+            const __m128 box_min[3] = { _mm_set1_ps( min.x ), _mm_set1_ps( min.y ), _mm_set1_ps( min.z ) };
+            const __m128 box_max[3] = { _mm_set1_ps( max.x ), _mm_set1_ps( max.y ), _mm_set1_ps( max.z ) };
+            uint32_t mask = 0;
+            for( size_t lane=0; lane<N; lane+=4 ) {
+                __m128 near = _mm_setzero_ps();
+                __m128 far = _mm_load_ps( &t_max[lane] );
+                for( int axis=0; axis<3; axis++ ) {
+                    __m128 position = _mm_load_ps( &origin[axis][lane] );
+                    __m128 inverse = _mm_load_ps( &inverse_direction[axis][lane] );
+                    __m128 t1 = _mm_mul_ps( _mm_sub_ps( box_min[axis], position ), inverse );
+                    __m128 t2 = _mm_mul_ps( _mm_sub_ps( box_max[axis], position ), inverse );
+                    near = _mm_max_ps( near, _mm_min_ps( t1, t2 ) );
+                    far = _mm_min_ps( far, _mm_max_ps( t1, t2 ) );
+                }
+                _mm_storeu_ps( &distances[lane], near );
+                mask |= uint32_t( _mm_movemask_ps( _mm_cmple_ps( near, far ) ) ) << lane;
+            }
+            return mask;
+        }
+#endif
+#ifdef REPLICATOR_RAY_PACKET_X86
+        // eight lanes per register, only called when the CPU has AVX
+        __attribute__((target("avx")))
+        uint32_t _intersects_avx( const glm::vec3& min, const glm::vec3& max, float* distances ) const {
+            const __m256 box_min[3] = { _mm256_set1_ps( min.x ), _mm256_set1_ps( min.y ), _mm256_set1_ps( min.z ) };
+            const __m256 box_max[3] = { _mm256_set1_ps( max.x ), _mm256_set1_ps( max.y ), _mm256_set1_ps( max.z ) };
+            uint32_t mask = 0;
+            for( size_t lane=0; lane<N; lane+=8 ) {
+                __m256 near = _mm256_setzero_ps();
+                __m256 far = _mm256_load_ps( &t_max[lane] );
+                for( int axis=0; axis<3; axis++ ) {
+                    __m256 position = _mm256_load_ps( &origin[axis][lane] );
+                    __m256 inverse = _mm256_load_ps( &inverse_direction[axis][lane] );
+                    __m256 t1 = _mm256_mul_ps( _mm256_sub_ps( box_min[axis], position ), inverse );
+                    __m256 t2 = _mm256_mul_ps( _mm256_sub_ps( box_max[axis], position ), inverse );
+                    near = _mm256_max_ps( near, _mm256_min_ps( t1, t2 ) );
+                    far = _mm256_min_ps( far, _mm256_max_ps( t1, t2 ) );
+                }
+                _mm256_storeu_ps( &distances[lane], near );
+                mask |= uint32_t( _mm256_movemask_ps( _mm256_cmp_ps( near, far, _CMP_LE_OQ ) ) ) << lane;
+            }
+            return mask;
+        }
+#endif
+};
+
+#endif // _REPLICATOR_GEOMETRY_RAY_PACKET_H_
@@ -0,0 +1,121 @@
+#ifndef _REPLICATOR_GEOMETRY_SPATIAL_HASH_H_
+#define _REPLICATOR_GEOMETRY_SPATIAL_HASH_H_
+
+#include "geometry/box.hpp"
+#include "geometry/ray.hpp"
+#include "thread_pool.hpp"
+
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// Uniform grid over boxes. Every (cell key, box) entry is kept in one array
+// radix sorted by a key packing the cell's coordinates relative to the grid
+// bounds in as few bits as they need, so the boxes of a cell are a
+// contiguous run found by binary search. Boxes moving within their cells only
+// update their bounds, the entries of boxes that changed cells are sorted on
+// their own and merged back. Boxes covering too many cells are kept aside and
+// tested against everything. Given a pool, rebuild sorts and merges and pairs
+// collects in parallel.
+class SpatialHash {
+    public:
+        // boxes over more cells than this are oversized
+        static constexpr int MAX_CELLS = 64;
+
+        SpatialHash( float cell_size = 4.0 );
+
+        // Add box, returns its id, ids of removed boxes are reused
+        uint32_t insert( const Box& box );
+        // Move box, unchanged bounds are skipped
+        void set( uint32_t id, const Box& box );
+        void remove( uint32_t id );
+        void clear();
+
+        // Update the cell entries of boxes that changed cells, queries and pairs
+        // reflect insert, set and remove only after it
+        void rebuild( ThreadPool* pool = nullptr );
+
+        inline const Box& box( uint32_t id ) const { return _objects[id].box; }
+        inline size_t size() const { return _objects.size() - _free.size(); }
+        inline float cell_size() const { return _cell_size; }
+        // cell entries of the last rebuild
+        inline size_t entry_count() const { return _entries.size(); }
+
+        // Ids of the boxes intersecting box, each once
+        void query( const Box& box, std::vector<uint32_t>& ids ) const;
+        // Ids and entry distances of the boxes along the ray up to max_distance,
+        // closest first
+        void query( const Ray& ray, std::vector<std::pair<uint32_t, float>>& hits,
+                float max_distance = std::numeric_limits<float>::infinity() ) const;
+        // Every pair of intersecting boxes once, lower id first
+        void pairs( std::vector<std::pair<uint32_t, uint32_t>>& pairs, ThreadPool* pool = nullptr ) const;
+
+    private:
+        // inclusive cell coordinate range of a box
+        struct Range {
+            int min[3];
+            int max[3];
+            inline bool operator==( const Range& other ) const {
+                return min[0] == other.min[0] && min[1] == other.min[1] && min[2] == other.min[2]
+                    && max[0] == other.max[0] && max[1] == other.max[1] && max[2] == other.max[2];
+            }
+        };
+
+        struct Object {
+            Box box;
+            Range range;
+            // range of the entries of the last rebuild
+            Range cells;
+            bool alive = false;
+            bool oversized = false;
+        };
+
+        struct Entry {
+            uint64_t key;
+            uint32_t id;
+        };
+
+        float _cell_size;
+        float _inverse_cell_size;
+        std::vector<Object> _objects;
+        std::vector<uint32_t> _free;
+        std::vector<uint32_t> _oversized;
+        std::vector<Entry> _entries;
+        std::vector<Entry> _added;
+        // radix sort passes swap with _scratch, merges with _merged, so
+        // neither reallocates from frame to frame
+        std::vector<Entry> _scratch;
+        std::vector<Entry> _merged;
+        // boxes that changed cells since the last rebuild, flags by id are
+        // apart from the objects so filtering the entries stays in cache
+        std::vector<uint32_t> _moved;
+        std::vector<uint8_t> _moved_flags;
+        // grows with the boxes, limits ray walks
+        Box _bounds;
+        // cell coordinates of the keys, redone when a box leaves them
+        bool _relayout = true;
+        int _origin[3] = {0, 0, 0};
+        int _bits[3] = {0, 0, 0};
+        int _key_bits = 0;
+
+        Range _range( const Box& box ) const;
+        // key of cell, NO_KEY outside the grid
+        static constexpr uint64_t NO_KEY = std::numeric_limits<uint64_t>::max();
+        uint64_t _key( int x, int y, int z ) const;
+        void _coordinates( uint64_t key, int coordinates[3] ) const;
+        static bool _oversized_range( const Range& range );
+        void _move( uint32_t id );
+        void _layout();
+        // entries of the boxes appended, oversized ones go to _oversized
+        void _add( const std::vector<uint32_t>& ids, std::vector<Entry>& entries, ThreadPool* pool );
+        void _sort( std::vector<Entry>& entries, ThreadPool* pool );
+        // replace the entries of the moved boxes by the sorted added ones
+        void _merge( ThreadPool* pool );
+        // pairs within the cells of entries [begin, end), which start a cell
+        void _cell_pairs( size_t begin, size_t end, std::vector<std::pair<uint32_t, uint32_t>>& pairs ) const;
+        // entries of the cell with key, as [begin, end)
+        std::pair<const Entry*, const Entry*> _cell( uint64_t key ) const;
+};
+
+#endif // _REPLICATOR_GEOMETRY_SPATIAL_HASH_H_
@@ -0,0 +1,27 @@
+#ifndef _REPLICATOR_GEOMETRY_SPHERE_H_
+#define _REPLICATOR_GEOMETRY_SPHERE_H_
+
+#include "geometry/box.hpp"
+
+#include "glm/vec3.hpp"
+
+class Sphere {
+    public:
+        Sphere( const glm::vec3& center, float radius ) :
+            _center{center}, _radius{radius} {}
+
+        inline const glm::vec3& center() const { return _center; }
+        inline float radius() const { return _radius; }
+
+        // Sphere box intersection test
+        bool intersects( const Box& box ) const;
+
+        // Smallest sphere containing a cone with apex, unit direction, length and half angle
+        static Sphere bounding_cone( const glm::vec3& apex, const glm::vec3& direction, float length, float angle );
+
+    private:
+        glm::vec3 _center;
+        float _radius;
+};
+
+#endif // _REPLICATOR_GEOMETRY_SPHERE_H_
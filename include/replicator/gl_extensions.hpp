@@ -0,0 +1,45 @@
+#ifndef _REPLICATOR_GL_EXTENSIONS_H_
+#define _REPLICATOR_GL_EXTENSIONS_H_
+
+#include "glad/glad.h"
+
+#include <string>
+
+// Features beyond the OpenGL 3.3 core profile loaded by glad are queried here.
+
+// Return true if the current context exposes the extension
+bool gl_extension_supported( const std::string& name );
+
+// Return true if the current context version is at least major.minor
+bool gl_version_at_least( int major, int minor );
+
+// Get entry point of an extension function (nullptr if not available)
+void* gl_extension_function( const char* name );
+
+// Return true if ARB_bindless_texture and its entry points are available. Shaders
+// get BINDLESS_TEXTURES defined exactly when this is true (see preprocess_shader).
+bool gl_bindless_textures_supported();
+
+// ARB_bindless_texture
+typedef GLuint64 (APIENTRYP PFNGLGETTEXTUREHANDLEARBPROC)( GLuint texture );
+typedef void (APIENTRYP PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)( GLuint64 handle );
+typedef void (APIENTRYP PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC)( GLuint64 handle );
+
+// ARB_copy_image
+typedef void (APIENTRYP PFNGLCOPYIMAGESUBDATAPROC)(
+        GLuint src_name, GLenum src_target, GLint src_level, GLint src_x, GLint src_y, GLint src_z,
+        GLuint dst_name, GLenum dst_target, GLint dst_level, GLint dst_x, GLint dst_y, GLint dst_z,
+        GLsizei width, GLsizei height, GLsizei depth );
+
+// ARB_get_program_binary
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT  0x8257
+#define GL_PROGRAM_BINARY_LENGTH            0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS       0x87FE
+#define GL_PROGRAM_BINARY_FORMATS           0x87FF
+#endif
+typedef void (APIENTRYP PFNGLGETPROGRAMBINARYPROC)( GLuint program, GLsizei buf_size, GLsizei* length, GLenum* binary_format, void* binary );
+typedef void (APIENTRYP PFNGLPROGRAMBINARYPROC)( GLuint program, GLenum binary_format, const void* binary, GLsizei length );
+typedef void (APIENTRYP PFNGLPROGRAMPARAMETERIPROC)( GLuint program, GLenum pname, GLint value );
+
+#endif // _REPLICATOR_GL_EXTENSIONS_H_
@@ -0,0 +1,108 @@
+#ifndef _REPLICATOR_LIGHT_BUFFER_H_
+#define _REPLICATOR_LIGHT_BUFFER_H_
+
+#include "lights.hpp"
+#include "shaders.hpp"
+#include "geometry/sphere.hpp"
+
+#include "glad/glad.h"
+
+#include "glm/vec4.hpp"
+
+#include "entt/entt.hpp"
+
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Persistent packed array of all lights, keyed by entity. Component signals
+// record changed entities, light_system only repacks those and only the dirty
+// range is uploaded to the texture buffer read by the shaders. GL objects are
+// created on the first update, packing alone runs without a context.
+class LightBuffer {
+    public:
+        // Index of entities without a light
+        static constexpr size_t NONE = (size_t)-1;
+        // Texture unit of the light data buffer
+        static constexpr GLuint UNIT = 4;
+        // (position, radius), (direction, type), (color, cos outer), (cos inner, -, -, -)
+        static constexpr size_t TEXELS_PER_LIGHT = 4;
+
+        LightBuffer() = default;
+        ~LightBuffer();
+
+        LightBuffer( const LightBuffer& other ) = delete;
+        LightBuffer& operator=( const LightBuffer& other ) = delete;
+
+        // Insert or update the light of entity
+        void set( entt::entity entity, const ShaderLight& light );
+        // Remove the light of entity if present
+        void remove( entt::entity entity );
+
+        // Upload the dirty range and bind the buffer to its unit
+        void update();
+
+        // Set light data sampler of program
+        static void bind( ShaderProgram& program );
+
+        // Packed lights, their entities and world bounds (valid for ranged lights)
+        inline const std::vector<ShaderLight>& lights() const { return _lights; }
+        inline const std::vector<entt::entity>& entities() const { return _entities; }
+        inline const std::vector<Sphere>& bounds() const { return _bounds; }
+
+        // Packed index of the light of entity or NONE
+        size_t index( entt::entity entity ) const;
+
+        // Bytes uploaded by the last update
+        inline size_t uploaded() const { return _uploaded; }
+        // Light range [first, second) the next update uploads, storage growth aside
+        inline std::pair<size_t, size_t> dirty() const { return { _dirty_begin, _dirty_end }; }
+        // Texels of the light at index as the shaders read them
+        inline const glm::vec4* data( size_t index ) const { return _data.data() + index * TEXELS_PER_LIGHT; }
+
+        // Entities whose light components changed since the last take_changed
+        std::vector<entt::entity> take_changed();
+
+        // Record a change of a light component
+        template<class T>
+        static void on_change( entt::entity entity, entt::registry& registry, T& ) {
+            auto buffer_ptr = registry.try_ctx<LightBuffer>();
+            if( buffer_ptr != nullptr && registry.has<LightColor>( entity ) ) {
+                buffer_ptr->_changed.push_back( entity );
+            }
+        }
+        // Drop a light when it loses its color or transform
+        template<class T>
+        static void on_destroy( entt::entity entity, entt::registry& registry, T& ) {
+            auto buffer_ptr = registry.try_ctx<LightBuffer>();
+            if( buffer_ptr != nullptr ) {
+                buffer_ptr->remove( entity );
+            }
+        }
+
+        // Connect change signals of light components
+        static void connect( entt::registry& registry );
+
+    private:
+        GLuint _buffer = 0;
+        GLuint _texture = 0;
+        // lights in buffer storage
+        size_t _capacity = 0;
+
+        std::vector<ShaderLight> _lights;
+        std::vector<Sphere> _bounds;
+        std::vector<entt::entity> _entities;
+        std::unordered_map<entt::entity, size_t> _index;
+        std::vector<glm::vec4> _data;
+        std::vector<entt::entity> _changed;
+
+        // dirty light range [begin, end)
+        size_t _dirty_begin = 0;
+        size_t _dirty_end = 0;
+        size_t _uploaded = 0;
+
+        void _pack( size_t index );
+        void _mark( size_t index );
+};
+
+#endif // _REPLICATOR_LIGHT_BUFFER_H_
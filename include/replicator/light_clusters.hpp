@@ -0,0 +1,110 @@
+#ifndef _REPLICATOR_LIGHT_CLUSTERS_H_
+#define _REPLICATOR_LIGHT_CLUSTERS_H_
+
+#include "lights.hpp"
+#include "shaders.hpp"
+#include "thread_pool.hpp"
+#include "geometry/box.hpp"
+
+#include "glad/glad.h"
+
+#include "glm/mat4x4.hpp"
+#include "glm/vec3.hpp"
+#include "glm/vec4.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// Clustered forward lighting. The view frustum is split in screen tiles and
+// exponential depth slices, lights with a radius are binned into the clusters
+// they touch and shaders only iterate the lights of their fragment's cluster.
+// Cluster data is uploaded as texture buffers (the 3.3 core profile has no
+// storage buffers) holding indices into the LightBuffer light data.
+class LightClusters {
+    public:
+        // Grid size, must match CLUSTER_X/Y/Z in shaders/lights.glsl
+        static constexpr unsigned int X = 16;
+        static constexpr unsigned int Y = 9;
+        static constexpr unsigned int Z = 24;
+        static constexpr unsigned int COUNT = X * Y * Z;
+        // Lights beyond this are dropped from a cluster
+        static constexpr unsigned int MAX_LIGHTS_PER_CLUSTER = 128;
+        // Texture units of the cluster grid and light index buffers
+        static constexpr GLuint GRID_UNIT = 6;
+        static constexpr GLuint INDICES_UNIT = 7;
+
+        LightClusters( ThreadPool& pool );
+        ~LightClusters();
+
+        LightClusters( const LightClusters& other ) = delete;
+        LightClusters& operator=( const LightClusters& other ) = delete;
+
+        // Bin the candidate lights (indices into lights, which are world space)
+        // into the clusters of the camera view and upload them
+        void build( const std::vector<ShaderLight>& lights, const std::vector<GLuint>& candidates,
+                const glm::mat4& view, const glm::mat4& projection,
+                float near, float far, unsigned int width, unsigned int height );
+        // Bin without uploading, needs no GL context
+        void bin( const std::vector<ShaderLight>& lights, const std::vector<GLuint>& candidates,
+                const glm::mat4& view, const glm::mat4& projection,
+                float near, float far, unsigned int width, unsigned int height );
+
+        // Set cluster uniforms of program
+        void bind( ShaderProgram& program ) const;
+
+        // Assign the cluster samplers their units without enabling clustering,
+        // buffer samplers left on unit 0 would clash with other sampler types
+        static void bind_units( ShaderProgram& program );
+
+        // Lights binned in last build and their references in all clusters
+        inline size_t light_count() const { return _light_count; }
+        inline size_t reference_count() const { return _indices.size(); }
+
+        // Light indices of a cluster (x + X*(y + Y*z)) in the last build
+        std::vector<GLuint> cluster_lights( size_t cluster ) const;
+        // View space box of a cluster
+        Box cluster_bounds( size_t cluster ) const;
+
+        // "avx2", "sse" or "scalar"
+        static const char* implementation();
+
+    private:
+        // cluster boxes as structure of arrays, a row of clusters is tested at once
+        struct Bounds {
+            std::vector<float> min[3];
+            std::vector<float> max[3];
+        };
+
+        // View space sphere and cluster range of a light
+        struct LightBounds {
+            GLuint index;
+            glm::vec3 center;
+            float radius;
+            int x0, x1, y0, y1, z0, z1;
+        };
+
+        ThreadPool& _pool;
+        GLuint _buffers[2] = {0, 0};
+        GLuint _textures[2] = {0, 0};
+
+        // grid configuration the cluster bounds were computed for
+        glm::mat4 _projection{0.0};
+        float _near = 0.0, _far = 0.0;
+        unsigned int _width = 0, _height = 0;
+        float _tile_width = 1.0, _tile_height = 1.0;
+        float _z_scale = 0.0, _z_bias = 0.0;
+        Bounds _cluster_bounds;
+
+        std::vector<LightBounds> _light_bounds;
+        std::vector<uint32_t> _counts;
+        std::vector<uint32_t> _cluster_lights;
+        std::vector<uint32_t> _grid;
+        std::vector<uint32_t> _indices;
+        size_t _light_count = 0;
+
+        void _update_bounds( const glm::mat4& projection, float near, float far, unsigned int width, unsigned int height );
+        LightBounds _light_bounds_for( const ShaderLight& light, const glm::mat4& view ) const;
+        void _upload();
+};
+
+#endif // _REPLICATOR_LIGHT_CLUSTERS_H_
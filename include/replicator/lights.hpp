@@ -1,11 +1,20 @@
 #ifndef _REPLICATOR_LIGHTS_H_
 #define _REPLICATOR_LIGHTS_H_
 
+#include "geometry/box.hpp"
+#include "geometry/sphere.hpp"
+
+#include "glad/glad.h"
+
 #include "glm/vec3.hpp"
 #include "glm/vec4.hpp"
 
 #include "entt/entt.hpp"
 
+#include <vector>
+
+class ShaderProgram;
+
 
 struct ShaderLight {
     enum Type : unsigned int {
@@ -21,6 +30,9 @@ struct ShaderLight {
     float inner_angle = 0.0;
     float outer_angle = 0.0;
 
+    // range of point and spotlights, 0 is unbounded
+    float radius = 0.0;
+
     Type type = None;
 };
 
@@ -33,7 +45,17 @@ class LightColor {
 };
 
 class DirectionalLight{};
-class PointLight {};
+// Lights with a radius fade out to zero at that distance, they are culled
+// against the camera frustum and only shade the models (or clusters when
+// LightClusters is in the registry context) they reach
+class PointLight {
+    public:
+        PointLight( float radius = 0.0 ) : _radius{radius} {}
+        float radius() const { return _radius; }
+        void set_radius( float radius ) { _radius = radius; }
+    private:
+        float _radius;
+};
 class Spotlight {
     public:
         Spotlight( float outer_angle )
@@ -42,11 +64,44 @@ class Spotlight {
         Spotlight( float outer_angle, float inner_angle ) 
             : _inner_angle{inner_angle},
               _outer_angle{outer_angle} {}
+        Spotlight( float outer_angle, float inner_angle, float radius )
+            : _inner_angle{inner_angle},
+              _outer_angle{outer_angle},
+              _radius{radius} {}
         float inner() const { return _inner_angle; }
         float outer() const { return _outer_angle; }
+        float radius() const { return _radius; }
+        void set_radius( float radius ) { _radius = radius; }
     private:
         float _inner_angle; 
         float _outer_angle;
+        float _radius = 0.0;
+};
+
+// World space bounding sphere of a ranged light, spotlights are bounded by their cone
+Sphere light_bounds( const ShaderLight& light );
+
+// Lights of the current frame as indices into the LightBuffer, filled by light_system
+struct FrameLights {
+    // directional and unbounded lights, used by every program
+    std::vector<GLuint> global;
+    // ranged lights in the camera frustum and their bounds, used by the models they reach
+    std::vector<GLuint> ranged;
+    std::vector<Sphere> bounds;
+    // ranged lights outside of the camera frustum
+    size_t culled = 0;
+
+    void clear();
+
+    // Append the positions in ranged of lights reaching world space box
+    void affecting( const Box& box, std::vector<size_t>& indices ) const;
+
+    // Set light indices of program to the global lights and the ranged ones reaching box
+    void bind( ShaderProgram& program, const Box& box ) const;
+
+    private:
+        mutable std::vector<size_t> _affecting;
+        mutable std::vector<GLuint> _indices;
 };
 
 void light_system( entt::registry& registry ); 
@@ -0,0 +1,38 @@
+#ifndef _REPLICATOR_LOD_H_
+#define _REPLICATOR_LOD_H_
+
+#include "mesh.hpp"
+#include "geometry/box.hpp"
+
+#include "glm/mat4x4.hpp"
+#include "glm/vec3.hpp"
+
+#include <vector>
+
+// Coarser meshes of a Model, model_system draws the level matching the
+// projected size of the model bounds instead of Model::mesh
+class LODGroup {
+    public:
+        struct Level {
+            Mesh mesh;
+            // used while the model covers less than this fraction of the screen height
+            float screen_size;
+        };
+
+        // Add a level, levels are kept sorted from the finest (largest screen size)
+        void add_level( Mesh mesh, float screen_size );
+
+        // Mesh to draw at screen_size, nullptr for the model mesh
+        const Mesh* select( float screen_size ) const;
+
+        inline const std::vector<Level>& levels() const { return _levels; }
+
+    private:
+        std::vector<Level> _levels;
+};
+
+// Fraction of the screen height covered by the bounding sphere of a world box
+// seen from eye through projection, 1.0 or more when eye is inside it
+float projected_size( const Box& box, const glm::vec3& eye, const glm::mat4& projection );
+
+#endif // _REPLICATOR_LOD_H_
@@ -7,6 +7,9 @@
 
 #include "texture.hpp"
 
+#include <memory>
+#include <vector>
+
 class Material {
     public:
         Material( 
@@ -25,13 +28,13 @@ class Material {
         ) : _ambient{color*ambient}, _diffuse{color*diffuse}, _specular{color*specular}, _shininess{shininess} {}
 
 
-        inline void set_ambient( const glm::vec3& value ) { _ambient = value; }
-        inline void set_diffuse( const glm::vec3& value ) { _diffuse = value; }
-        inline void set_specular( const glm::vec3& value ) { _specular = value; }
+        inline void set_ambient( const glm::vec3& value ) { _ambient = value; _change(); }
+        inline void set_diffuse( const glm::vec3& value ) { _diffuse = value; _change(); }
+        inline void set_specular( const glm::vec3& value ) { _specular = value; _change(); }
 
-        void add_ambient_texture( entt::resource_handle<Texture> texture ) { _ambient_textures.push_back( texture ); }
-        void add_diffuse_texture( entt::resource_handle<Texture> texture ) { _diffuse_textures.push_back( texture ); }
-        void add_specular_texture( entt::resource_handle<Texture> texture ) { _specular_textures.push_back( texture ); }
+        void add_ambient_texture( entt::resource_handle<Texture> texture ) { _ambient_textures.push_back( texture ); _change(); }
+        void add_diffuse_texture( entt::resource_handle<Texture> texture ) { _diffuse_textures.push_back( texture ); _change(); }
+        void add_specular_texture( entt::resource_handle<Texture> texture ) { _specular_textures.push_back( texture ); _change(); }
 
         inline const glm::vec3& ambient() const { return _ambient; }
         inline const glm::vec3& diffuse() const { return _diffuse; }
@@ -44,6 +47,10 @@ class Material {
         inline void set_twosided( bool value ) { _twosided = value; }
         inline bool twosided() const { return _twosided; }
 
+        // Index in the MaterialBuffer (0 if not registered), copies share the
+        // entry until one of them is changed
+        inline GLuint index() const { return _index; }
+
     private:
         std::vector<entt::resource_handle<Texture>> _ambient_textures{};
         std::vector<entt::resource_handle<Texture>> _diffuse_textures{};
@@ -53,6 +60,22 @@ class Material {
         glm::vec3 _specular;
         float _shininess;
         bool _twosided = false;
+
+        GLuint _index = 0;
+        // shared by the copies using the entry at _index
+        std::shared_ptr<GLuint> _entry;
+        bool _changed = false;
+
+        // a changed copy leaves the shared entry and registers its own
+        inline void _change() {
+            if( _entry.use_count() > 1 ) {
+                _index = 0;
+                _entry.reset();
+            }
+            _changed = true;
+        }
+
+        friend class MaterialBuffer;
 };
 
 #endif // _REPLICATOR_MATERIAL_H_
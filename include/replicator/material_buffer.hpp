@@ -0,0 +1,158 @@
+#ifndef _REPLICATOR_MATERIAL_BUFFER_H_
+#define _REPLICATOR_MATERIAL_BUFFER_H_
+
+#include "material.hpp"
+#include "shaders.hpp"
+#include "texture.hpp"
+#include "gl_extensions.hpp"
+
+#include "glad/glad.h"
+
+#include "glm/vec4.hpp"
+
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Texture array pools, textures with the same size, format and mip count
+// share a GL_TEXTURE_2D_ARRAY and are addressed by pool and layer. A pooled
+// texture releases its own storage, the layer is its only copy.
+class TexturePools {
+    public:
+        // Slot value for no texture
+        static constexpr GLuint NONE = 0xFFFFFFFF;
+        // Pools visible to shaders (texture_pools[] in fragment_main.glsl)
+        static constexpr unsigned int MAX_POOLS = 8;
+        static constexpr int LAYERS_PER_POOL = 16;
+        // Texture unit of the first pool when bindless textures are not available
+        static constexpr GLuint FIRST_UNIT = 8;
+        // Uniform block binding of pool handles when bindless textures are available
+        static constexpr GLuint HANDLES_BINDING = 1;
+
+        TexturePools();
+        ~TexturePools();
+
+        TexturePools( const TexturePools& other ) = delete;
+        TexturePools& operator=( const TexturePools& other ) = delete;
+
+        // Move texture into a pool layer, return its slot (pool << 16 | layer) or NONE
+        GLuint add( Texture& texture );
+
+        // True if texture storage was replaced since it was added
+        bool stale( const Texture& texture ) const;
+
+        // Free the layers of textures whose ids aren't in used, textures
+        // still alive get their own storage back
+        void release_unused( const std::unordered_set<uint64_t>& used );
+
+        // Copy a pooled texture back into its own storage, its layer is
+        // freed once the texture changes generation
+        void restore( Texture& texture );
+
+        // Bind pools to their texture units, or their handles when bindless
+        void bind() const;
+
+        // Set sampler or handle block of a program
+        void bind( ShaderProgram& program ) const;
+
+        inline bool bindless() const { return _bindless; }
+        inline size_t size() const { return _pools.size(); }
+        // Estimated GPU memory of the allocated pools, every layer counts
+        size_t memory() const;
+
+    private:
+        struct Pool {
+            GLuint texture_id = 0;
+            GLenum format = 0;
+            int width = 0, height = 0, levels = 0;
+            int layers = 0;
+            // layers released by textures that changed size, the pool is
+            // deleted when every allocated layer is free
+            std::vector<int> free_layers;
+            GLuint64 handle = 0;
+        };
+
+        struct Slot {
+            GLuint slot;
+            unsigned int generation;
+            std::weak_ptr<Texture> texture;
+        };
+
+        std::vector<Pool> _pools;
+        // by texture id, addresses of destroyed textures get reused
+        std::unordered_map<uint64_t, Slot> _slots;
+
+        bool _bindless = false;
+        GLuint _handle_buffer = 0;
+        PFNGLGETTEXTUREHANDLEARBPROC _get_texture_handle = nullptr;
+        PFNGLMAKETEXTUREHANDLERESIDENTARBPROC _make_handle_resident = nullptr;
+        PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC _make_handle_non_resident = nullptr;
+        PFNGLCOPYIMAGESUBDATAPROC _copy_image = nullptr;
+
+        size_t _pool_for( const Texture& texture );
+        void _copy( const Texture& texture, const Pool& pool, int layer ) const;
+        // Copy a layer back into standalone storage of its texture
+        void _restore( Texture& texture, GLuint slot ) const;
+        void _free( GLuint slot );
+        void _upload_handles() const;
+};
+
+// Material properties of every registered material in a single uniform
+// buffer, models select their material by index instead of setting uniforms
+// and binding textures for each draw.
+class MaterialBuffer {
+    public:
+        // Uniform block binding of the materials
+        static constexpr GLuint BINDING = 0;
+        // Materials in the uniform block (64 bytes each, fits the 16KB minimum block size)
+        static constexpr GLuint MAX_MATERIALS = 256;
+
+        // Index 0 holds the default material
+        MaterialBuffer();
+        ~MaterialBuffer();
+
+        MaterialBuffer( const MaterialBuffer& other ) = delete;
+        MaterialBuffer& operator=( const MaterialBuffer& other ) = delete;
+
+        // Register material or upload its changes, return its index
+        GLuint index( Material& material );
+
+        // Place textures that finished streaming and bind pools, call once per frame
+        void update();
+
+        // Set block bindings and samplers of program (once per program)
+        void bind( ShaderProgram& program );
+
+        inline size_t size() const { return _materials.size(); }
+        inline const TexturePools& pools() const { return _pools; }
+        inline TexturePools& pools() { return _pools; }
+
+    private:
+        // std140 layout of a material in fragment_main.glsl
+        struct Entry {
+            glm::vec4 ambient;
+            glm::vec4 diffuse;
+            // w is shininess
+            glm::vec4 specular;
+            // diffuse 0, diffuse 1, specular 0, specular 1
+            GLuint textures[4];
+        };
+        static_assert( sizeof(Entry) == 64, "Material entry must match std140 layout" );
+
+        GLuint _buffer = 0;
+        TexturePools _pools;
+        std::vector<Material> _materials;
+        // materials with textures that are still streaming
+        std::unordered_set<GLuint> _pending;
+        // programs with bindings set, by GL name, the unique id tells a new
+        // program that got the name of a destroyed one
+        std::unordered_map<GLuint, uint64_t> _bound;
+        bool _full_warned = false;
+        // a material changed textures, unused pool layers are freed on update
+        bool _release = false;
+
+        void _upload( GLuint index );
+};
+
+#endif // _REPLICATOR_MATERIAL_BUFFER_H_
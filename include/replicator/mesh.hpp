@@ -9,12 +9,50 @@
 #include "glad/glad.h"
 
 #include "shaders.hpp"
+#include "mesh_geometry.hpp"
 
+#include <cstdint>
 #include <vector>
 #include <memory>
-#include <map>
+#include <limits>
+#include <utility>
 
 
+// Joints influencing a vertex and their weights as unorm8 summing to 255,
+// uploaded as one 8 byte attribute (locations 4 and 5)
+struct VertexSkin {
+    static constexpr unsigned int MAX_INFLUENCES = 4;
+    // joints of a mesh are addressed by 8 bits
+    static constexpr unsigned int MAX_JOINTS = 256;
+
+    uint8_t joints[MAX_INFLUENCES] = {0, 0, 0, 0};
+    uint8_t weights[MAX_INFLUENCES] = {0, 0, 0, 0};
+
+    // Keep the largest (joint, weight) influences, normalized and quantized,
+    // vertices without influences follow joint 0
+    static VertexSkin from_influences( std::vector<std::pair<unsigned int, float>> influences );
+};
+
+// CPU side of a mesh baked by MeshBuilder::bake(), can be made on any thread
+// and uploaded later on the render thread
+struct MeshData {
+    std::vector<GLuint> indices;
+    // indices narrowed by bake() for GL_UNSIGNED_SHORT, uploaded instead of indices
+    std::vector<GLushort> short_indices;
+    std::vector<glm::vec4> vertices;
+    std::vector<glm::vec4> colors;
+    std::vector<glm::vec4> normals;
+    std::vector<glm::vec2> texcoords;
+    std::vector<VertexSkin> skins;
+    // GL_UNSIGNED_SHORT uploads 16-bit indices, all must fit
+    GLenum index_type = GL_UNSIGNED_INT;
+    Box bounding_box;
+    std::shared_ptr<MeshGeometry> geometry;
+
+    // bytes the upload writes to GPU buffers
+    size_t upload_size() const;
+};
+
 class Mesh {
     public:
         // Create mesh from vertice list and index list
@@ -23,12 +61,46 @@ class Mesh {
             const std::vector<glm::vec4>& vertices, 
             const std::vector<glm::vec4>& colors = {},
             const std::vector<glm::vec4>& normals = {},
-            const std::vector<glm::vec2>& texcoords = {}
+            const std::vector<glm::vec2>& texcoords = {},
+            // GL_UNSIGNED_SHORT uploads 16-bit indices, all must fit
+            GLenum index_type = GL_UNSIGNED_INT
         );
+        // Upload baked data, render thread only
+        Mesh( const MeshData& data );
         ~Mesh();
 
+        // Copies share the GL objects, the last one destroyed or assigned over deletes them
+        Mesh( const Mesh& other ) = default;
+        Mesh( Mesh&& other ) = default;
+        Mesh& operator=( const Mesh& other );
+        Mesh& operator=( Mesh&& other );
+
         // Draw mesh using program
         void draw( const ShaderProgram& program ) const;
+        // Draw only vertex positions (attribute 0), for depth passes
+        void draw_positions( const ShaderProgram& program ) const;
+        // Draw count instances, gl_InstanceID selects per instance data
+        void draw_instanced( const ShaderProgram& program, GLsizei count ) const;
+
+        // Model space bounding box of the vertices
+        inline const Box& bounding_box() const { return _bounding_box; }
+
+        // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+        inline GLenum index_type() const { return _index_type; }
+        inline size_t index_count() const { return _index_array_size; }
+        // GPU memory of the buffers in bytes
+        inline size_t vertex_memory() const { return _vertex_memory; }
+        inline size_t index_memory() const { return _index_array_size * ( _index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint) ); }
+        // vertex array object, shared by copies of the mesh
+        inline GLuint id() const { return _vao; }
+        // has joint indices and weights for skinning
+        inline bool skinned() const { return _skin_buffer != 0; }
+
+        // CPU positions and triangles if retained (see MeshBuilder::retain_geometry),
+        // shared by copies of the mesh
+        inline const std::shared_ptr<MeshGeometry>& geometry() const { return _geometry; }
+        // attach geometry, such as one read from cooked data
+        inline void set_geometry( std::shared_ptr<MeshGeometry> geometry ) { _geometry = std::move(geometry); }
 
     private:
         GLuint _index_buffer = 0;
@@ -36,9 +108,40 @@ class Mesh {
         GLuint _color_buffer = 0;
         GLuint _normal_buffer = 0;
         GLuint _texcoord_buffer = 0;
+        GLuint _skin_buffer = 0;
         GLuint _vao = 0;
+        GLuint _position_vao = 0;
         size_t _index_array_size = 0;
+        GLenum _index_type = GL_UNSIGNED_INT;
+        size_t _vertex_memory = 0;
+        Box _bounding_box;
+        std::shared_ptr<MeshGeometry> _geometry;
         std::shared_ptr<bool> _ref_counter;
+
+        // delete the GL objects if no copy shares them
+        void _release();
+        // share the objects of other
+        void _assign( const Mesh& other );
+
+        // indices are GLushort or GLuint as _index_type says
+        void _upload(
+            const void* indices,
+            size_t index_count,
+            const std::vector<glm::vec4>& vertices,
+            const std::vector<glm::vec4>& colors,
+            const std::vector<glm::vec4>& normals,
+            const std::vector<glm::vec2>& texcoords,
+            const std::vector<VertexSkin>& skins
+        );
+};
+
+// Post-transform vertex cache efficiency of an optimization
+struct MeshOptimizeStats {
+    size_t vertices_before = 0;
+    size_t vertices_after = 0;
+    // average cache miss ratio, transformed vertices per triangle
+    float acmr_before = 0.0;
+    float acmr_after = 0.0;
 };
 
 class MeshBuilder {
@@ -54,6 +157,8 @@ class MeshBuilder {
         void add_normal( glm::vec4 n, unsigned int count=1 );
         // Add texture coordinates
         void add_texcoord( glm::vec2 t, unsigned int count=1 );
+        // Add joint influences for skinning
+        void add_skin( const VertexSkin& skin, unsigned int count=1 );
         // Add index
         void add_index( GLuint index );
 
@@ -61,6 +166,7 @@ class MeshBuilder {
         void clear_colors() { _colors.clear(); }
         void clear_normals() { _normals.clear(); }
         void clear_texcoord() { _texcoords.clear(); }
+        void clear_skins() { _skins.clear(); }
 
         // Adde rectangle with normals
         void rect( glm::vec3 pos, glm::vec3 top, glm::vec3 right );
@@ -70,22 +176,50 @@ class MeshBuilder {
         void circle( glm::vec3 radius_angle, glm::vec3 front, unsigned int sections, glm::vec3 position = glm::vec3{0.0} );
         // Add a cylinder
         void cylinder( glm::vec3 radius_angle, glm::vec3 up_height, unsigned int sections, glm::vec3 position = glm::vec3{0.0} );
-        // Add icosphere
-        void icosphere( float radius, unsigned int divisions, glm::vec3 position = glm::vec3{0.0} );
-
-        // Build mesh
+        // Add icosphere, each division splits every triangle in four, levels are
+        // split over the workers of pool if given
+        void icosphere( float radius, unsigned int divisions, glm::vec3 position = glm::vec3{0.0}, ThreadPool* pool = nullptr );
+
+        // Quadric edge collapse simplification to about ratio of the triangles, collapses
+        // stop early when their error exceeds max_error. Borders and attribute seams
+        // (vertices sharing a position with different attributes) are kept.
+        MeshBuilder simplify( float ratio, float max_error = std::numeric_limits<float>::infinity() ) const;
+
+        // Weld vertices equal in every attribute, order triangles for a post-transform
+        // vertex cache of cache_size (Tipsify) and vertices by first use, so build()
+        // can upload 16-bit indices for more meshes
+        MeshOptimizeStats optimize( unsigned int cache_size = 16 );
+
+        // Average cache miss ratio of the triangles with a FIFO cache of cache_size
+        float acmr( unsigned int cache_size = 16 ) const;
+
+        inline size_t vertex_count() const { return _vertices.size(); }
+        inline size_t triangle_count() const { return ( _indices.size() > 0 ? _indices.size() : _vertices.size() ) / 3; }
+
+        // Keep positions and triangles of built meshes on the CPU with a triangle
+        // BVH for exact ray queries, the BVH is built on a worker of pool if given
+        inline void retain_geometry( bool retain = true, ThreadPool* pool = nullptr ) { _retain_geometry = retain; _geometry_pool = pool; }
+
+        // Copy the attributes into immutable mesh data, index type and bounds
+        // included, no GL calls so builders can bake on worker threads
+        std::shared_ptr<const MeshData> bake() const;
+        // Build mesh, render thread only
         Mesh build();
         // Get bounding box
-        Box bounding_box( const glm::mat4& transform = glm::mat4{} );
+        Box bounding_box( const glm::mat4& transform = glm::mat4{1.0} );
 
     private:
         std::vector<glm::vec4> _vertices;
         std::vector<glm::vec4> _colors;
         std::vector<glm::vec4> _normals;
         std::vector<glm::vec2> _texcoords;
+        std::vector<VertexSkin> _skins;
         std::vector<GLuint> _indices;
+        bool _retain_geometry = false;
+        ThreadPool* _geometry_pool = nullptr;
 
-        unsigned int _get_middle_vertex( std::map<std::pair<unsigned int, unsigned int>, unsigned int>& mp_map, std::vector<glm::vec3>& vertices, std::pair<unsigned int, unsigned int> segment );
+        // index of the first vertex equal in every attribute to each vertex
+        std::vector<unsigned int> _weld_map() const;
 
 };
 
@@ -0,0 +1,82 @@
+#ifndef _REPLICATOR_MESH_GEOMETRY_H_
+#define _REPLICATOR_MESH_GEOMETRY_H_
+
+#include "geometry/bvh.hpp"
+#include "thread_pool.hpp"
+
+#include "glm/vec3.hpp"
+#include "glad/glad.h"
+
+#include <atomic>
+#include <cstdint>
+#include <istream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <vector>
+
+// Closest triangle of a mesh hit by a ray
+struct MeshHit {
+    // triangle in the mesh indices, its vertices are indices 3*triangle to 3*triangle+2
+    uint32_t triangle = 0;
+    // weights of the triangle's three vertices at the hit point
+    glm::vec3 barycentric{0.0};
+    // ray parameter of the hit, the distance for unit directions
+    float distance = std::numeric_limits<float>::infinity();
+    // hit point, in world space for mesh queries through a transform
+    glm::vec3 position{0.0};
+};
+
+// CPU copy of a mesh's positions and triangles, kept on request after upload
+// for exact picking and collision queries, with a triangle BVH to find hits.
+class MeshGeometry {
+    public:
+        MeshGeometry( std::vector<glm::vec3> positions, std::vector<GLuint> indices );
+        // a running BVH build finishes first, a queued one is dropped
+        ~MeshGeometry();
+
+        MeshGeometry( const MeshGeometry& other ) = delete;
+        MeshGeometry& operator=( const MeshGeometry& other ) = delete;
+
+        // Build the triangle BVH now, or on a worker of pool and return at once.
+        // Waiting on a build no worker started yet runs it on the waiting thread.
+        void build_bvh( ThreadPool* pool = nullptr );
+        // Whether the BVH is built and queries won't wait
+        bool ready() const;
+
+        // Closest triangle hit by a model space ray, waits for a pending BVH build,
+        // position is in model space
+        std::optional<MeshHit> intersect( const glm::vec3& origin, const glm::vec3& direction,
+                float max_distance = std::numeric_limits<float>::infinity() ) const;
+
+        inline const std::vector<glm::vec3>& positions() const { return _positions; }
+        inline const std::vector<GLuint>& indices() const { return _indices; }
+        inline size_t triangle_count() const { return _indices.size() / 3; }
+        // waits for a pending build
+        const BVH& bvh() const;
+
+        // Write positions, triangles and BVH as a cooked binary blob
+        void write( std::ostream& stream ) const;
+        // Read a blob written by write, throws MeshCreationException on invalid data
+        static std::shared_ptr<MeshGeometry> read( std::istream& stream );
+
+    private:
+        // queued BVH build, shared with its task so a waiter can take it over
+        struct PendingBuild {
+            std::once_flag once;
+            std::atomic<bool> done{false};
+        };
+
+        std::vector<glm::vec3> _positions;
+        std::vector<GLuint> _indices;
+        // written by whichever thread runs the pending build
+        mutable BVH _bvh;
+        std::shared_ptr<PendingBuild> _pending;
+
+        void _wait() const;
+        static BVH _build( const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices );
+};
+
+#endif // _REPLICATOR_MESH_GEOMETRY_H_
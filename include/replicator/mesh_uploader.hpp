@@ -0,0 +1,54 @@
+#ifndef _REPLICATOR_MESH_UPLOADER_H_
+#define _REPLICATOR_MESH_UPLOADER_H_
+
+#include "mesh.hpp"
+
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+
+// Queue of baked meshes uploaded on the render thread, spending at most the
+// upload budget each frame. Meshes can be baked and queued from any thread,
+// so tools can generate many procedural meshes on the thread pool.
+class MeshUploader {
+    public:
+        // Default per frame upload budget in bytes
+        static constexpr size_t DEFAULT_UPLOAD_BUDGET = 8 * 1024 * 1024;
+
+        MeshUploader( size_t upload_budget = DEFAULT_UPLOAD_BUDGET ) : _upload_budget{upload_budget} {}
+
+        MeshUploader( const MeshUploader& other ) = delete;
+        MeshUploader& operator=( const MeshUploader& other ) = delete;
+
+        // Queue data for upload, thread safe. The future is set on the render
+        // thread once the mesh is uploaded, or to the MeshCreationException.
+        std::future<Mesh> upload( std::shared_ptr<const MeshData> data );
+        // Queue data for upload, thread safe. on_upload is called with the mesh
+        // on the render thread, such as to add it to a model.
+        void upload( std::shared_ptr<const MeshData> data, std::function<void(Mesh&&)> on_upload );
+
+        // Upload queued meshes, must be called once per frame from the render thread
+        void update();
+
+        inline void set_upload_budget( size_t bytes ) { _upload_budget = bytes; }
+        inline size_t upload_budget() const { return _upload_budget; }
+
+        // Number of meshes not uploaded yet
+        size_t pending() const;
+
+    private:
+        struct Job {
+            std::shared_ptr<const MeshData> data;
+            std::function<void(Mesh&&)> on_upload;
+            // set instead of calling on_upload if present
+            std::shared_ptr<std::promise<Mesh>> promise;
+        };
+
+        mutable std::mutex _mutex;
+        std::deque<Job> _queue;
+        size_t _upload_budget;
+};
+
+#endif // _REPLICATOR_MESH_UPLOADER_H_
@@ -2,9 +2,13 @@
 #define _REPLICATOR_MODEL_LOADER_H_
 
 #include "mesh.hpp"
+#include "lod.hpp"
 #include "material.hpp"
 #include "texture.hpp"
 #include "transform.hpp"
+#include "shader_variants.hpp"
+#include "animation.hpp"
+#include "thread_pool.hpp"
 #include "geometry/box.hpp"
 
 #include "entt/entt.hpp"
@@ -13,6 +17,8 @@
 #include "assimp/scene.h"
 #include "assimp/postprocess.h"
 
+#include <memory>
+#include <optional>
 #include <vector>
 
 class ModelLoader {
@@ -22,6 +28,13 @@ class ModelLoader {
             _importer.SetPropertyInteger( AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_POINT | aiPrimitiveType_LINE );
         }
 
+        // Model loader giving each material a program specialized for its features,
+        // built from sources through the registry ShaderVariants
+        ModelLoader( const ShaderSources& sources, unsigned int max_lights = ShaderPermutation::DEFAULT_MAX_LIGHTS )
+            : _sources{sources}, _max_lights{max_lights} {
+            _importer.SetPropertyInteger( AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_POINT | aiPrimitiveType_LINE );
+        }
+
         // Load model into registry from file in given path.
         entt::entity load_model( 
                 entt::registry& registry, 
@@ -30,17 +43,56 @@ class ModelLoader {
 
         // Get model bounding box.
         Box bounding_box();
+
+        // Level of detail generated for every mesh, keeping triangle_ratio of the
+        // mesh triangles and used below screen_size (see LODGroup)
+        struct LODSetting {
+            float triangle_ratio;
+            float screen_size;
+        };
+        // Simplify meshes into the given levels when loading, none by default
+        inline void set_lod_levels( const std::vector<LODSetting>& levels ) { _lod_levels = levels; }
+
+        // Keep CPU geometry and a triangle BVH of loaded meshes for exact ray
+        // queries, BVHs are built on the registry ThreadPool, off by default
+        inline void set_retain_geometry( bool retain ) { _retain_geometry = retain; }
+
+        // Frames per second animations are resampled at, 30 by default
+        inline void set_animation_sample_rate( float rate ) { _animation_sample_rate = rate; }
+        // Animations of the last loaded model, its root Animator plays the first
+        inline const std::vector<std::shared_ptr<const AnimationClip>>& animations() const { return _animations; }
     private:
         Assimp::Importer _importer;
         entt::resource_handle<ShaderProgram> _program_handle;
+        std::optional<ShaderSources> _sources;
+        unsigned int _max_lights = ShaderPermutation::DEFAULT_MAX_LIGHTS;
         std::vector<std::pair<Mesh, unsigned int>> _meshes;
         std::vector<MeshBuilder> _mesh_builders;
+        std::vector<LODSetting> _lod_levels;
+        bool _retain_geometry = false;
+        // generated levels of each mesh
+        std::vector<LODGroup> _lods;
         std::vector<Material> _materials;
+        // program of each material
+        std::vector<entt::resource_handle<ShaderProgram>> _programs;
+        // program of each material for skinned meshes
+        std::vector<entt::resource_handle<ShaderProgram>> _skinned_programs;
+        // bones and their ancestors, none without bones
+        std::shared_ptr<const Skeleton> _skeleton;
+        // binding of each mesh, none for unskinned meshes
+        std::vector<std::shared_ptr<const SkinBinding>> _skin_bindings;
+        std::vector<std::shared_ptr<const AnimationClip>> _animations;
+        float _animation_sample_rate = 30.0;
+        // mesh entities of the current load skinned by the root Animator
+        std::vector<std::pair<entt::entity, unsigned int>> _skinned_entities;
 
-        void get_meshes( const aiScene* scene );
+        void get_skeleton( const aiScene* scene );
+        void get_meshes( const aiScene* scene, ThreadPool* pool );
+        void get_animations( const aiScene* scene );
         void get_materials( entt::registry& registry, const aiScene* scene, const std::string directory );
         Transform get_transform( const aiNode* node ); 
         entt::resource_handle<Texture> get_texture( entt::registry& registry, const std::string path );
+        void get_programs( entt::registry& registry );
 
         entt::entity load_node( 
                 entt::registry& registry, 
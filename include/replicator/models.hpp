@@ -18,4 +18,16 @@ struct Model {
 // model system
 void model_system( entt::registry& registry );
 
+// GPU memory of the meshes used by models and their levels of detail
+struct MeshMemoryReport {
+    size_t meshes = 0;
+    size_t vertex_bytes = 0;
+    size_t index_bytes = 0;
+    // index memory if every mesh used 32-bit indices
+    size_t index_bytes_32bit = 0;
+};
+
+// Sum memory of distinct meshes in the registry and log it
+MeshMemoryReport mesh_memory_report( entt::registry& registry );
+
 #endif // _REPLICATOR_MODEL_H_
@@ -0,0 +1,81 @@
+#ifndef _REPLICATOR_OCCLUSION_H_
+#define _REPLICATOR_OCCLUSION_H_
+
+#include "geometry/box.hpp"
+#include "geometry/frustum.hpp"
+
+#include "glad/glad.h"
+
+#include "glm/mat4x4.hpp"
+
+#include <vector>
+
+// Frustum and occlusion culling of models, used by model_system when in the
+// registry context. Occlusion is tested against a hierarchical max depth
+// pyramid of the previous frame, read back from the GPU one frame late, so
+// models uncovered by a fast moving camera may pop in a frame late.
+class OcclusionCulling {
+    public:
+        // base_width is the width of the finest pyramid level, the depth
+        // buffer is reduced to it keeping the farthest depth
+        OcclusionCulling( unsigned int base_width = 256, bool enabled = true );
+        ~OcclusionCulling();
+
+        OcclusionCulling( const OcclusionCulling& other ) = delete;
+        OcclusionCulling& operator=( const OcclusionCulling& other ) = delete;
+
+        inline bool enabled() const { return _enabled; }
+        inline void set_enabled( bool enabled ) { _enabled = enabled; }
+
+        // Start a frame seen through view and projection (near is the camera near, negative),
+        // builds the pyramid from the last finished read back and resets counters
+        void begin( const glm::mat4& view, const glm::mat4& projection, float near );
+
+        // Whether a world space box may be visible this frame
+        bool visible( const Box& box );
+
+        // Read back the depth buffer of the frame, call after drawing occluders
+        void capture( unsigned int width, unsigned int height );
+
+        // Counters of the current frame
+        inline size_t tested() const { return _tested; }
+        inline size_t frustum_culled() const { return _frustum_culled; }
+        inline size_t occlusion_culled() const { return _occlusion_culled; }
+
+    private:
+        // a depth read back in flight
+        struct Readback {
+            GLuint buffer = 0;
+            unsigned int width = 0, height = 0;
+            glm::mat4 view{1.0}, projection{1.0};
+            float near = 0.0;
+            bool pending = false;
+        };
+
+        void _build( const Readback& readback, const float* depth );
+        bool _occluded( const Box& box ) const;
+
+        unsigned int _base_width;
+        bool _enabled;
+
+        Readback _readbacks[2];
+        unsigned int _current = 0;
+
+        // pyramid levels, finest first
+        std::vector<std::vector<float>> _levels;
+        std::vector<unsigned int> _widths, _heights;
+        // matrices of the frame the pyramid was read from
+        glm::mat4 _pyramid_view{1.0}, _pyramid_projection{1.0};
+        float _pyramid_near = 0.0;
+
+        // matrices of the current frame
+        glm::mat4 _view{1.0}, _projection{1.0};
+        Frustum _frustum{glm::mat4{1.0}};
+        float _near = 0.0;
+
+        size_t _tested = 0;
+        size_t _frustum_culled = 0;
+        size_t _occlusion_culled = 0;
+};
+
+#endif // _REPLICATOR_OCCLUSION_H_
@@ -0,0 +1,50 @@
+#ifndef _REPLICATOR_PROGRAM_BINARY_CACHE_H_
+#define _REPLICATOR_PROGRAM_BINARY_CACHE_H_
+
+#include "shaders.hpp"
+#include "gl_extensions.hpp"
+
+#include "glad/glad.h"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// On disk cache of linked program binaries, entries are keyed by the shader
+// sources and the driver so a driver update invalidates them.
+class ProgramBinaryCache {
+    public:
+        static constexpr const char* DEFAULT_DIRECTORY = "shader_cache";
+
+        ProgramBinaryCache( const std::string& directory = DEFAULT_DIRECTORY );
+
+        // True if the driver can retrieve and load program binaries
+        inline bool supported() const { return _supported; }
+
+        // Key of a program built from the sources (in link order)
+        uint64_t key( const std::vector<std::pair<Shader::Type, std::string>>& sources ) const;
+
+        // Return linked program from cache, 0 on miss or if the driver rejects the binary
+        GLuint load( uint64_t key );
+
+        // Save binary of linked program
+        void store( uint64_t key, GLuint program );
+
+        inline size_t hits() const { return _hits; }
+        inline size_t misses() const { return _misses; }
+
+    private:
+        std::string _directory;
+        std::string _driver;
+        bool _supported = false;
+        size_t _hits = 0;
+        size_t _misses = 0;
+
+        PFNGLGETPROGRAMBINARYPROC _get_program_binary = nullptr;
+        PFNGLPROGRAMBINARYPROC _program_binary = nullptr;
+
+        std::string _path( uint64_t key ) const;
+};
+
+#endif // _REPLICATOR_PROGRAM_BINARY_CACHE_H_
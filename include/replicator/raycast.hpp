@@ -0,0 +1,50 @@
+#ifndef _REPLICATOR_RAYCAST_H_
+#define _REPLICATOR_RAYCAST_H_
+
+#include "geometry/ray.hpp"
+#include "geometry/bvh.hpp"
+#include "thread_pool.hpp"
+
+#include "glm/vec3.hpp"
+
+#include "entt/entt.hpp"
+
+#include <limits>
+#include <vector>
+
+// closest model hit by a ray, entity is null on a miss
+struct RayHit {
+    entt::entity entity = entt::null;
+    float distance = std::numeric_limits<float>::infinity();
+    glm::vec3 position{0.0};
+};
+
+// Batch ray queries against the world bounds of the visible models, for
+// offline visibility sampling with many rays. Rays are traced in packets
+// through a BVH, batches are split over the thread pool.
+class Raycaster {
+    public:
+        // rays traced together, consecutive rays of a batch should be coherent
+        static constexpr size_t PACKET_SIZE = 8;
+
+        Raycaster( ThreadPool& pool ) : _pool{pool} {}
+
+        // Rebuild the BVH from the current model bounds, needed after models
+        // move or are added
+        void update( entt::registry& registry );
+
+        // Closest hit of each ray, safe to call from several threads
+        std::vector<RayHit> intersect( const std::vector<Ray>& rays ) const;
+        RayHit intersect( const Ray& ray ) const;
+
+        inline size_t size() const { return _entities.size(); }
+        inline const BVH& bvh() const { return _bvh; }
+
+    private:
+        ThreadPool& _pool;
+        std::vector<entt::entity> _entities;
+        std::vector<Box> _bounds;
+        BVH _bvh;
+};
+
+#endif // _REPLICATOR_RAYCAST_H_
@@ -0,0 +1,13 @@
+#ifndef _REPLICATOR_SHADER_PREPROCESSOR_H_
+#define _REPLICATOR_SHADER_PREPROCESSOR_H_
+
+#include <string>
+#include <vector>
+
+// Read GLSL source, resolving #include "file" relative to the including file
+// (each file is included once) and adding a #define for each given define
+// ("NAME" or "NAME VALUE") right after the #version line. BINDLESS_TEXTURES is
+// also defined when gl_bindless_textures_supported() is true.
+std::string preprocess_shader( const std::string& path, const std::vector<std::string>& defines = {} );
+
+#endif // _REPLICATOR_SHADER_PREPROCESSOR_H_
@@ -0,0 +1,68 @@
+#ifndef _REPLICATOR_SHADER_VARIANTS_H_
+#define _REPLICATOR_SHADER_VARIANTS_H_
+
+#include "shaders.hpp"
+#include "material.hpp"
+#include "program_binary_cache.hpp"
+#include "gl_extensions.hpp"
+
+#include "entt/entt.hpp"
+
+#include <string>
+#include <vector>
+
+// KHR_parallel_shader_compile
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)( GLuint count );
+
+// Source files of a program
+struct ShaderSources {
+    std::vector<std::string> vertex;
+    std::vector<std::string> fragment;
+};
+
+// Compile time features of a program, see shaders/permutation.glsl
+struct ShaderPermutation {
+    static constexpr unsigned int DEFAULT_MAX_LIGHTS = 16;
+
+    bool diffuse_texture = false;
+    bool specular_texture = false;
+    bool two_sided = false;
+    // joint palette skinning in the vertex shader
+    bool skinned = false;
+    unsigned int max_lights = DEFAULT_MAX_LIGHTS;
+
+    // Features used by material
+    static ShaderPermutation from_material( const Material& material, unsigned int max_lights = DEFAULT_MAX_LIGHTS );
+
+    // Preprocessor defines selecting the features
+    std::vector<std::string> defines() const;
+    // Readable key, e.g. "HAS_DIFFUSE_TEX|MAX_LIGHTS=16"
+    std::string name() const;
+
+    bool operator==( const ShaderPermutation& other ) const;
+};
+
+// Specialized programs built from the same sources, stored in the program
+// resource cache with one entry per sources and permutation.
+class ShaderVariants {
+    public:
+        ShaderVariants( entt::resource_cache<ShaderProgram>& cache, ProgramBinaryCache* binary_cache = nullptr );
+
+        // Program for permutation, compiled on first use
+        entt::resource_handle<ShaderProgram> get( const ShaderSources& sources, const ShaderPermutation& permutation );
+
+        // Compile missing permutations together so the driver can build them in parallel
+        void prepare( const ShaderSources& sources, const std::vector<ShaderPermutation>& permutations );
+
+        // True if the driver compiles in background threads
+        inline bool parallel() const { return _parallel; }
+
+    private:
+        entt::resource_cache<ShaderProgram>& _cache;
+        ProgramBinaryCache* _binary_cache;
+        bool _parallel = false;
+
+        static std::string _name( const ShaderSources& sources, const ShaderPermutation& permutation );
+};
+
+#endif // _REPLICATOR_SHADER_VARIANTS_H_
@@ -11,9 +11,12 @@
 
 #include "entt/entt.hpp"
 
+#include <atomic>
+#include <cstdint>
 #include <string>
 #include <memory>
 #include <vector>
+#include <utility>
 
 class Shader {
     public:
@@ -23,24 +26,41 @@ class Shader {
             FRAGMENT = GL_FRAGMENT_SHADER
         };
 
-        // Create a new shader from string
-        Shader(Type type, std::string& source);
+        // Create a new shader from string, without wait errors are reported by check()
+        Shader(Type type, const std::string& source, bool wait = true);
 
         ~Shader();
 
         // Conversion to GLint
         operator GLuint () const { return *_shader_id_shared; }
 
+        // Throw ShaderException if compilation failed
+        void check() const;
+
     private:
         std::shared_ptr<GLuint> _shader_id_shared;
 };
 
 class ShaderProgramDeleter;
+class ProgramBinaryCache;
 
 class ShaderProgram {
     public:
-        // Create new program from multiple shaders
-        ShaderProgram(std::vector<Shader>);
+        // Create new program from multiple shaders (retrievable allows reading its binary),
+        // without wait errors are reported by check()
+        ShaderProgram(std::vector<Shader>, bool retrievable = false, bool wait = true);
+
+        // Take ownership of a linked program
+        explicit ShaderProgram(GLuint program_id);
+
+        // Conversion to GLuint
+        operator GLuint () const { return _program_id; }
+
+        // Unique over every program created, never reused unlike GL names
+        inline uint64_t id() const { return _id; }
+
+        // Throw ShaderException if linking failed
+        void check() const;
 
         // Use shader program
         void use() const;
@@ -50,23 +70,61 @@ class ShaderProgram {
             auto location = glGetUniformLocation( _program_id, name.c_str() );
             _uniforms_to_set_m4[ location ] = value;
         }
+        void uniform( const std::string name, const glm::vec4& value ) {
+            auto location = glGetUniformLocation( _program_id, name.c_str() );
+            _uniforms_to_set_v4[ location ] = value;
+        }
         void uniform( const std::string name, const GLuint value  ) {
             auto location = glGetUniformLocation( _program_id, name.c_str() );
             _uniforms_to_set_u[ location ] = value;
         }
+        // Set arrays from their first element
+        void uniform( const std::string name, const std::vector<glm::mat4>& values ) {
+            auto location = glGetUniformLocation( _program_id, name.c_str() );
+            _uniforms_to_set_m4v[ location ] = values;
+        }
+        void uniform( const std::string name, const std::vector<glm::vec4>& values ) {
+            auto location = glGetUniformLocation( _program_id, name.c_str() );
+            _uniforms_to_set_v4v[ location ] = values;
+        }
+        void uniform( const std::string name, const std::vector<GLuint>& values ) {
+            auto location = glGetUniformLocation( _program_id, name.c_str() );
+            _uniforms_to_set_uv[ location ] = values;
+        }
 
+        // Set texture unit of a sampler uniform
+        void uniform_sampler( const std::string name, const GLint unit ) {
+            auto location = glGetUniformLocation( _program_id, name.c_str() );
+            _uniforms_to_set_i[ location ] = unit;
+        }
+
+        // Assign uniform block to a buffer binding point (ignored if not in program)
+        void uniform_block( const std::string name, const GLuint binding ) {
+            auto index = glGetUniformBlockIndex( _program_id, name.c_str() );
+            if( index != GL_INVALID_INDEX ) {
+                glUniformBlockBinding( _program_id, index, binding );
+            }
+        }
+
+        // Bind material textures to units, textures moved into TexturePools have no storage of their own
         void uniform( const std::string name, const Material& value ); 
 
         void uniform( const std::string& name, const ShaderLight& value ); 
 
     private:
+        static std::atomic<uint64_t> _next_id;
+
         GLuint _program_id;
+        uint64_t _id = _next_id++;
 
         mutable std::unordered_map<GLint, glm::mat4> _uniforms_to_set_m4;
+        mutable std::unordered_map<GLint, std::vector<glm::mat4>> _uniforms_to_set_m4v;
         mutable std::unordered_map<GLint, glm::vec3> _uniforms_to_set_v3;
         mutable std::unordered_map<GLint, glm::vec4> _uniforms_to_set_v4;
+        mutable std::unordered_map<GLint, std::vector<glm::vec4>> _uniforms_to_set_v4v;
         mutable std::unordered_map<GLint, GLfloat> _uniforms_to_set_f;
         mutable std::unordered_map<GLint, GLuint> _uniforms_to_set_u;
+        mutable std::unordered_map<GLint, std::vector<GLuint>> _uniforms_to_set_uv;
         mutable std::unordered_map<GLint, GLint> _uniforms_to_set_i;
         mutable std::unordered_map<GLenum, GLuint> _textures_to_set;
 
@@ -90,8 +148,16 @@ class ShaderException : public std::exception {
 class ShaderProgramLoader final: public entt::resource_loader<ShaderProgramLoader, ShaderProgram> {
     public:
         std::shared_ptr<ShaderProgram> load( const std::vector<std::string>& vs_paths, const std::vector<std::string>& fs_paths ) const;
+        // Load linked binary from cache when possible, compile and store it otherwise
+        std::shared_ptr<ShaderProgram> load( const std::vector<std::string>& vs_paths, const std::vector<std::string>& fs_paths, ProgramBinaryCache& cache ) const;
+        // Compile with preprocessor defines added to every source
+        std::shared_ptr<ShaderProgram> load( const std::vector<std::string>& vs_paths, const std::vector<std::string>& fs_paths, const std::vector<std::string>& defines ) const;
+        // Adopt program built elsewhere (batch compiled permutations)
+        std::shared_ptr<ShaderProgram> load( std::shared_ptr<ShaderProgram> program ) const { return program; }
     private:
-        std::string _load_file( const std::string& path ) const;
+        std::vector<std::pair<Shader::Type, std::string>> _load_sources( const std::vector<std::string>& vs_paths, const std::vector<std::string>& fs_paths, const std::vector<std::string>& defines = {} ) const;
+        std::shared_ptr<ShaderProgram> _compile( const std::vector<std::pair<Shader::Type, std::string>>& sources, bool retrievable ) const;
+        static std::string _program_name( const std::vector<std::string>& vs_paths, const std::vector<std::string>& fs_paths );
 };
 
 #endif // _REPLICATOR_SHADERS_HPP_
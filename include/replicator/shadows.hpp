@@ -0,0 +1,126 @@
+#ifndef _REPLICATOR_SHADOWS_H_
+#define _REPLICATOR_SHADOWS_H_
+
+#include "shaders.hpp"
+#include "models.hpp"
+#include "transform.hpp"
+#include "geometry/box.hpp"
+
+#include "glad/glad.h"
+
+#include "glm/mat4x4.hpp"
+#include "glm/vec4.hpp"
+
+#include "entt/entt.hpp"
+
+#include <vector>
+
+// Component of a directional light or spotlight casting shadows
+class Shadows {
+    public:
+        // cascades and distance from the camera covered only apply to directional lights
+        Shadows( unsigned int cascades = 3, float distance = 50.0 )
+            : _cascades{cascades}, _distance{distance} {}
+        inline unsigned int cascades() const { return _cascades; }
+        inline float distance() const { return _distance; }
+    private:
+        unsigned int _cascades;
+        float _distance;
+};
+
+// Depth maps of the shadowed lights in the layers of one depth texture array.
+// Directional lights get cascades fit to the CurrentCamera, snapped to whole
+// texels so they stay unchanged while the camera moves within a texel.
+// A layer is only re-rendered when its matrix changed or a caster moved
+// inside it, static scenes reuse the maps of previous frames.
+class ShadowMaps {
+    public:
+        static constexpr unsigned int MAX_SHADOWS = 4;
+        static constexpr unsigned int MAX_CASCADES = 4;
+        static constexpr unsigned int MAX_LAYERS = 16;
+        // Texture unit of the shadow maps
+        static constexpr GLuint UNIT = 5;
+
+        // Depth program takes the model_transform and shadow_transform uniforms
+        ShadowMaps( entt::resource_handle<ShaderProgram> depth_program, unsigned int resolution = 1024, unsigned int layers = 8 );
+        ~ShadowMaps();
+
+        ShadowMaps( const ShadowMaps& other ) = delete;
+        ShadowMaps& operator=( const ShadowMaps& other ) = delete;
+
+        // Render the layers of shadowed lights that changed
+        void update( entt::registry& registry );
+
+        // Set shadow uniforms of program
+        void bind( ShaderProgram& program ) const;
+        // Assign the shadow sampler its unit, without any shadowed light
+        static void bind_units( ShaderProgram& program );
+
+        // Depth program of skinned casters, shadow_vertex.glsl built with SKINNED,
+        // skins cast no shadow without one
+        inline void set_skinned_program( entt::resource_handle<ShaderProgram> program ) { _skinned_program = program; }
+
+        // Depth offset in shadow map depth units
+        inline void set_bias( float bias ) { _bias = bias; }
+        // Distance behind a cascade searched for casters, towards the light
+        inline void set_caster_distance( float distance ) { _caster_distance = distance; }
+
+        // Layers rendered and reused in the last update
+        inline size_t rendered() const { return _rendered; }
+        inline size_t cached() const { return _cached; }
+
+        // Record the old and new bounds of casters that change
+        static void on_transform_replace( entt::entity entity, entt::registry& registry, Transform& transform );
+        template<class T>
+        static void on_caster_change( entt::entity entity, entt::registry& registry, T& ) {
+            auto shadow_maps_ptr = registry.try_ctx<ShadowMaps>();
+            auto model_ptr = registry.try_get<Model>( entity );
+            auto transform_ptr = registry.try_get<Transform>( entity );
+            if( shadow_maps_ptr != nullptr && model_ptr != nullptr && transform_ptr != nullptr ) {
+                shadow_maps_ptr->_changed.push_back( transform_ptr->global_affine() * model_ptr->mesh.bounding_box() );
+            }
+        }
+
+        // Connect caster change signals
+        static void connect( entt::registry& registry );
+
+    private:
+        struct Layer {
+            glm::mat4 matrix{1.0};
+            bool valid = false;
+        };
+
+        entt::resource_handle<ShaderProgram> _depth_program;
+        entt::resource_handle<ShaderProgram> _skinned_program;
+        unsigned int _resolution;
+        unsigned int _layer_count;
+        float _bias = 0.0005;
+        float _caster_distance = 100.0;
+
+        GLuint _texture = 0;
+        GLuint _framebuffer = 0;
+        Layer _layers[MAX_LAYERS];
+
+        // per shadowed light: light index, first layer, layer count and cascade ends
+        std::vector<GLuint> _light_indices;
+        std::vector<GLuint> _first_layers;
+        std::vector<GLuint> _layer_counts;
+        std::vector<glm::vec4> _splits;
+        std::vector<glm::mat4> _matrices;
+
+        std::vector<Box> _changed;
+        // posed skin bounds of the last update, animated skins change every frame
+        std::vector<Box> _skin_bounds;
+        size_t _rendered = 0;
+        size_t _cached = 0;
+
+        // cascade matrices of a directional light and their far depths
+        bool _cascades( entt::registry& registry, const glm::vec3& direction, unsigned int count, float distance,
+                std::vector<glm::mat4>& matrices, glm::vec4& splits ) const;
+        void _render( entt::registry& registry, const std::vector<bool>& stale );
+};
+
+// Render shadow maps, run after light_system and before model_system
+void shadow_system( entt::registry& registry );
+
+#endif // _REPLICATOR_SHADOWS_H_
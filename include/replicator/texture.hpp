@@ -5,21 +5,90 @@
 
 #include "entt/entt.hpp"
 
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <string>
 
-class Texture {
+class TextureStreamer;
+class TextureResidency;
+class TexturePools;
+struct CompressedImage;
+
+class Texture : public std::enable_shared_from_this<Texture> {
     public:
+        // Load texture from image file (DDS and KTX files keep their compressed format)
         Texture( const std::string& path );
+        // Create texture from block compressed image with precomputed mips
+        Texture( const CompressedImage& image );
+        // Create 1x1 texture with given color
+        Texture( unsigned char red, unsigned char green, unsigned char blue );
         ~Texture();
+        // 0 while the texels live in a pool layer only (see pooled())
         operator GLuint () const { return _texture_id; }
+
+        inline int width() const { return _width; }
+        inline int height() const { return _height; }
+        // OpenGL internal format and number of mip levels
+        inline GLenum format() const { return _format; }
+        inline int levels() const { return _levels; }
+        // True while full resolution data is still being streamed
+        inline bool streaming() const { return _streaming; }
+        // True when streaming could not load the image, the placeholder is kept
+        inline bool failed() const { return _failed; }
+
+        // Estimated GPU memory of all levels in bytes
+        size_t memory() const;
+        static size_t memory( GLenum format, int width, int height, int levels );
+        // Top mip levels dropped to save memory
+        inline int dropped_levels() const { return _dropped_levels; }
+        // Frame the texture was last drawn with (see TextureResidency)
+        inline unsigned long last_used() const { return _last_used; }
+        // Changes whenever the texture storage is replaced
+        inline unsigned int generation() const { return _generation; }
+        // Unique over every texture created, never reused unlike addresses
+        inline uint64_t id() const { return _id; }
+        // True when the standalone storage was released after copying into
+        // a TexturePools layer, the pools copy it back before freeing the layer
+        inline bool pooled() const { return _pooled; }
     private:
+        static std::atomic<uint64_t> _next_id;
+
         int _width, _height, _channels;
-        GLuint _texture_id;
+        GLenum _format = GL_RGB;
+        int _levels = 1;
+        GLuint _texture_id = 0;
+        bool _streaming = false;
+        bool _failed = false;
+        bool _pooled = false;
+        int _dropped_levels = 0;
+        mutable unsigned long _last_used = 0;
+        unsigned int _generation = 0;
+        uint64_t _id = _next_id++;
+
+        void _upload_compressed( const CompressedImage& image );
+        // Release the largest levels keeping the rest of the mip chain
+        void _drop_levels( int count );
+        // Take storage of other texture (used to restore dropped levels)
+        void _adopt( Texture& other );
+        // Channels requested from stb for an image with given channels
+        static int _channels_for( int channels );
+        static GLenum _format_for( int channels );
+        // Number of levels in a full mip chain
+        static int _mip_levels( int width, int height );
+
+        friend class TextureStreamer;
+        friend class TextureResidency;
+        friend class TexturePools;
 };
 
 class TextureLoader final: public entt::resource_loader<TextureLoader, Texture> {
     public:
         std::shared_ptr<Texture> load( const std::string& texture_path ) const;
+        // Return placeholder texture and stream the image in background
+        std::shared_ptr<Texture> load( const std::string& texture_path, TextureStreamer& streamer ) const;
+        // Load texture tracked by the residency manager
+        std::shared_ptr<Texture> load( const std::string& texture_path, TextureResidency& residency ) const;
 };
 
 class TextureException : public std::exception {
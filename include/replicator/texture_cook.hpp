@@ -0,0 +1,17 @@
+#ifndef _REPLICATOR_TEXTURE_COOK_H_
+#define _REPLICATOR_TEXTURE_COOK_H_
+
+#include "compressed_image.hpp"
+
+#include <string>
+
+// Offline texture compression: builds the mip chain of an uncompressed image
+// and encodes it as BC1 (opaque) or BC3 (with alpha).
+
+// Compress RGBA8 pixels into a block compressed image with full mip chain
+CompressedImage compress_image( const unsigned char* rgba, int width, int height, bool alpha );
+
+// Load image file with stb and write its compressed version as DDS
+void cook_texture( const std::string& source_path, const std::string& dds_path );
+
+#endif // _REPLICATOR_TEXTURE_COOK_H_
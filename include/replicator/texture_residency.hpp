@@ -0,0 +1,86 @@
+#ifndef _REPLICATOR_TEXTURE_RESIDENCY_H_
+#define _REPLICATOR_TEXTURE_RESIDENCY_H_
+
+#include "texture.hpp"
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+class TextureStreamer;
+class TexturePools;
+
+// Residency statistics
+struct TextureResidencyStats {
+    // bytes used by tracked textures and texture pools, and budget
+    size_t usage = 0;
+    size_t budget = 0;
+    size_t textures = 0;
+    // textures that dropped levels and textures restored since start
+    size_t evictions = 0;
+    size_t reloads = 0;
+};
+
+// Keeps the memory of loaded textures under a budget. Least recently used
+// textures drop their largest mip levels and are reloaded when drawn again.
+// Texture pools count whole, reduced textures move to smaller pool layers.
+class TextureResidency {
+    public:
+        static constexpr size_t DEFAULT_BUDGET = 512 * 1024 * 1024;
+        // Textures are not reduced below this size
+        static constexpr int MIN_SIZE = 16;
+        // Textures drawn in the last frames are never reduced
+        static constexpr unsigned long MIN_IDLE_FRAMES = 2;
+
+        // Textures are streamed in background when streamer is given
+        TextureResidency( TextureStreamer* streamer = nullptr, size_t budget = DEFAULT_BUDGET );
+
+        TextureResidency( const TextureResidency& other ) = delete;
+        TextureResidency& operator=( const TextureResidency& other ) = delete;
+
+        // Load and track texture
+        std::shared_ptr<Texture> load( const std::string& path );
+
+        // Record texture use in current frame
+        void touch( const Texture& texture );
+
+        // Reload requested textures and enforce budget, call once per frame
+        void update();
+
+        // Count pool memory and reduce pooled textures (pools must outlive this)
+        void set_pools( TexturePools* pools );
+
+        void set_budget( size_t bytes );
+        inline size_t budget() const { return _budget; }
+        inline unsigned long frame() const { return _frame; }
+
+        TextureResidencyStats stats() const;
+
+    private:
+        struct Entry {
+            std::weak_ptr<Texture> texture;
+            std::string path;
+            // full texture being loaded to replace dropped levels
+            std::shared_ptr<Texture> reload;
+            // a reload failed, the reduced texture is kept
+            bool failed = false;
+        };
+
+        TextureStreamer* _streamer;
+        TexturePools* _pools = nullptr;
+        size_t _budget;
+        unsigned long _frame = 1;
+        std::unordered_map<const Texture*, Entry> _entries;
+        // reduced textures drawn since last update
+        std::unordered_set<const Texture*> _wanted;
+
+        size_t _evictions = 0;
+        size_t _reloads = 0;
+
+        std::shared_ptr<Texture> _load( const std::string& path );
+        size_t _usage() const;
+        void _evict( size_t usage );
+};
+
+#endif // _REPLICATOR_TEXTURE_RESIDENCY_H_
@@ -0,0 +1,86 @@
+#ifndef _REPLICATOR_TEXTURE_STREAMER_H_
+#define _REPLICATOR_TEXTURE_STREAMER_H_
+
+#include "texture.hpp"
+#include "thread_pool.hpp"
+#include "compressed_image.hpp"
+
+#include "glad/glad.h"
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Decodes textures on worker threads and uploads them through a ring of
+// pixel buffer objects, spending at most the upload budget each frame.
+// DDS/KTX files are read on the workers and uploaded without decoding.
+class TextureStreamer {
+    public:
+        // Default per frame upload budget in bytes
+        static constexpr size_t DEFAULT_UPLOAD_BUDGET = 4 * 1024 * 1024;
+        // Maximum size of the low resolution placeholder mip
+        static constexpr int PLACEHOLDER_SIZE = 32;
+
+        TextureStreamer( ThreadPool& pool, size_t upload_budget = DEFAULT_UPLOAD_BUDGET, unsigned int pbo_count = 3 );
+        ~TextureStreamer();
+
+        TextureStreamer( const TextureStreamer& other ) = delete;
+        TextureStreamer& operator=( const TextureStreamer& other ) = delete;
+
+        // Create placeholder texture and start decoding the image in background
+        std::shared_ptr<Texture> request( const std::string& path );
+
+        // Upload decoded data, must be called once per frame from the render thread
+        void update();
+
+        void set_upload_budget( size_t bytes );
+        inline size_t upload_budget() const { return _upload_budget; }
+
+        // Number of textures not fully uploaded yet
+        size_t pending() const;
+
+    private:
+        // Decoded image data
+        struct Image {
+            int width = 0, height = 0, channels = 0;
+            std::vector<unsigned char> pixels;
+        };
+
+        // Texture being streamed
+        struct Job {
+            std::shared_ptr<Texture> texture;
+            std::string path;
+            Image full;
+            Image placeholder;
+            CompressedImage compressed;
+            GLuint target_id = 0;
+            int next_row = 0;
+        };
+
+        // State shared with worker threads
+        struct Shared {
+            std::mutex mutex;
+            std::deque<std::shared_ptr<Job>> decoded;
+            size_t in_flight = 0;
+        };
+
+        ThreadPool& _pool;
+        std::shared_ptr<Shared> _shared;
+        std::deque<std::shared_ptr<Job>> _ready;
+        std::deque<std::shared_ptr<Job>> _uploads;
+
+        size_t _upload_budget;
+        std::vector<GLuint> _pbos;
+        size_t _pbo_size = 0;
+        unsigned int _next_pbo = 0;
+
+        static void _decode( Job& job );
+        static Image _downsample( const Image& image, int max_size );
+        size_t _upload_rows( Job& job, size_t budget );
+        void _finish( Job& job );
+        void _resize_pbos( size_t size );
+};
+
+#endif // _REPLICATOR_TEXTURE_STREAMER_H_
@@ -0,0 +1,104 @@
+#ifndef _REPLICATOR_THREAD_POOL_H_
+#define _REPLICATOR_THREAD_POOL_H_
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+class ThreadPool {
+    public:
+        // Create pool with given number of workers (0 uses hardware concurrency)
+        ThreadPool( unsigned int threads = 0 );
+        ~ThreadPool();
+
+        ThreadPool( const ThreadPool& other ) = delete;
+        ThreadPool& operator=( const ThreadPool& other ) = delete;
+
+        // Number of worker threads
+        inline unsigned int size() const { return _workers.size(); }
+
+        // True when called from one of the pool's workers
+        inline bool worker() const { return _current == this; }
+
+        // Run task on a worker, returns future with the task result
+        template <class F>
+        std::future<std::invoke_result_t<F>> submit( F&& task ) {
+            using Result = std::invoke_result_t<F>;
+            auto packaged = std::make_shared<std::packaged_task<Result()>>( std::forward<F>(task) );
+            auto future = packaged->get_future();
+            {
+                std::lock_guard<std::mutex> lock{ _mutex };
+                _tasks.emplace( [packaged](){ (*packaged)(); } );
+            }
+            _condition.notify_one();
+            return future;
+        }
+
+        // Call function( begin, end ) over chunks of [begin, end) in parallel and wait for all.
+        // Workers run the whole range themselves, waiting on chunks queued behind
+        // them could leave no worker free to run the chunks.
+        template <class F>
+        void parallel_for( size_t begin, size_t end, F function, size_t grain = 1 ) {
+            if( end <= begin ) {
+                return;
+            }
+            size_t count = end - begin;
+            size_t chunks = std::min<size_t>( size() + 1, (count + grain - 1) / std::max<size_t>( grain, 1 ) );
+            if( chunks <= 1 || worker() ) {
+                function( begin, end );
+                return;
+            }
+            size_t chunk_size = (count + chunks - 1) / chunks;
+            std::vector<std::future<void>> futures;
+            futures.reserve( chunks - 1 );
+            // first chunk runs on the calling thread
+            for( size_t c=1; c<chunks; c++ ) {
+                size_t chunk_begin = begin + c*chunk_size;
+                size_t chunk_end = std::min( end, chunk_begin + chunk_size );
+                if( chunk_begin < chunk_end ) {
+                    futures.push_back( submit( [&function, chunk_begin, chunk_end](){ function( chunk_begin, chunk_end ); } ) );
+                }
+            }
+            // chunks hold function by reference, all of them finish before an
+            // exception of any chunk leaves this scope
+            std::exception_ptr error;
+            try {
+                function( begin, std::min( end, begin + chunk_size ) );
+            } catch( ... ) {
+                error = std::current_exception();
+            }
+            for( auto& future : futures ) {
+                try {
+                    future.get();
+                } catch( ... ) {
+                    if( !error ) {
+                        error = std::current_exception();
+                    }
+                }
+            }
+            if( error ) {
+                std::rethrow_exception( error );
+            }
+        }
+
+    private:
+        std::vector<std::thread> _workers;
+        std::queue<std::function<void()>> _tasks;
+        std::mutex _mutex;
+        std::condition_variable _condition;
+        bool _stopping = false;
+        // pool of the calling thread's worker
+        static thread_local const ThreadPool* _current;
+
+        void _work();
+};
+
+#endif // _REPLICATOR_THREAD_POOL_H_
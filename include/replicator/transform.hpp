@@ -5,6 +5,8 @@
 #include "glm/mat4x4.hpp"
 #include "glm/gtx/quaternion.hpp"
 
+#include "affine.hpp"
+
 #include "entt/entt.hpp"
 
 void transform_system( entt::registry& registry );
@@ -18,7 +20,9 @@ class Transform {
         glm::mat4 local_matrix() const;
 
         // get global transformation matrix
-        inline const glm::mat4& global_matrix() const { return _global; }
+        inline glm::mat4 global_matrix() const { return _global.to_mat4(); }
+        // global transformation as stored, 3x4 rows
+        inline const Affine& global_affine() const { return _global; }
 
         // rotations
         Transform& rotate_x( float angle );
@@ -60,7 +64,7 @@ class Transform {
         glm::vec3 _scale{1.0, 1.0, 1.0};
         glm::quat _rotation{1.0, 0.0, 0.0, 0.0};
 
-        glm::mat4 _global{1.0};
+        Affine _global;
         friend void transform_system( entt::registry& registry );
 };
 
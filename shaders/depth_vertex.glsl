@@ -0,0 +1,15 @@
+#version 330 core
+
+// depth pre-pass, must compute gl_Position exactly like vertex_main.glsl
+layout (location = 0) in vec4 vertice_in;
+
+uniform mat4 model_transform;
+uniform mat4 projection_transform;
+uniform mat4 view_transform;
+
+invariant gl_Position;
+
+void main() {
+    vec4 position = model_transform * vertice_in;
+    gl_Position = projection_transform * view_transform * position;
+}
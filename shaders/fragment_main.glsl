@@ -1,4 +1,14 @@
 #version 330 core
+// defined by preprocess_shader when TexturePools uses bindless handles
+#ifdef BINDLESS_TEXTURES
+#extension GL_ARB_bindless_texture : require
+#endif
+
+#include "permutation.glsl"
+
+#define MAX_MATERIALS   256
+#define MAX_POOLS       8
+#define NO_TEXTURE      0xFFFFFFFFu
 
 in vec4 color_f;
 in vec4 normal_f;
@@ -6,35 +16,79 @@ in vec4 position_f;
 in vec2 texcoords_f;
 out vec4 color;
 
-uniform struct {
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-    float shininess;
+struct material_data {
+    vec4 ambient;
+    vec4 diffuse;
+    // w is shininess
+    vec4 specular;
+    // diffuse 0, diffuse 1, specular 0, specular 1 as pool << 16 | layer
+    uvec4 textures;
+};
+
+layout(std140) uniform Materials {
+    material_data materials[MAX_MATERIALS];
+};
+uniform uint material_index;
+
+#ifdef BINDLESS_TEXTURES
+// two 64 bit handles per element
+layout(std140) uniform TexturePoolHandles {
+    uvec4 pool_handles[MAX_POOLS/2];
+};
+
+vec4 sample_pool( uint pool, vec3 coords ) {
+    uvec4 handles = pool_handles[pool/2u];
+    uvec2 handle = (pool % 2u) == 0u ? handles.xy : handles.zw;
+    return texture( sampler2DArray(handle), coords );
+}
+#else
+uniform sampler2DArray texture_pools[MAX_POOLS];
+
+vec4 sample_pool( uint pool, vec3 coords ) {
+    // sampler arrays can only be indexed with constants
+    switch( pool ) {
+        case 0u: return texture( texture_pools[0], coords );
+        case 1u: return texture( texture_pools[1], coords );
+        case 2u: return texture( texture_pools[2], coords );
+        case 3u: return texture( texture_pools[3], coords );
+        case 4u: return texture( texture_pools[4], coords );
+        case 5u: return texture( texture_pools[5], coords );
+        case 6u: return texture( texture_pools[6], coords );
+        case 7u: return texture( texture_pools[7], coords );
+    }
+    return vec4(0.0);
+}
+#endif
 
-    sampler2D diffuse_textures[4];
-    uint diffuse_texture_count;
-    sampler2D specular_textures[4];
-    uint specular_texture_count;
-} material;
+vec3 texture_color( uint slot ) {
+    if( slot == NO_TEXTURE ) {
+        return vec3(0.0);
+    }
+    return sample_pool( slot >> 16u, vec3( texcoords_f, float(slot & 0xFFFFu) ) ).rgb;
+}
 
 vec4 apply_lights( vec3 ambient_color, vec3 diffuse_color, vec3 specular_color, float shininess, vec4 normal, vec4 position );
 
 void main() {
+    material_data material = materials[material_index];
 
-    vec3 ambient_color = material.ambient;
-    vec3 diffuse_color = material.diffuse;
-    vec3 specular_color = material.specular;
+    vec3 ambient_color = material.ambient.rgb;
+    vec3 diffuse_color = material.diffuse.rgb;
+    vec3 specular_color = material.specular.rgb;
+#ifdef HAS_DIFFUSE_TEX
+    diffuse_color += texture_color( material.textures.x ) + texture_color( material.textures.y );
+#endif
+#ifdef HAS_SPECULAR_TEX
+    specular_color += texture_color( material.textures.z ) + texture_color( material.textures.w );
+#endif
 
-    for( uint i=0u; i<material.diffuse_texture_count; i++ ) {
-        vec3 tex_color = texture( material.diffuse_textures[i], texcoords_f ).rgb;
-        //ambient_color += tex_color;
-        diffuse_color += tex_color;
-    }
-    for( uint i=0u; i<material.specular_texture_count; i++ ) {
-        vec3 tex_color = texture( material.specular_textures[i], texcoords_f ).rgb;
-        specular_color += tex_color;
+    vec4 normal = normal_f;
+#ifdef TWO_SIDED
+    // back faces are lit from their own side
+    if( !gl_FrontFacing ) {
+        normal = -normal;
     }
+#endif
 
-    color = apply_lights( ambient_color, diffuse_color, specular_color, material.shininess, normal_f, position_f );
+    color = apply_lights( ambient_color, diffuse_color, specular_color, material.specular.w, normal, position_f );
 }
@@ -1,9 +1,16 @@
 #version 330 core
 
+#include "permutation.glsl"
+
 #define DIRECTIONAL     1u
 #define POINT           2u
 #define SPOTLIGHT       4u
 
+// must match LightClusters::X/Y/Z
+#define CLUSTER_X       16u
+#define CLUSTER_Y       9u
+#define CLUSTER_Z       24u
+
 vec3 ambient_light(vec3 obj_color, vec3 light_color);
 vec3 diffuse_light(vec3 obj_color, vec3 light_color, vec4 normal, vec4 light_direction);
 vec3 specular_light(vec3 obj_color, float shininess, vec3 light_color, vec4 normal, vec4 light_direction, vec4 view_direction);
@@ -19,37 +26,149 @@ struct light {
 
     float outer_angle;
     float inner_angle;
+
+    // 0 is unbounded
+    float radius;
 };
 
 uniform mat4 view_transform;
 
-uniform light lights[16];
+// all lights, 4 texels per light:
+// (position, radius), (direction, type), (color, cos outer), (cos inner, -, -, -)
+uniform samplerBuffer light_data;
+
+// lights of this draw
+uniform uint light_indices[MAX_LIGHTS];
 uniform uint light_count;
 
+// clustered lights, (offset, count) per cluster
+uniform uint clustered;
+uniform usamplerBuffer cluster_grid;
+uniform usamplerBuffer cluster_light_indices;
+// tile width, tile height, depth slice scale, depth slice bias
+uniform vec4 cluster_params;
+
+// must match ShadowMaps::MAX_SHADOWS/MAX_LAYERS
+#define MAX_SHADOWS         4
+#define MAX_SHADOW_LAYERS   16
+
+// shadowed lights, each with one layer or a layer per cascade
+uniform sampler2DArrayShadow shadow_maps;
+uniform uint shadow_count;
+uniform uint shadow_light_index[MAX_SHADOWS];
+uniform uint shadow_first_layer[MAX_SHADOWS];
+uniform uint shadow_layer_count[MAX_SHADOWS];
+// view depth where each cascade ends
+uniform vec4 shadow_splits[MAX_SHADOWS];
+uniform mat4 shadow_transforms[MAX_SHADOW_LAYERS];
+// x is the depth bias
+uniform vec4 shadow_params;
+
+struct material_colors {
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+    float shininess;
+};
+
+// smooth falloff reaching zero at radius
+float range_window( float distance, float radius ) {
+    if( radius <= 0.0 ) {
+        return 1.0;
+    }
+    float ratio = distance / radius;
+    float window = clamp( 1.0 - ratio*ratio*ratio*ratio, 0.0, 1.0 );
+    return window * window;
+}
+
+// fraction of light reaching position, 1 for lights without shadows
+float shadow_factor( uint index, vec4 position, float view_depth ) {
+    for( uint s=0u; s<min(shadow_count, uint(MAX_SHADOWS)); s++ ) {
+        if( shadow_light_index[s] != index ) {
+            continue;
+        }
+        uint layer = shadow_first_layer[s];
+        if( shadow_layer_count[s] > 1u ) {
+            uint cascade = 0u;
+            while( cascade < shadow_layer_count[s] && view_depth > shadow_splits[s][cascade] ) {
+                cascade++;
+            }
+            if( cascade == shadow_layer_count[s] ) {
+                return 1.0;
+            }
+            layer += cascade;
+        }
+        vec4 shadow_position = shadow_transforms[layer] * position;
+        vec3 coords = shadow_position.xyz / shadow_position.w * 0.5 + 0.5;
+        if( any(lessThan(coords, vec3(0.0))) || any(greaterThan(coords, vec3(1.0))) ) {
+            return 1.0;
+        }
+        return texture( shadow_maps, vec4( coords.xy, float(layer), coords.z - shadow_params.x ) );
+    }
+    return 1.0;
+}
+
+vec3 shade_light( light l, material_colors material, vec4 normal, vec4 position, vec4 view_direction, float shadow ) {
+    vec3 color = vec3(0.0);
+    if( (l.type & DIRECTIONAL) > 0u ) {
+        vec4 light_direction = -l.direction;
+        color += ambient_light(material.ambient, l.color);
+        color += shadow*diffuse_light(material.diffuse, l.color, normal, light_direction);
+        color += shadow*specular_light(material.specular, material.shininess, l.color, normal, light_direction, view_direction);
+    }
+    if( (l.type & (POINT | SPOTLIGHT)) > 0u ) {
+        vec4 to_light = l.position - position;
+        float window = range_window( length(to_light), l.radius );
+        if( window <= 0.0 ) {
+            return color;
+        }
+        vec4 light_direction = normalize(to_light);
+        if( (l.type & POINT) > 0u ) {
+            color += window*ambient_light(material.ambient, l.color);
+            color += window*diffuse_light(material.diffuse, l.color, normal, light_direction);
+            color += window*specular_light(material.specular, material.shininess, l.color, normal, light_direction, view_direction);
+        }
+        if( (l.type & SPOTLIGHT) > 0u ) {
+            float theta = dot(light_direction, normalize(-l.direction));
+            float intensity = shadow*window*clamp( (theta-l.outer_angle) / (l.inner_angle - l.outer_angle), 0.0, 1.0);
+            color += window*ambient_light(material.ambient, l.color);
+            color += intensity*diffuse_light(material.diffuse, l.color, normal, light_direction);
+            color += intensity*specular_light(material.specular, material.shininess, l.color, normal, light_direction, view_direction);
+        }
+    }
+    return color;
+}
+
+light fetch_light( int index ) {
+    vec4 position = texelFetch( light_data, 4*index );
+    vec4 direction = texelFetch( light_data, 4*index + 1 );
+    vec4 color = texelFetch( light_data, 4*index + 2 );
+    vec4 inner = texelFetch( light_data, 4*index + 3 );
+    return light( uint(direction.w), vec4(position.xyz, 1.0), vec4(direction.xyz, 0.0), color.rgb, color.w, inner.x, position.w );
+}
+
 vec4 apply_lights( vec3 ambient_color, vec3 diffuse_color, vec3 specular_color, float shininess, vec4 normal, vec4 position ) {
     vec4 color = vec4(0.0, 0.0, 0.0, 1.0);
     vec4 camera_pos = inverse(view_transform) * vec4(0.0, 0.0, 0.0, 1.0);
     vec4 view_direction = normalize( camera_pos - position );
-    for( uint i=0u; i<light_count; i++ ) {
-        if( (lights[i].type & DIRECTIONAL) > 0u ) {
-            vec4 light_direction = -lights[i].direction;
-            color += vec4(ambient_light(ambient_color, lights[i].color), 0.0);
-            color += vec4(diffuse_light(diffuse_color, lights[i].color, normal, light_direction), 0.0);
-            color += vec4(specular_light(specular_color, shininess, lights[i].color, normal, light_direction, view_direction), 0.0);
-        }
-        if( (lights[i].type & POINT) > 0u ) {
-            vec4 light_direction = normalize(lights[i].position - position);
-            color += vec4(ambient_light(ambient_color, lights[i].color), 0.0);
-            color += vec4(diffuse_light(diffuse_color, lights[i].color, normal, light_direction), 0.0);
-            color += vec4(specular_light(specular_color, shininess, lights[i].color, normal, light_direction, view_direction), 0.0);
-        }
-        if( (lights[i].type & SPOTLIGHT) > 0u ) {
-            vec4 light_direction = normalize(lights[i].position - position);
-            float theta = dot(light_direction, normalize(-lights[i].direction));
-            float intensity = clamp( (theta-lights[i].outer_angle) / (lights[i].inner_angle - lights[i].outer_angle), 0.0, 1.0); 
-            color += vec4(ambient_light(ambient_color, lights[i].color), 0.0);
-            color += intensity*vec4(diffuse_light(diffuse_color, lights[i].color, normal, light_direction), 0.0);
-            color += intensity*vec4(specular_light(specular_color, shininess, lights[i].color, normal, light_direction, view_direction), 0.0);
+    material_colors material = material_colors( ambient_color, diffuse_color, specular_color, shininess );
+    float depth = max( -(view_transform * position).z, 1e-4 );
+    for( uint i=0u; i<min(light_count, uint(MAX_LIGHTS)); i++ ) {
+        uint index = light_indices[i];
+        float shadow = shadow_factor( index, position, depth );
+        color.rgb += shade_light( fetch_light( int(index) ), material, normal, position, view_direction, shadow );
+    }
+
+    if( clustered > 0u ) {
+        // cluster of the fragment from its tile and view depth
+        uvec2 tile = min( uvec2( gl_FragCoord.xy / cluster_params.xy ), uvec2( CLUSTER_X - 1u, CLUSTER_Y - 1u ) );
+        uint slice = uint( clamp( log(depth) * cluster_params.z + cluster_params.w, 0.0, float(CLUSTER_Z - 1u) ) );
+        int cluster = int( tile.x + CLUSTER_X * ( tile.y + CLUSTER_Y * slice ) );
+        uvec2 range = texelFetch( cluster_grid, cluster ).xy;
+        for( uint i=0u; i<range.y; i++ ) {
+            int index = int( texelFetch( cluster_light_indices, int(range.x + i) ).x );
+            float shadow = shadow_factor( uint(index), position, depth );
+            color.rgb += shade_light( fetch_light( index ), material, normal, position, view_direction, shadow );
         }
     }
     return color;
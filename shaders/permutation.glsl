@@ -0,0 +1,12 @@
+#version 330 core
+
+// Programs built without a permutation sample every texture and shade like
+// before permutations, TWO_SIDED only comes from ShaderPermutation::two_sided
+#ifndef PERMUTATION
+#define HAS_DIFFUSE_TEX
+#define HAS_SPECULAR_TEX
+#endif
+
+#ifndef MAX_LIGHTS
+#define MAX_LIGHTS 16
+#endif
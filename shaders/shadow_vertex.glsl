@@ -0,0 +1,41 @@
+#version 330 core
+
+// depth only pass of shadow maps, no fragment shader is attached
+layout (location = 0) in vec4 vertice_in;
+#ifdef SKINNED
+layout (location = 4) in uvec4 joints_in;
+layout (location = 5) in vec4 weights_in;
+#endif
+
+uniform mat4 model_transform;
+uniform mat4 shadow_transform;
+
+#ifdef SKINNED
+// world space joint matrices as three rows per joint, like vertex_main.glsl
+uniform samplerBuffer joint_palettes;
+uniform uint joint_offset;
+uniform uint joint_count;
+
+mat4 joint_matrix( uint joint ) {
+    int texel = 3 * int( joint_offset + uint(gl_InstanceID) * joint_count + joint );
+    return transpose( mat4(
+        texelFetch( joint_palettes, texel ),
+        texelFetch( joint_palettes, texel + 1 ),
+        texelFetch( joint_palettes, texel + 2 ),
+        vec4( 0.0, 0.0, 0.0, 1.0 )
+    ) );
+}
+#endif
+
+void main() {
+#ifdef SKINNED
+    // palettes already include the model transform
+    mat4 skin_transform = weights_in.x * joint_matrix( joints_in.x )
+        + weights_in.y * joint_matrix( joints_in.y )
+        + weights_in.z * joint_matrix( joints_in.z )
+        + weights_in.w * joint_matrix( joints_in.w );
+    gl_Position = shadow_transform * skin_transform * vertice_in;
+#else
+    gl_Position = shadow_transform * model_transform * vertice_in;
+#endif
+}
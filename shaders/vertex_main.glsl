@@ -4,6 +4,10 @@ layout (location = 0) in vec4 vertice_in;
 layout (location = 1) in vec4 color_in;
 layout (location = 2) in vec4 normal_in;
 layout (location = 3) in vec2 texcoord_in;
+#ifdef SKINNED
+layout (location = 4) in uvec4 joints_in;
+layout (location = 5) in vec4 weights_in;
+#endif
 
 out vec4 color_f;
 out vec4 normal_f;
@@ -14,10 +18,40 @@ uniform mat4 model_transform;
 uniform mat4 projection_transform;
 uniform mat4 view_transform;
 
+#ifdef SKINNED
+// world space joint matrices as three rows per joint, instances follow each other
+uniform samplerBuffer joint_palettes;
+uniform uint joint_offset;
+uniform uint joint_count;
+
+mat4 joint_matrix( uint joint ) {
+    int texel = 3 * int( joint_offset + uint(gl_InstanceID) * joint_count + joint );
+    return transpose( mat4(
+        texelFetch( joint_palettes, texel ),
+        texelFetch( joint_palettes, texel + 1 ),
+        texelFetch( joint_palettes, texel + 2 ),
+        vec4( 0.0, 0.0, 0.0, 1.0 )
+    ) );
+}
+#endif
+
+// depth pre-pass positions must match exactly
+invariant gl_Position;
+
 void main() {
+#ifdef SKINNED
+    // palettes already include the model transform
+    mat4 skin_transform = weights_in.x * joint_matrix( joints_in.x )
+        + weights_in.y * joint_matrix( joints_in.y )
+        + weights_in.z * joint_matrix( joints_in.z )
+        + weights_in.w * joint_matrix( joints_in.w );
+    position_f = skin_transform * vertice_in;
+    normal_f = vec4(normalize((inverse(transpose(skin_transform))*normal_in).xyz), 0.0);
+#else
     position_f = model_transform * vertice_in;
+    normal_f = vec4(normalize((inverse(transpose(model_transform))*normal_in).xyz), 0.0);
+#endif
     gl_Position = projection_transform * view_transform * position_f;
     color_f = color_in;
-    normal_f = vec4(normalize((inverse(transpose(model_transform))*normal_in).xyz), 0.0);
     texcoords_f = texcoord_in;
 }
@@ -0,0 +1,306 @@
+#include "affine.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define REPLICATOR_AFFINE_X86
+#include <immintrin.h>
+#endif
+
+glm::mat4 Affine::to_mat4() const {
+    glm::mat4 matrix{1.0};
+    for( int row=0; row<3; row++ ) {
+        for( int col=0; col<4; col++ ) {
+            matrix[col][row] = rows[row][col];
+        }
+    }
+    return matrix;
+}
+
+Affine Affine::from_mat4( const glm::mat4& matrix ) {
+    Affine affine;
+    for( int row=0; row<3; row++ ) {
+        affine.rows[row] = glm::vec4{ matrix[0][row], matrix[1][row], matrix[2][row], matrix[3][row] };
+    }
+    return affine;
+}
+
+Affine Affine::inverse() const {
+    const auto& r0 = rows[0];
+    const auto& r1 = rows[1];
+    const auto& r2 = rows[2];
+    // cofactors of the 3x3 part
+    float c00 = r1.y*r2.z - r1.z*r2.y;
+    float c01 = r1.z*r2.x - r1.x*r2.z;
+    float c02 = r1.x*r2.y - r1.y*r2.x;
+    float det = r0.x*c00 + r0.y*c01 + r0.z*c02;
+    float inv = det != 0.0f ? 1.0f / det : 0.0f;
+
+    Affine result;
+    result.rows[0] = glm::vec4{ c00*inv, (r0.z*r2.y - r0.y*r2.z)*inv, (r0.y*r1.z - r0.z*r1.y)*inv, 0.0 };
+    result.rows[1] = glm::vec4{ c01*inv, (r0.x*r2.z - r0.z*r2.x)*inv, (r0.z*r1.x - r0.x*r1.z)*inv, 0.0 };
+    result.rows[2] = glm::vec4{ c02*inv, (r0.y*r2.x - r0.x*r2.y)*inv, (r0.x*r1.y - r0.y*r1.x)*inv, 0.0 };
+    auto translation = result.transform_vector( glm::vec3{ r0.w, r1.w, r2.w } );
+    result.rows[0].w = -translation.x;
+    result.rows[1].w = -translation.y;
+    result.rows[2].w = -translation.z;
+    return result;
+}
+
+Affine Affine::operator*( const Affine& other ) const {
+    return affine_op::multiply( *this, other );
+}
+
+// rows as a flat array of 12 floats
+static inline float* data( Affine& affine ) { return &affine.rows[0].x; }
+static inline const float* data( const Affine& affine ) { return &affine.rows[0].x; }
+
+// scalar kernels
+
+static void compose_scalar( const glm::vec3* translations, const glm::quat* rotations, const glm::vec3* scales, Affine* out, size_t count ) {
+    for( size_t i=0; i<count; i++ ) {
+        const auto& q = rotations[i];
+        const auto& s = scales[i];
+        const auto& t = translations[i];
+        float xx = q.x*q.x, yy = q.y*q.y, zz = q.z*q.z;
+        float xy = q.x*q.y, xz = q.x*q.z, yz = q.y*q.z;
+        float wx = q.w*q.x, wy = q.w*q.y, wz = q.w*q.z;
+        float* m = data( out[i] );
+        m[0] = ( 1.0f - 2.0f*(yy + zz) ) * s.x;
+        m[1] = 2.0f*(xy - wz) * s.y;
+        m[2] = 2.0f*(xz + wy) * s.z;
+        m[3] = t.x;
+        m[4] = 2.0f*(xy + wz) * s.x;
+        m[5] = ( 1.0f - 2.0f*(xx + zz) ) * s.y;
+        m[6] = 2.0f*(yz - wx) * s.z;
+        m[7] = t.y;
+        m[8] = 2.0f*(xz - wy) * s.x;
+        m[9] = 2.0f*(yz + wx) * s.y;
+        m[10] = ( 1.0f - 2.0f*(xx + yy) ) * s.z;
+        m[11] = t.z;
+    }
+}
+
+static void multiply_scalar( const Affine* parents, const Affine* locals, Affine* out, size_t count ) {
+    for( size_t i=0; i<count; i++ ) {
+        const float* p = data( parents[i] );
+        const float* l = data( locals[i] );
+        float result[12];
+        for( int row=0; row<3; row++ ) {
+            const float* pr = p + 4*row;
+            for( int col=0; col<4; col++ ) {
+                result[4*row + col] = pr[0]*l[col] + pr[1]*l[4 + col] + pr[2]*l[8 + col];
+            }
+            result[4*row + 3] += pr[3];
+        }
+        float* o = data( out[i] );
+        for( int k=0; k<12; k++ ) {
+            o[k] = result[k];
+        }
+    }
+}
+
+#ifdef REPLICATOR_AFFINE_X86
+
+// SSE kernels, four transforms at a time in structure of arrays form
+
+static void compose_sse( const glm::vec3* translations, const glm::quat* rotations, const glm::vec3* scales, Affine* out, size_t count ) {
+    size_t i = 0;
+    const __m128 one = _mm_set1_ps( 1.0f );
+    const __m128 two = _mm_set1_ps( 2.0f );
+    for( ; i + 4 <= count; i += 4 ) {
+        const auto* q = rotations + i;
+        const auto* s = scales + i;
+        const auto* t = translations + i;
+        __m128 qx = _mm_setr_ps( q[0].x, q[1].x, q[2].x, q[3].x );
+        __m128 qy = _mm_setr_ps( q[0].y, q[1].y, q[2].y, q[3].y );
+        __m128 qz = _mm_setr_ps( q[0].z, q[1].z, q[2].z, q[3].z );
+        __m128 qw = _mm_setr_ps( q[0].w, q[1].w, q[2].w, q[3].w );
+        __m128 sx = _mm_setr_ps( s[0].x, s[1].x, s[2].x, s[3].x );
+        __m128 sy = _mm_setr_ps( s[0].y, s[1].y, s[2].y, s[3].y );
+        __m128 sz = _mm_setr_ps( s[0].z, s[1].z, s[2].z, s[3].z );
+
+        __m128 x2 = _mm_mul_ps( qx, two ), y2 = _mm_mul_ps( qy, two ), z2 = _mm_mul_ps( qz, two );
+        __m128 xx = _mm_mul_ps( qx, x2 ), yy = _mm_mul_ps( qy, y2 ), zz = _mm_mul_ps( qz, z2 );
+        __m128 xy = _mm_mul_ps( qx, y2 ), xz = _mm_mul_ps( qx, z2 ), yz = _mm_mul_ps( qy, z2 );
+        __m128 wx = _mm_mul_ps( qw, x2 ), wy = _mm_mul_ps( qw, y2 ), wz = _mm_mul_ps( qw, z2 );
+
+        __m128 rows[3][4] = {
+            { _mm_mul_ps( _mm_sub_ps( one, _mm_add_ps( yy, zz ) ), sx ), _mm_mul_ps( _mm_sub_ps( xy, wz ), sy ),
+              _mm_mul_ps( _mm_add_ps( xz, wy ), sz ), _mm_setr_ps( t[0].x, t[1].x, t[2].x, t[3].x ) },
+            { _mm_mul_ps( _mm_add_ps( xy, wz ), sx ), _mm_mul_ps( _mm_sub_ps( one, _mm_add_ps( xx, zz ) ), sy ),
+              _mm_mul_ps( _mm_sub_ps( yz, wx ), sz ), _mm_setr_ps( t[0].y, t[1].y, t[2].y, t[3].y ) },
+            { _mm_mul_ps( _mm_sub_ps( xz, wy ), sx ), _mm_mul_ps( _mm_add_ps( yz, wx ), sy ),
+              _mm_mul_ps( _mm_sub_ps( one, _mm_add_ps( xx, yy ) ), sz ), _mm_setr_ps( t[0].z, t[1].z, t[2].z, t[3].z ) },
+        };
+        // columns of the four transforms into rows of each one
+        for( int row=0; row<3; row++ ) {
+            _MM_TRANSPOSE4_PS( rows[row][0], rows[row][1], rows[row][2], rows[row][3] );
+            for( int k=0; k<4; k++ ) {
+                _mm_storeu_ps( data( out[i + k] ) + 4*row, rows[row][k] );
+            }
+        }
+    }
+    compose_scalar( translations + i, rotations + i, scales + i, out + i, count - i );
+}
+
+static void multiply_sse( const Affine* parents, const Affine* locals, Affine* out, size_t count ) {
+    const __m128 last = _mm_castsi128_ps( _mm_setr_epi32( 0, 0, 0, -1 ) );
+    for( size_t i=0; i<count; i++ ) {
+        const float* p = data( parents[i] );
+        const float* l = data( locals[i] );
+        __m128 l0 = _mm_loadu_ps( l );
+        __m128 l1 = _mm_loadu_ps( l + 4 );
+        __m128 l2 = _mm_loadu_ps( l + 8 );
+        __m128 results[3];
+        for( int row=0; row<3; row++ ) {
+            __m128 pr = _mm_loadu_ps( p + 4*row );
+            __m128 result = _mm_mul_ps( _mm_shuffle_ps( pr, pr, _MM_SHUFFLE(0, 0, 0, 0) ), l0 );
+            result = _mm_add_ps( result, _mm_mul_ps( _mm_shuffle_ps( pr, pr, _MM_SHUFFLE(1, 1, 1, 1) ), l1 ) );
+            result = _mm_add_ps( result, _mm_mul_ps( _mm_shuffle_ps( pr, pr, _MM_SHUFFLE(2, 2, 2, 2) ), l2 ) );
+            // parent translation only adds to the translation column
+            results[row] = _mm_add_ps( result, _mm_and_ps( pr, last ) );
+        }
+        float* o = data( out[i] );
+        _mm_storeu_ps( o, results[0] );
+        _mm_storeu_ps( o + 4, results[1] );
+        _mm_storeu_ps( o + 8, results[2] );
+    }
+}
+
+// AVX2 kernels, eight transforms at a time for composition and two per
+// register for multiplication, with fused multiply adds
+
+__attribute__((target("avx2,fma")))
+static void compose_avx2( const glm::vec3* translations, const glm::quat* rotations, const glm::vec3* scales, Affine* out, size_t count ) {
+    size_t i = 0;
+    const __m256 one = _mm256_set1_ps( 1.0f );
+    const __m256 two = _mm256_set1_ps( 2.0f );
+    for( ; i + 8 <= count; i += 8 ) {
+        const auto* q = rotations + i;
+        const auto* s = scales + i;
+        const auto* t = translations + i;
+        __m256 qx = _mm256_setr_ps( q[0].x, q[1].x, q[2].x, q[3].x, q[4].x, q[5].x, q[6].x, q[7].x );
+        __m256 qy = _mm256_setr_ps( q[0].y, q[1].y, q[2].y, q[3].y, q[4].y, q[5].y, q[6].y, q[7].y );
+        __m256 qz = _mm256_setr_ps( q[0].z, q[1].z, q[2].z, q[3].z, q[4].z, q[5].z, q[6].z, q[7].z );
+        __m256 qw = _mm256_setr_ps( q[0].w, q[1].w, q[2].w, q[3].w, q[4].w, q[5].w, q[6].w, q[7].w );
+        __m256 sx = _mm256_setr_ps( s[0].x, s[1].x, s[2].x, s[3].x, s[4].x, s[5].x, s[6].x, s[7].x );
+        __m256 sy = _mm256_setr_ps( s[0].y, s[1].y, s[2].y, s[3].y, s[4].y, s[5].y, s[6].y, s[7].y );
+        __m256 sz = _mm256_setr_ps( s[0].z, s[1].z, s[2].z, s[3].z, s[4].z, s[5].z, s[6].z, s[7].z );
+
+        __m256 x2 = _mm256_mul_ps( qx, two ), y2 = _mm256_mul_ps( qy, two ), z2 = _mm256_mul_ps( qz, two );
+        __m256 xx = _mm256_mul_ps( qx, x2 ), yy = _mm256_mul_ps( qy, y2 ), zz = _mm256_mul_ps( qz, z2 );
+        __m256 xy = _mm256_mul_ps( qx, y2 ), xz = _mm256_mul_ps( qx, z2 ), yz = _mm256_mul_ps( qy, z2 );
+        __m256 wx = _mm256_mul_ps( qw, x2 ), wy = _mm256_mul_ps( qw, y2 ), wz = _mm256_mul_ps( qw, z2 );
+
+        __m256 rows[3][4] = {
+            { _mm256_mul_ps( _mm256_sub_ps( one, _mm256_add_ps( yy, zz ) ), sx ), _mm256_mul_ps( _mm256_sub_ps( xy, wz ), sy ),
+              _mm256_mul_ps( _mm256_add_ps( xz, wy ), sz ),
+              _mm256_setr_ps( t[0].x, t[1].x, t[2].x, t[3].x, t[4].x, t[5].x, t[6].x, t[7].x ) },
+            { _mm256_mul_ps( _mm256_add_ps( xy, wz ), sx ), _mm256_mul_ps( _mm256_sub_ps( one, _mm256_add_ps( xx, zz ) ), sy ),
+              _mm256_mul_ps( _mm256_sub_ps( yz, wx ), sz ),
+              _mm256_setr_ps( t[0].y, t[1].y, t[2].y, t[3].y, t[4].y, t[5].y, t[6].y, t[7].y ) },
+            { _mm256_mul_ps( _mm256_sub_ps( xz, wy ), sx ), _mm256_mul_ps( _mm256_add_ps( yz, wx ), sy ),
+              _mm256_mul_ps( _mm256_sub_ps( one, _mm256_add_ps( xx, yy ) ), sz ),
+              _mm256_setr_ps( t[0].z, t[1].z, t[2].z, t[3].z, t[4].z, t[5].z, t[6].z, t[7].z ) },
+        };
+        // each 128-bit half holds four transforms, transposed as in the SSE kernel
+        for( int row=0; row<3; row++ ) {
+            for( int half=0; half<2; half++ ) {
+                __m128 c0 = half ? _mm256_extractf128_ps( rows[row][0], 1 ) : _mm256_castps256_ps128( rows[row][0] );
+                __m128 c1 = half ? _mm256_extractf128_ps( rows[row][1], 1 ) : _mm256_castps256_ps128( rows[row][1] );
+                __m128 c2 = half ? _mm256_extractf128_ps( rows[row][2], 1 ) : _mm256_castps256_ps128( rows[row][2] );
+                __m128 c3 = half ? _mm256_extractf128_ps( rows[row][3], 1 ) : _mm256_castps256_ps128( rows[row][3] );
+                _MM_TRANSPOSE4_PS( c0, c1, c2, c3 );
+                _mm_storeu_ps( data( out[i + 4*half] ) + 4*row, c0 );
+                _mm_storeu_ps( data( out[i + 4*half + 1] ) + 4*row, c1 );
+                _mm_storeu_ps( data( out[i + 4*half + 2] ) + 4*row, c2 );
+                _mm_storeu_ps( data( out[i + 4*half + 3] ) + 4*row, c3 );
+            }
+        }
+    }
+    compose_scalar( translations + i, rotations + i, scales + i, out + i, count - i );
+}
+
+__attribute__((target("avx2,fma")))
+static void multiply_avx2( const Affine* parents, const Affine* locals, Affine* out, size_t count ) {
+    const __m256 last = _mm256_castsi256_ps( _mm256_setr_epi32( 0, 0, 0, -1, 0, 0, 0, -1 ) );
+    size_t i = 0;
+    // low half for transform i, high half for transform i + 1
+    for( ; i + 2 <= count; i += 2 ) {
+        const float* pa = data( parents[i] );
+        const float* pb = data( parents[i + 1] );
+        const float* la = data( locals[i] );
+        const float* lb = data( locals[i + 1] );
+        __m256 l0 = _mm256_loadu2_m128( lb, la );
+        __m256 l1 = _mm256_loadu2_m128( lb + 4, la + 4 );
+        __m256 l2 = _mm256_loadu2_m128( lb + 8, la + 8 );
+        __m256 results[3];
+        for( int row=0; row<3; row++ ) {
+            __m256 pr = _mm256_loadu2_m128( pb + 4*row, pa + 4*row );
+            __m256 result = _mm256_mul_ps( _mm256_permute_ps( pr, _MM_SHUFFLE(0, 0, 0, 0) ), l0 );
+            result = _mm256_fmadd_ps( _mm256_permute_ps( pr, _MM_SHUFFLE(1, 1, 1, 1) ), l1, result );
+            result = _mm256_fmadd_ps( _mm256_permute_ps( pr, _MM_SHUFFLE(2, 2, 2, 2) ), l2, result );
+            results[row] = _mm256_add_ps( result, _mm256_and_ps( pr, last ) );
+        }
+        float* oa = data( out[i] );
+        float* ob = data( out[i + 1] );
+        for( int row=0; row<3; row++ ) {
+            _mm256_storeu2_m128( ob + 4*row, oa + 4*row, results[row] );
+        }
+    }
+    multiply_sse( parents + i, locals + i, out + i, count - i );
+}
+
+#endif // REPLICATOR_AFFINE_X86
+
+// kernels chosen once for the running CPU
+struct AffineKernels {
+    void (*compose)( const glm::vec3*, const glm::quat*, const glm::vec3*, Affine*, size_t );
+    void (*multiply)( const Affine*, const Affine*, Affine*, size_t );
+    const char* name;
+};
+
+static AffineKernels select_kernels() {
+#ifdef REPLICATOR_AFFINE_X86
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" ) ) {
+        return AffineKernels{ compose_avx2, multiply_avx2, "avx2" };
+    }
+    if( __builtin_cpu_supports( "sse2" ) ) {
+        return AffineKernels{ compose_sse, multiply_sse, "sse" };
+    }
+#endif
+    return AffineKernels{ compose_scalar, multiply_scalar, "scalar" };
+}
+
+static const AffineKernels& kernels() {
+    static const AffineKernels selected = select_kernels();
+    return selected;
+}
+
+namespace affine_op {
+
+    void compose( const glm::vec3* translations, const glm::quat* rotations, const glm::vec3* scales, Affine* out, size_t count ) {
+        kernels().compose( translations, rotations, scales, out, count );
+    }
+
+    void multiply( const Affine* parents, const Affine* locals, Affine* out, size_t count ) {
+        kernels().multiply( parents, locals, out, count );
+    }
+
+    Affine compose( const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale ) {
+        Affine affine;
+        compose_scalar( &translation, &rotation, &scale, &affine, 1 );
+        return affine;
+    }
+
+    Affine multiply( const Affine& parent, const Affine& local ) {
+        Affine affine;
+        kernels().multiply( &parent, &local, &affine, 1 );
+        return affine;
+    }
+
+    const char* implementation() {
+        return kernels().name;
+    }
+
+}
@@ -0,0 +1,236 @@
+#include "animation.hpp"
+
+#include "transform.hpp"
+#include "models.hpp"
+#include "thread_pool.hpp"
+#include "time.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <cmath>
+
+// animators and skins per pool task
+static constexpr size_t ANIMATORS_PER_TASK = 16;
+static constexpr size_t SKINS_PER_TASK = 64;
+
+std::optional<uint16_t> Skeleton::find( const std::string& name ) const {
+    auto it = std::find( names.begin(), names.end(), name );
+    if( it == names.end() ) {
+        return std::nullopt;
+    }
+    return it - names.begin();
+}
+
+PackedQuat PackedQuat::pack( const glm::quat& rotation ) {
+    auto to_snorm = []( float value ){
+        return (int16_t)std::lround( std::clamp( value, -1.0f, 1.0f ) * 32767.0f );
+    };
+    return PackedQuat{ to_snorm( rotation.x ), to_snorm( rotation.y ), to_snorm( rotation.z ), to_snorm( rotation.w ) };
+}
+
+glm::quat PackedQuat::unpack() const {
+    return glm::normalize( glm::quat{ w / 32767.0f, x / 32767.0f, y / 32767.0f, z / 32767.0f } );
+}
+
+void AnimationClip::sample( const Skeleton& skeleton, float time, glm::vec3* out_translations, glm::quat* out_rotations, glm::vec3* out_scales ) const {
+    // keys around time and the blend between them
+    float frame = std::clamp( time * sample_rate, 0.0f, (float)std::max( frame_count, 1u ) - 1.0f );
+    uint32_t key = (uint32_t)frame;
+    uint32_t next = std::min( key + 1, std::max( frame_count, 1u ) - 1 );
+    float blend = frame - key;
+
+    for( size_t joint=0; joint<skeleton.size(); joint++ ) {
+        if( joint >= channels.size() ) {
+            out_translations[joint] = skeleton.translations[joint];
+            out_rotations[joint] = skeleton.rotations[joint];
+            out_scales[joint] = skeleton.scales[joint];
+            continue;
+        }
+        const auto& channel = channels[joint];
+        const auto& translation = channel.translation;
+        if( translation.count == 0 ) {
+            out_translations[joint] = skeleton.translations[joint];
+        } else if( translation.count == 1 ) {
+            out_translations[joint] = translations[ translation.first ];
+        } else {
+            out_translations[joint] = glm::mix( translations[ translation.first + key ], translations[ translation.first + next ], blend );
+        }
+        const auto& rotation = channel.rotation;
+        if( rotation.count == 0 ) {
+            out_rotations[joint] = skeleton.rotations[joint];
+        } else if( rotation.count == 1 ) {
+            out_rotations[joint] = rotations[ rotation.first ].unpack();
+        } else {
+            // normalized lerp along the shorter arc, keys are close
+            auto a = rotations[ rotation.first + key ].unpack();
+            auto b = rotations[ rotation.first + next ].unpack();
+            if( glm::dot( a, b ) < 0.0f ) {
+                b = -b;
+            }
+            out_rotations[joint] = glm::normalize( a * ( 1.0f - blend ) + b * blend );
+        }
+        const auto& scale = channel.scale;
+        if( scale.count == 0 ) {
+            out_scales[joint] = skeleton.scales[joint];
+        } else if( scale.count == 1 ) {
+            out_scales[joint] = scales[ scale.first ];
+        } else {
+            out_scales[joint] = glm::mix( scales[ scale.first + key ], scales[ scale.first + next ], blend );
+        }
+    }
+}
+
+size_t AnimationClip::memory() const {
+    return translations.size() * sizeof(glm::vec3) + rotations.size() * sizeof(PackedQuat)
+        + scales.size() * sizeof(glm::vec3) + channels.size() * sizeof(Channel);
+}
+
+JointPalettes::JointPalettes() {
+    glGenBuffers( 1, &_buffer );
+    glGenTextures( 1, &_texture );
+    glBindBuffer( GL_TEXTURE_BUFFER, _buffer );
+    glBufferData( GL_TEXTURE_BUFFER, sizeof(Affine), nullptr, GL_STREAM_DRAW );
+    glBindTexture( GL_TEXTURE_BUFFER, _texture );
+    glTexBuffer( GL_TEXTURE_BUFFER, GL_RGBA32F, _buffer );
+    glBindTexture( GL_TEXTURE_BUFFER, 0 );
+    glBindBuffer( GL_TEXTURE_BUFFER, 0 );
+}
+
+JointPalettes::~JointPalettes() {
+    glDeleteTextures( 1, &_texture );
+    glDeleteBuffers( 1, &_buffer );
+}
+
+void JointPalettes::upload( const std::vector<Affine>& joints ) {
+    // new storage every frame, draws of the last frame may still read the old one
+    glBindBuffer( GL_TEXTURE_BUFFER, _buffer );
+    glBufferData( GL_TEXTURE_BUFFER, std::max<size_t>( joints.size(), 1 ) * sizeof(Affine), nullptr, GL_STREAM_DRAW );
+    glBufferSubData( GL_TEXTURE_BUFFER, 0, joints.size() * sizeof(Affine), joints.data() );
+    glBindBuffer( GL_TEXTURE_BUFFER, 0 );
+
+    glActiveTexture( GL_TEXTURE0 + UNIT );
+    glBindTexture( GL_TEXTURE_BUFFER, _texture );
+    glActiveTexture( GL_TEXTURE0 );
+}
+
+void JointPalettes::bind( ShaderProgram& program ) {
+    program.uniform_sampler( "joint_palettes", UNIT );
+}
+
+// local pose of every joint composed and multiplied down the hierarchy
+static void pose( Animator& animator, float delta ) {
+    const auto& skeleton = *animator.skeleton;
+    size_t count = skeleton.size();
+    // scratch per worker, no allocations once warm
+    thread_local std::vector<glm::vec3> translations;
+    thread_local std::vector<glm::quat> rotations;
+    thread_local std::vector<glm::vec3> scales;
+    translations.resize( count );
+    rotations.resize( count );
+    scales.resize( count );
+    if( animator.clip ) {
+        const auto& clip = *animator.clip;
+        animator.time += delta * animator.speed;
+        if( animator.loop && clip.duration > 0.0 ) {
+            animator.time = std::fmod( animator.time, clip.duration );
+            if( animator.time < 0.0 ) {
+                animator.time += clip.duration;
+            }
+        } else {
+            animator.time = std::clamp( animator.time, 0.0f, clip.duration );
+        }
+        clip.sample( skeleton, animator.time, translations.data(), rotations.data(), scales.data() );
+    } else {
+        translations = skeleton.translations;
+        rotations = skeleton.rotations;
+        scales = skeleton.scales;
+    }
+    animator.joints.resize( count );
+    affine_op::compose( translations.data(), rotations.data(), scales.data(), animator.joints.data(), count );
+    for( size_t joint=0; joint<count; joint++ ) {
+        auto parent = skeleton.parents[joint];
+        if( parent != Skeleton::NO_PARENT ) {
+            animator.joints[joint] = affine_op::multiply( animator.joints[parent], animator.joints[joint] );
+        }
+    }
+}
+
+void animation_system( entt::registry& registry ) {
+    auto palettes_ptr = registry.try_ctx<JointPalettes>();
+    if( palettes_ptr == nullptr ) {
+        spdlog::warn("No joint palettes set!");
+        return;
+    }
+    auto pool_ptr = registry.try_ctx<ThreadPool>();
+    auto delta_ptr = registry.try_ctx<DeltaTime>();
+    float delta = delta_ptr != nullptr ? delta_ptr->value : 0.0;
+    auto for_range = [pool_ptr]( size_t count, size_t grain, auto f ){
+        if( pool_ptr != nullptr ) {
+            pool_ptr->parallel_for( 0, count, f, grain );
+        } else {
+            f( 0, count );
+        }
+    };
+
+    // animators are independent, their joints are posed in parallel
+    std::vector<Animator*> animators;
+    registry.view<Animator>().each([&animators](auto, auto& animator){
+            if( animator.skeleton ) {
+                animators.push_back( &animator );
+            }
+    });
+    for_range( animators.size(), ANIMATORS_PER_TASK, [&animators, delta]( size_t begin, size_t end ){
+            for( size_t i=begin; i<end; i++ ) {
+                pose( *animators[i], delta );
+            }
+    });
+
+    // palette ranges of the skins, then world space palettes and bounds in parallel
+    struct SkinJob {
+        Skin* skin;
+        const Animator* animator;
+        Affine world;
+        Box mesh_bounds;
+    };
+    std::vector<SkinJob> jobs;
+    auto& palettes = palettes_ptr->palettes();
+    size_t joint_count = 0;
+    registry.view<Skin>().each([&registry, &jobs, &joint_count](auto entity, auto& skin){
+            auto animator_ptr = registry.valid( skin.animator ) ? registry.try_get<Animator>( skin.animator ) : nullptr;
+            auto transform_ptr = registry.valid( skin.animator ) ? registry.try_get<Transform>( skin.animator ) : nullptr;
+            // stale offsets would draw the joints of another skin
+            if( animator_ptr == nullptr || !skin.binding || animator_ptr->joints.empty() ) {
+                skin.palette = Skin::NO_PALETTE;
+                skin.bounds = Box{};
+                return;
+            }
+            skin.palette = joint_count;
+            joint_count += skin.binding->joints.size();
+            auto model_ptr = registry.try_get<Model>( entity );
+            jobs.push_back( SkinJob{ &skin, animator_ptr, transform_ptr != nullptr ? transform_ptr->global_affine() : Affine{},
+                    model_ptr != nullptr ? model_ptr->mesh.bounding_box() : Box{} } );
+    });
+    palettes.resize( joint_count );
+    for_range( jobs.size(), SKINS_PER_TASK, [&jobs, &palettes]( size_t begin, size_t end ){
+            for( size_t i=begin; i<end; i++ ) {
+                const auto& job = jobs[i];
+                const auto& binding = *job.skin->binding;
+                const auto& joints = job.animator->joints;
+                auto palette = palettes.begin() + job.skin->palette;
+                // skinned vertices blend their joints' transforms, so they stay
+                // inside the union of the joint bounds each palette moves
+                bool joint_bounds = binding.bounds.size() == binding.joints.size();
+                Box bounds;
+                for( size_t joint=0; joint<binding.joints.size(); joint++ ) {
+                    auto skeleton_joint = std::min<size_t>( binding.joints[joint], joints.size() - 1 );
+                    palette[joint] = job.world * ( joints[skeleton_joint] * binding.inverse_binds[joint] );
+                    const auto& local = joint_bounds ? binding.bounds[joint] : job.mesh_bounds;
+                    if( local.min().x <= local.max().x ) {
+                        bounds += palette[joint] * local;
+                    }
+                }
+                job.skin->bounds = bounds;
+            }
+    });
+}
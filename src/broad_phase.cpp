@@ -0,0 +1,129 @@
+#include "broad_phase.hpp"
+
+#include "models.hpp"
+#include "transform.hpp"
+#include "geometry/box_batch.hpp"
+
+#include "spdlog/spdlog.h"
+
+void BroadPhase::set( entt::entity entity, const Box& bounds ) {
+    auto it = _ids.find( entity );
+    if( it != _ids.end() ) {
+        _hash.set( it->second, bounds );
+        return;
+    }
+    auto id = _hash.insert( bounds );
+    _ids.emplace( entity, id );
+    if( id >= _entities.size() ) {
+        _entities.resize( id + 1, entt::null );
+    }
+    _entities[id] = entity;
+}
+
+void BroadPhase::remove( entt::entity entity ) {
+    auto it = _ids.find( entity );
+    if( it == _ids.end() ) {
+        return;
+    }
+    _hash.remove( it->second );
+    _entities[it->second] = entt::null;
+    _ids.erase( it );
+}
+
+void BroadPhase::update() {
+    _hash.rebuild( _pool );
+    _hash.pairs( _id_pairs, _pool );
+    _pairs.clear();
+    _pairs.reserve( _id_pairs.size() );
+    for( const auto& pair : _id_pairs ) {
+        _pairs.emplace_back( _entities[pair.first], _entities[pair.second] );
+    }
+}
+
+std::vector<entt::entity> BroadPhase::query( const Box& box ) const {
+    std::vector<uint32_t> ids;
+    _hash.query( box, ids );
+    std::vector<entt::entity> entities;
+    entities.reserve( ids.size() );
+    for( auto id : ids ) {
+        entities.push_back( _entities[id] );
+    }
+    return entities;
+}
+
+std::vector<std::pair<entt::entity, float>> BroadPhase::query( const Ray& ray, float max_distance ) const {
+    std::vector<std::pair<uint32_t, float>> hits;
+    _hash.query( ray, hits, max_distance );
+    std::vector<std::pair<entt::entity, float>> entities;
+    entities.reserve( hits.size() );
+    for( const auto& hit : hits ) {
+        entities.emplace_back( _entities[hit.first], hit.second );
+    }
+    return entities;
+}
+
+std::vector<entt::entity> BroadPhase::take_changed() {
+    // every transform changes on moving frames, duplicates are cheaper than sorting
+    std::vector<entt::entity> changed;
+    changed.swap( _changed );
+    return changed;
+}
+
+void BroadPhase::connect( entt::registry& registry ) {
+    // transform_system replaces every dirty transform after propagating it
+    registry.on_construct<Transform>().connect<&BroadPhase::on_change<Transform>>();
+    registry.on_replace<Transform>().connect<&BroadPhase::on_change<Transform>>();
+    registry.on_destroy<Transform>().connect<&BroadPhase::on_change<Transform>>();
+    registry.on_construct<Model>().connect<&BroadPhase::on_change<Model>>();
+    registry.on_replace<Model>().connect<&BroadPhase::on_change<Model>>();
+    registry.on_destroy<Model>().connect<&BroadPhase::on_change<Model>>();
+    registry.on_construct<Collider>().connect<&BroadPhase::on_change<Collider>>();
+    registry.on_replace<Collider>().connect<&BroadPhase::on_change<Collider>>();
+    registry.on_destroy<Collider>().connect<&BroadPhase::on_change<Collider>>();
+
+    // entities from before the connection
+    auto broad_phase_ptr = registry.try_ctx<BroadPhase>();
+    if( broad_phase_ptr != nullptr ) {
+        registry.view<Transform>().each([&registry, broad_phase_ptr](auto entity, const auto&){
+                if( registry.has<Collider>( entity ) || registry.has<Model>( entity ) ) {
+                    broad_phase_ptr->_changed.push_back( entity );
+                }
+        });
+    }
+}
+
+void broad_phase_system( entt::registry& registry ) {
+    auto broad_phase_ptr = registry.try_ctx<BroadPhase>();
+    if( broad_phase_ptr == nullptr ) {
+        spdlog::warn("No broad phase set!");
+        return;
+    }
+    auto& broad_phase = *broad_phase_ptr;
+
+    // world bounds of the changed entities in one batch, signals of destroyed
+    // components fire before removal so presence is checked now
+    std::vector<entt::entity> entities;
+    std::vector<Affine> transforms;
+    BoxBatch local_bounds, world_bounds;
+    for( auto entity : broad_phase.take_changed() ) {
+        if( !registry.valid( entity ) || !registry.has<Transform>( entity ) ) {
+            broad_phase.remove( entity );
+            continue;
+        }
+        if( auto collider_ptr = registry.try_get<Collider>( entity ) ) {
+            local_bounds.push_back( collider_ptr->bounds );
+        } else if( auto model_ptr = registry.try_get<Model>( entity ) ) {
+            local_bounds.push_back( model_ptr->mesh.bounding_box() );
+        } else {
+            broad_phase.remove( entity );
+            continue;
+        }
+        entities.push_back( entity );
+        transforms.push_back( registry.get<Transform>( entity ).global_affine() );
+    }
+    box_op::transform( transforms.data(), local_bounds, world_bounds );
+    for( size_t i=0; i<entities.size(); i++ ) {
+        broad_phase.set( entities[i], world_bounds.get( i ) );
+    }
+    broad_phase.update();
+}
@@ -29,7 +29,7 @@ void camera_system( entt::registry& registry ) {
             glm::mat4 view_matrix{1.0};
             auto camera_transform_ptr = registry.try_get<Transform>( current_camera_ptr->entity );
             if( camera_transform_ptr != nullptr ) {
-                view_matrix = glm::inverse( camera_transform_ptr->global_matrix() );
+                view_matrix = camera_transform_ptr->global_affine().inverse().to_mat4();
             }
             // TODO Optimization: update matrices only once for each shader program (from a model)
             auto& program_cache = registry.ctx<entt::resource_cache<ShaderProgram>>();
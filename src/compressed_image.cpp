@@ -0,0 +1,399 @@
+#include "compressed_image.hpp"
+
+#include "texture.hpp"
+#include "gl_extensions.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+
+namespace {
+
+    const unsigned char KTX1_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+    const unsigned char KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+    constexpr uint32_t fourcc( char a, char b, char c, char d ) {
+        return (uint32_t)a | ((uint32_t)b << 8) | ((uint32_t)c << 16) | ((uint32_t)d << 24);
+    }
+
+    template <class T>
+    T read( const std::vector<unsigned char>& data, size_t offset ) {
+        if( offset + sizeof(T) > data.size() ) {
+            throw TextureException{ "Unexpected end of compressed image" };
+        }
+        T value;
+        std::memcpy( &value, data.data() + offset, sizeof(T) );
+        return value;
+    }
+
+    template <class T>
+    void write( std::ofstream& file, T value ) {
+        file.write( reinterpret_cast<const char*>(&value), sizeof(T) );
+    }
+
+    std::string extension( const std::string& path ) {
+        auto dot = path.find_last_of( '.' );
+        if( dot == std::string::npos ) {
+            return "";
+        }
+        auto ext = path.substr( dot + 1 );
+        std::transform( ext.begin(), ext.end(), ext.begin(), [](unsigned char c){ return std::tolower(c); } );
+        return ext;
+    }
+
+    // largest width or height accepted from a file
+    constexpr uint32_t MAX_SIZE = 1 << 16;
+
+    // Set image size from header values, throws on sizes no texture can have
+    void set_size( CompressedImage& image, uint32_t width, uint32_t height ) {
+        if( width == 0 || height == 0 || width > MAX_SIZE || height > MAX_SIZE ) {
+            throw TextureException{ "Invalid compressed image size" };
+        }
+        image.width = width;
+        image.height = height;
+    }
+
+    // Throws if level_count exceeds the mip chain of the image
+    void check_level_count( const CompressedImage& image, uint32_t level_count ) {
+        uint32_t chain = 1;
+        for( int size = std::max( image.width, image.height ); size > 1; size /= 2 ) {
+            chain++;
+        }
+        if( level_count > chain ) {
+            throw TextureException{ "Invalid compressed image mip count" };
+        }
+    }
+
+    void read_levels( CompressedImage& image, const std::vector<unsigned char>& data, size_t offset, unsigned int level_count ) {
+        check_level_count( image, level_count );
+        int width = image.width, height = image.height;
+        for( unsigned int level=0; level<std::max( 1u, level_count ); level++ ) {
+            auto size = compressed_level_size( image.format, width, height );
+            if( offset + size > data.size() ) {
+                throw TextureException{ "Unexpected end of compressed image" };
+            }
+            image.levels.emplace_back( data.begin() + offset, data.begin() + offset + size );
+            offset += size;
+            width = std::max( 1, width / 2 );
+            height = std::max( 1, height / 2 );
+        }
+    }
+
+    GLenum dxgi_to_gl( uint32_t dxgi_format ) {
+        switch( dxgi_format ) {
+            case 71: return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+            case 72: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT;
+            case 74: return GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+            case 75: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT;
+            case 77: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            case 78: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+            case 80: return GL_COMPRESSED_RED_RGTC1;
+            case 81: return GL_COMPRESSED_SIGNED_RED_RGTC1;
+            case 83: return GL_COMPRESSED_RG_RGTC2;
+            case 84: return GL_COMPRESSED_SIGNED_RG_RGTC2;
+            case 95: return GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT;
+            case 96: return GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT;
+            case 98: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+            case 99: return GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM;
+            default: return 0;
+        }
+    }
+
+    GLenum vulkan_to_gl( uint32_t vk_format ) {
+        switch( vk_format ) {
+            case 131: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+            case 132: return GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+            case 133: return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+            case 134: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT;
+            case 135: return GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+            case 136: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT;
+            case 137: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            case 138: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+            case 139: return GL_COMPRESSED_RED_RGTC1;
+            case 140: return GL_COMPRESSED_SIGNED_RED_RGTC1;
+            case 141: return GL_COMPRESSED_RG_RGTC2;
+            case 142: return GL_COMPRESSED_SIGNED_RG_RGTC2;
+            case 143: return GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT;
+            case 144: return GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT;
+            case 145: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+            case 146: return GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM;
+            case 147: return GL_COMPRESSED_RGB8_ETC2;
+            case 148: return GL_COMPRESSED_SRGB8_ETC2;
+            case 149: return GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2;
+            case 150: return GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2;
+            case 151: return GL_COMPRESSED_RGBA8_ETC2_EAC;
+            case 152: return GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC;
+            case 153: return GL_COMPRESSED_R11_EAC;
+            case 154: return GL_COMPRESSED_SIGNED_R11_EAC;
+            case 155: return GL_COMPRESSED_RG11_EAC;
+            case 156: return GL_COMPRESSED_SIGNED_RG11_EAC;
+            default: return 0;
+        }
+    }
+
+    CompressedImage parse_dds( const std::vector<unsigned char>& data ) {
+        if( read<uint32_t>( data, 0 ) != fourcc( 'D', 'D', 'S', ' ' ) || read<uint32_t>( data, 4 ) != 124 ) {
+            throw TextureException{ "Invalid DDS header" };
+        }
+        CompressedImage image;
+        set_size( image, read<uint32_t>( data, 16 ), read<uint32_t>( data, 12 ) );
+        auto mip_count = read<uint32_t>( data, 28 );
+        auto pixel_format_flags = read<uint32_t>( data, 80 );
+        auto format_fourcc = read<uint32_t>( data, 84 );
+        size_t offset = 128;
+
+        // DDPF_FOURCC
+        if( (pixel_format_flags & 0x4) == 0 ) {
+            throw TextureException{ "Uncompressed DDS files are not supported" };
+        }
+        switch( format_fourcc ) {
+            case fourcc( 'D', 'X', 'T', '1' ): image.format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; break;
+            case fourcc( 'D', 'X', 'T', '3' ): image.format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT; break;
+            case fourcc( 'D', 'X', 'T', '5' ): image.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; break;
+            case fourcc( 'A', 'T', 'I', '1' ):
+            case fourcc( 'B', 'C', '4', 'U' ): image.format = GL_COMPRESSED_RED_RGTC1; break;
+            case fourcc( 'A', 'T', 'I', '2' ):
+            case fourcc( 'B', 'C', '5', 'U' ): image.format = GL_COMPRESSED_RG_RGTC2; break;
+            case fourcc( 'D', 'X', '1', '0' ):
+                image.format = dxgi_to_gl( read<uint32_t>( data, 128 ) );
+                offset += 20;
+                break;
+        }
+        if( image.format == 0 ) {
+            throw TextureException{ "Unsupported DDS pixel format" };
+        }
+
+        read_levels( image, data, offset, mip_count );
+        return image;
+    }
+
+    CompressedImage parse_ktx1( const std::vector<unsigned char>& data ) {
+        if( read<uint32_t>( data, 12 ) != 0x04030201 ) {
+            throw TextureException{ "Big endian KTX files are not supported" };
+        }
+        CompressedImage image;
+        image.format = read<uint32_t>( data, 28 );
+        // 1D textures have no height
+        set_size( image, read<uint32_t>( data, 36 ), std::max<uint32_t>( 1, read<uint32_t>( data, 40 ) ) );
+        auto faces = read<uint32_t>( data, 52 );
+        auto mip_count = read<uint32_t>( data, 56 );
+        auto key_value_bytes = read<uint32_t>( data, 60 );
+        if( read<uint32_t>( data, 16 ) != 0 || compressed_block_size( image.format ) == 0 ) {
+            throw TextureException{ "Uncompressed KTX files are not supported" };
+        }
+        if( faces > 1 ) {
+            throw TextureException{ "Cube map KTX files are not supported" };
+        }
+
+        check_level_count( image, mip_count );
+        size_t offset = 64 + (size_t)key_value_bytes;
+        int width = image.width, height = image.height;
+        for( unsigned int level=0; level<std::max( 1u, mip_count ); level++ ) {
+            auto size = read<uint32_t>( data, offset );
+            offset += 4;
+            if( offset > data.size() || size > data.size() - offset || size < compressed_level_size( image.format, width, height ) ) {
+                throw TextureException{ "Unexpected end of compressed image" };
+            }
+            image.levels.emplace_back( data.begin() + offset, data.begin() + offset + size );
+            // levels are padded to 4 bytes
+            offset += (size + 3) & ~3u;
+            width = std::max( 1, width / 2 );
+            height = std::max( 1, height / 2 );
+        }
+        return image;
+    }
+
+    CompressedImage parse_ktx2( const std::vector<unsigned char>& data ) {
+        CompressedImage image;
+        image.format = vulkan_to_gl( read<uint32_t>( data, 12 ) );
+        set_size( image, read<uint32_t>( data, 20 ), std::max<uint32_t>( 1, read<uint32_t>( data, 24 ) ) );
+        auto faces = read<uint32_t>( data, 36 );
+        auto level_count = std::max<uint32_t>( 1, read<uint32_t>( data, 40 ) );
+        if( read<uint32_t>( data, 44 ) != 0 ) {
+            throw TextureException{ "Supercompressed KTX2 files are not supported" };
+        }
+        if( image.format == 0 ) {
+            throw TextureException{ "Unsupported KTX2 format" };
+        }
+        if( faces > 1 ) {
+            throw TextureException{ "Cube map KTX2 files are not supported" };
+        }
+
+        check_level_count( image, level_count );
+
+        // level index follows the 80 bytes header
+        int width = image.width, height = image.height;
+        for( unsigned int level=0; level<level_count; level++ ) {
+            auto offset = read<uint64_t>( data, 80 + level*24 );
+            auto size = read<uint64_t>( data, 80 + level*24 + 8 );
+            // compared without a sum that could wrap around
+            if( offset > data.size() || size > data.size() - offset || size < compressed_level_size( image.format, width, height ) ) {
+                throw TextureException{ "Unexpected end of compressed image" };
+            }
+            image.levels.emplace_back( data.begin() + offset, data.begin() + offset + size );
+            width = std::max( 1, width / 2 );
+            height = std::max( 1, height / 2 );
+        }
+        return image;
+    }
+}
+
+size_t CompressedImage::size() const {
+    size_t total = 0;
+    for( const auto& level : levels ) {
+        total += level.size();
+    }
+    return total;
+}
+
+bool is_compressed_image( const std::string& path ) {
+    auto ext = extension( path );
+    return ext == "dds" || ext == "ktx" || ext == "ktx2";
+}
+
+CompressedImage load_compressed_image( const std::string& path ) {
+    std::ifstream file( path, std::ios::binary );
+    if( !file ) {
+        throw TextureException{ std::string{"Could not open '"} + path + std::string{"'"} };
+    }
+    std::vector<unsigned char> data{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+    file.close();
+
+    if( data.size() >= 12 && std::memcmp( data.data(), KTX2_IDENTIFIER, 12 ) == 0 ) {
+        return parse_ktx2( data );
+    }
+    if( data.size() >= 12 && std::memcmp( data.data(), KTX1_IDENTIFIER, 12 ) == 0 ) {
+        return parse_ktx1( data );
+    }
+    return parse_dds( data );
+}
+
+void save_dds( const CompressedImage& image, const std::string& path ) {
+    uint32_t format_fourcc;
+    switch( image.format ) {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT: format_fourcc = fourcc( 'D', 'X', 'T', '1' ); break;
+        case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT: format_fourcc = fourcc( 'D', 'X', 'T', '3' ); break;
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: format_fourcc = fourcc( 'D', 'X', 'T', '5' ); break;
+        case GL_COMPRESSED_RED_RGTC1: format_fourcc = fourcc( 'A', 'T', 'I', '1' ); break;
+        case GL_COMPRESSED_RG_RGTC2: format_fourcc = fourcc( 'A', 'T', 'I', '2' ); break;
+        default:
+            throw TextureException{ "Format can not be written to DDS" };
+    }
+
+    std::ofstream file( path, std::ios::binary );
+    if( !file ) {
+        throw TextureException{ std::string{"Could not write '"} + path + std::string{"'"} };
+    }
+
+    // DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE
+    uint32_t flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000;
+    // DDSCAPS_TEXTURE | DDSCAPS_COMPLEX | DDSCAPS_MIPMAP
+    uint32_t caps = 0x1000 | ( image.levels.size() > 1 ? 0x8 | 0x400000 : 0 );
+
+    write<uint32_t>( file, fourcc( 'D', 'D', 'S', ' ' ) );
+    write<uint32_t>( file, 124 );
+    write<uint32_t>( file, flags );
+    write<uint32_t>( file, image.height );
+    write<uint32_t>( file, image.width );
+    write<uint32_t>( file, image.levels.empty() ? 0 : image.levels[0].size() );
+    write<uint32_t>( file, 0 );
+    write<uint32_t>( file, image.levels.size() );
+    for( int i=0; i<11; i++ ) {
+        write<uint32_t>( file, 0 );
+    }
+    // pixel format
+    write<uint32_t>( file, 32 );
+    write<uint32_t>( file, 0x4 );
+    write<uint32_t>( file, format_fourcc );
+    for( int i=0; i<5; i++ ) {
+        write<uint32_t>( file, 0 );
+    }
+    write<uint32_t>( file, caps );
+    for( int i=0; i<4; i++ ) {
+        write<uint32_t>( file, 0 );
+    }
+
+    for( const auto& level : image.levels ) {
+        file.write( reinterpret_cast<const char*>( level.data() ), level.size() );
+    }
+}
+
+size_t compressed_block_size( GLenum format ) {
+    switch( format ) {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RED_RGTC1:
+        case GL_COMPRESSED_SIGNED_RED_RGTC1:
+        case GL_COMPRESSED_RGB8_ETC2:
+        case GL_COMPRESSED_SRGB8_ETC2:
+        case GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+        case GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+        case GL_COMPRESSED_R11_EAC:
+        case GL_COMPRESSED_SIGNED_R11_EAC:
+            return 8;
+        case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+        case GL_COMPRESSED_RG_RGTC2:
+        case GL_COMPRESSED_SIGNED_RG_RGTC2:
+        case GL_COMPRESSED_RGBA_BPTC_UNORM:
+        case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+        case GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT:
+        case GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT:
+        case GL_COMPRESSED_RGBA8_ETC2_EAC:
+        case GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC:
+        case GL_COMPRESSED_RG11_EAC:
+        case GL_COMPRESSED_SIGNED_RG11_EAC:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+size_t compressed_level_size( GLenum format, int width, int height ) {
+    return (size_t)std::max( 1, (width + 3) / 4 ) * std::max( 1, (height + 3) / 4 ) * compressed_block_size( format );
+}
+
+bool compressed_format_supported( GLenum format ) {
+    switch( format ) {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+            return gl_extension_supported( "GL_EXT_texture_compression_s3tc" );
+        case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+            return gl_extension_supported( "GL_EXT_texture_sRGB" ) || gl_extension_supported( "GL_EXT_texture_compression_s3tc_srgb" );
+        case GL_COMPRESSED_RED_RGTC1:
+        case GL_COMPRESSED_SIGNED_RED_RGTC1:
+        case GL_COMPRESSED_RG_RGTC2:
+        case GL_COMPRESSED_SIGNED_RG_RGTC2:
+            return true;
+        case GL_COMPRESSED_RGBA_BPTC_UNORM:
+        case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+        case GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT:
+        case GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT:
+            return gl_version_at_least( 4, 2 ) || gl_extension_supported( "GL_ARB_texture_compression_bptc" );
+        case GL_COMPRESSED_RGB8_ETC2:
+        case GL_COMPRESSED_SRGB8_ETC2:
+        case GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+        case GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+        case GL_COMPRESSED_RGBA8_ETC2_EAC:
+        case GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC:
+        case GL_COMPRESSED_R11_EAC:
+        case GL_COMPRESSED_SIGNED_R11_EAC:
+        case GL_COMPRESSED_RG11_EAC:
+        case GL_COMPRESSED_SIGNED_RG11_EAC:
+            return gl_version_at_least( 4, 3 ) || gl_extension_supported( "GL_ARB_ES3_compatibility" );
+        default:
+            return false;
+    }
+}
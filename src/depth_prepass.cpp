@@ -0,0 +1,38 @@
+#include "depth_prepass.hpp"
+
+DepthPrepass::DepthPrepass( entt::resource_handle<ShaderProgram> depth_program, bool enabled )
+    : _depth_program{depth_program}, _enabled{enabled} {
+    glGenQueries( 2, _queries );
+}
+
+DepthPrepass::~DepthPrepass() {
+    glDeleteQueries( 2, _queries );
+}
+
+void DepthPrepass::begin_count() {
+    glBeginQuery( GL_SAMPLES_PASSED, _queries[_current] );
+}
+
+void DepthPrepass::end_count( unsigned int width, unsigned int height ) {
+    glEndQuery( GL_SAMPLES_PASSED );
+    _pending[_current] = true;
+    _pixels[_current] = width * height;
+
+    // read the previous frame query if the GPU is done with it
+    unsigned int previous = 1 - _current;
+    if( _pending[previous] ) {
+        GLuint available = 0;
+        glGetQueryObjectuiv( _queries[previous], GL_QUERY_RESULT_AVAILABLE, &available );
+        if( available ) {
+            GLuint64 samples = 0;
+            glGetQueryObjectui64v( _queries[previous], GL_QUERY_RESULT, &samples );
+            _shaded_samples = samples;
+            _samples_per_pixel = _pixels[previous] > 0 ? (double)samples / _pixels[previous] : 0.0;
+            _pending[previous] = false;
+        }
+    }
+    // while the previous query is in flight the current one is reused next frame
+    if( !_pending[previous] ) {
+        _current = previous;
+    }
+}
@@ -0,0 +1,207 @@
+#include "dynamic_mesh.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <limits>
+
+// float components of each attribute by location
+static constexpr GLint COMPONENTS[4] = { 4, 4, 4, 2 };
+
+// nanoseconds waited per fence check
+static constexpr GLuint64 FENCE_TIMEOUT = 1000000;
+
+DynamicMesh::DynamicMesh(
+        const std::vector<GLuint>& indices,
+        size_t vertex_count,
+        bool colors,
+        bool normals,
+        bool texcoords
+) : _index_count{indices.size()}, _vertex_count{vertex_count} {
+    for( auto index : indices ) {
+        if( index >= vertex_count ) {
+            throw MeshCreationException{"Index out of the dynamic mesh's vertices!"};
+        }
+    }
+    // 16-bit indices when every vertex can be addressed, base vertices add the copy
+    _index_type = vertex_count <= std::numeric_limits<GLushort>::max() + 1u ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+    glGenVertexArrays( 1, &_vao );
+    glBindVertexArray( _vao );
+    bool present[4] = { true, colors, normals, texcoords };
+    for( GLuint location=0; location<4; location++ ) {
+        if( !present[location] ) {
+            continue;
+        }
+        glGenBuffers( 1, &_buffers[location] );
+        glBindBuffer( GL_ARRAY_BUFFER, _buffers[location] );
+        glBufferData( GL_ARRAY_BUFFER, sizeof(GLfloat)*COMPONENTS[location]*vertex_count*FRAMES, NULL, GL_STREAM_DRAW );
+        glVertexAttribPointer( location, COMPONENTS[location], GL_FLOAT, GL_FALSE, 0, 0 );
+        glEnableVertexAttribArray( location );
+    }
+
+    glGenBuffers( 1, &_index_buffer );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, _index_buffer );
+    if( _index_type == GL_UNSIGNED_SHORT ) {
+        std::vector<GLushort> short_indices( indices.begin(), indices.end() );
+        glBufferData( GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort)*_index_count, short_indices.data(), GL_STATIC_DRAW );
+    } else {
+        glBufferData( GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint)*_index_count, indices.data(), GL_STATIC_DRAW );
+    }
+    glBindVertexArray( 0 );
+
+    // position only vertex array for depth passes
+    glGenVertexArrays( 1, &_position_vao );
+    glBindVertexArray( _position_vao );
+    glBindBuffer( GL_ARRAY_BUFFER, _buffers[0] );
+    glVertexAttribPointer( 0, COMPONENTS[0], GL_FLOAT, GL_FALSE, 0, 0 );
+    glEnableVertexAttribArray( 0 );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, _index_buffer );
+    glBindVertexArray( 0 );
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+}
+
+DynamicMesh::~DynamicMesh() {
+    if( _mapped ) {
+        unmap();
+    }
+    for( auto& fence : _fences ) {
+        if( fence != nullptr ) {
+            glDeleteSync( fence );
+        }
+    }
+    for( auto buffer : _buffers ) {
+        if( buffer != 0 ) {
+            glDeleteBuffers( 1, &buffer );
+        }
+    }
+    glDeleteBuffers( 1, &_index_buffer );
+    glDeleteVertexArrays( 1, &_vao );
+    glDeleteVertexArrays( 1, &_position_vao );
+}
+
+DynamicMesh::Frame DynamicMesh::map() {
+    if( _mapped ) {
+        unmap();
+    }
+    // draws of the current copy so far are the last to read it before it's replaced
+    if( _fences[_drawn] != nullptr ) {
+        glDeleteSync( _fences[_drawn] );
+    }
+    _fences[_drawn] = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+
+    _writing = ( _drawn + 1 ) % FRAMES;
+    auto& fence = _fences[_writing];
+    if( fence != nullptr ) {
+        if( glClientWaitSync( fence, 0, 0 ) == GL_TIMEOUT_EXPIRED ) {
+            _stalls++;
+            GLenum result;
+            do {
+                result = glClientWaitSync( fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT );
+            } while( result == GL_TIMEOUT_EXPIRED );
+            if( result == GL_WAIT_FAILED ) {
+                spdlog::error("Waiting for a dynamic mesh fence failed");
+            }
+        }
+        glDeleteSync( fence );
+        fence = nullptr;
+    }
+
+    // nothing reads this copy anymore, no need for the driver to synchronize
+    Frame frame;
+    void** pointers[4] = { (void**)&frame.vertices, (void**)&frame.colors, (void**)&frame.normals, (void**)&frame.texcoords };
+    for( GLuint location=0; location<4; location++ ) {
+        if( _buffers[location] == 0 ) {
+            continue;
+        }
+        size_t size = sizeof(GLfloat)*COMPONENTS[location]*_vertex_count;
+        glBindBuffer( GL_ARRAY_BUFFER, _buffers[location] );
+        *pointers[location] = glMapBufferRange( GL_ARRAY_BUFFER, size*_writing, size,
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT );
+        if( *pointers[location] == nullptr ) {
+            // release the buffers mapped so far, the drawn copy stays as it was
+            for( GLuint mapped=0; mapped<location; mapped++ ) {
+                if( _buffers[mapped] != 0 ) {
+                    glBindBuffer( GL_ARRAY_BUFFER, _buffers[mapped] );
+                    glUnmapBuffer( GL_ARRAY_BUFFER );
+                }
+            }
+            glBindBuffer( GL_ARRAY_BUFFER, 0 );
+            throw MeshCreationException{"Mapping a dynamic mesh buffer failed!"};
+        }
+    }
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+    _mapped = true;
+    return frame;
+}
+
+void DynamicMesh::unmap() {
+    if( !_mapped ) {
+        return;
+    }
+    for( GLuint location=0; location<4; location++ ) {
+        if( _buffers[location] == 0 ) {
+            continue;
+        }
+        glBindBuffer( GL_ARRAY_BUFFER, _buffers[location] );
+        if( glUnmapBuffer( GL_ARRAY_BUFFER ) == GL_FALSE ) {
+            spdlog::warn("Dynamic mesh buffer was corrupted while mapped");
+        }
+    }
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+    _mapped = false;
+    _written = true;
+    _drawn = _writing;
+}
+
+void DynamicMesh::update(
+        const std::vector<glm::vec4>& vertices,
+        const std::vector<glm::vec4>& colors,
+        const std::vector<glm::vec4>& normals,
+        const std::vector<glm::vec2>& texcoords
+) {
+    if( vertices.size() != _vertex_count
+            || ( _buffers[1] != 0 && colors.size() != _vertex_count )
+            || ( _buffers[2] != 0 && normals.size() != _vertex_count )
+            || ( _buffers[3] != 0 && texcoords.size() != _vertex_count ) ) {
+        throw MeshCreationException{"Number of attributes must be equal to the dynamic mesh's vertices!"};
+    }
+    auto frame = map();
+    std::copy( vertices.begin(), vertices.end(), frame.vertices );
+    if( frame.colors != nullptr ) {
+        std::copy( colors.begin(), colors.end(), frame.colors );
+    }
+    if( frame.normals != nullptr ) {
+        std::copy( normals.begin(), normals.end(), frame.normals );
+    }
+    if( frame.texcoords != nullptr ) {
+        std::copy( texcoords.begin(), texcoords.end(), frame.texcoords );
+    }
+    unmap();
+
+    _bounding_box = Box{};
+    for( const auto& vertex : vertices ) {
+        _bounding_box += Box{ glm::vec3{vertex}, glm::vec3{vertex} };
+    }
+}
+
+void DynamicMesh::draw( const ShaderProgram& program ) const {
+    // no copy holds vertices before the first unmap
+    if( !_written ) {
+        return;
+    }
+    program.use();
+    glBindVertexArray( _vao );
+    glDrawElementsBaseVertex( GL_TRIANGLES, _index_count, _index_type, (GLvoid*)0, _drawn*_vertex_count );
+    glBindVertexArray( 0 );
+}
+
+void DynamicMesh::draw_positions( const ShaderProgram& program ) const {
+    if( !_written ) {
+        return;
+    }
+    program.use();
+    glBindVertexArray( _position_vao );
+    glDrawElementsBaseVertex( GL_TRIANGLES, _index_count, _index_type, (GLvoid*)0, _drawn*_vertex_count );
+    glBindVertexArray( 0 );
+}
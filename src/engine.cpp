@@ -5,6 +5,13 @@
 #include "matrix_op.hpp"
 #include "hierarchy.hpp"
 #include "time.hpp"
+#include "thread_pool.hpp"
+#include "texture_streamer.hpp"
+#include "material_buffer.hpp"
+#include "light_buffer.hpp"
+#include "light_clusters.hpp"
+#include "shadows.hpp"
+#include "animation.hpp"
 
 #include "entt/entt.hpp"
 
@@ -26,9 +33,34 @@ void Engine::run(State* state_ptr) {
     registry.on_replace<Transform>().connect<&Transform::on_change>();
 
     // create default caches
-    registry.set<entt::resource_cache<ShaderProgram>>();
+    auto& program_cache = registry.set<entt::resource_cache<ShaderProgram>>();
+    auto& binary_cache = registry.set<ProgramBinaryCache>( _shader_cache_directory );
+    registry.set<ShaderVariants>( program_cache, &binary_cache );
     registry.set<entt::resource_cache<Texture>>();
 
+    // background work and texture streaming
+    auto& thread_pool = registry.set<ThreadPool>();
+    auto& texture_streamer = registry.set<TextureStreamer>( thread_pool, _texture_upload_budget );
+    auto& texture_residency = registry.set<TextureResidency>( &texture_streamer, _texture_memory_budget );
+    // meshes baked on any thread are uploaded here
+    registry.set<MeshUploader>( _mesh_upload_budget );
+
+    // materials and their textures shared by all model programs
+    auto& material_buffer = registry.set<MaterialBuffer>();
+    // texture pools count against the texture memory budget
+    texture_residency.set_pools( &material_buffer.pools() );
+    // packed lights updated from component changes
+    registry.set<LightBuffer>();
+    LightBuffer::connect( registry );
+    // shadow maps are set by the state with its depth program, track casters anyway
+    ShadowMaps::connect( registry );
+    // ranged point and spotlights binned per view cluster, per model bounds otherwise
+    if( _clustered_lighting ) {
+        registry.set<LightClusters>( thread_pool );
+    }
+    // skinning matrices written by animation_system, drawn by model_system
+    registry.set<JointPalettes>();
+
     spdlog::info("Running!");
     
     window->poll_events();
@@ -49,6 +81,11 @@ void Engine::run(State* state_ptr) {
         state_ptr->update( registry );
         before = now;
 
+        registry.ctx<TextureStreamer>().update();
+        registry.ctx<TextureResidency>().update();
+        registry.ctx<MeshUploader>().update();
+        registry.ctx<MaterialBuffer>().update();
+
         window->refresh();
         window->reset();
     }
@@ -18,9 +18,9 @@ void Box::operator+=( const Box& other ) {
 }
 
 bool Box::intersects( const Box& other ) const {
-    if( _p2.x < other._p2.x || _p1.x > other._p2.x ) return false;
-    if( _p2.z < other._p2.z || _p1.z > other._p2.z ) return false;
-    if( _p2.y < other._p2.y || _p1.y > other._p2.y ) return false;
+    if( _p2.x < other._p1.x || _p1.x > other._p2.x ) return false;
+    if( _p2.z < other._p1.z || _p1.z > other._p2.z ) return false;
+    if( _p2.y < other._p1.y || _p1.y > other._p2.y ) return false;
     return true;
 }
 
@@ -33,6 +33,10 @@ std::string Box::to_string() {
 }
 
 Box operator*( const glm::mat4& transform, const Box& box ) {
+    // affine matrices don't need the eight corners
+    if( transform[0][3] == 0.0 && transform[1][3] == 0.0 && transform[2][3] == 0.0 && transform[3][3] == 1.0 ) {
+        return Affine::from_mat4( transform ) * box;
+    }
     auto c0 = transform * glm::vec4{ box.min().x, box.min().y, box.min().z, 1.0 };
     auto c1 = transform * glm::vec4{ box.min().x, box.min().y, box.max().z, 1.0 };
     auto c2 = transform * glm::vec4{ box.min().x, box.max().y, box.min().z, 1.0 };
@@ -52,3 +56,21 @@ Box operator*( const glm::mat4& transform, const Box& box ) {
 
     return Box{ {min_x, min_y, min_z}, {max_x, max_y, max_z} };
 }
+
+Box operator*( const Affine& transform, const Box& box ) {
+    // empty boxes stay empty
+    if( box.min().x > box.max().x ) {
+        return box;
+    }
+    glm::vec3 p1 = transform.translation();
+    glm::vec3 p2 = p1;
+    for( int row=0; row<3; row++ ) {
+        for( int col=0; col<3; col++ ) {
+            float a = transform.rows[row][col] * box.min()[col];
+            float b = transform.rows[row][col] * box.max()[col];
+            p1[row] += std::min( a, b );
+            p2[row] += std::max( a, b );
+        }
+    }
+    return Box{ p1, p2 };
+}
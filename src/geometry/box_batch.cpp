@@ -0,0 +1,266 @@
+#include "geometry/box_batch.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define REPLICATOR_BOX_X86
+#include <immintrin.h>
+#endif
+
+void BoxBatch::clear() {
+    for( auto array : { &min_x, &min_y, &min_z, &max_x, &max_y, &max_z } ) {
+        array->clear();
+    }
+}
+
+void BoxBatch::reserve( size_t count ) {
+    for( auto array : { &min_x, &min_y, &min_z, &max_x, &max_y, &max_z } ) {
+        array->reserve( count );
+    }
+}
+
+void BoxBatch::resize( size_t count ) {
+    for( auto array : { &min_x, &min_y, &min_z, &max_x, &max_y, &max_z } ) {
+        array->resize( count );
+    }
+}
+
+void BoxBatch::push_back( const Box& box ) {
+    min_x.push_back( box.min().x );
+    min_y.push_back( box.min().y );
+    min_z.push_back( box.min().z );
+    max_x.push_back( box.max().x );
+    max_y.push_back( box.max().y );
+    max_z.push_back( box.max().z );
+}
+
+Box BoxBatch::get( size_t index ) const {
+    return Box{
+        glm::vec3{ min_x[index], min_y[index], min_z[index] },
+        glm::vec3{ max_x[index], max_y[index], max_z[index] }
+    };
+}
+
+// affine element of row and column, 12 floats per transform
+static inline float element( const Affine* transforms, size_t index, int row, int col ) {
+    return ( &transforms[index].rows[0].x )[4*row + col];
+}
+
+// scalar kernels
+
+static void transform_scalar( const Affine* transforms, const BoxBatch& boxes, BoxBatch& out, size_t begin ) {
+    for( size_t i=begin; i<boxes.size(); i++ ) {
+        // empty boxes stay empty
+        if( boxes.min_x[i] > boxes.max_x[i] ) {
+            out.min_x[i] = boxes.min_x[i]; out.min_y[i] = boxes.min_y[i]; out.min_z[i] = boxes.min_z[i];
+            out.max_x[i] = boxes.max_x[i]; out.max_y[i] = boxes.max_y[i]; out.max_z[i] = boxes.max_z[i];
+            continue;
+        }
+        float center[3] = { ( boxes.min_x[i] + boxes.max_x[i] ) * 0.5f, ( boxes.min_y[i] + boxes.max_y[i] ) * 0.5f, ( boxes.min_z[i] + boxes.max_z[i] ) * 0.5f };
+        float extent[3] = { ( boxes.max_x[i] - boxes.min_x[i] ) * 0.5f, ( boxes.max_y[i] - boxes.min_y[i] ) * 0.5f, ( boxes.max_z[i] - boxes.min_z[i] ) * 0.5f };
+        float world_center[3], world_extent[3];
+        for( int row=0; row<3; row++ ) {
+            world_center[row] = element( transforms, i, row, 3 );
+            world_extent[row] = 0.0;
+            for( int col=0; col<3; col++ ) {
+                float a = element( transforms, i, row, col );
+                world_center[row] += a * center[col];
+                world_extent[row] += std::fabs( a ) * extent[col];
+            }
+        }
+        out.min_x[i] = world_center[0] - world_extent[0];
+        out.min_y[i] = world_center[1] - world_extent[1];
+        out.min_z[i] = world_center[2] - world_extent[2];
+        out.max_x[i] = world_center[0] + world_extent[0];
+        out.max_y[i] = world_center[1] + world_extent[1];
+        out.max_z[i] = world_center[2] + world_extent[2];
+    }
+}
+
+static Box merge_scalar( const BoxBatch& boxes, size_t begin, Box box ) {
+    glm::vec3 p1 = box.min(), p2 = box.max();
+    for( size_t i=begin; i<boxes.size(); i++ ) {
+        p1.x = std::min( p1.x, boxes.min_x[i] );
+        p1.y = std::min( p1.y, boxes.min_y[i] );
+        p1.z = std::min( p1.z, boxes.min_z[i] );
+        p2.x = std::max( p2.x, boxes.max_x[i] );
+        p2.y = std::max( p2.y, boxes.max_y[i] );
+        p2.z = std::max( p2.z, boxes.max_z[i] );
+    }
+    return Box{ p1, p2 };
+}
+
+#ifdef REPLICATOR_BOX_X86
+
+// SSE kernels, four boxes at a time
+
+static void transform_sse( const Affine* transforms, const BoxBatch& boxes, BoxBatch& out ) {
+    const __m128 half = _mm_set1_ps( 0.5f );
+    const __m128 abs_mask = _mm_castsi128_ps( _mm_set1_epi32( 0x7fffffff ) );
+    size_t i = 0;
+    for( ; i + 4 <= boxes.size(); i += 4 ) {
+        __m128 min[3] = { _mm_loadu_ps( &boxes.min_x[i] ), _mm_loadu_ps( &boxes.min_y[i] ), _mm_loadu_ps( &boxes.min_z[i] ) };
+        __m128 max[3] = { _mm_loadu_ps( &boxes.max_x[i] ), _mm_loadu_ps( &boxes.max_y[i] ), _mm_loadu_ps( &boxes.max_z[i] ) };
+        // empty boxes stay empty
+        __m128 empty = _mm_cmpgt_ps( min[0], max[0] );
+        __m128 center[3], extent[3];
+        for( int axis=0; axis<3; axis++ ) {
+            center[axis] = _mm_mul_ps( _mm_add_ps( min[axis], max[axis] ), half );
+            extent[axis] = _mm_mul_ps( _mm_sub_ps( max[axis], min[axis] ), half );
+        }
+        float* out_min[3] = { &out.min_x[i], &out.min_y[i], &out.min_z[i] };
+        float* out_max[3] = { &out.max_x[i], &out.max_y[i], &out.max_z[i] };
+        for( int row=0; row<3; row++ ) {
+            __m128 world_center = _mm_setr_ps( element( transforms, i, row, 3 ), element( transforms, i + 1, row, 3 ),
+                    element( transforms, i + 2, row, 3 ), element( transforms, i + 3, row, 3 ) );
+            __m128 world_extent = _mm_setzero_ps();
+            for( int col=0; col<3; col++ ) {
+                __m128 a = _mm_setr_ps( element( transforms, i, row, col ), element( transforms, i + 1, row, col ),
+                        element( transforms, i + 2, row, col ), element( transforms, i + 3, row, col ) );
+                world_center = _mm_add_ps( world_center, _mm_mul_ps( a, center[col] ) );
+                world_extent = _mm_add_ps( world_extent, _mm_mul_ps( _mm_and_ps( a, abs_mask ), extent[col] ) );
+            }
+            __m128 world_min = _mm_sub_ps( world_center, world_extent );
+            __m128 world_max = _mm_add_ps( world_center, world_extent );
+            _mm_storeu_ps( out_min[row], _mm_or_ps( _mm_and_ps( empty, min[row] ), _mm_andnot_ps( empty, world_min ) ) );
+            _mm_storeu_ps( out_max[row], _mm_or_ps( _mm_and_ps( empty, max[row] ), _mm_andnot_ps( empty, world_max ) ) );
+        }
+    }
+    transform_scalar( transforms, boxes, out, i );
+}
+
+static Box merge_sse( const BoxBatch& boxes ) {
+    const float infinity = std::numeric_limits<float>::infinity();
+    __m128 min[3] = { _mm_set1_ps( infinity ), _mm_set1_ps( infinity ), _mm_set1_ps( infinity ) };
+    __m128 max[3] = { _mm_set1_ps( -infinity ), _mm_set1_ps( -infinity ), _mm_set1_ps( -infinity ) };
+    size_t i = 0;
+    for( ; i + 4 <= boxes.size(); i += 4 ) {
+        min[0] = _mm_min_ps( min[0], _mm_loadu_ps( &boxes.min_x[i] ) );
+        min[1] = _mm_min_ps( min[1], _mm_loadu_ps( &boxes.min_y[i] ) );
+        min[2] = _mm_min_ps( min[2], _mm_loadu_ps( &boxes.min_z[i] ) );
+        max[0] = _mm_max_ps( max[0], _mm_loadu_ps( &boxes.max_x[i] ) );
+        max[1] = _mm_max_ps( max[1], _mm_loadu_ps( &boxes.max_y[i] ) );
+        max[2] = _mm_max_ps( max[2], _mm_loadu_ps( &boxes.max_z[i] ) );
+    }
+    float lanes[4];
+    glm::vec3 p1{ infinity }, p2{ -infinity };
+    for( int axis=0; axis<3; axis++ ) {
+        _mm_storeu_ps( lanes, min[axis] );
+        p1[axis] = std::min( { lanes[0], lanes[1], lanes[2], lanes[3] } );
+        _mm_storeu_ps( lanes, max[axis] );
+        p2[axis] = std::max( { lanes[0], lanes[1], lanes[2], lanes[3] } );
+    }
+    return merge_scalar( boxes, i, Box{ p1, p2 } );
+}
+
+// AVX2 kernels, eight boxes at a time, transform elements gathered with a stride
+
+__attribute__((target("avx2,fma")))
+static void transform_avx2( const Affine* transforms, const BoxBatch& boxes, BoxBatch& out ) {
+    const __m256 half = _mm256_set1_ps( 0.5f );
+    const __m256 abs_mask = _mm256_castsi256_ps( _mm256_set1_epi32( 0x7fffffff ) );
+    // float offsets of consecutive transforms
+    const __m256i stride = _mm256_setr_epi32( 0, 12, 24, 36, 48, 60, 72, 84 );
+    size_t i = 0;
+    for( ; i + 8 <= boxes.size(); i += 8 ) {
+        __m256 min[3] = { _mm256_loadu_ps( &boxes.min_x[i] ), _mm256_loadu_ps( &boxes.min_y[i] ), _mm256_loadu_ps( &boxes.min_z[i] ) };
+        __m256 max[3] = { _mm256_loadu_ps( &boxes.max_x[i] ), _mm256_loadu_ps( &boxes.max_y[i] ), _mm256_loadu_ps( &boxes.max_z[i] ) };
+        __m256 empty = _mm256_cmp_ps( min[0], max[0], _CMP_GT_OQ );
+        __m256 center[3], extent[3];
+        for( int axis=0; axis<3; axis++ ) {
+            center[axis] = _mm256_mul_ps( _mm256_add_ps( min[axis], max[axis] ), half );
+            extent[axis] = _mm256_mul_ps( _mm256_sub_ps( max[axis], min[axis] ), half );
+        }
+        const float* base = &transforms[i].rows[0].x;
+        float* out_min[3] = { &out.min_x[i], &out.min_y[i], &out.min_z[i] };
+        float* out_max[3] = { &out.max_x[i], &out.max_y[i], &out.max_z[i] };
+        for( int row=0; row<3; row++ ) {
+            __m256 world_center = _mm256_i32gather_ps( base + 4*row + 3, stride, 4 );
+            __m256 world_extent = _mm256_setzero_ps();
+            for( int col=0; col<3; col++ ) {
+                __m256 a = _mm256_i32gather_ps( base + 4*row + col, stride, 4 );
+                world_center = _mm256_fmadd_ps( a, center[col], world_center );
+                world_extent = _mm256_fmadd_ps( _mm256_and_ps( a, abs_mask ), extent[col], world_extent );
+            }
+            __m256 world_min = _mm256_sub_ps( world_center, world_extent );
+            __m256 world_max = _mm256_add_ps( world_center, world_extent );
+            _mm256_storeu_ps( out_min[row], _mm256_blendv_ps( world_min, min[row], empty ) );
+            _mm256_storeu_ps( out_max[row], _mm256_blendv_ps( world_max, max[row], empty ) );
+        }
+    }
+    transform_scalar( transforms, boxes, out, i );
+}
+
+__attribute__((target("avx2,fma")))
+static Box merge_avx2( const BoxBatch& boxes ) {
+    const float infinity = std::numeric_limits<float>::infinity();
+    __m256 min[3] = { _mm256_set1_ps( infinity ), _mm256_set1_ps( infinity ), _mm256_set1_ps( infinity ) };
+    __m256 max[3] = { _mm256_set1_ps( -infinity ), _mm256_set1_ps( -infinity ), _mm256_set1_ps( -infinity ) };
+    size_t i = 0;
+    for( ; i + 8 <= boxes.size(); i += 8 ) {
+        min[0] = _mm256_min_ps( min[0], _mm256_loadu_ps( &boxes.min_x[i] ) );
+        min[1] = _mm256_min_ps( min[1], _mm256_loadu_ps( &boxes.min_y[i] ) );
+        min[2] = _mm256_min_ps( min[2], _mm256_loadu_ps( &boxes.min_z[i] ) );
+        max[0] = _mm256_max_ps( max[0], _mm256_loadu_ps( &boxes.max_x[i] ) );
+        max[1] = _mm256_max_ps( max[1], _mm256_loadu_ps( &boxes.max_y[i] ) );
+        max[2] = _mm256_max_ps( max[2], _mm256_loadu_ps( &boxes.max_z[i] ) );
+    }
+    float lanes[8];
+    glm::vec3 p1{ infinity }, p2{ -infinity };
+    for( int axis=0; axis<3; axis++ ) {
+        _mm256_storeu_ps( lanes, min[axis] );
+        p1[axis] = *std::min_element( lanes, lanes + 8 );
+        _mm256_storeu_ps( lanes, max[axis] );
+        p2[axis] = *std::max_element( lanes, lanes + 8 );
+    }
+    return merge_scalar( boxes, i, Box{ p1, p2 } );
+}
+
+#endif // REPLICATOR_BOX_X86
+
+// kernels chosen once for the running CPU
+struct BoxKernels {
+    void (*transform)( const Affine*, const BoxBatch&, BoxBatch& );
+    Box (*merge)( const BoxBatch& );
+};
+
+static void transform_fallback( const Affine* transforms, const BoxBatch& boxes, BoxBatch& out ) {
+    transform_scalar( transforms, boxes, out, 0 );
+}
+
+static Box merge_fallback( const BoxBatch& boxes ) {
+    return merge_scalar( boxes, 0, Box{} );
+}
+
+static BoxKernels select_kernels() {
+#ifdef REPLICATOR_BOX_X86
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" ) ) {
+        return BoxKernels{ transform_avx2, merge_avx2 };
+    }
+    if( __builtin_cpu_supports( "sse2" ) ) {
+        return BoxKernels{ transform_sse, merge_sse };
+    }
+#endif
+    return BoxKernels{ transform_fallback, merge_fallback };
+}
+
+static const BoxKernels& kernels() {
+    static const BoxKernels selected = select_kernels();
+    return selected;
+}
+
+namespace box_op {
+
+    void transform( const Affine* transforms, const BoxBatch& boxes, BoxBatch& out ) {
+        out.resize( boxes.size() );
+        kernels().transform( transforms, boxes, out );
+    }
+
+    Box merge( const BoxBatch& boxes ) {
+        return kernels().merge( boxes );
+    }
+
+}
@@ -0,0 +1,156 @@
+#include "geometry/bvh.hpp"
+
+#include <algorithm>
+
+// centroid bins per axis of the surface area heuristic
+static constexpr int BINS = 16;
+// largest leaf made when splitting costs more than testing all primitives
+static constexpr size_t MAX_SAH_LEAF_SIZE = 16;
+// below this depth nodes are halved by count, keeping traversal stacks small
+static constexpr unsigned int MAX_SAH_DEPTH = 40;
+
+static float surface_area( const Box& box ) {
+    if( box.min().x > box.max().x ) {
+        return 0.0;
+    }
+    return 2.0f * ( box.width() * box.height() + box.height() * box.length() + box.length() * box.width() );
+}
+
+struct BVHBuilder {
+    const std::vector<Box>& boxes;
+    std::vector<glm::vec3> centroids;
+    std::vector<BVH::Node>& nodes;
+    std::vector<uint32_t>& primitives;
+    unsigned int max_leaf_size;
+
+    void make_leaf( size_t node_index, size_t begin, size_t end ) {
+        nodes[node_index].first = begin;
+        nodes[node_index].count = end - begin;
+        nodes[node_index].axis = 0;
+    }
+
+    void build( size_t node_index, size_t begin, size_t end, unsigned int depth ) {
+        Box bounds, centroid_bounds;
+        for( size_t i=begin; i<end; i++ ) {
+            bounds += boxes[ primitives[i] ];
+            centroid_bounds += Box{ centroids[ primitives[i] ], centroids[ primitives[i] ] };
+        }
+        nodes[node_index].min = bounds.min();
+        nodes[node_index].max = bounds.max();
+        size_t count = end - begin;
+        // traversal stacks hold MAX_DEPTH levels, counts are halved from
+        // MAX_SAH_DEPTH on so forced leaves stay small for 32 bit indices
+        if( count <= max_leaf_size || depth >= BVH::MAX_DEPTH ) {
+            make_leaf( node_index, begin, end );
+            return;
+        }
+
+        // cheapest split between centroid bins, cost relative to the node's area
+        int best_axis = -1, best_split = 0;
+        float best_cost = std::numeric_limits<float>::infinity();
+        float parent_area = std::max( surface_area( bounds ), std::numeric_limits<float>::min() );
+        auto bin_of = [&centroid_bounds]( const glm::vec3& centroid, int axis ){
+            float extent = centroid_bounds.max()[axis] - centroid_bounds.min()[axis];
+            int bin = ( centroid[axis] - centroid_bounds.min()[axis] ) * BINS / extent;
+            return std::min( bin, BINS - 1 );
+        };
+        for( int axis=0; depth < MAX_SAH_DEPTH && axis<3; axis++ ) {
+            if( centroid_bounds.max()[axis] <= centroid_bounds.min()[axis] ) {
+                continue;
+            }
+            Box bin_bounds[BINS];
+            size_t bin_counts[BINS] = {0};
+            for( size_t i=begin; i<end; i++ ) {
+                int bin = bin_of( centroids[ primitives[i] ], axis );
+                bin_bounds[bin] += boxes[ primitives[i] ];
+                bin_counts[bin]++;
+            }
+            // areas and counts left of each split, then swept from the right
+            float left_costs[BINS - 1];
+            Box left;
+            size_t left_count = 0;
+            for( int split=0; split<BINS - 1; split++ ) {
+                left += bin_bounds[split];
+                left_count += bin_counts[split];
+                left_costs[split] = surface_area( left ) * left_count;
+            }
+            Box right;
+            size_t right_count = 0;
+            for( int split=BINS - 2; split>=0; split-- ) {
+                right += bin_bounds[split + 1];
+                right_count += bin_counts[split + 1];
+                float cost = 1.0f + ( left_costs[split] + surface_area( right ) * right_count ) / parent_area;
+                if( cost < best_cost ) {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_split = split;
+                }
+            }
+        }
+        if( best_axis >= 0 && best_cost >= count && count <= MAX_SAH_LEAF_SIZE ) {
+            make_leaf( node_index, begin, end );
+            return;
+        }
+
+        size_t middle = begin;
+        if( best_axis >= 0 ) {
+            auto middle_it = std::partition( primitives.begin() + begin, primitives.begin() + end,
+                    [this, &bin_of, best_axis, best_split]( uint32_t primitive ){
+                        return bin_of( centroids[primitive], best_axis ) <= best_split;
+                    });
+            middle = middle_it - primitives.begin();
+        }
+        if( middle == begin || middle == end ) {
+            // identical centroids or too deep, halve by count along the widest axis
+            best_axis = 0;
+            auto extent = centroid_bounds.max() - centroid_bounds.min();
+            if( extent.y > extent[best_axis] ) best_axis = 1;
+            if( extent.z > extent[best_axis] ) best_axis = 2;
+            middle = begin + count / 2;
+            std::nth_element( primitives.begin() + begin, primitives.begin() + middle, primitives.begin() + end,
+                    [this, best_axis]( uint32_t a, uint32_t b ){
+                        return centroids[a][best_axis] < centroids[b][best_axis];
+                    });
+        }
+
+        size_t children = nodes.size();
+        nodes.resize( children + 2 );
+        nodes[node_index].first = children;
+        nodes[node_index].count = 0;
+        nodes[node_index].axis = best_axis;
+        build( children, begin, middle, depth + 1 );
+        build( children + 1, middle, end, depth + 1 );
+    }
+};
+
+BVH::BVH( const std::vector<Box>& boxes, unsigned int max_leaf_size ) {
+    if( boxes.empty() ) {
+        return;
+    }
+    // leaves keep their count in 16 bits
+    max_leaf_size = std::clamp( max_leaf_size, 1u, 0xffffu );
+    _primitives.resize( boxes.size() );
+    for( size_t i=0; i<boxes.size(); i++ ) {
+        _primitives[i] = i;
+    }
+    BVHBuilder builder{ boxes, {}, _nodes, _primitives, max_leaf_size };
+    builder.centroids.reserve( boxes.size() );
+    for( const auto& box : boxes ) {
+        // empty boxes are never hit, any centroid does
+        if( box.min().x > box.max().x ) {
+            builder.centroids.push_back( glm::vec3{0.0} );
+        } else {
+            builder.centroids.push_back( ( box.min() + box.max() ) * 0.5f );
+        }
+    }
+    _nodes.reserve( 2 * boxes.size() / std::max( 1u, max_leaf_size / 2 ) + 1 );
+    _nodes.resize( 1 );
+    builder.build( 0, 0, boxes.size(), 0 );
+}
+
+Box BVH::bounds() const {
+    if( _nodes.empty() ) {
+        return Box{};
+    }
+    return Box{ _nodes[0].min, _nodes[0].max };
+}
@@ -0,0 +1,51 @@
+#include "geometry/frustum.hpp"
+
+#include "glm/glm.hpp"
+
+// plane a*x + b*y + c*z + d = 0 as position and normal
+static Plane make_plane( const glm::vec4& coefficients ) {
+    glm::vec3 normal{ coefficients.x, coefficients.y, coefficients.z };
+    float length = glm::length( normal );
+    normal = normal / length;
+    return Plane{ normal * ( -coefficients.w / length ), normal };
+}
+
+Frustum::Frustum( const glm::mat4& view_projection ) : _planes{
+    // clip space -w <= x, y, z <= w
+    make_plane( glm::vec4{ view_projection[0][3], view_projection[1][3], view_projection[2][3], view_projection[3][3] }
+              + glm::vec4{ view_projection[0][0], view_projection[1][0], view_projection[2][0], view_projection[3][0] } ),
+    make_plane( glm::vec4{ view_projection[0][3], view_projection[1][3], view_projection[2][3], view_projection[3][3] }
+              - glm::vec4{ view_projection[0][0], view_projection[1][0], view_projection[2][0], view_projection[3][0] } ),
+    make_plane( glm::vec4{ view_projection[0][3], view_projection[1][3], view_projection[2][3], view_projection[3][3] }
+              + glm::vec4{ view_projection[0][1], view_projection[1][1], view_projection[2][1], view_projection[3][1] } ),
+    make_plane( glm::vec4{ view_projection[0][3], view_projection[1][3], view_projection[2][3], view_projection[3][3] }
+              - glm::vec4{ view_projection[0][1], view_projection[1][1], view_projection[2][1], view_projection[3][1] } ),
+    make_plane( glm::vec4{ view_projection[0][3], view_projection[1][3], view_projection[2][3], view_projection[3][3] }
+              + glm::vec4{ view_projection[0][2], view_projection[1][2], view_projection[2][2], view_projection[3][2] } ),
+    make_plane( glm::vec4{ view_projection[0][3], view_projection[1][3], view_projection[2][3], view_projection[3][3] }
+              - glm::vec4{ view_projection[0][2], view_projection[1][2], view_projection[2][2], view_projection[3][2] } ),
+} {}
+
+bool Frustum::intersects( const Box& box ) const {
+    for( const auto& plane : _planes ) {
+        // box corner furthest along the plane normal
+        glm::vec3 corner{
+            plane.normal().x >= 0.0 ? box.max().x : box.min().x,
+            plane.normal().y >= 0.0 ? box.max().y : box.min().y,
+            plane.normal().z >= 0.0 ? box.max().z : box.min().z,
+        };
+        if( glm::dot( corner - plane.position(), plane.normal() ) < 0.0 ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Frustum::intersects( const Sphere& sphere ) const {
+    for( const auto& plane : _planes ) {
+        if( glm::dot( sphere.center() - plane.position(), plane.normal() ) < -sphere.radius() ) {
+            return false;
+        }
+    }
+    return true;
+}
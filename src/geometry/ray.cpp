@@ -1,5 +1,6 @@
 #include "geometry/ray.hpp"
 
+#include "mesh.hpp"
 #include "camera.hpp"
 #include "transform.hpp"
 #include "window.hpp"
@@ -60,6 +61,19 @@ std::optional<std::pair<float, glm::vec3>> Ray::intersects( const Box& box ) {
     return result;
 }
 
+std::optional<MeshHit> Ray::intersects( const Mesh& mesh, const Transform& transform ) {
+    if( !mesh.geometry() ) {
+        return std::nullopt;
+    }
+    // model space ray, same parameter along it as in world space
+    auto inverse = transform.global_affine().inverse();
+    auto hit = mesh.geometry()->intersect( inverse.transform_point( _position ), inverse.transform_vector( _direction ) );
+    if( hit ) {
+        hit->position = glm::vec3{ transform.global_matrix() * glm::vec4{ hit->position, 1.0 } };
+    }
+    return hit;
+}
+
 Ray Ray::from_screen( const entt::registry& registry, double screen_x, double screen_y ) {
     auto camera_entity = registry.ctx<CurrentCamera>().entity;
     auto camera = registry.get<Camera>( camera_entity );
@@ -70,10 +84,11 @@ Ray Ray::from_screen( const entt::registry& registry, double screen_x, double sc
 
     glm::vec4 point_ndc{ pos_x, -pos_y, -1.0, 1.0 };
     auto point_view = glm::inverse( camera.projection_matrix ) * point_ndc;
-    auto point_global = camera_transform.global_matrix() * point_view;
-    point_global /= point_global.w;
+    point_view /= point_view.w;
+    const auto& camera_global = camera_transform.global_affine();
+    auto point_global = glm::vec4{ camera_global.transform_point( glm::vec3{ point_view.x, point_view.y, point_view.z } ), 1.0 };
 
-    auto camera_pos = camera_transform.global_matrix() * glm::vec4{0.0, 0.0, 0.0, 1.0};
+    auto camera_pos = glm::vec4{ camera_global.translation(), 1.0 };
     auto point_dir = glm::normalize(point_global - camera_pos);
 
     return Ray{ camera_pos, point_dir };
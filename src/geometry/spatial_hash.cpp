@@ -0,0 +1,542 @@
+#include "geometry/spatial_hash.hpp"
+#include "geometry/ray_packet.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+// cell coordinates fit 21 bits per axis
+static constexpr int COORDINATE_LIMIT = ( 1 << 20 ) - 1;
+// bits sorted per radix pass, at most
+static constexpr int RADIX_BITS = 11;
+// cells the key layout extends past the bounds on each side, at least
+static constexpr int64_t LAYOUT_MARGIN = 16;
+// cells a ray walks before giving up
+static constexpr int MAX_RAY_STEPS = 1 << 16;
+// entries per parallel chunk, at least
+static constexpr size_t PARALLEL_GRAIN = 16384;
+
+// chunks to split count entries into, one without a pool
+static size_t chunk_count( ThreadPool* pool, size_t count ) {
+    if( pool == nullptr || pool->worker() ) {
+        return 1;
+    }
+    return std::max<size_t>( 1, std::min<size_t>( pool->size() + 1, count / PARALLEL_GRAIN ) );
+}
+
+// call function( chunk ) for every chunk, on the pool when there are several
+template <class F>
+static void for_chunks( ThreadPool* pool, size_t chunks, F function ) {
+    if( chunks <= 1 ) {
+        function( 0 );
+        return;
+    }
+    pool->parallel_for( 0, chunks, [&function]( size_t begin, size_t end ){
+            for( size_t chunk=begin; chunk<end; chunk++ ) {
+                function( chunk );
+            }
+    });
+}
+
+SpatialHash::SpatialHash( float cell_size ) : _cell_size{cell_size}, _inverse_cell_size{1.0f / cell_size} {}
+
+uint32_t SpatialHash::insert( const Box& box ) {
+    uint32_t id;
+    if( !_free.empty() ) {
+        id = _free.back();
+        _free.pop_back();
+    } else {
+        id = _objects.size();
+        _objects.emplace_back();
+        _moved_flags.push_back( false );
+    }
+    auto& object = _objects[id];
+    object.box = box;
+    object.range = _range( box );
+    object.alive = true;
+    _bounds += box;
+    _move( id );
+    return id;
+}
+
+void SpatialHash::set( uint32_t id, const Box& box ) {
+    auto& object = _objects[id];
+    if( box.min() == object.box.min() && box.max() == object.box.max() ) {
+        return;
+    }
+    object.box = box;
+    _bounds += box;
+    // most moves stay within the same cells
+    auto range = _range( box );
+    if( !( range == object.range ) ) {
+        object.range = range;
+        _move( id );
+    }
+}
+
+void SpatialHash::remove( uint32_t id ) {
+    if( id >= _objects.size() || !_objects[id].alive ) {
+        return;
+    }
+    _objects[id].alive = false;
+    _free.push_back( id );
+    _move( id );
+}
+
+void SpatialHash::clear() {
+    _objects.clear();
+    _free.clear();
+    _moved.clear();
+    _moved_flags.clear();
+    _oversized.clear();
+    _entries.clear();
+    _bounds = Box{};
+    _relayout = true;
+}
+
+void SpatialHash::rebuild( ThreadPool* pool ) {
+    if( _relayout ) {
+        _relayout = false;
+        _layout();
+        _entries.clear();
+        _oversized.clear();
+        std::vector<uint32_t> ids( _objects.size() );
+        std::iota( ids.begin(), ids.end(), 0 );
+        _add( ids, _entries, pool );
+        for( auto id : _moved ) {
+            _moved_flags[id] = false;
+        }
+        _moved.clear();
+        _sort( _entries, pool );
+        return;
+    }
+    if( _moved.empty() ) {
+        return;
+    }
+
+    // replace the entries of the moved boxes, the rest stay sorted
+    _oversized.erase( std::remove_if( _oversized.begin(), _oversized.end(),
+                [this]( uint32_t id ){ return _moved_flags[id]; }), _oversized.end() );
+    _added.clear();
+    _add( _moved, _added, pool );
+    _sort( _added, pool );
+    _merge( pool );
+    for( auto id : _moved ) {
+        _moved_flags[id] = false;
+    }
+    _moved.clear();
+}
+
+void SpatialHash::_move( uint32_t id ) {
+    auto& object = _objects[id];
+    if( !_moved_flags[id] ) {
+        _moved_flags[id] = true;
+        _moved.push_back( id );
+    }
+    // keys can't address cells outside of the layout
+    if( object.alive && !_oversized_range( object.range ) ) {
+        for( int axis=0; axis<3; axis++ ) {
+            if( object.range.min[axis] < _origin[axis] || (int64_t)object.range.max[axis] - _origin[axis] >= ( 1ll << _bits[axis] ) ) {
+                _relayout = true;
+            }
+        }
+    }
+}
+
+void SpatialHash::_layout() {
+    _bounds = Box{};
+    for( const auto& object : _objects ) {
+        if( object.alive ) {
+            _bounds += object.box;
+        }
+    }
+    // key bits for the cells of the bounds with room to move around them
+    auto bounds = _range( _bounds );
+    _key_bits = 0;
+    for( int axis=0; axis<3; axis++ ) {
+        _origin[axis] = 0;
+        _bits[axis] = 0;
+        if( bounds.max[axis] < bounds.min[axis] ) {
+            continue;
+        }
+        int64_t extent = (int64_t)bounds.max[axis] - bounds.min[axis] + 1;
+        int64_t margin = std::max<int64_t>( extent / 4, LAYOUT_MARGIN );
+        int64_t min = std::max<int64_t>( bounds.min[axis] - margin, -COORDINATE_LIMIT );
+        int64_t max = std::min<int64_t>( bounds.max[axis] + margin, COORDINATE_LIMIT );
+        _origin[axis] = min;
+        while( ( 1ll << _bits[axis] ) < max - min + 1 ) {
+            _bits[axis]++;
+        }
+        _key_bits += _bits[axis];
+    }
+}
+
+void SpatialHash::_add( const std::vector<uint32_t>& ids, std::vector<Entry>& entries, ThreadPool* pool ) {
+    // cells of each chunk are counted first so chunks write their entries in place
+    size_t chunks = chunk_count( pool, ids.size() );
+    size_t chunk_size = ( ids.size() + chunks - 1 ) / chunks;
+    std::vector<size_t> offsets( chunks + 1, entries.size() );
+    for_chunks( pool, chunks, [&]( size_t chunk ){
+            size_t count = 0;
+            size_t end = std::min( ids.size(), ( chunk + 1 ) * chunk_size );
+            for( size_t i=chunk*chunk_size; i<end; i++ ) {
+                auto& object = _objects[ ids[i] ];
+                if( !object.alive ) {
+                    continue;
+                }
+                object.cells = object.range;
+                object.oversized = _oversized_range( object.range );
+                if( !object.oversized ) {
+                    count += ( object.range.max[0] - object.range.min[0] + 1 )
+                        * ( object.range.max[1] - object.range.min[1] + 1 )
+                        * ( object.range.max[2] - object.range.min[2] + 1 );
+                }
+            }
+            offsets[chunk + 1] = count;
+    });
+    for( size_t chunk=0; chunk<chunks; chunk++ ) {
+        offsets[chunk + 1] += offsets[chunk];
+    }
+    entries.resize( offsets[chunks] );
+    for_chunks( pool, chunks, [&]( size_t chunk ){
+            auto out = entries.begin() + offsets[chunk];
+            size_t end = std::min( ids.size(), ( chunk + 1 ) * chunk_size );
+            for( size_t i=chunk*chunk_size; i<end; i++ ) {
+                const auto& object = _objects[ ids[i] ];
+                if( !object.alive || object.oversized ) {
+                    continue;
+                }
+                const auto& range = object.cells;
+                for( int x=range.min[0]; x<=range.max[0]; x++ ) {
+                    for( int y=range.min[1]; y<=range.max[1]; y++ ) {
+                        for( int z=range.min[2]; z<=range.max[2]; z++ ) {
+                            *out++ = Entry{ _key( x, y, z ), ids[i] };
+                        }
+                    }
+                }
+            }
+    });
+    for( auto id : ids ) {
+        if( _objects[id].alive && _objects[id].oversized ) {
+            _oversized.push_back( id );
+        }
+    }
+}
+
+void SpatialHash::_sort( std::vector<Entry>& entries, ThreadPool* pool ) {
+    // LSD radix sort by key in as few passes as RADIX_BITS allow, each chunk
+    // counts and scatters its own entries
+    _scratch.resize( entries.size() );
+    size_t chunks = chunk_count( pool, entries.size() );
+    size_t chunk_size = ( entries.size() + chunks - 1 ) / chunks;
+    int passes = ( _key_bits + RADIX_BITS - 1 ) / RADIX_BITS;
+    int bits = passes > 0 ? ( _key_bits + passes - 1 ) / passes : 0;
+    size_t buckets = size_t{1} << bits;
+    const uint64_t mask = buckets - 1;
+    std::vector<size_t> counts( chunks * buckets );
+    for( int shift=0; shift<_key_bits; shift+=bits ) {
+        auto count = [&]( size_t chunk ){
+            auto chunk_counts = counts.data() + chunk * buckets;
+            std::fill( chunk_counts, chunk_counts + buckets, 0 );
+            size_t end = std::min( entries.size(), ( chunk + 1 ) * chunk_size );
+            for( size_t i=chunk*chunk_size; i<end; i++ ) {
+                chunk_counts[ ( entries[i].key >> shift ) & mask ]++;
+            }
+        };
+        auto scatter = [&]( size_t chunk ){
+            auto chunk_counts = counts.data() + chunk * buckets;
+            size_t end = std::min( entries.size(), ( chunk + 1 ) * chunk_size );
+            for( size_t i=chunk*chunk_size; i<end; i++ ) {
+                _scratch[ chunk_counts[ ( entries[i].key >> shift ) & mask ]++ ] = entries[i];
+            }
+        };
+        for_chunks( pool, chunks, count );
+        // offsets by bucket, then by chunk so the sort stays stable
+        size_t offset = 0;
+        for( size_t bucket=0; bucket<buckets; bucket++ ) {
+            for( size_t chunk=0; chunk<chunks; chunk++ ) {
+                auto next = offset + counts[ chunk * buckets + bucket ];
+                counts[ chunk * buckets + bucket ] = offset;
+                offset = next;
+            }
+        }
+        for_chunks( pool, chunks, scatter );
+        entries.swap( _scratch );
+    }
+}
+
+void SpatialHash::_merge( ThreadPool* pool ) {
+    // chunks split at keys of the entries so runs of a cell stay in one,
+    // kept entries are counted first to place each chunk's output
+    size_t chunks = chunk_count( pool, _entries.size() );
+    std::vector<size_t> entry_splits( chunks + 1 ), added_splits( chunks + 1 ), offsets( chunks + 1, 0 );
+    entry_splits[chunks] = _entries.size();
+    added_splits[chunks] = _added.size();
+    auto less = []( const Entry& entry, uint64_t key ){ return entry.key < key; };
+    for( size_t chunk=1; chunk<chunks; chunk++ ) {
+        auto key = _entries[ chunk * _entries.size() / chunks ].key;
+        entry_splits[chunk] = std::lower_bound( _entries.begin(), _entries.end(), key, less ) - _entries.begin();
+        added_splits[chunk] = std::lower_bound( _added.begin(), _added.end(), key, less ) - _added.begin();
+    }
+    auto kept = [&]( size_t chunk ){
+        size_t count = 0;
+        for( size_t i=entry_splits[chunk]; i<entry_splits[chunk + 1]; i++ ) {
+            count += !_moved_flags[ _entries[i].id ];
+        }
+        offsets[chunk + 1] = count + added_splits[chunk + 1] - added_splits[chunk];
+    };
+    auto merge = [&]( size_t chunk ){
+        auto out = _merged.begin() + offsets[chunk];
+        auto added = _added.begin() + added_splits[chunk], added_end = _added.begin() + added_splits[chunk + 1];
+        for( size_t i=entry_splits[chunk]; i<entry_splits[chunk + 1]; i++ ) {
+            const auto& entry = _entries[i];
+            if( _moved_flags[ entry.id ] ) {
+                continue;
+            }
+            while( added != added_end && added->key < entry.key ) {
+                *out++ = *added++;
+            }
+            *out++ = entry;
+        }
+        std::copy( added, added_end, out );
+    };
+    for_chunks( pool, chunks, kept );
+    for( size_t chunk=0; chunk<chunks; chunk++ ) {
+        offsets[chunk + 1] += offsets[chunk];
+    }
+    _merged.resize( offsets[chunks] );
+    for_chunks( pool, chunks, merge );
+    _entries.swap( _merged );
+}
+
+std::pair<const SpatialHash::Entry*, const SpatialHash::Entry*> SpatialHash::_cell( uint64_t key ) const {
+    if( key == NO_KEY ) {
+        return { nullptr, nullptr };
+    }
+    auto begin = std::lower_bound( _entries.begin(), _entries.end(), key, []( const Entry& entry, uint64_t key ){
+            return entry.key < key;
+    });
+    auto end = begin;
+    while( end != _entries.end() && end->key == key ) {
+        ++end;
+    }
+    return { _entries.data() + ( begin - _entries.begin() ), _entries.data() + ( end - _entries.begin() ) };
+}
+
+SpatialHash::Range SpatialHash::_range( const Box& box ) const {
+    Range range;
+    for( int axis=0; axis<3; axis++ ) {
+        range.min[axis] = (int)std::clamp( std::floor( box.min()[axis] * _inverse_cell_size ), (float)-COORDINATE_LIMIT, (float)COORDINATE_LIMIT );
+        range.max[axis] = (int)std::clamp( std::floor( box.max()[axis] * _inverse_cell_size ), (float)-COORDINATE_LIMIT, (float)COORDINATE_LIMIT );
+    }
+    return range;
+}
+
+uint64_t SpatialHash::_key( int x, int y, int z ) const {
+    int64_t coordinates[3] = { (int64_t)x - _origin[0], (int64_t)y - _origin[1], (int64_t)z - _origin[2] };
+    for( int axis=0; axis<3; axis++ ) {
+        if( coordinates[axis] < 0 || coordinates[axis] >= ( 1ll << _bits[axis] ) ) {
+            return NO_KEY;
+        }
+    }
+    return ( (uint64_t)coordinates[0] << ( _bits[1] + _bits[2] ) ) | ( (uint64_t)coordinates[1] << _bits[2] ) | (uint64_t)coordinates[2];
+}
+
+void SpatialHash::_coordinates( uint64_t key, int coordinates[3] ) const {
+    coordinates[2] = (int)( key & ( ( 1ull << _bits[2] ) - 1 ) ) + _origin[2];
+    key >>= _bits[2];
+    coordinates[1] = (int)( key & ( ( 1ull << _bits[1] ) - 1 ) ) + _origin[1];
+    key >>= _bits[1];
+    coordinates[0] = (int)key + _origin[0];
+}
+
+bool SpatialHash::_oversized_range( const Range& range ) {
+    int64_t cells = 1;
+    for( int axis=0; axis<3; axis++ ) {
+        // empty boxes have inverted ranges, keep them out of the cells
+        if( range.max[axis] < range.min[axis] ) {
+            return true;
+        }
+        cells *= (int64_t)range.max[axis] - range.min[axis] + 1;
+    }
+    return cells > MAX_CELLS;
+}
+
+void SpatialHash::query( const Box& box, std::vector<uint32_t>& ids ) const {
+    ids.clear();
+    auto range = _range( box );
+    if( _oversized_range( range ) ) {
+        // large queries test every box instead of walking their cells
+        for( uint32_t id=0; id<_objects.size(); id++ ) {
+            if( _objects[id].alive && _objects[id].box.intersects( box ) ) {
+                ids.push_back( id );
+            }
+        }
+        return;
+    }
+    for( int x=range.min[0]; x<=range.max[0]; x++ ) {
+        for( int y=range.min[1]; y<=range.max[1]; y++ ) {
+            for( int z=range.min[2]; z<=range.max[2]; z++ ) {
+                auto cell = _cell( _key( x, y, z ) );
+                for( auto entry=cell.first; entry!=cell.second; ++entry ) {
+                    auto id = entry->id;
+                    // reported in the first cell both ranges share only
+                    const auto& other = _objects[id].cells;
+                    if( _objects[id].alive
+                            && x == std::max( range.min[0], other.min[0] )
+                            && y == std::max( range.min[1], other.min[1] )
+                            && z == std::max( range.min[2], other.min[2] )
+                            && _objects[id].box.intersects( box ) ) {
+                        ids.push_back( id );
+                    }
+                }
+            }
+        }
+    }
+    for( auto id : _oversized ) {
+        if( _objects[id].alive && _objects[id].box.intersects( box ) ) {
+            ids.push_back( id );
+        }
+    }
+}
+
+void SpatialHash::query( const Ray& ray, std::vector<std::pair<uint32_t, float>>& hits, float max_distance ) const {
+    hits.clear();
+    RayPacket<1> packet;
+    packet.set( 0, ray, max_distance );
+    float distance;
+    for( auto id : _oversized ) {
+        if( _objects[id].alive && packet.intersects( _objects[id].box, &distance ) ) {
+            hits.emplace_back( id, distance );
+        }
+    }
+
+    // walk the cells along the part of the ray inside the boxes' bounds
+    float begin;
+    if( _entries.empty() || !packet.intersects( _bounds, &begin ) ) {
+        std::sort( hits.begin(), hits.end(), []( const auto& a, const auto& b ){ return a.second < b.second; } );
+        return;
+    }
+    const auto& origin = ray.position();
+    const auto& direction = ray.direction();
+    auto start = origin + begin * direction;
+    int cell[3], step[3], last[3];
+    float next[3], delta[3];
+    auto bounds_range = _range( _bounds );
+    for( int axis=0; axis<3; axis++ ) {
+        cell[axis] = std::clamp( (int)std::floor( start[axis] * _inverse_cell_size ), bounds_range.min[axis], bounds_range.max[axis] );
+        if( direction[axis] > 0.0 ) {
+            step[axis] = 1;
+            last[axis] = bounds_range.max[axis] + 1;
+            next[axis] = ( ( cell[axis] + 1 ) * _cell_size - origin[axis] ) / direction[axis];
+            delta[axis] = _cell_size / direction[axis];
+        } else if( direction[axis] < 0.0 ) {
+            step[axis] = -1;
+            last[axis] = bounds_range.min[axis] - 1;
+            next[axis] = ( cell[axis] * _cell_size - origin[axis] ) / direction[axis];
+            delta[axis] = -_cell_size / direction[axis];
+        } else {
+            step[axis] = 0;
+            last[axis] = bounds_range.max[axis] + 1;
+            next[axis] = std::numeric_limits<float>::infinity();
+            delta[axis] = std::numeric_limits<float>::infinity();
+        }
+    }
+
+    size_t cell_hits_begin = hits.size();
+    for( int steps=0; steps<MAX_RAY_STEPS; steps++ ) {
+        auto found = _cell( _key( cell[0], cell[1], cell[2] ) );
+        for( auto entry=found.first; entry!=found.second; ++entry ) {
+            if( _objects[ entry->id ].alive && packet.intersects( _objects[ entry->id ].box, &distance ) ) {
+                hits.emplace_back( entry->id, distance );
+            }
+        }
+        // next cell across the nearest boundary
+        int axis = next[0] < next[1] ? ( next[0] < next[2] ? 0 : 2 ) : ( next[1] < next[2] ? 1 : 2 );
+        if( next[axis] > max_distance ) {
+            break;
+        }
+        cell[axis] += step[axis];
+        if( cell[axis] == last[axis] ) {
+            break;
+        }
+        next[axis] += delta[axis];
+    }
+
+    // boxes over several cells along the ray are found once per cell
+    std::sort( hits.begin() + cell_hits_begin, hits.end() );
+    hits.erase( std::unique( hits.begin() + cell_hits_begin, hits.end() ), hits.end() );
+    std::sort( hits.begin(), hits.end(), []( const auto& a, const auto& b ){ return a.second < b.second; } );
+}
+
+void SpatialHash::pairs( std::vector<std::pair<uint32_t, uint32_t>>& pairs, ThreadPool* pool ) const {
+    pairs.clear();
+    // chunks start on the first entry of a cell, their pairs are appended in order
+    size_t chunks = chunk_count( pool, _entries.size() );
+    std::vector<size_t> splits( chunks + 1, _entries.size() );
+    splits[0] = 0;
+    for( size_t chunk=1; chunk<chunks; chunk++ ) {
+        auto split = std::max( splits[chunk - 1], chunk * _entries.size() / chunks );
+        while( split > 0 && split < _entries.size() && _entries[split].key == _entries[split - 1].key ) {
+            split++;
+        }
+        splits[chunk] = split;
+    }
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> chunk_pairs( chunks - 1 );
+    for_chunks( pool, chunks, [&]( size_t chunk ){
+            _cell_pairs( splits[chunk], splits[chunk + 1], chunk == 0 ? pairs : chunk_pairs[chunk - 1] );
+    });
+    for( const auto& found : chunk_pairs ) {
+        pairs.insert( pairs.end(), found.begin(), found.end() );
+    }
+
+    for( size_t i=0; i<_oversized.size(); i++ ) {
+        if( !_objects[ _oversized[i] ].alive ) {
+            continue;
+        }
+        const auto& box = _objects[ _oversized[i] ].box;
+        for( uint32_t id=0; id<_objects.size(); id++ ) {
+            // pairs of two oversized boxes once
+            if( !_objects[id].alive || id == _oversized[i] || ( _objects[id].oversized && id < _oversized[i] ) ) {
+                continue;
+            }
+            if( _objects[id].box.intersects( box ) ) {
+                pairs.emplace_back( std::min( id, _oversized[i] ), std::max( id, _oversized[i] ) );
+            }
+        }
+    }
+}
+
+void SpatialHash::_cell_pairs( size_t entries_begin, size_t entries_end, std::vector<std::pair<uint32_t, uint32_t>>& pairs ) const {
+    int coordinates[3];
+    for( size_t begin=entries_begin, end=entries_begin; begin<entries_end; begin=end ) {
+        // run of the entries of one cell
+        end = begin + 1;
+        while( end < entries_end && _entries[end].key == _entries[begin].key ) {
+            end++;
+        }
+        if( end - begin < 2 ) {
+            continue;
+        }
+        _coordinates( _entries[begin].key, coordinates );
+        for( size_t i=begin; i<end; i++ ) {
+            const auto& a = _objects[ _entries[i].id ];
+            if( !a.alive ) {
+                continue;
+            }
+            for( size_t j=i+1; j<end; j++ ) {
+                const auto& b = _objects[ _entries[j].id ];
+                // a pair sharing several cells is reported in the first one
+                if( !b.alive
+                        || coordinates[0] != std::max( a.cells.min[0], b.cells.min[0] )
+                        || coordinates[1] != std::max( a.cells.min[1], b.cells.min[1] )
+                        || coordinates[2] != std::max( a.cells.min[2], b.cells.min[2] ) ) {
+                    continue;
+                }
+                if( a.box.intersects( b.box ) ) {
+                    pairs.emplace_back( std::min( _entries[i].id, _entries[j].id ), std::max( _entries[i].id, _entries[j].id ) );
+                }
+            }
+        }
+    }
+}
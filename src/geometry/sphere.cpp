@@ -0,0 +1,24 @@
+#include "geometry/sphere.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+bool Sphere::intersects( const Box& box ) const {
+    // squared distance from center to the closest point of the box
+    float distance = 0.0;
+    for( int i=0; i<3; i++ ) {
+        float d = std::max( { box.min()[i] - _center[i], 0.f, _center[i] - box.max()[i] } );
+        distance += d*d;
+    }
+    return distance <= _radius*_radius;
+}
+
+Sphere Sphere::bounding_cone( const glm::vec3& apex, const glm::vec3& direction, float length, float angle ) {
+    // wide cones are bounded by the sphere around their base disk
+    if( angle > M_PI/4 ) {
+        return Sphere{ apex + direction * ( length * std::cos( angle ) ), length * std::sin( angle ) };
+    }
+    // narrow cones by the sphere through apex and base rim
+    float radius = length / ( 2.f * std::cos( angle ) );
+    return Sphere{ apex + direction * radius, radius };
+}
@@ -0,0 +1,39 @@
+#include "gl_extensions.hpp"
+
+#include <GLFW/glfw3.h>
+
+#include <unordered_set>
+
+bool gl_extension_supported( const std::string& name ) {
+    // extensions do not change during the context lifetime
+    static std::unordered_set<std::string> extensions;
+    static bool loaded = false;
+    if( !loaded ) {
+        GLint count = 0;
+        glGetIntegerv( GL_NUM_EXTENSIONS, &count );
+        for( GLint i=0; i<count; i++ ) {
+            extensions.emplace( reinterpret_cast<const char*>( glGetStringi( GL_EXTENSIONS, i ) ) );
+        }
+        loaded = true;
+    }
+    return extensions.count( name ) != 0;
+}
+
+bool gl_version_at_least( int major, int minor ) {
+    GLint context_major = 0, context_minor = 0;
+    glGetIntegerv( GL_MAJOR_VERSION, &context_major );
+    glGetIntegerv( GL_MINOR_VERSION, &context_minor );
+    return context_major > major || ( context_major == major && context_minor >= minor );
+}
+
+void* gl_extension_function( const char* name ) {
+    return reinterpret_cast<void*>( glfwGetProcAddress( name ) );
+}
+
+bool gl_bindless_textures_supported() {
+    static bool supported = gl_extension_supported( "GL_ARB_bindless_texture" )
+        && gl_extension_function( "glGetTextureHandleARB" ) != nullptr
+        && gl_extension_function( "glMakeTextureHandleResidentARB" ) != nullptr
+        && gl_extension_function( "glMakeTextureHandleNonResidentARB" ) != nullptr;
+    return supported;
+}
@@ -0,0 +1,146 @@
+#include "light_buffer.hpp"
+
+#include "transform.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+LightBuffer::~LightBuffer() {
+    if( _buffer != 0 ) {
+        glDeleteTextures( 1, &_texture );
+        glDeleteBuffers( 1, &_buffer );
+    }
+}
+
+void LightBuffer::set( entt::entity entity, const ShaderLight& light ) {
+    auto it = _index.find( entity );
+    size_t index;
+    if( it == _index.end() ) {
+        index = _lights.size();
+        _index[ entity ] = index;
+        _entities.push_back( entity );
+        _lights.push_back( light );
+        _bounds.push_back( light_bounds( light ) );
+        _data.resize( _data.size() + TEXELS_PER_LIGHT );
+    } else {
+        index = it->second;
+        _lights[index] = light;
+        _bounds[index] = light_bounds( light );
+    }
+    _pack( index );
+    _mark( index );
+}
+
+void LightBuffer::remove( entt::entity entity ) {
+    auto it = _index.find( entity );
+    if( it == _index.end() ) {
+        return;
+    }
+    // move the last light into the hole
+    size_t index = it->second;
+    size_t last = _lights.size() - 1;
+    _index.erase( it );
+    if( index != last ) {
+        _lights[index] = _lights[last];
+        _bounds[index] = _bounds[last];
+        _entities[index] = _entities[last];
+        _index[ _entities[index] ] = index;
+        std::copy( _data.begin() + last*TEXELS_PER_LIGHT, _data.end(), _data.begin() + index*TEXELS_PER_LIGHT );
+        _mark( index );
+    }
+    _lights.pop_back();
+    _bounds.pop_back();
+    _entities.pop_back();
+    _data.resize( _data.size() - TEXELS_PER_LIGHT );
+    _dirty_end = std::min( _dirty_end, _lights.size() );
+    _dirty_begin = std::min( _dirty_begin, _dirty_end );
+}
+
+size_t LightBuffer::index( entt::entity entity ) const {
+    auto it = _index.find( entity );
+    return it != _index.end() ? it->second : NONE;
+}
+
+void LightBuffer::update() {
+    // created on first update, packing alone runs without a context
+    if( _buffer == 0 ) {
+        glGenBuffers( 1, &_buffer );
+        glGenTextures( 1, &_texture );
+        glBindBuffer( GL_TEXTURE_BUFFER, _buffer );
+        glBufferData( GL_TEXTURE_BUFFER, 16, nullptr, GL_DYNAMIC_DRAW );
+        glBindTexture( GL_TEXTURE_BUFFER, _texture );
+        glTexBuffer( GL_TEXTURE_BUFFER, GL_RGBA32F, _buffer );
+        glBindTexture( GL_TEXTURE_BUFFER, 0 );
+    }
+    _uploaded = 0;
+    glBindBuffer( GL_TEXTURE_BUFFER, _buffer );
+    if( _lights.size() > _capacity ) {
+        // grow storage and upload everything
+        _capacity = std::max( _lights.size(), 2*_capacity );
+        glBufferData( GL_TEXTURE_BUFFER, _capacity * TEXELS_PER_LIGHT * sizeof(glm::vec4), nullptr, GL_DYNAMIC_DRAW );
+        _dirty_begin = 0;
+        _dirty_end = _lights.size();
+    }
+    if( _dirty_begin < _dirty_end ) {
+        _uploaded = ( _dirty_end - _dirty_begin ) * TEXELS_PER_LIGHT * sizeof(glm::vec4);
+        glBufferSubData( GL_TEXTURE_BUFFER,
+                _dirty_begin * TEXELS_PER_LIGHT * sizeof(glm::vec4),
+                _uploaded,
+                _data.data() + _dirty_begin * TEXELS_PER_LIGHT );
+    }
+    glBindBuffer( GL_TEXTURE_BUFFER, 0 );
+    _dirty_begin = _dirty_end = 0;
+
+    glActiveTexture( GL_TEXTURE0 + UNIT );
+    glBindTexture( GL_TEXTURE_BUFFER, _texture );
+    glActiveTexture( GL_TEXTURE0 );
+}
+
+void LightBuffer::bind( ShaderProgram& program ) {
+    program.uniform_sampler( "light_data", UNIT );
+}
+
+std::vector<entt::entity> LightBuffer::take_changed() {
+    std::vector<entt::entity> changed;
+    changed.swap( _changed );
+    std::sort( changed.begin(), changed.end() );
+    changed.erase( std::unique( changed.begin(), changed.end() ), changed.end() );
+    return changed;
+}
+
+void LightBuffer::connect( entt::registry& registry ) {
+    registry.on_construct<LightColor>().connect<&LightBuffer::on_change<LightColor>>();
+    registry.on_replace<LightColor>().connect<&LightBuffer::on_change<LightColor>>();
+    registry.on_destroy<LightColor>().connect<&LightBuffer::on_destroy<LightColor>>();
+    registry.on_construct<Transform>().connect<&LightBuffer::on_change<Transform>>();
+    registry.on_replace<Transform>().connect<&LightBuffer::on_change<Transform>>();
+    registry.on_destroy<Transform>().connect<&LightBuffer::on_destroy<Transform>>();
+    // light types can be added or removed
+    registry.on_construct<DirectionalLight>().connect<&LightBuffer::on_change<DirectionalLight>>();
+    registry.on_destroy<DirectionalLight>().connect<&LightBuffer::on_change<DirectionalLight>>();
+    registry.on_construct<PointLight>().connect<&LightBuffer::on_change<PointLight>>();
+    registry.on_replace<PointLight>().connect<&LightBuffer::on_change<PointLight>>();
+    registry.on_destroy<PointLight>().connect<&LightBuffer::on_change<PointLight>>();
+    registry.on_construct<Spotlight>().connect<&LightBuffer::on_change<Spotlight>>();
+    registry.on_replace<Spotlight>().connect<&LightBuffer::on_change<Spotlight>>();
+    registry.on_destroy<Spotlight>().connect<&LightBuffer::on_change<Spotlight>>();
+}
+
+void LightBuffer::_pack( size_t index ) {
+    const auto& light = _lights[index];
+    auto data = _data.begin() + index*TEXELS_PER_LIGHT;
+    data[0] = glm::vec4{ light.position.x, light.position.y, light.position.z, light.radius };
+    data[1] = glm::vec4{ light.direction.x, light.direction.y, light.direction.z, (float)light.type };
+    data[2] = glm::vec4{ light.color.x, light.color.y, light.color.z, std::cos( light.outer_angle ) };
+    data[3] = glm::vec4{ std::cos( light.inner_angle ), 0.0, 0.0, 0.0 };
+}
+
+void LightBuffer::_mark( size_t index ) {
+    if( _dirty_begin == _dirty_end ) {
+        _dirty_begin = index;
+        _dirty_end = index + 1;
+    } else {
+        _dirty_begin = std::min( _dirty_begin, index );
+        _dirty_end = std::max( _dirty_end, index + 1 );
+    }
+}
@@ -0,0 +1,351 @@
+#include "light_clusters.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define REPLICATOR_CLUSTERS_X86
+#include <immintrin.h>
+#endif
+
+// boxes of count clusters in a row, bit i of the result set if the sphere touches box i
+typedef uint32_t (*RowTest)( const float* const min[3], const float* const max[3], size_t count,
+        const glm::vec3& center, float radius2 );
+
+static uint32_t row_test_scalar( const float* const min[3], const float* const max[3], size_t count,
+        const glm::vec3& center, float radius2 ) {
+    uint32_t mask = 0;
+    for( size_t i=0; i<count; i++ ) {
+        // squared distance from light center to cluster box
+        float distance2 = 0.0;
+        for( int axis=0; axis<3; axis++ ) {
+            float d = std::max( { min[axis][i] - center[axis], 0.f, center[axis] - max[axis][i] } );
+            distance2 += d*d;
+        }
+        if( distance2 <= radius2 ) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+}
+
+#ifdef REPLICATOR_CLUSTERS_X86
+
+static uint32_t row_test_sse( const float* const min[3], const float* const max[3], size_t count,
+        const glm::vec3& center, float radius2 ) {
+    uint32_t mask = 0;
+    __m128 zero = _mm_setzero_ps();
+    __m128 r2 = _mm_set1_ps( radius2 );
+    size_t i = 0;
+    for( ; i + 4 <= count; i += 4 ) {
+        __m128 distance2 = zero;
+        for( int axis=0; axis<3; axis++ ) {
+            __m128 c = _mm_set1_ps( center[axis] );
+            __m128 d = _mm_max_ps( _mm_max_ps( _mm_sub_ps( _mm_loadu_ps( min[axis] + i ), c ), zero ),
+                    _mm_sub_ps( c, _mm_loadu_ps( max[axis] + i ) ) );
+            distance2 = _mm_add_ps( distance2, _mm_mul_ps( d, d ) );
+        }
+        mask |= (uint32_t)_mm_movemask_ps( _mm_cmple_ps( distance2, r2 ) ) << i;
+    }
+    const float* const min_rest[3] = { min[0] + i, min[1] + i, min[2] + i };
+    const float* const max_rest[3] = { max[0] + i, max[1] + i, max[2] + i };
+    return mask | row_test_scalar( min_rest, max_rest, count - i, center, radius2 ) << i;
+}
+
+__attribute__((target("avx2,fma")))
+static uint32_t row_test_avx2( const float* const min[3], const float* const max[3], size_t count,
+        const glm::vec3& center, float radius2 ) {
+    uint32_t mask = 0;
+    __m256 zero = _mm256_setzero_ps();
+    __m256 r2 = _mm256_set1_ps( radius2 );
+    size_t i = 0;
+    for( ; i + 8 <= count; i += 8 ) {
+        __m256 distance2 = zero;
+        for( int axis=0; axis<3; axis++ ) {
+            __m256 c = _mm256_set1_ps( center[axis] );
+            __m256 d = _mm256_max_ps( _mm256_max_ps( _mm256_sub_ps( _mm256_loadu_ps( min[axis] + i ), c ), zero ),
+                    _mm256_sub_ps( c, _mm256_loadu_ps( max[axis] + i ) ) );
+            distance2 = _mm256_fmadd_ps( d, d, distance2 );
+        }
+        mask |= (uint32_t)_mm256_movemask_ps( _mm256_cmp_ps( distance2, r2, _CMP_LE_OQ ) ) << i;
+    }
+    const float* const min_rest[3] = { min[0] + i, min[1] + i, min[2] + i };
+    const float* const max_rest[3] = { max[0] + i, max[1] + i, max[2] + i };
+    return mask | row_test_sse( min_rest, max_rest, count - i, center, radius2 ) << i;
+}
+
+#endif // REPLICATOR_CLUSTERS_X86
+
+// row test chosen once for the running CPU
+struct RowKernel {
+    RowTest test;
+    const char* name;
+};
+
+static RowKernel select_kernel() {
+#ifdef REPLICATOR_CLUSTERS_X86
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" ) ) {
+        return RowKernel{ row_test_avx2, "avx2" };
+    }
+    if( __builtin_cpu_supports( "sse2" ) ) {
+        return RowKernel{ row_test_sse, "sse" };
+    }
+#endif
+    return RowKernel{ row_test_scalar, "scalar" };
+}
+
+static const RowKernel& kernel() {
+    static const RowKernel selected = select_kernel();
+    return selected;
+}
+
+static_assert( LightClusters::X <= 32, "a row of clusters is tested into a 32 bit mask" );
+
+LightClusters::LightClusters( ThreadPool& pool ) : _pool{pool} {
+    _counts.resize( COUNT, 0 );
+    _cluster_lights.resize( (size_t)COUNT * MAX_LIGHTS_PER_CLUSTER );
+    _grid.resize( 2 * COUNT, 0 );
+}
+
+LightClusters::~LightClusters() {
+    if( _buffers[0] != 0 ) {
+        glDeleteTextures( 2, _textures );
+        glDeleteBuffers( 2, _buffers );
+    }
+}
+
+void LightClusters::build( const std::vector<ShaderLight>& lights, const std::vector<GLuint>& candidates,
+        const glm::mat4& view, const glm::mat4& projection,
+        float near, float far, unsigned int width, unsigned int height ) {
+    bin( lights, candidates, view, projection, near, far, width, height );
+    _upload();
+}
+
+void LightClusters::bin( const std::vector<ShaderLight>& lights, const std::vector<GLuint>& candidates,
+        const glm::mat4& view, const glm::mat4& projection,
+        float near, float far, unsigned int width, unsigned int height ) {
+    _update_bounds( projection, std::fabs(near), std::fabs(far), width, height );
+
+    // cluster range of each light
+    _light_count = candidates.size();
+    _light_bounds.resize( candidates.size() );
+    _pool.parallel_for( 0, candidates.size(), [this, &lights, &candidates, &view]( size_t begin, size_t end ){
+            for( size_t i=begin; i<end; i++ ) {
+                _light_bounds[i] = _light_bounds_for( lights[ candidates[i] ], view );
+                _light_bounds[i].index = candidates[i];
+            }
+    }, 256 );
+
+    // each depth slice is binned by one task, so clusters have a single writer
+    std::atomic<bool> overflow{false};
+    auto test = kernel().test;
+    _pool.parallel_for( 0, Z, [this, &overflow, test]( size_t begin, size_t end ){
+            for( size_t z=begin; z<end; z++ ) {
+                std::fill( _counts.begin() + z*X*Y, _counts.begin() + (z+1)*X*Y, 0 );
+                for( size_t i=0; i<_light_bounds.size(); i++ ) {
+                    const auto& light = _light_bounds[i];
+                    if( (int)z < light.z0 || (int)z > light.z1 ) {
+                        continue;
+                    }
+                    float radius2 = light.radius * light.radius;
+                    for( int y=light.y0; y<=light.y1; y++ ) {
+                        // clusters x0 to x1 of the row in one test
+                        size_t first = light.x0 + X*( y + Y*z );
+                        const float* const min[3] = { &_cluster_bounds.min[0][first], &_cluster_bounds.min[1][first], &_cluster_bounds.min[2][first] };
+                        const float* const max[3] = { &_cluster_bounds.max[0][first], &_cluster_bounds.max[1][first], &_cluster_bounds.max[2][first] };
+                        uint32_t mask = test( min, max, light.x1 - light.x0 + 1, light.center, radius2 );
+                        for( size_t cluster=first; mask != 0; cluster++, mask >>= 1 ) {
+                            if( !( mask & 1u ) ) {
+                                continue;
+                            }
+                            auto& count = _counts[cluster];
+                            if( count < MAX_LIGHTS_PER_CLUSTER ) {
+                                _cluster_lights[ cluster*MAX_LIGHTS_PER_CLUSTER + count ] = light.index;
+                                count++;
+                            } else {
+                                overflow = true;
+                            }
+                        }
+                    }
+                }
+            }
+    });
+    if( overflow ) {
+        spdlog::debug("Light cluster overflow, lights beyond {} per cluster were dropped", MAX_LIGHTS_PER_CLUSTER);
+    }
+
+    // compact lists: (offset, count) per cluster followed by light indices
+    _indices.clear();
+    for( size_t cluster=0; cluster<COUNT; cluster++ ) {
+        _grid[2*cluster] = _indices.size();
+        _grid[2*cluster + 1] = _counts[cluster];
+        auto first = _cluster_lights.begin() + cluster*MAX_LIGHTS_PER_CLUSTER;
+        _indices.insert( _indices.end(), first, first + _counts[cluster] );
+    }
+}
+
+std::vector<GLuint> LightClusters::cluster_lights( size_t cluster ) const {
+    auto first = _indices.begin() + _grid[2*cluster];
+    return std::vector<GLuint>( first, first + _grid[2*cluster + 1] );
+}
+
+Box LightClusters::cluster_bounds( size_t cluster ) const {
+    const auto& b = _cluster_bounds;
+    return Box{ glm::vec3{ b.min[0][cluster], b.min[1][cluster], b.min[2][cluster] },
+        glm::vec3{ b.max[0][cluster], b.max[1][cluster], b.max[2][cluster] } };
+}
+
+const char* LightClusters::implementation() {
+    return kernel().name;
+}
+
+void LightClusters::bind( ShaderProgram& program ) const {
+    bind_units( program );
+    program.uniform( "clustered", (GLuint)1 );
+    program.uniform( "cluster_params", glm::vec4{ _tile_width, _tile_height, _z_scale, _z_bias } );
+}
+
+void LightClusters::bind_units( ShaderProgram& program ) {
+    program.uniform_sampler( "cluster_grid", GRID_UNIT );
+    program.uniform_sampler( "cluster_light_indices", INDICES_UNIT );
+}
+
+void LightClusters::_update_bounds( const glm::mat4& projection, float near, float far, unsigned int width, unsigned int height ) {
+    if( projection == _projection && near == _near && far == _far && width == _width && height == _height ) {
+        return;
+    }
+    _projection = projection;
+    _near = near;
+    _far = far;
+    _width = std::max( 1u, width );
+    _height = std::max( 1u, height );
+    _tile_width = std::ceil( (float)_width / X );
+    _tile_height = std::ceil( (float)_height / Y );
+
+    // slice = log(depth) * scale + bias, exponential between near and far
+    _z_scale = Z / std::log( _far / _near );
+    _z_bias = -(float)Z * std::log( _near ) / std::log( _far / _near );
+
+    // view space direction through a screen point, camera looks down -z
+    auto inverse = glm::inverse( _projection );
+    auto direction = [this, &inverse]( float px, float py ) {
+        auto point = inverse * glm::vec4{ std::min( px / _width, 1.f ) * 2.f - 1.f, std::min( py / _height, 1.f ) * 2.f - 1.f, 1.0, 1.0 };
+        return glm::vec3{ point.x / -point.z, point.y / -point.z, -1.0 };
+    };
+
+    for( int axis=0; axis<3; axis++ ) {
+        _cluster_bounds.min[axis].resize( COUNT );
+        _cluster_bounds.max[axis].resize( COUNT );
+    }
+    for( unsigned int z=0; z<Z; z++ ) {
+        float depth_near = _near * std::pow( _far / _near, (float)z / Z );
+        float depth_far = _near * std::pow( _far / _near, (float)(z + 1) / Z );
+        for( unsigned int y=0; y<Y; y++ ) {
+            for( unsigned int x=0; x<X; x++ ) {
+                glm::vec3 corners[4] = {
+                    direction( x*_tile_width, y*_tile_height ),
+                    direction( (x+1)*_tile_width, y*_tile_height ),
+                    direction( x*_tile_width, (y+1)*_tile_height ),
+                    direction( (x+1)*_tile_width, (y+1)*_tile_height )
+                };
+                glm::vec3 min{ INFINITY }, max{ -INFINITY };
+                for( const auto& corner : corners ) {
+                    for( float depth : { depth_near, depth_far } ) {
+                        glm::vec3 point{ corner.x * depth, corner.y * depth, -depth };
+                        min = glm::min( min, point );
+                        max = glm::max( max, point );
+                    }
+                }
+                size_t cluster = x + X*( y + Y*z );
+                for( int axis=0; axis<3; axis++ ) {
+                    _cluster_bounds.min[axis][cluster] = min[axis];
+                    _cluster_bounds.max[axis][cluster] = max[axis];
+                }
+            }
+        }
+    }
+}
+
+LightClusters::LightBounds LightClusters::_light_bounds_for( const ShaderLight& light, const glm::mat4& view ) const {
+    LightBounds bounds;
+    auto center = view * glm::vec4{ light.position.x, light.position.y, light.position.z, 1.0 };
+    bounds.center = glm::vec3{ center.x, center.y, center.z };
+    bounds.radius = light.radius;
+
+    // empty range when the sphere is outside the depth range
+    float depth_min = -bounds.center.z - bounds.radius;
+    float depth_max = -bounds.center.z + bounds.radius;
+    if( depth_max < _near || depth_min > _far ) {
+        bounds.x0 = bounds.y0 = bounds.z0 = 0;
+        bounds.x1 = bounds.y1 = bounds.z1 = -1;
+        return bounds;
+    }
+    depth_min = std::max( depth_min, _near );
+    depth_max = std::min( depth_max, _far );
+    auto slice = [this]( float depth ) {
+        return std::clamp( (int)std::floor( std::log( depth ) * _z_scale + _z_bias ), 0, (int)Z - 1 );
+    };
+    bounds.z0 = slice( depth_min );
+    bounds.z1 = slice( depth_max );
+
+    // screen rectangle of the view space box in front of the near plane
+    float min_x = INFINITY, min_y = INFINITY, max_x = -INFINITY, max_y = -INFINITY;
+    for( float x : { bounds.center.x - bounds.radius, bounds.center.x + bounds.radius } ) {
+        for( float y : { bounds.center.y - bounds.radius, bounds.center.y + bounds.radius } ) {
+            for( float depth : { depth_min, depth_max } ) {
+                auto clip = _projection * glm::vec4{ x, y, -depth, 1.0 };
+                min_x = std::min( min_x, clip.x / clip.w );
+                max_x = std::max( max_x, clip.x / clip.w );
+                min_y = std::min( min_y, clip.y / clip.w );
+                max_y = std::max( max_y, clip.y / clip.w );
+            }
+        }
+    }
+    auto tile = []( float ndc, float size, float tile_size, unsigned int count ) {
+        return std::clamp( (int)std::floor( ( ndc + 1.f ) * 0.5f * size / tile_size ), 0, (int)count - 1 );
+    };
+    bounds.x0 = tile( min_x, _width, _tile_width, X );
+    bounds.x1 = tile( max_x, _width, _tile_width, X );
+    bounds.y0 = tile( min_y, _height, _tile_height, Y );
+    bounds.y1 = tile( max_y, _height, _tile_height, Y );
+    return bounds;
+}
+
+void LightClusters::_upload() {
+    // created on first upload, binning alone runs without a context
+    if( _buffers[0] == 0 ) {
+        glGenBuffers( 2, _buffers );
+        glGenTextures( 2, _textures );
+        GLenum formats[2] = { GL_RG32UI, GL_R32UI };
+        for( int i=0; i<2; i++ ) {
+            glBindBuffer( GL_TEXTURE_BUFFER, _buffers[i] );
+            glBufferData( GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW );
+            glBindTexture( GL_TEXTURE_BUFFER, _textures[i] );
+            glTexBuffer( GL_TEXTURE_BUFFER, formats[i], _buffers[i] );
+        }
+        glBindTexture( GL_TEXTURE_BUFFER, 0 );
+    }
+
+    const void* data[2] = { _grid.data(), _indices.data() };
+    size_t sizes[2] = { _grid.size() * sizeof(uint32_t), _indices.size() * sizeof(uint32_t) };
+    for( int i=0; i<2; i++ ) {
+        glBindBuffer( GL_TEXTURE_BUFFER, _buffers[i] );
+        // orphan last frame storage
+        glBufferData( GL_TEXTURE_BUFFER, std::max<size_t>( sizes[i], 16 ), nullptr, GL_STREAM_DRAW );
+        if( sizes[i] > 0 ) {
+            glBufferSubData( GL_TEXTURE_BUFFER, 0, sizes[i], data[i] );
+        }
+    }
+    glBindBuffer( GL_TEXTURE_BUFFER, 0 );
+
+    GLuint units[2] = { GRID_UNIT, INDICES_UNIT };
+    for( int i=0; i<2; i++ ) {
+        glActiveTexture( GL_TEXTURE0 + units[i] );
+        glBindTexture( GL_TEXTURE_BUFFER, _textures[i] );
+    }
+    glActiveTexture( GL_TEXTURE0 );
+}
@@ -1,61 +1,198 @@
 #include "lights.hpp"
 
+#include "camera.hpp"
+#include "light_buffer.hpp"
+#include "light_clusters.hpp"
+#include "shadows.hpp"
 #include "models.hpp"
 #include "transform.hpp"
+#include "window.hpp"
+#include "geometry/frustum.hpp"
 
 #include "glad/glad.h"
 
 #include "spdlog/spdlog.h"
 
-void light_system( entt::registry& registry ) {
-    auto light_view = registry.view<LightColor, Transform>();
-    auto model_view = registry.view<Model>();
+#include <optional>
+#include <vector>
 
-    // Directional Lights
-    size_t i = 0;
-    light_view.each([&i, &model_view, &registry](const auto entity, const auto& light, const auto& transform){
-            std::string uniform_name 
-                = std::string{"lights["} 
-                + std::to_string( i )
-                + std::string{"]"};
+Sphere light_bounds( const ShaderLight& light ) {
+    glm::vec3 position{ light.position.x, light.position.y, light.position.z };
+    if( (light.type & ShaderLight::Type::Spotlight) && !(light.type & ShaderLight::Type::Point) ) {
+        glm::vec3 direction{ light.direction.x, light.direction.y, light.direction.z };
+        return Sphere::bounding_cone( position, direction, light.radius, light.outer_angle );
+    }
+    return Sphere{ position, light.radius };
+}
 
+void FrameLights::clear() {
+    global.clear();
+    ranged.clear();
+    bounds.clear();
+    culled = 0;
+}
 
-            ShaderLight shader_light{};
+void FrameLights::affecting( const Box& box, std::vector<size_t>& indices ) const {
+    for( size_t i=0; i<bounds.size(); i++ ) {
+        if( bounds[i].intersects( box ) ) {
+            indices.push_back( i );
+        }
+    }
+}
 
-            bool directional = registry.has<DirectionalLight>( entity ); 
-            bool point = registry.has<PointLight>( entity ); 
-            bool spotlight = registry.has<Spotlight>( entity ); 
+void FrameLights::bind( ShaderProgram& program, const Box& box ) const {
+    _affecting.clear();
+    affecting( box, _affecting );
+    _indices = global;
+    for( auto i : _affecting ) {
+        _indices.push_back( ranged[i] );
+    }
+    program.uniform( "light_indices", _indices );
+    program.uniform( "light_count", (GLuint)_indices.size() );
+}
 
-            if( directional || spotlight ) {
-                shader_light.direction = glm::normalize(transform.global_matrix() * glm::vec4{ 0.0, 0.0, -1.0, 0.0 });
-            }
-            if( point || spotlight ) {
-                shader_light.position = transform.global_matrix() * glm::vec4{ 0.0, 0.0, 0.0, 1.0 };
-            }
+// view and projection of the current camera
+struct CameraView {
+    glm::mat4 view{1.0};
+    const Camera* camera;
+};
 
-            if( directional ) {
-                shader_light.type = (ShaderLight::Type)(shader_light.type | ShaderLight::Type::Directional);
-            }
-            if( point ) {
-                shader_light.type = (ShaderLight::Type)(shader_light.type | ShaderLight::Type::Point);
-            }
-            if( spotlight ) {
-                auto& spotlight_comp = registry.get<Spotlight>( entity );
-                shader_light.type = (ShaderLight::Type)(shader_light.type | ShaderLight::Type::Spotlight);
-                shader_light.inner_angle = spotlight_comp.inner();
-                shader_light.outer_angle = spotlight_comp.outer();
-            }
+static std::optional<CameraView> current_camera( entt::registry& registry ) {
+    auto current_camera_ptr = registry.try_ctx<CurrentCamera>();
+    if( current_camera_ptr == nullptr ) {
+        return std::nullopt;
+    }
+    auto camera_ptr = registry.try_get<Camera>( current_camera_ptr->entity );
+    if( camera_ptr == nullptr ) {
+        return std::nullopt;
+    }
+    CameraView camera_view{ glm::mat4{1.0}, camera_ptr };
+    auto camera_transform_ptr = registry.try_get<Transform>( current_camera_ptr->entity );
+    if( camera_transform_ptr != nullptr ) {
+        camera_view.view = camera_transform_ptr->global_affine().inverse().to_mat4();
+    }
+    return camera_view;
+}
 
-            shader_light.color = light.color();
+// bin ranged lights for the current camera and enable clustering on all programs
+static void build_clusters( entt::registry& registry, const CameraView& camera_view, LightClusters& clusters,
+        const LightBuffer& light_buffer, const std::vector<GLuint>& candidates ) {
+    auto window = registry.ctx<WindowHandler>();
+    const auto& camera = *camera_view.camera;
+    clusters.build( light_buffer.lights(), candidates, camera_view.view, camera.projection_matrix,
+            camera.near, camera.far, window->width(), window->height() );
 
-            // TODO Optimization: update matrices only once for each shader program (from a model)
-            model_view.each([&uniform_name, &shader_light](auto& model){
-                    model.program->uniform( uniform_name, shader_light );
-            });
-
-            i++;
+    auto& program_cache = registry.ctx<entt::resource_cache<ShaderProgram>>();
+    program_cache.each([&clusters](ShaderProgram& program){
+            clusters.bind( program );
     });
-    model_view.each([&light_view](auto& model){
-            model.program->uniform( "light_count", light_view.size() );
+}
+
+// shader light of an entity from its components
+static ShaderLight make_shader_light( entt::registry& registry, entt::entity entity ) {
+    const auto& transform = registry.get<Transform>( entity );
+    ShaderLight shader_light{};
+
+    bool directional = registry.has<DirectionalLight>( entity ); 
+    bool point = registry.has<PointLight>( entity ); 
+    bool spotlight = registry.has<Spotlight>( entity ); 
+
+    if( directional || spotlight ) {
+        shader_light.direction = glm::vec4{ glm::normalize( transform.global_affine().transform_vector( glm::vec3{ 0.0, 0.0, -1.0 } ) ), 0.0 };
+    }
+    if( point || spotlight ) {
+        shader_light.position = glm::vec4{ transform.global_affine().translation(), 1.0 };
+    }
+
+    if( directional ) {
+        shader_light.type = (ShaderLight::Type)(shader_light.type | ShaderLight::Type::Directional);
+    }
+    if( point ) {
+        shader_light.type = (ShaderLight::Type)(shader_light.type | ShaderLight::Type::Point);
+        shader_light.radius = registry.get<PointLight>( entity ).radius();
+    }
+    if( spotlight ) {
+        auto& spotlight_comp = registry.get<Spotlight>( entity );
+        shader_light.type = (ShaderLight::Type)(shader_light.type | ShaderLight::Type::Spotlight);
+        shader_light.inner_angle = spotlight_comp.inner();
+        shader_light.outer_angle = spotlight_comp.outer();
+        shader_light.radius = spotlight_comp.radius();
+    }
+
+    shader_light.color = registry.get<LightColor>( entity ).color();
+    return shader_light;
+}
+
+void light_system( entt::registry& registry ) {
+    auto light_buffer_ptr = registry.try_ctx<LightBuffer>();
+    if( light_buffer_ptr == nullptr ) {
+        spdlog::warn("No light buffer set!");
+        return;
+    }
+    auto& light_buffer = *light_buffer_ptr;
+
+    // repack only lights whose components changed
+    for( auto entity : light_buffer.take_changed() ) {
+        if( registry.valid( entity ) && registry.has<LightColor, Transform>( entity ) ) {
+            light_buffer.set( entity, make_shader_light( registry, entity ) );
+        } else {
+            light_buffer.remove( entity );
+        }
+    }
+    light_buffer.update();
+
+    std::vector<GLuint> clustered_lights;
+
+    auto frame_lights_ptr = registry.try_ctx<FrameLights>();
+    if( frame_lights_ptr == nullptr ) {
+        frame_lights_ptr = &registry.set<FrameLights>();
+    }
+    auto& frame_lights = *frame_lights_ptr;
+    frame_lights.clear();
+
+    // ranged lights outside of the view are skipped
+    auto camera_view = current_camera( registry );
+    std::optional<Frustum> frustum;
+    if( camera_view ) {
+        frustum.emplace( camera_view->camera->projection_matrix * camera_view->view );
+    }
+    // clusters are laid out in the camera view, without one lights go per model
+    auto clusters_ptr = camera_view ? registry.try_ctx<LightClusters>() : nullptr;
+
+    const auto& lights = light_buffer.lights();
+    const auto& bounds = light_buffer.bounds();
+    for( GLuint i=0; i<lights.size(); i++ ) {
+        // lights with a range only reach models (or clusters) they touch
+        if( !(lights[i].type & ShaderLight::Type::Directional) && lights[i].radius > 0.0 ) {
+            if( frustum && !frustum->intersects( bounds[i] ) ) {
+                frame_lights.culled++;
+            } else if( clusters_ptr != nullptr ) {
+                clustered_lights.push_back( i );
+            } else {
+                frame_lights.ranged.push_back( i );
+                frame_lights.bounds.push_back( bounds[i] );
+            }
+        } else {
+            frame_lights.global.push_back( i );
+        }
+    }
+
+    // ranged lights are appended per draw by model_system
+    auto& program_cache = registry.ctx<entt::resource_cache<ShaderProgram>>();
+    program_cache.each([&frame_lights](ShaderProgram& program){
+            LightBuffer::bind( program );
+            ShadowMaps::bind_units( program );
+            program.uniform( "light_indices", frame_lights.global );
+            program.uniform( "light_count", (GLuint)frame_lights.global.size() );
     });
+
+    if( clusters_ptr != nullptr ) {
+        build_clusters( registry, *camera_view, *clusters_ptr, light_buffer, clustered_lights );
+    } else {
+        // programs clustered in an earlier frame go back to per model lights
+        program_cache.each([](ShaderProgram& program){
+                LightClusters::bind_units( program );
+                program.uniform( "clustered", (GLuint)0 );
+        });
+    }
 } 
@@ -0,0 +1,35 @@
+#include "lod.hpp"
+
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+void LODGroup::add_level( Mesh mesh, float screen_size ) {
+    auto position = std::find_if( _levels.begin(), _levels.end(), [screen_size]( const Level& level ){
+            return level.screen_size < screen_size;
+    });
+    _levels.insert( position, Level{ mesh, screen_size } );
+}
+
+const Mesh* LODGroup::select( float screen_size ) const {
+    const Mesh* mesh = nullptr;
+    for( const auto& level : _levels ) {
+        if( screen_size >= level.screen_size ) {
+            break;
+        }
+        mesh = &level.mesh;
+    }
+    return mesh;
+}
+
+float projected_size( const Box& box, const glm::vec3& eye, const glm::mat4& projection ) {
+    auto center = ( box.min() + box.max() ) * 0.5f;
+    float radius = glm::length( box.max() - box.min() ) * 0.5f;
+    float distance = glm::length( center - eye );
+    if( distance <= radius ) {
+        return 1.0;
+    }
+    // projection[1][1] is the cotangent of half the vertical field of view
+    return radius * std::fabs( projection[1][1] ) / distance;
+}
@@ -0,0 +1,478 @@
+#include "material_buffer.hpp"
+
+#include "compressed_image.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+
+// TexturePools class
+
+TexturePools::TexturePools() {
+    // shaders take the same decision, see preprocess_shader
+    if( gl_bindless_textures_supported() ) {
+        _get_texture_handle = reinterpret_cast<PFNGLGETTEXTUREHANDLEARBPROC>( gl_extension_function( "glGetTextureHandleARB" ) );
+        _make_handle_resident = reinterpret_cast<PFNGLMAKETEXTUREHANDLERESIDENTARBPROC>( gl_extension_function( "glMakeTextureHandleResidentARB" ) );
+        _make_handle_non_resident = reinterpret_cast<PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC>( gl_extension_function( "glMakeTextureHandleNonResidentARB" ) );
+        _bindless = true;
+    }
+    if( gl_version_at_least( 4, 3 ) || gl_extension_supported( "GL_ARB_copy_image" ) ) {
+        _copy_image = reinterpret_cast<PFNGLCOPYIMAGESUBDATAPROC>( gl_extension_function( "glCopyImageSubData" ) );
+    }
+
+    if( _bindless ) {
+        glGenBuffers( 1, &_handle_buffer );
+        glBindBuffer( GL_UNIFORM_BUFFER, _handle_buffer );
+        glBufferData( GL_UNIFORM_BUFFER, MAX_POOLS * sizeof(GLuint64), nullptr, GL_DYNAMIC_DRAW );
+        glBindBuffer( GL_UNIFORM_BUFFER, 0 );
+        glBindBufferBase( GL_UNIFORM_BUFFER, HANDLES_BINDING, _handle_buffer );
+        _upload_handles();
+    }
+    spdlog::debug("Texture pools: bindless={}, copy_image={}", _bindless, _copy_image != nullptr);
+}
+
+TexturePools::~TexturePools() {
+    // textures outliving the pools keep their texels
+    for( const auto& slot : _slots ) {
+        auto texture = slot.second.texture.lock();
+        if( texture && texture->pooled() ) {
+            _restore( *texture, slot.second.slot );
+        }
+    }
+    for( auto& pool : _pools ) {
+        if( pool.handle != 0 ) {
+            _make_handle_non_resident( pool.handle );
+        }
+        glDeleteTextures( 1, &pool.texture_id );
+    }
+    if( _handle_buffer != 0 ) {
+        glDeleteBuffers( 1, &_handle_buffer );
+    }
+}
+
+GLuint TexturePools::add( Texture& texture ) {
+    auto slot_it = _slots.find( texture.id() );
+    if( slot_it != _slots.end() ) {
+        if( slot_it->second.generation == texture.generation() ) {
+            return slot_it->second.slot;
+        }
+        // storage was reduced or restored, give the layer back
+        _free( slot_it->second.slot );
+        _slots.erase( slot_it );
+    }
+
+    GLuint slot = NONE;
+    auto pool_index = _pool_for( texture );
+    if( pool_index < MAX_POOLS ) {
+        auto& pool = _pools[pool_index];
+        int layer = pool.layers;
+        if( !pool.free_layers.empty() ) {
+            layer = pool.free_layers.back();
+            pool.free_layers.pop_back();
+        } else {
+            pool.layers++;
+        }
+        _copy( texture, pool, layer );
+        slot = ( (GLuint)pool_index << 16 ) | (GLuint)layer;
+        // only shared textures can be found again to restore their storage
+        if( !texture.weak_from_this().expired() ) {
+            glDeleteTextures( 1, &texture._texture_id );
+            texture._texture_id = 0;
+            texture._pooled = true;
+        }
+    }
+    _slots[ texture.id() ] = Slot{ slot, texture.generation(), texture.weak_from_this() };
+    return slot;
+}
+
+bool TexturePools::stale( const Texture& texture ) const {
+    auto slot_it = _slots.find( texture.id() );
+    return slot_it != _slots.end() && slot_it->second.generation != texture.generation();
+}
+
+void TexturePools::release_unused( const std::unordered_set<uint64_t>& used ) {
+    for( auto slot_it = _slots.begin(); slot_it != _slots.end(); ) {
+        if( used.count( slot_it->first ) == 0 ) {
+            auto texture = slot_it->second.texture.lock();
+            if( texture && texture->pooled() ) {
+                _restore( *texture, slot_it->second.slot );
+            }
+            _free( slot_it->second.slot );
+            slot_it = _slots.erase( slot_it );
+        } else {
+            ++slot_it;
+        }
+    }
+}
+
+void TexturePools::restore( Texture& texture ) {
+    auto slot_it = _slots.find( texture.id() );
+    if( texture.pooled() && slot_it != _slots.end() ) {
+        _restore( texture, slot_it->second.slot );
+    }
+}
+
+size_t TexturePools::memory() const {
+    size_t size = 0;
+    for( const auto& pool : _pools ) {
+        if( pool.texture_id != 0 ) {
+            size += Texture::memory( pool.format, pool.width, pool.height, pool.levels ) * LAYERS_PER_POOL;
+        }
+    }
+    return size;
+}
+
+void TexturePools::bind() const {
+    if( _bindless ) {
+        return;
+    }
+    for( size_t i=0; i<_pools.size(); i++ ) {
+        glActiveTexture( GL_TEXTURE0 + FIRST_UNIT + i );
+        glBindTexture( GL_TEXTURE_2D_ARRAY, _pools[i].texture_id );
+    }
+    glActiveTexture( GL_TEXTURE0 );
+}
+
+void TexturePools::bind( ShaderProgram& program ) const {
+    if( _bindless ) {
+        program.uniform_block( "TexturePoolHandles", HANDLES_BINDING );
+        return;
+    }
+    for( unsigned int i=0; i<MAX_POOLS; i++ ) {
+        program.uniform_sampler( std::string{"texture_pools["} + std::to_string(i) + std::string{"]"}, FIRST_UNIT + i );
+    }
+}
+
+size_t TexturePools::_pool_for( const Texture& texture ) {
+    // deleted pools keep their index, shaders address pools by position
+    size_t unused = _pools.size();
+    for( size_t i=0; i<_pools.size(); i++ ) {
+        const auto& pool = _pools[i];
+        if( pool.texture_id == 0 ) {
+            unused = std::min( unused, i );
+        } else if( pool.format == texture.format() && pool.width == texture.width() && pool.height == texture.height()
+                && pool.levels == texture.levels()
+                && ( pool.layers < LAYERS_PER_POOL || !pool.free_layers.empty() ) ) {
+            return i;
+        }
+    }
+    if( unused == _pools.size() && _pools.size() >= MAX_POOLS ) {
+        spdlog::warn("No texture pool left for {}x{} texture", texture.width(), texture.height());
+        return MAX_POOLS;
+    }
+
+    Pool pool;
+    pool.format = texture.format();
+    pool.width = texture.width();
+    pool.height = texture.height();
+    pool.levels = texture.levels();
+
+    // allocate every level up front, bindless handles make the storage immutable
+    bool compressed = compressed_block_size( pool.format ) != 0;
+    glGenTextures( 1, &pool.texture_id );
+    glBindTexture( GL_TEXTURE_2D_ARRAY, pool.texture_id );
+    int width = pool.width, height = pool.height;
+    for( int level=0; level<pool.levels; level++ ) {
+        if( compressed ) {
+            auto size = compressed_level_size( pool.format, width, height ) * LAYERS_PER_POOL;
+            glCompressedTexImage3D( GL_TEXTURE_2D_ARRAY, level, pool.format, width, height, LAYERS_PER_POOL, 0, size, nullptr );
+        } else {
+            glTexImage3D( GL_TEXTURE_2D_ARRAY, level, pool.format, width, height, LAYERS_PER_POOL, 0, pool.format, GL_UNSIGNED_BYTE, nullptr );
+        }
+        width = std::max( 1, width / 2 );
+        height = std::max( 1, height / 2 );
+    }
+    glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, pool.levels - 1 );
+    glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT );
+    glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT );
+    glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, pool.levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR );
+    glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+    glBindTexture( GL_TEXTURE_2D_ARRAY, 0 );
+
+    if( _bindless ) {
+        pool.handle = _get_texture_handle( pool.texture_id );
+        _make_handle_resident( pool.handle );
+    }
+    if( unused == _pools.size() ) {
+        _pools.push_back( pool );
+    } else {
+        _pools[unused] = pool;
+    }
+
+    if( _bindless ) {
+        _upload_handles();
+    } else {
+        bind();
+    }
+
+    spdlog::debug("Created texture pool {} ({}x{}, format {:#x}, {} levels)", unused, pool.width, pool.height, pool.format, pool.levels);
+    return unused;
+}
+
+void TexturePools::_copy( const Texture& texture, const Pool& pool, int layer ) const {
+    int width = pool.width, height = pool.height;
+
+    if( _copy_image != nullptr ) {
+        for( int level=0; level<pool.levels; level++ ) {
+            _copy_image( texture, GL_TEXTURE_2D, level, 0, 0, 0, pool.texture_id, GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1 );
+            width = std::max( 1, width / 2 );
+            height = std::max( 1, height / 2 );
+        }
+        return;
+    }
+
+    // plain 3.3 contexts read the levels back through client memory
+    bool compressed = compressed_block_size( pool.format ) != 0;
+    std::vector<unsigned char> data;
+    glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+    glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+    glBindTexture( GL_TEXTURE_2D, texture );
+    glBindTexture( GL_TEXTURE_2D_ARRAY, pool.texture_id );
+    for( int level=0; level<pool.levels; level++ ) {
+        if( compressed ) {
+            GLint size = 0;
+            glGetTexLevelParameteriv( GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size );
+            data.resize( size );
+            glGetCompressedTexImage( GL_TEXTURE_2D, level, data.data() );
+            glCompressedTexSubImage3D( GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1, pool.format, size, data.data() );
+        } else {
+            int channels = pool.format == GL_RGBA ? 4 : 3;
+            data.resize( (size_t)width * height * channels );
+            glGetTexImage( GL_TEXTURE_2D, level, pool.format, GL_UNSIGNED_BYTE, data.data() );
+            glTexSubImage3D( GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1, pool.format, GL_UNSIGNED_BYTE, data.data() );
+        }
+        width = std::max( 1, width / 2 );
+        height = std::max( 1, height / 2 );
+    }
+    glBindTexture( GL_TEXTURE_2D_ARRAY, 0 );
+    glBindTexture( GL_TEXTURE_2D, 0 );
+    glPixelStorei( GL_PACK_ALIGNMENT, 4 );
+    glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+}
+
+void TexturePools::_restore( Texture& texture, GLuint slot ) const {
+    const auto& pool = _pools[ slot >> 16 ];
+    int layer = slot & 0xFFFF;
+    bool compressed = compressed_block_size( pool.format ) != 0;
+
+    GLuint texture_id;
+    glGenTextures( 1, &texture_id );
+    glBindTexture( GL_TEXTURE_2D, texture_id );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, pool.levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, pool.levels - 1 );
+    int width = pool.width, height = pool.height;
+    for( int level=0; level<pool.levels; level++ ) {
+        if( compressed ) {
+            glCompressedTexImage2D( GL_TEXTURE_2D, level, pool.format, width, height, 0, compressed_level_size( pool.format, width, height ), nullptr );
+        } else {
+            glTexImage2D( GL_TEXTURE_2D, level, pool.format, width, height, 0, pool.format, GL_UNSIGNED_BYTE, nullptr );
+        }
+        width = std::max( 1, width / 2 );
+        height = std::max( 1, height / 2 );
+    }
+    glBindTexture( GL_TEXTURE_2D, 0 );
+
+    width = pool.width;
+    height = pool.height;
+    if( _copy_image != nullptr ) {
+        for( int level=0; level<pool.levels; level++ ) {
+            _copy_image( pool.texture_id, GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, texture_id, GL_TEXTURE_2D, level, 0, 0, 0, width, height, 1 );
+            width = std::max( 1, width / 2 );
+            height = std::max( 1, height / 2 );
+        }
+    } else {
+        // array levels are read back with every layer, only this one is kept
+        std::vector<unsigned char> data;
+        glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+        glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+        glBindTexture( GL_TEXTURE_2D_ARRAY, pool.texture_id );
+        glBindTexture( GL_TEXTURE_2D, texture_id );
+        for( int level=0; level<pool.levels; level++ ) {
+            if( compressed ) {
+                size_t size = compressed_level_size( pool.format, width, height );
+                data.resize( size * LAYERS_PER_POOL );
+                glGetCompressedTexImage( GL_TEXTURE_2D_ARRAY, level, data.data() );
+                glCompressedTexSubImage2D( GL_TEXTURE_2D, level, 0, 0, width, height, pool.format, size, data.data() + layer * size );
+            } else {
+                size_t size = (size_t)width * height * ( pool.format == GL_RGBA ? 4 : 3 );
+                data.resize( size * LAYERS_PER_POOL );
+                glGetTexImage( GL_TEXTURE_2D_ARRAY, level, pool.format, GL_UNSIGNED_BYTE, data.data() );
+                glTexSubImage2D( GL_TEXTURE_2D, level, 0, 0, width, height, pool.format, GL_UNSIGNED_BYTE, data.data() + layer * size );
+            }
+            width = std::max( 1, width / 2 );
+            height = std::max( 1, height / 2 );
+        }
+        glBindTexture( GL_TEXTURE_2D, 0 );
+        glBindTexture( GL_TEXTURE_2D_ARRAY, 0 );
+        glPixelStorei( GL_PACK_ALIGNMENT, 4 );
+        glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+    }
+
+    texture._texture_id = texture_id;
+    texture._pooled = false;
+}
+
+void TexturePools::_free( GLuint slot ) {
+    if( slot == NONE ) {
+        return;
+    }
+    auto& pool = _pools[ slot >> 16 ];
+    pool.free_layers.push_back( slot & 0xFFFF );
+    if( (int)pool.free_layers.size() < pool.layers ) {
+        return;
+    }
+
+    // the arrays are allocated whole, only an empty pool gives memory back
+    if( pool.handle != 0 ) {
+        _make_handle_non_resident( pool.handle );
+    }
+    glDeleteTextures( 1, &pool.texture_id );
+    spdlog::debug("Deleted texture pool {} ({}x{})", slot >> 16, pool.width, pool.height);
+    pool = Pool{};
+    if( _bindless ) {
+        _upload_handles();
+    } else {
+        bind();
+    }
+}
+
+void TexturePools::_upload_handles() const {
+    // pairs of handles are read as uvec4 in the shader
+    std::vector<GLuint64> handles( MAX_POOLS, 0 );
+    for( size_t i=0; i<_pools.size(); i++ ) {
+        handles[i] = _pools[i].handle;
+    }
+    glBindBuffer( GL_UNIFORM_BUFFER, _handle_buffer );
+    glBufferSubData( GL_UNIFORM_BUFFER, 0, handles.size() * sizeof(GLuint64), handles.data() );
+    glBindBuffer( GL_UNIFORM_BUFFER, 0 );
+}
+
+// MaterialBuffer class
+
+MaterialBuffer::MaterialBuffer() {
+    glGenBuffers( 1, &_buffer );
+    glBindBuffer( GL_UNIFORM_BUFFER, _buffer );
+    glBufferData( GL_UNIFORM_BUFFER, MAX_MATERIALS * sizeof(Entry), nullptr, GL_DYNAMIC_DRAW );
+    glBindBuffer( GL_UNIFORM_BUFFER, 0 );
+    glBindBufferBase( GL_UNIFORM_BUFFER, BINDING, _buffer );
+
+    _materials.emplace_back();
+    _upload( 0 );
+}
+
+MaterialBuffer::~MaterialBuffer() {
+    glDeleteBuffers( 1, &_buffer );
+}
+
+GLuint MaterialBuffer::index( Material& material ) {
+    if( material._index == 0 ) {
+        if( _materials.size() >= MAX_MATERIALS ) {
+            if( !_full_warned ) {
+                spdlog::warn("Material buffer full ({} materials), using default material", MAX_MATERIALS);
+                _full_warned = true;
+            }
+            return 0;
+        }
+        material._index = _materials.size();
+        material._entry = std::make_shared<GLuint>( material._index );
+        _materials.push_back( material );
+        _materials.back()._entry.reset();
+    } else if( material._changed ) {
+        _materials[ material._index ] = material;
+        _materials[ material._index ]._entry.reset();
+        // the replaced textures may have been the last users of their layers
+        _release = true;
+    } else {
+        return material._index;
+    }
+    material._changed = false;
+    _upload( material._index );
+    return material._index;
+}
+
+void MaterialBuffer::update() {
+    // materials whose textures finished streaming or were resized
+    std::vector<GLuint> ready;
+    for( GLuint index=0; index<_materials.size(); index++ ) {
+        const auto& material = _materials[index];
+        bool streaming = false, stale = false;
+        for( const auto& textures : { &material.diffuse_textures(), &material.specular_textures() } ) {
+            for( const auto& texture : *textures ) {
+                streaming = streaming || ( texture && texture->streaming() );
+                stale = stale || ( texture && _pools.stale( *texture ) );
+            }
+        }
+        if( !streaming && ( stale || _pending.count( index ) != 0 ) ) {
+            ready.push_back( index );
+        }
+    }
+    for( auto index : ready ) {
+        _upload( index );
+    }
+
+    if( _release ) {
+        std::unordered_set<uint64_t> used;
+        for( const auto& material : _materials ) {
+            for( const auto& textures : { &material.diffuse_textures(), &material.specular_textures() } ) {
+                for( const auto& texture : *textures ) {
+                    if( texture ) {
+                        used.insert( texture->id() );
+                    }
+                }
+            }
+        }
+        _pools.release_unused( used );
+        _release = false;
+    }
+    _pools.bind();
+}
+
+void MaterialBuffer::bind( ShaderProgram& program ) {
+    auto bound_it = _bound.find( program );
+    if( bound_it != _bound.end() && bound_it->second == program.id() ) {
+        return;
+    }
+    program.uniform_block( "Materials", BINDING );
+    _pools.bind( program );
+    _bound[ program ] = program.id();
+}
+
+void MaterialBuffer::_upload( GLuint index ) {
+    auto& material = _materials[index];
+
+    Entry entry;
+    entry.ambient = glm::vec4{ material.ambient(), 0.0 };
+    entry.diffuse = glm::vec4{ material.diffuse(), 0.0 };
+    entry.specular = glm::vec4{ material.specular(), material.shininess() };
+    std::fill( std::begin(entry.textures), std::end(entry.textures), TexturePools::NONE );
+
+    // the shader samples up to two diffuse and two specular textures
+    bool pending = false;
+    auto place = [this, &pending]( auto& textures, GLuint* slots ) {
+        for( size_t i=0; i<std::min<size_t>( 2, textures.size() ); i++ ) {
+            if( !textures[i] ) {
+                continue;
+            }
+            if( textures[i]->streaming() ) {
+                pending = true;
+            } else {
+                slots[i] = _pools.add( *textures[i] );
+            }
+        }
+    };
+    place( material._diffuse_textures, entry.textures );
+    place( material._specular_textures, entry.textures + 2 );
+
+    glBindBuffer( GL_UNIFORM_BUFFER, _buffer );
+    glBufferSubData( GL_UNIFORM_BUFFER, index * sizeof(Entry), sizeof(Entry), &entry );
+    glBindBuffer( GL_UNIFORM_BUFFER, 0 );
+
+    if( pending ) {
+        _pending.insert( index );
+    } else {
+        _pending.erase( index );
+    }
+}
@@ -2,27 +2,127 @@
 
 #include "matrix_op.hpp"
 
+#include "glm/vec2.hpp"
+
 #include "spdlog/spdlog.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <string>
+
+
+// Throws if the attributes can't make a mesh
+static void check_attributes(
+        size_t vertex_count,
+        size_t color_count,
+        size_t normal_count,
+        size_t texcoord_count,
+        size_t skin_count,
+        GLenum index_type
+) {
+    if( index_type == GL_UNSIGNED_SHORT && vertex_count > std::numeric_limits<GLushort>::max() + 1u ) {
+        throw MeshCreationException{"Too many vertices for 16-bit indices!"};
+    }
+    if( color_count != 0 && color_count != vertex_count ) {
+        throw MeshCreationException{"Number of color attributes must be equal to vertices or zero!"};
+    }
+    if( normal_count != 0 && normal_count != vertex_count ) {
+        throw MeshCreationException{"Number of normal attributes must be equal to vertices or zero!"};
+    }
+    if( texcoord_count != 0 && texcoord_count != vertex_count ) {
+        throw MeshCreationException{"Number of texture coordinate attributes must be equal to vertices or zero!"};
+    }
+    if( skin_count != 0 && skin_count != vertex_count ) {
+        throw MeshCreationException{"Number of skin attributes must be equal to vertices or zero!"};
+    }
+}
+
+// 16-bit copy of indices that all fit
+static std::vector<GLushort> narrow( const std::vector<GLuint>& indices ) {
+    return std::vector<GLushort>( indices.begin(), indices.end() );
+}
+
+VertexSkin VertexSkin::from_influences( std::vector<std::pair<unsigned int, float>> influences ) {
+    VertexSkin skin;
+    std::sort( influences.begin(), influences.end(), []( const auto& a, const auto& b ){
+            return a.second > b.second;
+    });
+    if( influences.size() > MAX_INFLUENCES ) {
+        influences.resize( MAX_INFLUENCES );
+    }
+    float total = 0.0;
+    for( const auto& influence : influences ) {
+        total += std::max( influence.second, 0.0f );
+    }
+    if( total <= 0.0 ) {
+        skin.weights[0] = 255;
+        return skin;
+    }
+    // rounding error goes to the largest weight so the sum stays exact
+    int sum = 0;
+    for( size_t i=0; i<influences.size(); i++ ) {
+        if( influences[i].first >= MAX_JOINTS ) {
+            throw MeshCreationException{"Skin joint index must be below 256!"};
+        }
+        skin.joints[i] = influences[i].first;
+        skin.weights[i] = std::lround( std::max( influences[i].second, 0.0f ) / total * 255.0f );
+        sum += skin.weights[i];
+    }
+    skin.weights[0] += 255 - sum;
+    return skin;
+}
+
+size_t MeshData::upload_size() const {
+    return sizeof(GLfloat) * ( vertices.size()*4 + colors.size()*4 + normals.size()*4 + texcoords.size()*2 )
+        + skins.size() * sizeof(VertexSkin)
+        + indices.size() * ( index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint) );
+}
 
 Mesh::Mesh( 
         const std::vector<GLuint>& indices,
         const std::vector<glm::vec4>& vertices, 
         const std::vector<glm::vec4>& colors,
         const std::vector<glm::vec4>& normals,
-        const std::vector<glm::vec2>& texcoords
-) {
-    // Check sizes
-    if( colors.size() != 0 && colors.size() != vertices.size() ) {
-        throw MeshCreationException{"Number of color attributes must be equal to vertices or zero!"};
+        const std::vector<glm::vec2>& texcoords,
+        GLenum index_type
+) : _index_type{index_type}, _ref_counter{std::make_shared<bool>(true)} {
+    check_attributes( vertices.size(), colors.size(), normals.size(), texcoords.size(), 0, index_type );
+
+    for( const auto& vertex : vertices ) {
+        _bounding_box += Box{ glm::vec3{vertex}, glm::vec3{vertex} };
     }
-    if( normals.size() != 0 && normals.size() != vertices.size() ) {
-        throw MeshCreationException{"Number of normal attributes must be equal to vertices or zero!"};
+    if( index_type == GL_UNSIGNED_SHORT ) {
+        auto short_indices = narrow( indices );
+        _upload( short_indices.data(), short_indices.size(), vertices, colors, normals, texcoords, {} );
+    } else {
+        _upload( indices.data(), indices.size(), vertices, colors, normals, texcoords, {} );
     }
-    if( texcoords.size() != 0 && texcoords.size() != vertices.size() ) {
-        throw MeshCreationException{"Number of texture coordinate attributes must be equal to vertices or zero!"};
+}
+
+Mesh::Mesh( const MeshData& data )
+    : _index_type{data.index_type}, _bounding_box{data.bounding_box}, _geometry{data.geometry}, _ref_counter{std::make_shared<bool>(true)} {
+    check_attributes( data.vertices.size(), data.colors.size(), data.normals.size(), data.texcoords.size(), data.skins.size(), data.index_type );
+    if( data.index_type != GL_UNSIGNED_SHORT ) {
+        _upload( data.indices.data(), data.indices.size(), data.vertices, data.colors, data.normals, data.texcoords, data.skins );
+    } else if( data.short_indices.size() == data.indices.size() ) {
+        _upload( data.short_indices.data(), data.short_indices.size(), data.vertices, data.colors, data.normals, data.texcoords, data.skins );
+    } else {
+        // data not baked by MeshBuilder
+        auto short_indices = narrow( data.indices );
+        _upload( short_indices.data(), short_indices.size(), data.vertices, data.colors, data.normals, data.texcoords, data.skins );
     }
+}
 
+void Mesh::_upload(
+        const void* indices,
+        size_t index_count,
+        const std::vector<glm::vec4>& vertices,
+        const std::vector<glm::vec4>& colors,
+        const std::vector<glm::vec4>& normals,
+        const std::vector<glm::vec2>& texcoords,
+        const std::vector<VertexSkin>& skins
+) {
     // Create vertex array object
     glGenVertexArrays(1, &_vao);
     glBindVertexArray(_vao);
@@ -100,36 +200,125 @@ Mesh::Mesh(
     }
 
 
+    // joint indices and weights interleaved, 8 bytes per vertex
+    if( skins.size() > 0 ) {
+        GLuint skin_buffer;
+        glGenBuffers(1, &skin_buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, skin_buffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(VertexSkin)*skins.size(), skins.data(), GL_STATIC_DRAW);
+
+        // Bind to Vao, indices stay integers, weights are normalized
+        glVertexAttribIPointer(4, 4, GL_UNSIGNED_BYTE, sizeof(VertexSkin), (GLvoid*)offsetof(VertexSkin, joints));
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(5, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(VertexSkin), (GLvoid*)offsetof(VertexSkin, weights));
+        glEnableVertexAttribArray(5);
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        _skin_buffer = skin_buffer;
+    }
+
+    _vertex_memory = sizeof(GLfloat) * ( vertices.size()*4 + colors.size()*4 + normals.size()*4 + texcoords.size()*2 )
+        + sizeof(VertexSkin) * skins.size();
+
     // create index array
-    _index_array_size = indices.size();
+    _index_array_size = index_count;
 
     // Create index buffer
     GLuint index_buffer;
     glGenBuffers(1, &index_buffer);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint)*_index_array_size, NULL, GL_STATIC_DRAW);
-    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, sizeof(GLfloat)*_index_array_size, indices.data());
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_memory(), indices, GL_STATIC_DRAW);
 
 
     glBindVertexArray(0);
-    _index_buffer = vertex_buffer;
+    _index_buffer = index_buffer;
+
+    // position only vertex array for depth passes
+    glGenVertexArrays(1, &_position_vao);
+    glBindVertexArray(_position_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
 }
 
 Mesh::~Mesh() {
+    _release();
+}
+
+Mesh& Mesh::operator=( const Mesh& other ) {
+    if( this != &other ) {
+        // a copy keeps the shared objects alive while this one drops its own
+        Mesh copy{ other };
+        _release();
+        _assign( copy );
+    }
+    return *this;
+}
+
+Mesh& Mesh::operator=( Mesh&& other ) {
+    if( this != &other ) {
+        _release();
+        _assign( other );
+        // the moved from mesh no longer owns the objects
+        other._ref_counter.reset();
+        other._geometry.reset();
+    }
+    return *this;
+}
+
+void Mesh::_release() {
     if( _ref_counter.unique() ) {
         glDeleteBuffers(1, &_vertex_buffer);
         glDeleteBuffers(1, &_normal_buffer);
         glDeleteBuffers(1, &_color_buffer);
         glDeleteBuffers(1, &_texcoord_buffer);
+        glDeleteBuffers(1, &_skin_buffer);
         glDeleteBuffers(1, &_index_buffer);
+        glDeleteVertexArrays(1, &_vao);
+        glDeleteVertexArrays(1, &_position_vao);
     }
+    _ref_counter.reset();
+}
+
+void Mesh::_assign( const Mesh& other ) {
+    _index_buffer = other._index_buffer;
+    _vertex_buffer = other._vertex_buffer;
+    _color_buffer = other._color_buffer;
+    _normal_buffer = other._normal_buffer;
+    _texcoord_buffer = other._texcoord_buffer;
+    _skin_buffer = other._skin_buffer;
+    _vao = other._vao;
+    _position_vao = other._position_vao;
+    _index_array_size = other._index_array_size;
+    _index_type = other._index_type;
+    _vertex_memory = other._vertex_memory;
+    _bounding_box = other._bounding_box;
+    _geometry = other._geometry;
+    _ref_counter = other._ref_counter;
 }
 
 void Mesh::draw( const ShaderProgram& program ) const {
     program.use();
     glBindVertexArray(_vao);
-    glDrawElements(GL_TRIANGLES, _index_array_size, GL_UNSIGNED_INT, (GLvoid*)0);
+    glDrawElements(GL_TRIANGLES, _index_array_size, _index_type, (GLvoid*)0);
+    glBindVertexArray(0);
+}
+
+void Mesh::draw_instanced( const ShaderProgram& program, GLsizei count ) const {
+    program.use();
+    glBindVertexArray(_vao);
+    glDrawElementsInstanced(GL_TRIANGLES, _index_array_size, _index_type, (GLvoid*)0, count);
+    glBindVertexArray(0);
+}
+
+void Mesh::draw_positions( const ShaderProgram& program ) const {
+    program.use();
+    glBindVertexArray(_position_vao);
+    glDrawElements(GL_TRIANGLES, _index_array_size, _index_type, (GLvoid*)0);
     glBindVertexArray(0);
 }
 
@@ -161,6 +350,12 @@ void MeshBuilder::add_texcoord( glm::vec2 t, unsigned int count ) {
 
 
 
+void MeshBuilder::add_skin( const VertexSkin& skin, unsigned int count ) {
+    for( unsigned int i=0; i<count; i++ ) {
+        _skins.push_back( skin );
+    }
+}
+
 void MeshBuilder::add_index( GLuint index ) {
     _indices.push_back( index );
 }
@@ -253,27 +448,49 @@ void MeshBuilder::cylinder( glm::vec3 radius_angle, glm::vec3 up_height, unsigne
 
 }
 
+// edges or triangles of an icosphere level per pool task
+static constexpr size_t ICOSPHERE_GRAIN = 16384;
+
 // Add icosphere
-void MeshBuilder::icosphere( float radius, unsigned int divisions, glm::vec3 position ) {
-    auto prev_num_vertices = _vertices.size();
+void MeshBuilder::icosphere( float radius, unsigned int divisions, glm::vec3 position, ThreadPool* pool ) {
+    // each level adds a vertex per edge, halves every edge, adds three edges
+    // inside every triangle and quadruples the triangles
+    size_t vertex_count = 12, edge_count = 30, triangle_count = 20;
+    for( unsigned int d=0; d < divisions; d++ ) {
+        vertex_count += edge_count;
+        edge_count = 2*edge_count + 3*triangle_count;
+        triangle_count *= 4;
+    }
+    if( _vertices.size() + vertex_count > std::numeric_limits<GLuint>::max() ) {
+        throw MeshCreationException{"Icosphere with " + std::to_string( divisions ) + " divisions has too many vertices"};
+    }
+    auto for_range = [pool]( size_t count, auto f ){
+        if( pool != nullptr ) {
+            pool->parallel_for( 0, count, f, ICOSPHERE_GRAIN );
+        } else {
+            f( 0, count );
+        }
+    };
 
     std::vector<glm::vec3> vertices;
     std::vector<glm::uvec3> triangles;
+    vertices.reserve( vertex_count );
+    triangles.reserve( triangle_count );
 
     auto g = (1.0f + sqrt(5.f)) / 2.f;
 
     vertices.push_back(glm::normalize(glm::vec3{-1, g, 0}));
-    vertices.push_back(glm::normalize(normalize(glm::vec3{1, g, 0})));
-    vertices.push_back(glm::normalize(normalize(glm::vec3{-1, -g, 0})));
-    vertices.push_back(glm::normalize(normalize(glm::vec3{1, -g, 0})));
-    vertices.push_back(glm::normalize(normalize(glm::vec3{0, -1, g})));
-    vertices.push_back(glm::normalize(normalize(glm::vec3{0, 1, g})));
-    vertices.push_back(glm::normalize(normalize(glm::vec3{0, -1, -g})));
-    vertices.push_back(glm::normalize(normalize(glm::vec3{0, 1, -g})));
-    vertices.push_back(glm::normalize(normalize(glm::vec3{g, 0, -1})));
-    vertices.push_back(glm::normalize(normalize(glm::vec3{g, 0, 1})));
-    vertices.push_back(glm::normalize(normalize(glm::vec3{-g, 0, -1})));
-    vertices.push_back(glm::normalize(normalize(glm::vec3{-g, 0, 1})));
+    vertices.push_back(glm::normalize(glm::vec3{1, g, 0}));
+    vertices.push_back(glm::normalize(glm::vec3{-1, -g, 0}));
+    vertices.push_back(glm::normalize(glm::vec3{1, -g, 0}));
+    vertices.push_back(glm::normalize(glm::vec3{0, -1, g}));
+    vertices.push_back(glm::normalize(glm::vec3{0, 1, g}));
+    vertices.push_back(glm::normalize(glm::vec3{0, -1, -g}));
+    vertices.push_back(glm::normalize(glm::vec3{0, 1, -g}));
+    vertices.push_back(glm::normalize(glm::vec3{g, 0, -1}));
+    vertices.push_back(glm::normalize(glm::vec3{g, 0, 1}));
+    vertices.push_back(glm::normalize(glm::vec3{-g, 0, -1}));
+    vertices.push_back(glm::normalize(glm::vec3{-g, 0, 1}));
 
     triangles.push_back( {0, 11, 5} );
     triangles.push_back ( {0, 5 ,1 } );
@@ -296,45 +513,151 @@ void MeshBuilder::icosphere( float radius, unsigned int divisions, glm::vec3 pos
     triangles.push_back( { 8 ,    6 ,    7} );
     triangles.push_back( { 9 ,    8 ,    1} );
 
-    for( unsigned int d=0; d < divisions; d++ ) {
-        std::vector<glm::uvec3> new_triangles;
-        std::map<std::pair<unsigned int, unsigned int>, unsigned int> middle_vertices;
-
+    // edges as vertex pairs and the edges of each triangle (xy, yz, zx), the
+    // middle vertex of an edge is the vertex count plus the edge's index, so
+    // no edge is looked up
+    std::vector<glm::uvec2> edges;
+    std::vector<glm::uvec3> triangle_edges;
+    if( divisions > 0 ) {
         for( const auto& triangle : triangles ) {
-            auto mid_xy = _get_middle_vertex( middle_vertices, vertices, {triangle.x, triangle.y} );
-            auto mid_yz = _get_middle_vertex( middle_vertices, vertices, {triangle.y, triangle.z} );
-            auto mid_zx = _get_middle_vertex( middle_vertices, vertices, {triangle.z, triangle.x} );
-            new_triangles.push_back( {triangle.x, mid_xy, mid_zx} );
-            new_triangles.push_back( {triangle.y, mid_yz, mid_xy} );
-            new_triangles.push_back( {triangle.z, mid_zx, mid_yz} );
-            new_triangles.push_back( {mid_xy, mid_yz, mid_zx} );
+            glm::uvec3 triangle_edge;
+            for( int i=0; i<3; i++ ) {
+                glm::uvec2 edge{ triangle[i], triangle[(i+1)%3] };
+                auto found = std::find_if( edges.begin(), edges.end(), [&edge]( const glm::uvec2& other ){
+                        return other.x == edge.y && other.y == edge.x;
+                });
+                triangle_edge[i] = found - edges.begin();
+                if( found == edges.end() ) {
+                    edges.push_back( edge );
+                }
+            }
+            triangle_edges.push_back( triangle_edge );
         }
-
-        triangles = std::move( new_triangles );
     }
 
-    for( const auto& vertex : vertices ) {
-        add_vertex( position + radius * vertex );
-        add_normal( vertex );
-    }
+    std::vector<glm::uvec2> new_edges;
+    std::vector<glm::uvec3> new_triangles, new_triangle_edges;
+    for( unsigned int d=0; d < divisions; d++ ) {
+        GLuint first_middle = vertices.size();
+        vertices.resize( vertices.size() + edges.size() );
+        new_triangles.resize( 4*triangles.size() );
+        // the last level only needs the triangles
+        bool last = d + 1 == divisions;
+        if( !last ) {
+            new_edges.resize( 2*edges.size() + 3*triangles.size() );
+            new_triangle_edges.resize( 4*triangles.size() );
+        }
 
-    for( const auto& triangle : triangles ) {
-        add_index( prev_num_vertices + triangle.x );
-        add_index( prev_num_vertices + triangle.y );
-        add_index( prev_num_vertices + triangle.z );
+        for_range( edges.size(), [&]( size_t begin, size_t end ){
+                for( size_t e=begin; e<end; e++ ) {
+                    GLuint middle = first_middle + e;
+                    vertices[middle] = glm::normalize( vertices[ edges[e].x ] + vertices[ edges[e].y ] );
+                    if( !last ) {
+                        // half 2e starts at the edge's first vertex
+                        new_edges[2*e] = glm::uvec2{ edges[e].x, middle };
+                        new_edges[2*e + 1] = glm::uvec2{ middle, edges[e].y };
+                    }
+                }
+        });
+        for_range( triangles.size(), [&]( size_t begin, size_t end ){
+                for( size_t t=begin; t<end; t++ ) {
+                    const auto& triangle = triangles[t];
+                    const auto& triangle_edge = triangle_edges[t];
+                    GLuint mid_xy = first_middle + triangle_edge.x;
+                    GLuint mid_yz = first_middle + triangle_edge.y;
+                    GLuint mid_zx = first_middle + triangle_edge.z;
+                    new_triangles[4*t] = {triangle.x, mid_xy, mid_zx};
+                    new_triangles[4*t + 1] = {triangle.y, mid_yz, mid_xy};
+                    new_triangles[4*t + 2] = {triangle.z, mid_zx, mid_yz};
+                    new_triangles[4*t + 3] = {mid_xy, mid_yz, mid_zx};
+                    if( last ) {
+                        continue;
+                    }
+                    // halves of the triangle's edges touching a corner
+                    auto half = [&edges]( GLuint edge, GLuint vertex ){
+                        return edges[edge].x == vertex ? 2*edge : 2*edge + 1;
+                    };
+                    // inner edges opposite of x, y and z
+                    GLuint inner = 2*edges.size() + 3*t;
+                    new_edges[inner] = glm::uvec2{ mid_xy, mid_zx };
+                    new_edges[inner + 1] = glm::uvec2{ mid_yz, mid_xy };
+                    new_edges[inner + 2] = glm::uvec2{ mid_zx, mid_yz };
+                    new_triangle_edges[4*t] = { half( triangle_edge.x, triangle.x ), inner, half( triangle_edge.z, triangle.x ) };
+                    new_triangle_edges[4*t + 1] = { half( triangle_edge.y, triangle.y ), inner + 1, half( triangle_edge.x, triangle.y ) };
+                    new_triangle_edges[4*t + 2] = { half( triangle_edge.z, triangle.z ), inner + 2, half( triangle_edge.y, triangle.z ) };
+                    new_triangle_edges[4*t + 3] = { inner + 1, inner + 2, inner };
+                }
+        });
+
+        triangles.swap( new_triangles );
+        if( !last ) {
+            edges.swap( new_edges );
+            triangle_edges.swap( new_triangle_edges );
+        }
     }
 
+    size_t first_vertex = _vertices.size();
+    size_t first_normal = _normals.size();
+    size_t first_index = _indices.size();
+    _vertices.resize( first_vertex + vertices.size() );
+    _normals.resize( first_normal + vertices.size() );
+    _indices.resize( first_index + 3*triangles.size() );
+    for_range( vertices.size(), [&]( size_t begin, size_t end ){
+            for( size_t i=begin; i<end; i++ ) {
+                _vertices[first_vertex + i] = glm::vec4{ position + radius * vertices[i], 1.0 };
+                _normals[first_normal + i] = glm::vec4{ vertices[i], 0.0 };
+            }
+    });
+    for_range( triangles.size(), [&]( size_t begin, size_t end ){
+            for( size_t i=begin; i<end; i++ ) {
+                _indices[first_index + 3*i] = first_vertex + triangles[i].x;
+                _indices[first_index + 3*i + 1] = first_vertex + triangles[i].y;
+                _indices[first_index + 3*i + 2] = first_vertex + triangles[i].z;
+            }
+    });
 }
 
-Mesh MeshBuilder::build() {
-    // if no indices are set use sequence of number of vertices TODO: should not modify _indices
+std::shared_ptr<const MeshData> MeshBuilder::bake() const {
+    auto data = std::make_shared<MeshData>();
+    data->vertices = _vertices;
+    data->colors = _colors;
+    data->normals = _normals;
+    data->texcoords = _texcoords;
+    data->skins = _skins;
+    // if no indices are set use sequence of number of vertices
     if( _vertices.size() > 0 && _indices.size() == 0 ) {
+        data->indices.resize( _vertices.size() );
         for( unsigned int i=0; i<_vertices.size(); i++ ) {
-            _indices.push_back(i);
+            data->indices[i] = i;
+        }
+    } else {
+        data->indices = _indices;
+    }
+    // 16-bit indices when every vertex can be addressed
+    data->index_type = _vertices.size() <= std::numeric_limits<GLushort>::max() + 1u ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    check_attributes( data->vertices.size(), data->colors.size(), data->normals.size(), data->texcoords.size(), data->skins.size(), data->index_type );
+    // narrowed here so the render thread uploads them as they are
+    if( data->index_type == GL_UNSIGNED_SHORT ) {
+        data->short_indices = narrow( data->indices );
+    }
+
+    for( const auto& vertex : _vertices ) {
+        data->bounding_box += Box{ glm::vec3{vertex}, glm::vec3{vertex} };
+    }
+    if( _retain_geometry ) {
+        std::vector<glm::vec3> positions;
+        positions.reserve( _vertices.size() );
+        for( const auto& vertex : _vertices ) {
+            positions.emplace_back( vertex );
         }
+        data->geometry = std::make_shared<MeshGeometry>( std::move(positions), data->indices );
+        data->geometry->build_bvh( _geometry_pool );
     }
+    return data;
+}
 
-    return Mesh{ _indices, _vertices, _colors, _normals, _texcoords };
+Mesh MeshBuilder::build() {
+    return Mesh{ *bake() };
 }
 
 Box MeshBuilder::bounding_box( const glm::mat4& transform ) {
@@ -345,23 +668,9 @@ Box MeshBuilder::bounding_box( const glm::mat4& transform ) {
         p1.x = std::min(p1.x, v.x);
         p1.y = std::min(p1.y, v.y);
         p1.z = std::min(p1.z, v.z);
-        p2.x = std::max(p1.x, v.x);
-        p2.y = std::max(p1.y, v.y);
-        p2.z = std::max(p1.z, v.z);
+        p2.x = std::max(p2.x, v.x);
+        p2.y = std::max(p2.y, v.y);
+        p2.z = std::max(p2.z, v.z);
     }
     return Box{ p1, p2 };
 }
-
-unsigned int MeshBuilder::_get_middle_vertex( std::map<std::pair<unsigned int, unsigned int>, unsigned int>& mp_map, std::vector<glm::vec3>& vertices, std::pair<unsigned int, unsigned int> segment ) {
-    if( mp_map.count( segment ) == 1 ) {
-        return mp_map.at(segment);
-    }
-    auto inverted = std::pair{ segment.second, segment.first };
-    if( mp_map.count( inverted ) ) {
-        return mp_map.at( inverted );
-    } 
-    auto middle_point = glm::normalize( vertices[ segment.first ] + vertices[ segment.second ] );
-    vertices.push_back( middle_point );
-    mp_map[ segment ] = vertices.size()-1;
-    return vertices.size() - 1;
-}
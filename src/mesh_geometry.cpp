@@ -0,0 +1,206 @@
+#include "mesh_geometry.hpp"
+
+#include "mesh.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // cooked geometry header
+    constexpr char MAGIC[4] = { 'R', 'M', 'G', '1' };
+
+    // Möller-Trumbore, both faces, returns distance and the weights of v1 and v2
+    bool intersect_triangle( const glm::vec3& origin, const glm::vec3& direction,
+            const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2,
+            float& distance, float& u, float& v ) {
+        auto edge1 = v1 - v0;
+        auto edge2 = v2 - v0;
+        auto p = glm::cross( direction, edge2 );
+        float determinant = glm::dot( edge1, p );
+        if( std::abs( determinant ) < std::numeric_limits<float>::epsilon() ) {
+            return false;
+        }
+        float inverse = 1.0f / determinant;
+        auto s = origin - v0;
+        u = glm::dot( s, p ) * inverse;
+        if( u < 0.0 || u > 1.0 ) {
+            return false;
+        }
+        auto q = glm::cross( s, edge1 );
+        v = glm::dot( direction, q ) * inverse;
+        if( v < 0.0 || u + v > 1.0 ) {
+            return false;
+        }
+        distance = glm::dot( edge2, q ) * inverse;
+        return distance >= 0.0;
+    }
+
+    template <class T>
+    void write_array( std::ostream& stream, const std::vector<T>& values ) {
+        uint64_t size = values.size();
+        stream.write( reinterpret_cast<const char*>( &size ), sizeof(size) );
+        stream.write( reinterpret_cast<const char*>( values.data() ), sizeof(T) * values.size() );
+    }
+
+    template <class T>
+    std::vector<T> read_array( std::istream& stream ) {
+        uint64_t size = 0;
+        stream.read( reinterpret_cast<char*>( &size ), sizeof(size) );
+        // reject sizes the rest of a seekable stream can't hold before allocating
+        auto position = stream.tellg();
+        if( position != std::streampos(-1) ) {
+            stream.seekg( 0, std::ios::end );
+            auto remaining = stream.tellg() - position;
+            stream.seekg( position );
+            if( size > (uint64_t)remaining / sizeof(T) ) {
+                throw MeshCreationException{"Truncated mesh geometry data!"};
+            }
+        }
+        if( !stream ) {
+            throw MeshCreationException{"Truncated mesh geometry data!"};
+        }
+        std::vector<T> values( size );
+        stream.read( reinterpret_cast<char*>( values.data() ), sizeof(T) * size );
+        return values;
+    }
+}
+
+MeshGeometry::MeshGeometry( std::vector<glm::vec3> positions, std::vector<GLuint> indices )
+    : _positions{std::move(positions)}, _indices{std::move(indices)} {
+    if( _indices.size() % 3 != 0 ) {
+        throw MeshCreationException{"Mesh geometry indices must form triangles!"};
+    }
+    for( auto index : _indices ) {
+        if( index >= _positions.size() ) {
+            throw MeshCreationException{"Mesh geometry index out of range!"};
+        }
+    }
+}
+
+MeshGeometry::~MeshGeometry() {
+    // claimed here, a queued task finds its build done and never touches the geometry
+    if( _pending ) {
+        std::call_once( _pending->once, [](){} );
+    }
+}
+
+void MeshGeometry::build_bvh( ThreadPool* pool ) {
+    _wait();
+    if( pool == nullptr ) {
+        _bvh = _build( _positions, _indices );
+        return;
+    }
+    auto pending = std::make_shared<PendingBuild>();
+    _pending = pending;
+    pool->submit( [this, pending](){
+            std::call_once( pending->once, [this, &pending](){
+                    _bvh = _build( _positions, _indices );
+                    pending->done = true;
+            });
+    });
+}
+
+bool MeshGeometry::ready() const {
+    return !_pending || _pending->done;
+}
+
+const BVH& MeshGeometry::bvh() const {
+    _wait();
+    return _bvh;
+}
+
+void MeshGeometry::_wait() const {
+    if( !_pending ) {
+        return;
+    }
+    // builds here unless a worker started it, then waits for that worker only,
+    // never for a task queued behind the caller on the same pool
+    std::call_once( _pending->once, [this](){
+            _bvh = _build( _positions, _indices );
+            _pending->done = true;
+    });
+}
+
+BVH MeshGeometry::_build( const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices ) {
+    std::vector<Box> boxes;
+    boxes.reserve( indices.size() / 3 );
+    for( size_t i=0; i+2<indices.size(); i+=3 ) {
+        Box box;
+        for( int k=0; k<3; k++ ) {
+            box += Box{ positions[ indices[i + k] ], positions[ indices[i + k] ] };
+        }
+        boxes.push_back( box );
+    }
+    return BVH{ boxes };
+}
+
+std::optional<MeshHit> MeshGeometry::intersect( const glm::vec3& origin, const glm::vec3& direction, float max_distance ) const {
+    const auto& tree = bvh();
+    RayPacket<1> packet;
+    packet.set( 0, Ray{ origin, direction }, max_distance );
+    std::optional<MeshHit> result;
+    tree.traverse( packet, [this, &packet, &origin, &direction, &result]( uint32_t triangle, uint32_t ){
+            float distance, u, v;
+            bool hit = intersect_triangle( origin, direction,
+                    _positions[ _indices[3*triangle] ], _positions[ _indices[3*triangle + 1] ], _positions[ _indices[3*triangle + 2] ],
+                    distance, u, v );
+            if( hit && distance < packet.t_max[0] ) {
+                packet.t_max[0] = distance;
+                result = MeshHit{ triangle, glm::vec3{ 1.0f - u - v, u, v }, distance, origin + distance * direction };
+            }
+    });
+    return result;
+}
+
+void MeshGeometry::write( std::ostream& stream ) const {
+    const auto& tree = bvh();
+    stream.write( MAGIC, sizeof(MAGIC) );
+    write_array( stream, _positions );
+    write_array( stream, _indices );
+    write_array( stream, tree.nodes() );
+    write_array( stream, tree.primitives() );
+}
+
+std::shared_ptr<MeshGeometry> MeshGeometry::read( std::istream& stream ) {
+    char magic[4] = {};
+    stream.read( magic, sizeof(magic) );
+    if( !stream || std::string{ magic, 4 } != std::string{ MAGIC, 4 } ) {
+        throw MeshCreationException{"Not a mesh geometry blob!"};
+    }
+    auto positions = read_array<glm::vec3>( stream );
+    auto indices = read_array<GLuint>( stream );
+    auto nodes = read_array<BVH::Node>( stream );
+    auto primitives = read_array<uint32_t>( stream );
+    if( !stream ) {
+        throw MeshCreationException{"Truncated mesh geometry data!"};
+    }
+
+    auto geometry = std::make_shared<MeshGeometry>( std::move(positions), std::move(indices) );
+    // the traversal trusts the tree, check every reference and that its
+    // fixed stack holds the depth
+    for( auto primitive : primitives ) {
+        if( primitive >= geometry->triangle_count() ) {
+            throw MeshCreationException{"Mesh geometry BVH references a missing triangle!"};
+        }
+    }
+    std::vector<unsigned int> depths( nodes.size(), 0 );
+    for( size_t i=0; i<nodes.size(); i++ ) {
+        const auto& node = nodes[i];
+        bool valid = node.leaf() ? (size_t)node.first + node.count <= primitives.size()
+                                 : node.first > i && (size_t)node.first + 1 < nodes.size() && node.axis < 3;
+        if( !valid || depths[i] >= BVH::MAX_DEPTH ) {
+            throw MeshCreationException{"Invalid mesh geometry BVH!"};
+        }
+        if( !node.leaf() ) {
+            for( auto child : { node.first, node.first + 1 } ) {
+                depths[child] = std::max( depths[child], depths[i] + 1 );
+            }
+        }
+    }
+    geometry->_bvh = BVH{ std::move(nodes), std::move(primitives) };
+    spdlog::debug("Read mesh geometry with {} triangles", geometry->triangle_count());
+    return geometry;
+}
@@ -0,0 +1,199 @@
+#include "mesh.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <deque>
+#include <limits>
+#include <string>
+#include <unordered_map>
+
+std::vector<unsigned int> MeshBuilder::_weld_map() const {
+    if( ( !_colors.empty() && _colors.size() != _vertices.size() )
+            || ( !_normals.empty() && _normals.size() != _vertices.size() )
+            || ( !_texcoords.empty() && _texcoords.size() != _vertices.size() )
+            || ( !_skins.empty() && _skins.size() != _vertices.size() ) ) {
+        throw MeshCreationException{"Number of attributes must be equal to vertices or zero!"};
+    }
+    std::vector<unsigned int> map( _vertices.size() );
+    std::unordered_map<std::string, unsigned int> first_equal;
+    first_equal.reserve( _vertices.size() );
+    for( unsigned int i=0; i<_vertices.size(); i++ ) {
+        std::string key{ reinterpret_cast<const char*>( &_vertices[i] ), sizeof(glm::vec4) };
+        if( !_colors.empty() ) {
+            key.append( reinterpret_cast<const char*>( &_colors[i] ), sizeof(glm::vec4) );
+        }
+        if( !_normals.empty() ) {
+            key.append( reinterpret_cast<const char*>( &_normals[i] ), sizeof(glm::vec4) );
+        }
+        if( !_texcoords.empty() ) {
+            key.append( reinterpret_cast<const char*>( &_texcoords[i] ), sizeof(glm::vec2) );
+        }
+        if( !_skins.empty() ) {
+            key.append( reinterpret_cast<const char*>( &_skins[i] ), sizeof(VertexSkin) );
+        }
+        map[i] = first_equal.emplace( std::move( key ), i ).first->second;
+    }
+    return map;
+}
+
+float MeshBuilder::acmr( unsigned int cache_size ) const {
+    if( _indices.size() < 3 ) {
+        return 0.0;
+    }
+    std::deque<GLuint> cache;
+    size_t misses = 0;
+    for( auto index : _indices ) {
+        if( std::find( cache.begin(), cache.end(), index ) != cache.end() ) {
+            continue;
+        }
+        misses++;
+        cache.push_back( index );
+        if( cache.size() > cache_size ) {
+            cache.pop_front();
+        }
+    }
+    return (float)misses / ( _indices.size() / 3 );
+}
+
+// Tipsify (Sander, Nehab and Barczak 2007), fans triangles around vertices
+// still in the cache, jumping to the dead end stack or input order when none is
+static std::vector<GLuint> tipsify( const std::vector<GLuint>& indices, size_t vertex_count, unsigned int cache_size ) {
+    size_t triangle_count = indices.size() / 3;
+
+    // triangles around each vertex
+    std::vector<unsigned int> live( vertex_count, 0 );
+    for( auto index : indices ) {
+        live[index]++;
+    }
+    std::vector<unsigned int> offsets( vertex_count + 1, 0 );
+    for( size_t v=0; v<vertex_count; v++ ) {
+        offsets[v + 1] = offsets[v] + live[v];
+    }
+    std::vector<unsigned int> adjacency( indices.size() );
+    std::vector<unsigned int> filled( offsets.begin(), offsets.end() - 1 );
+    for( size_t t=0; t<triangle_count; t++ ) {
+        for( unsigned int k=0; k<3; k++ ) {
+            adjacency[ filled[ indices[3*t + k] ]++ ] = t;
+        }
+    }
+
+    std::vector<unsigned int> cache_time( vertex_count, 0 );
+    std::vector<bool> emitted( triangle_count, false );
+    std::vector<GLuint> dead_end;
+    std::vector<GLuint> candidates;
+    std::vector<GLuint> output;
+    output.reserve( indices.size() );
+
+    unsigned int time = cache_size + 1;
+    size_t cursor = 0;
+    long fanning = vertex_count > 0 ? 0 : -1;
+    while( fanning >= 0 ) {
+        candidates.clear();
+        for( auto a=offsets[fanning]; a<offsets[fanning + 1]; a++ ) {
+            auto t = adjacency[a];
+            if( emitted[t] ) {
+                continue;
+            }
+            for( unsigned int k=0; k<3; k++ ) {
+                auto v = indices[3*t + k];
+                output.push_back( v );
+                dead_end.push_back( v );
+                candidates.push_back( v );
+                live[v]--;
+                if( time - cache_time[v] > cache_size ) {
+                    cache_time[v] = time++;
+                }
+            }
+            emitted[t] = true;
+        }
+
+        // candidate staying in the cache while its remaining triangles are emitted
+        fanning = -1;
+        long best = -1;
+        for( auto v : candidates ) {
+            if( live[v] == 0 ) {
+                continue;
+            }
+            long priority = 0;
+            if( time - cache_time[v] + 2 * live[v] <= cache_size ) {
+                priority = time - cache_time[v];
+            }
+            if( priority > best ) {
+                best = priority;
+                fanning = v;
+            }
+        }
+        if( fanning >= 0 ) {
+            continue;
+        }
+        while( !dead_end.empty() ) {
+            auto v = dead_end.back();
+            dead_end.pop_back();
+            if( live[v] > 0 ) {
+                fanning = v;
+                break;
+            }
+        }
+        while( fanning < 0 && cursor < vertex_count ) {
+            if( live[cursor] > 0 ) {
+                fanning = cursor;
+            }
+            cursor++;
+        }
+    }
+    return output;
+}
+
+MeshOptimizeStats MeshBuilder::optimize( unsigned int cache_size ) {
+    MeshOptimizeStats stats;
+    if( _indices.empty() ) {
+        for( unsigned int i=0; i<_vertices.size(); i++ ) {
+            _indices.push_back( i );
+        }
+    }
+    stats.vertices_before = _vertices.size();
+    stats.acmr_before = acmr( cache_size );
+
+    auto weld = _weld_map();
+    for( auto& index : _indices ) {
+        index = weld[index];
+    }
+    _indices = tipsify( _indices, _vertices.size(), cache_size );
+
+    // vertices in order of first use, unused ones are dropped
+    std::vector<GLuint> remap( _vertices.size(), std::numeric_limits<GLuint>::max() );
+    std::vector<glm::vec4> vertices, colors, normals;
+    std::vector<glm::vec2> texcoords;
+    std::vector<VertexSkin> skins;
+    for( auto& index : _indices ) {
+        if( remap[index] == std::numeric_limits<GLuint>::max() ) {
+            remap[index] = vertices.size();
+            vertices.push_back( _vertices[index] );
+            if( !_colors.empty() ) {
+                colors.push_back( _colors[index] );
+            }
+            if( !_normals.empty() ) {
+                normals.push_back( _normals[index] );
+            }
+            if( !_texcoords.empty() ) {
+                texcoords.push_back( _texcoords[index] );
+            }
+            if( !_skins.empty() ) {
+                skins.push_back( _skins[index] );
+            }
+        }
+        index = remap[index];
+    }
+    _vertices = std::move( vertices );
+    _colors = std::move( colors );
+    _normals = std::move( normals );
+    _texcoords = std::move( texcoords );
+    _skins = std::move( skins );
+
+    stats.vertices_after = _vertices.size();
+    stats.acmr_after = acmr( cache_size );
+    spdlog::debug("Mesh optimized: {} -> {} vertices, ACMR {:.3f} -> {:.3f}",
+            stats.vertices_before, stats.vertices_after, stats.acmr_before, stats.acmr_after);
+    return stats;
+}
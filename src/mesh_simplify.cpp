@@ -0,0 +1,280 @@
+#include "mesh.hpp"
+
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+
+// symmetric 4x4 error quadric of squared distances to planes
+struct Quadric {
+    // a2, ab, ac, ad, b2, bc, bd, c2, cd, d2
+    std::array<double, 10> q{};
+
+    static Quadric plane( const glm::dvec3& normal, double d, double weight ) {
+        Quadric quadric;
+        double a = normal.x, b = normal.y, c = normal.z;
+        quadric.q = { a*a, a*b, a*c, a*d, b*b, b*c, b*d, c*c, c*d, d*d };
+        for( auto& value : quadric.q ) {
+            value *= weight;
+        }
+        return quadric;
+    }
+
+    void operator+=( const Quadric& other ) {
+        for( size_t i=0; i<q.size(); i++ ) {
+            q[i] += other.q[i];
+        }
+    }
+
+    double error( const glm::dvec3& p ) const {
+        double x = p.x, y = p.y, z = p.z;
+        return q[0]*x*x + 2*q[1]*x*y + 2*q[2]*x*z + 2*q[3]*x
+             + q[4]*y*y + 2*q[5]*y*z + 2*q[6]*y
+             + q[7]*z*z + 2*q[8]*z
+             + q[9];
+    }
+};
+
+// candidate collapse of vertex from into vertex to
+struct Collapse {
+    double error;
+    unsigned int from, to;
+    unsigned int from_version, to_version;
+
+    bool operator>( const Collapse& other ) const { return error > other.error; }
+};
+
+// key of a position for exact comparison
+static std::array<uint32_t, 3> position_key( const glm::vec4& v ) {
+    std::array<uint32_t, 3> key;
+    std::memcpy( key.data(), &v.x, sizeof(float) );
+    std::memcpy( key.data() + 1, &v.y, sizeof(float) );
+    std::memcpy( key.data() + 2, &v.z, sizeof(float) );
+    return key;
+}
+
+struct PositionKeyHash {
+    size_t operator()( const std::array<uint32_t, 3>& key ) const {
+        return ( (size_t)key[0] * 73856093u ) ^ ( (size_t)key[1] * 19349663u ) ^ ( (size_t)key[2] * 83492791u );
+    }
+};
+
+MeshBuilder MeshBuilder::simplify( float ratio, float max_error ) const {
+    std::vector<GLuint> indices = _indices;
+    if( indices.empty() ) {
+        for( unsigned int i=0; i<_vertices.size(); i++ ) {
+            indices.push_back( i );
+        }
+    }
+    size_t vertex_count = _vertices.size();
+    size_t triangle_count = indices.size() / 3;
+
+    // weld vertices equal in every attribute, so unindexed meshes get connected
+    auto canonical = _weld_map();
+    for( auto& index : indices ) {
+        index = canonical[index];
+    }
+    size_t target = (size_t)( std::clamp( ratio, 0.0f, 1.0f ) * triangle_count );
+
+    std::vector<glm::dvec3> positions( vertex_count );
+    for( size_t i=0; i<vertex_count; i++ ) {
+        positions[i] = glm::dvec3{ _vertices[i].x, _vertices[i].y, _vertices[i].z };
+    }
+
+    // triangles around each vertex
+    std::vector<std::vector<unsigned int>> vertex_triangles( vertex_count );
+    for( unsigned int t=0; t<triangle_count; t++ ) {
+        for( unsigned int k=0; k<3; k++ ) {
+            vertex_triangles[ indices[3*t + k] ].push_back( t );
+        }
+    }
+
+    // seam vertices share their position with another vertex
+    std::vector<bool> locked( vertex_count, false );
+    std::unordered_map<std::array<uint32_t, 3>, unsigned int, PositionKeyHash> first_at;
+    for( unsigned int i=0; i<vertex_count; i++ ) {
+        if( canonical[i] != i ) {
+            continue;
+        }
+        auto [it, inserted] = first_at.emplace( position_key( _vertices[i] ), i );
+        if( !inserted ) {
+            locked[i] = true;
+            locked[it->second] = true;
+        }
+    }
+    // border vertices have an edge used by a single triangle
+    std::unordered_map<uint64_t, unsigned int> edge_uses;
+    auto edge_key = []( unsigned int a, unsigned int b ) {
+        return ( (uint64_t)std::min( a, b ) << 32 ) | std::max( a, b );
+    };
+    for( size_t t=0; t<triangle_count; t++ ) {
+        for( unsigned int k=0; k<3; k++ ) {
+            edge_uses[ edge_key( indices[3*t + k], indices[3*t + (k+1)%3] ) ]++;
+        }
+    }
+    for( const auto& [key, uses] : edge_uses ) {
+        if( uses == 1 ) {
+            locked[ key >> 32 ] = true;
+            locked[ key & 0xffffffffu ] = true;
+        }
+    }
+
+    // plane quadrics weighted by triangle area
+    std::vector<Quadric> quadrics( vertex_count );
+    for( size_t t=0; t<triangle_count; t++ ) {
+        const auto& p0 = positions[ indices[3*t] ];
+        const auto& p1 = positions[ indices[3*t + 1] ];
+        const auto& p2 = positions[ indices[3*t + 2] ];
+        auto normal = glm::cross( p1 - p0, p2 - p0 );
+        double length = glm::length( normal );
+        if( length <= 0.0 ) {
+            continue;
+        }
+        normal /= length;
+        auto quadric = Quadric::plane( normal, -glm::dot( normal, p0 ), length * 0.5 );
+        for( unsigned int k=0; k<3; k++ ) {
+            quadrics[ indices[3*t + k] ] += quadric;
+        }
+    }
+
+    std::vector<bool> removed_triangle( triangle_count, false );
+    std::vector<unsigned int> version( vertex_count, 0 );
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+
+    auto push_collapses = [&]( unsigned int v ) {
+        for( auto t : vertex_triangles[v] ) {
+            if( removed_triangle[t] ) {
+                continue;
+            }
+            for( unsigned int k=0; k<3; k++ ) {
+                auto other = indices[3*t + k];
+                if( other == v ) {
+                    continue;
+                }
+                if( !locked[v] ) {
+                    auto quadric = quadrics[v];
+                    quadric += quadrics[other];
+                    queue.push( Collapse{ quadric.error( positions[other] ), v, other, version[v], version[other] } );
+                }
+                if( !locked[other] ) {
+                    auto quadric = quadrics[other];
+                    quadric += quadrics[v];
+                    queue.push( Collapse{ quadric.error( positions[v] ), other, v, version[other], version[v] } );
+                }
+            }
+        }
+    };
+    for( unsigned int v=0; v<vertex_count; v++ ) {
+        if( !locked[v] ) {
+            push_collapses( v );
+        }
+    }
+
+    // moving from onto to must not flip any remaining triangle
+    auto flips = [&]( unsigned int from, unsigned int to ) {
+        for( auto t : vertex_triangles[from] ) {
+            if( removed_triangle[t] ) {
+                continue;
+            }
+            std::array<unsigned int, 3> corners{ indices[3*t], indices[3*t + 1], indices[3*t + 2] };
+            if( std::find( corners.begin(), corners.end(), to ) != corners.end() ) {
+                continue;
+            }
+            auto before = glm::cross( positions[corners[1]] - positions[corners[0]], positions[corners[2]] - positions[corners[0]] );
+            for( auto& corner : corners ) {
+                if( corner == from ) {
+                    corner = to;
+                }
+            }
+            auto after = glm::cross( positions[corners[1]] - positions[corners[0]], positions[corners[2]] - positions[corners[0]] );
+            if( glm::dot( before, after ) <= 0.0 ) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    size_t remaining = triangle_count;
+    while( remaining > target && !queue.empty() ) {
+        auto collapse = queue.top();
+        queue.pop();
+        if( collapse.error > max_error ) {
+            break;
+        }
+        // stale candidate, one of the vertices changed since
+        if( collapse.from_version != version[collapse.from] || collapse.to_version != version[collapse.to] ) {
+            continue;
+        }
+        if( flips( collapse.from, collapse.to ) ) {
+            continue;
+        }
+
+        auto from = collapse.from;
+        auto to = collapse.to;
+        for( auto t : vertex_triangles[from] ) {
+            if( removed_triangle[t] ) {
+                continue;
+            }
+            bool degenerate = false;
+            for( unsigned int k=0; k<3; k++ ) {
+                if( indices[3*t + k] == to ) {
+                    degenerate = true;
+                }
+            }
+            if( degenerate ) {
+                removed_triangle[t] = true;
+                remaining--;
+            } else {
+                for( unsigned int k=0; k<3; k++ ) {
+                    if( indices[3*t + k] == from ) {
+                        indices[3*t + k] = to;
+                    }
+                }
+                vertex_triangles[to].push_back( t );
+            }
+        }
+        vertex_triangles[from].clear();
+        quadrics[to] += quadrics[from];
+        version[from]++;
+        version[to]++;
+        // drop removed triangles from the kept vertex
+        auto& to_triangles = vertex_triangles[to];
+        to_triangles.erase( std::remove_if( to_triangles.begin(), to_triangles.end(), [&removed_triangle]( unsigned int t ){
+                    return removed_triangle[t];
+        }), to_triangles.end() );
+        push_collapses( to );
+    }
+
+    // compact the used vertices into a new builder
+    MeshBuilder builder;
+    std::vector<GLuint> remap( vertex_count, std::numeric_limits<GLuint>::max() );
+    for( size_t t=0; t<triangle_count; t++ ) {
+        if( removed_triangle[t] ) {
+            continue;
+        }
+        for( unsigned int k=0; k<3; k++ ) {
+            auto v = indices[3*t + k];
+            if( remap[v] == std::numeric_limits<GLuint>::max() ) {
+                remap[v] = builder._vertices.size();
+                builder._vertices.push_back( _vertices[v] );
+                if( !_colors.empty() ) {
+                    builder._colors.push_back( _colors[v] );
+                }
+                if( !_normals.empty() ) {
+                    builder._normals.push_back( _normals[v] );
+                }
+                if( !_texcoords.empty() ) {
+                    builder._texcoords.push_back( _texcoords[v] );
+                }
+                if( !_skins.empty() ) {
+                    builder._skins.push_back( _skins[v] );
+                }
+            }
+            builder._indices.push_back( remap[v] );
+        }
+    }
+    return builder;
+}
@@ -0,0 +1,57 @@
+#include "mesh_uploader.hpp"
+
+#include "spdlog/spdlog.h"
+
+std::future<Mesh> MeshUploader::upload( std::shared_ptr<const MeshData> data ) {
+    auto promise = std::make_shared<std::promise<Mesh>>();
+    auto future = promise->get_future();
+    std::lock_guard<std::mutex> lock{ _mutex };
+    _queue.push_back( Job{ std::move(data), nullptr, std::move(promise) } );
+    return future;
+}
+
+void MeshUploader::upload( std::shared_ptr<const MeshData> data, std::function<void(Mesh&&)> on_upload ) {
+    std::lock_guard<std::mutex> lock{ _mutex };
+    _queue.push_back( Job{ std::move(data), std::move(on_upload), nullptr } );
+}
+
+void MeshUploader::update() {
+    size_t budget = _upload_budget;
+    // meshes are uploaded whole, at least one per frame so big ones still progress
+    bool first = true;
+    while( first || budget > 0 ) {
+        Job job;
+        {
+            std::lock_guard<std::mutex> lock{ _mutex };
+            if( _queue.empty() ) {
+                break;
+            }
+            auto size = _queue.front().data->upload_size();
+            if( !first && size > budget ) {
+                break;
+            }
+            job = std::move( _queue.front() );
+            _queue.pop_front();
+        }
+        first = false;
+        budget -= std::min( budget, job.data->upload_size() );
+        try {
+            Mesh mesh{ *job.data };
+            if( job.promise ) {
+                job.promise->set_value( std::move(mesh) );
+            } else {
+                job.on_upload( std::move(mesh) );
+            }
+        } catch( MeshCreationException& e ) {
+            spdlog::error("Could not upload mesh: {}", e.what());
+            if( job.promise ) {
+                job.promise->set_exception( std::current_exception() );
+            }
+        }
+    }
+}
+
+size_t MeshUploader::pending() const {
+    std::lock_guard<std::mutex> lock{ _mutex };
+    return _queue.size();
+}
@@ -2,9 +2,16 @@
 
 #include "hierarchy.hpp"
 #include "models.hpp"
+#include "texture_streamer.hpp"
+#include "texture_residency.hpp"
+#include "material_buffer.hpp"
 
 #include "spdlog/spdlog.h"
 
+#include <algorithm>
+#include <cmath>
+#include <unordered_set>
+
 entt::entity ModelLoader::load_model( 
         entt::registry& registry, 
         const std::string& path 
@@ -30,16 +37,92 @@ entt::entity ModelLoader::load_model(
 
     std::string directory = path.substr(0, path.find_last_of('/'));
 
-    get_meshes( scene );
+    get_skeleton( scene );
+    get_meshes( scene, registry.try_ctx<ThreadPool>() );
+    get_animations( scene );
     get_materials( registry, scene, directory );
+    get_programs( registry );
 
+    _skinned_entities.clear();
     auto model_root = load_node( registry, scene->mRootNode );
+
+    // the root plays the skeleton, its skinned meshes follow
+    if( _skeleton ) {
+        auto& animator = registry.assign<Animator>( model_root );
+        animator.skeleton = _skeleton;
+        if( !_animations.empty() ) {
+            animator.clip = _animations.front();
+        }
+        for( const auto& [entity, mesh_index] : _skinned_entities ) {
+            auto& skin = registry.assign<Skin>( entity );
+            skin.animator = model_root;
+            skin.binding = _skin_bindings[mesh_index];
+        }
+    }
     return model_root;
 }
 
-void ModelLoader::get_meshes( const aiScene* scene ) {
+// Add node and its descendants leading to bones as joints, parents first.
+// Returns false and adds nothing when no bone is below node.
+static bool add_joints( const aiNode* node, uint16_t parent, const std::unordered_set<std::string>& bones, Skeleton& skeleton ) {
+    auto joint = (uint16_t)skeleton.size();
+    aiVector3D scaling;
+    aiQuaternion rotation;
+    aiVector3D translation;
+    node->mTransformation.Decompose( scaling, rotation, translation );
+    skeleton.names.emplace_back( node->mName.C_Str() );
+    skeleton.parents.push_back( parent );
+    skeleton.translations.emplace_back( translation.x, translation.y, translation.z );
+    skeleton.rotations.emplace_back( rotation.w, rotation.x, rotation.y, rotation.z );
+    skeleton.scales.emplace_back( scaling.x, scaling.y, scaling.z );
+
+    bool used = bones.count( skeleton.names.back() ) != 0;
+    for( unsigned int i=0; i<node->mNumChildren; i++ ) {
+        used = add_joints( node->mChildren[i], joint, bones, skeleton ) || used;
+    }
+    // nothing was added after the joint, drop it
+    if( !used ) {
+        skeleton.names.pop_back();
+        skeleton.parents.pop_back();
+        skeleton.translations.pop_back();
+        skeleton.rotations.pop_back();
+        skeleton.scales.pop_back();
+    }
+    return used;
+}
+
+void ModelLoader::get_skeleton( const aiScene* scene ) {
+    _skeleton.reset();
+
+    std::unordered_set<std::string> bones;
+    for( unsigned int i=0; i<scene->mNumMeshes; i++ ) {
+        const auto assimp_mesh = scene->mMeshes[i];
+        for( unsigned int j=0; j<assimp_mesh->mNumBones; j++ ) {
+            bones.insert( assimp_mesh->mBones[j]->mName.C_Str() );
+        }
+    }
+    if( bones.empty() ) {
+        return;
+    }
+
+    // joints are relative to the root node, which becomes the Animator entity
+    auto skeleton = std::make_shared<Skeleton>();
+    for( unsigned int i=0; i<scene->mRootNode->mNumChildren; i++ ) {
+        add_joints( scene->mRootNode->mChildren[i], Skeleton::NO_PARENT, bones, *skeleton );
+    }
+    if( skeleton->size() >= Skeleton::NO_PARENT ) {
+        spdlog::warn("Skeleton of {} joints is too large, model is not skinned", skeleton->size());
+        return;
+    }
+    spdlog::trace("Skeleton: {} joints, {} bones", skeleton->size(), bones.size());
+    _skeleton = skeleton;
+}
+
+void ModelLoader::get_meshes( const aiScene* scene, ThreadPool* pool ) {
     _meshes.clear();
     _mesh_builders.clear();
+    _lods.clear();
+    _skin_bindings.clear();
 
     for(unsigned int i=0; i<scene->mNumMeshes; i++) {
         const auto assimp_mesh = scene->mMeshes[i];
@@ -96,6 +179,53 @@ void ModelLoader::get_meshes( const aiScene* scene ) {
             mesh_attributes += std::string{"TextureCoords "};
         }
 
+        // get joint influences, bone j of the mesh is its joint j
+        _skin_bindings.emplace_back();
+        if( _skeleton && assimp_mesh->mNumBones > VertexSkin::MAX_JOINTS ) {
+            spdlog::warn("Mesh '{}' ({}) has {} bones, more than {}, it is not skinned", (assimp_mesh->mName).C_Str(), i, assimp_mesh->mNumBones, VertexSkin::MAX_JOINTS);
+        } else if( _skeleton && assimp_mesh->mNumBones > 0 ) {
+            auto binding = std::make_shared<SkinBinding>();
+            std::vector<std::vector<std::pair<unsigned int, float>>> influences( assimp_mesh->mNumVertices );
+            for( unsigned int j=0; j<assimp_mesh->mNumBones; j++ ) {
+                const auto bone = assimp_mesh->mBones[j];
+                // bones outside the skeleton keep their slot but move no vertex
+                auto joint = _skeleton->find( bone->mName.C_Str() );
+                if( !joint ) {
+                    spdlog::warn("Bone '{}' of mesh '{}' ({}) is not in the skeleton, its weights are dropped", bone->mName.C_Str(), (assimp_mesh->mName).C_Str(), i);
+                }
+                binding->joints.push_back( joint ? *joint : 0 );
+                // assimp matrices are row major like Affine
+                const auto& offset = bone->mOffsetMatrix;
+                Affine inverse_bind;
+                inverse_bind.rows[0] = glm::vec4{ offset.a1, offset.a2, offset.a3, offset.a4 };
+                inverse_bind.rows[1] = glm::vec4{ offset.b1, offset.b2, offset.b3, offset.b4 };
+                inverse_bind.rows[2] = glm::vec4{ offset.c1, offset.c2, offset.c3, offset.c4 };
+                binding->inverse_binds.push_back( inverse_bind );
+                for( unsigned int k=0; joint && k<bone->mNumWeights; k++ ) {
+                    influences[ bone->mWeights[k].mVertexId ].emplace_back( j, bone->mWeights[k].mWeight );
+                }
+            }
+            // bind pose bounds per joint, vertices without influences follow joint 0
+            binding->bounds.resize( binding->joints.size() );
+            for( unsigned int k=0; k<assimp_mesh->mNumVertices; k++ ) {
+                const auto& vertice = assimp_mesh->mVertices[k];
+                Box point{ glm::vec3{ vertice.x, vertice.y, vertice.z }, glm::vec3{ vertice.x, vertice.y, vertice.z } };
+                if( influences[k].empty() ) {
+                    binding->bounds[0] += point;
+                }
+                for( const auto& influence : influences[k] ) {
+                    if( influence.second > 0.0 ) {
+                        binding->bounds[ influence.first ] += point;
+                    }
+                }
+            }
+            for( auto& vertex_influences : influences ) {
+                mb.add_skin( VertexSkin::from_influences( std::move( vertex_influences ) ) );
+            }
+            _skin_bindings.back() = binding;
+            mesh_attributes += std::string{"Skins "};
+        }
+
         // get indices
         for( unsigned int j=0; j<assimp_mesh->mNumFaces; j++ ) {
             const auto face = assimp_mesh->mFaces[j];
@@ -108,7 +238,142 @@ void ModelLoader::get_meshes( const aiScene* scene ) {
 
         auto mesh_material_index = assimp_mesh->mMaterialIndex;
 
+        // faces come unwelded, join them and order for the vertex cache
+        mb.optimize();
+        mb.retain_geometry( _retain_geometry, pool );
         _meshes.emplace_back( mb.build(), mesh_material_index );
+
+        // simplified levels, skipping those barely smaller than the previous one,
+        // skinned meshes are always drawn whole
+        _lods.emplace_back();
+        if( _skin_bindings.back() ) {
+            continue;
+        }
+        auto triangles = mb.triangle_count();
+        for( const auto& setting : _lod_levels ) {
+            auto simplified = mb.simplify( setting.triangle_ratio );
+            if( simplified.triangle_count() == 0 || simplified.triangle_count() * 10 > triangles * 9 ) {
+                continue;
+            }
+            spdlog::trace("Mesh '{}' ({}) LOD below {}: {} triangles", (assimp_mesh->mName).C_Str(), i, setting.screen_size, simplified.triangle_count());
+            triangles = simplified.triangle_count();
+            _lods.back().add_level( simplified.build(), setting.screen_size );
+        }
+    }
+}
+
+// Resampled keys as a track of clip values, a single key when they are all the same
+template<typename Value, typename Same>
+static AnimationClip::Track append_track( std::vector<Value>& values, std::vector<Value>& keys, Same same ) {
+    AnimationClip::Track track{ (uint32_t)values.size(), (uint32_t)keys.size() };
+    if( !keys.empty() && std::all_of( keys.begin() + 1, keys.end(), [&keys, &same]( const Value& key ){ return same( keys.front(), key ); } ) ) {
+        keys.resize( 1 );
+        track.count = 1;
+    }
+    values.insert( values.end(), keys.begin(), keys.end() );
+    return track;
+}
+
+// Key index at or before tick, keys are sorted and ticks only increase
+template<typename Key>
+static unsigned int key_at( const Key* keys, unsigned int count, double tick, unsigned int cursor ) {
+    while( cursor + 1 < count && keys[cursor + 1].mTime <= tick ) {
+        cursor++;
+    }
+    return cursor;
+}
+
+// Blend from key to the next at tick
+template<typename Key>
+static float key_blend( const Key* keys, unsigned int count, double tick, unsigned int key ) {
+    if( key + 1 >= count || tick <= keys[key].mTime ) {
+        return 0.0;
+    }
+    return std::min( ( tick - keys[key].mTime ) / ( keys[key + 1].mTime - keys[key].mTime ), 1.0 );
+}
+
+static std::vector<glm::vec3> resample( const aiVectorKey* keys, unsigned int count, const std::vector<double>& ticks ) {
+    std::vector<glm::vec3> values;
+    if( count == 0 ) {
+        return values;
+    }
+    values.reserve( ticks.size() );
+    unsigned int key = 0;
+    for( auto tick : ticks ) {
+        key = key_at( keys, count, tick, key );
+        auto blend = key_blend( keys, count, tick, key );
+        const auto& a = keys[key].mValue;
+        const auto& b = keys[ std::min( key + 1, count - 1 ) ].mValue;
+        values.push_back( glm::mix( glm::vec3{ a.x, a.y, a.z }, glm::vec3{ b.x, b.y, b.z }, blend ) );
+    }
+    return values;
+}
+
+static std::vector<PackedQuat> resample( const aiQuatKey* keys, unsigned int count, const std::vector<double>& ticks ) {
+    std::vector<PackedQuat> values;
+    if( count == 0 ) {
+        return values;
+    }
+    values.reserve( ticks.size() );
+    unsigned int key = 0;
+    for( auto tick : ticks ) {
+        key = key_at( keys, count, tick, key );
+        auto blend = key_blend( keys, count, tick, key );
+        const auto& a = keys[key].mValue;
+        const auto& b = keys[ std::min( key + 1, count - 1 ) ].mValue;
+        values.push_back( PackedQuat::pack( glm::slerp( glm::quat{ a.w, a.x, a.y, a.z }, glm::quat{ b.w, b.x, b.y, b.z }, blend ) ) );
+    }
+    return values;
+}
+
+void ModelLoader::get_animations( const aiScene* scene ) {
+    _animations.clear();
+    if( !_skeleton ) {
+        return;
+    }
+
+    for( unsigned int i=0; i<scene->mNumAnimations; i++ ) {
+        const auto assimp_animation = scene->mAnimations[i];
+        double ticks_per_second = assimp_animation->mTicksPerSecond != 0.0 ? assimp_animation->mTicksPerSecond : 25.0;
+
+        auto clip = std::make_shared<AnimationClip>();
+        clip->name = assimp_animation->mName.C_Str();
+        clip->duration = assimp_animation->mDuration / ticks_per_second;
+        clip->sample_rate = _animation_sample_rate;
+        clip->frame_count = (uint32_t)std::ceil( clip->duration * clip->sample_rate ) + 1;
+        clip->channels.resize( _skeleton->size() );
+
+        // tick of every frame, the last one at the end of the clip
+        std::vector<double> ticks( clip->frame_count );
+        for( uint32_t frame=0; frame<clip->frame_count; frame++ ) {
+            ticks[frame] = std::min( frame / (double)clip->sample_rate, (double)clip->duration ) * ticks_per_second;
+        }
+
+        auto same_vector = []( const glm::vec3& a, const glm::vec3& b ){
+            auto d = glm::abs( a - b );
+            return std::max( d.x, std::max( d.y, d.z ) ) < 1e-5f;
+        };
+        auto same_rotation = []( const PackedQuat& a, const PackedQuat& b ){
+            return a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w;
+        };
+        for( unsigned int j=0; j<assimp_animation->mNumChannels; j++ ) {
+            const auto assimp_channel = assimp_animation->mChannels[j];
+            // nodes outside the skeleton aren't animated
+            auto joint = _skeleton->find( assimp_channel->mNodeName.C_Str() );
+            if( !joint ) {
+                continue;
+            }
+            auto& channel = clip->channels[*joint];
+            auto translations = resample( assimp_channel->mPositionKeys, assimp_channel->mNumPositionKeys, ticks );
+            channel.translation = append_track( clip->translations, translations, same_vector );
+            auto rotations = resample( assimp_channel->mRotationKeys, assimp_channel->mNumRotationKeys, ticks );
+            channel.rotation = append_track( clip->rotations, rotations, same_rotation );
+            auto scales = resample( assimp_channel->mScalingKeys, assimp_channel->mNumScalingKeys, ticks );
+            channel.scale = append_track( clip->scales, scales, same_vector );
+        }
+
+        spdlog::trace("Animation '{}' ({}): {:.2f}s, {} frames, {} bytes", clip->name, i, clip->duration, clip->frame_count, clip->memory());
+        _animations.push_back( clip );
     }
 }
 
@@ -190,12 +455,69 @@ void ModelLoader::get_materials( entt::registry& registry, const aiScene* scene,
                 _materials.back().add_specular_texture( texture_handle );
             }
         }
+
+        // register once so every mesh using the material shares its entry
+        auto material_buffer_ptr = registry.try_ctx<MaterialBuffer>();
+        if( material_buffer_ptr != nullptr ) {
+            material_buffer_ptr->index( _materials.back() );
+        }
+    }
+}
+
+void ModelLoader::get_programs( entt::registry& registry ) {
+    _programs.assign( _materials.size(), _program_handle );
+    _skinned_programs.assign( _materials.size(), _program_handle );
+    if( !_sources ) {
+        return;
+    }
+
+    std::vector<ShaderPermutation> permutations;
+    for( const auto& material : _materials ) {
+        permutations.push_back( ShaderPermutation::from_material( material, _max_lights ) );
+    }
+    // skinned permutations only of materials on skinned meshes
+    std::vector<bool> skinned( _materials.size(), false );
+    for( size_t i=0; i<_meshes.size(); i++ ) {
+        if( _skin_bindings[i] ) {
+            skinned[ _meshes[i].second ] = true;
+        }
+    }
+    std::vector<ShaderPermutation> skinned_permutations;
+    for( size_t i=0; i<_materials.size(); i++ ) {
+        if( skinned[i] ) {
+            skinned_permutations.push_back( permutations[i] );
+            skinned_permutations.back().skinned = true;
+        }
+    }
+
+    // compile every permutation of the model at once
+    auto& variants = registry.ctx<ShaderVariants>();
+    auto all = permutations;
+    all.insert( all.end(), skinned_permutations.begin(), skinned_permutations.end() );
+    variants.prepare( *_sources, all );
+    for( size_t i=0; i<permutations.size(); i++ ) {
+        _programs[i] = variants.get( *_sources, permutations[i] );
+        if( skinned[i] ) {
+            auto permutation = permutations[i];
+            permutation.skinned = true;
+            _skinned_programs[i] = variants.get( *_sources, permutation );
+        }
     }
 }
 
 entt::resource_handle<Texture> ModelLoader::get_texture( entt::registry& registry, const std::string path ) {
     try {
         auto& texture_cache = registry.ctx<entt::resource_cache<Texture>>();
+        // track memory of textures when residency is managed
+        auto residency_ptr = registry.try_ctx<TextureResidency>();
+        if( residency_ptr != nullptr ) {
+            return texture_cache.load<TextureLoader>( entt::hashed_string{path.c_str()}, path, *residency_ptr );
+        }
+        // decode in background when streaming is available
+        auto streamer_ptr = registry.try_ctx<TextureStreamer>();
+        if( streamer_ptr != nullptr ) {
+            return texture_cache.load<TextureLoader>( entt::hashed_string{path.c_str()}, path, *streamer_ptr );
+        }
         auto texture_handle = texture_cache.load<TextureLoader>( entt::hashed_string{path.c_str()}, path );
         return texture_handle;
     } catch( TextureException& e ) {
@@ -246,8 +568,16 @@ entt::entity ModelLoader::load_node(
     // add meshes
     for( unsigned int i=0; i<node->mNumMeshes; i++ ) {
         auto mesh_entity = registry.create();
-        registry.assign<Model>( mesh_entity, _meshes[node->mMeshes[i]].first, _program_handle );
+        if( _skin_bindings[node->mMeshes[i]] ) {
+            registry.assign<Model>( mesh_entity, _meshes[node->mMeshes[i]].first, _skinned_programs[ _meshes[node->mMeshes[i]].second ] );
+            _skinned_entities.emplace_back( mesh_entity, node->mMeshes[i] );
+        } else {
+            registry.assign<Model>( mesh_entity, _meshes[node->mMeshes[i]].first, _programs[ _meshes[node->mMeshes[i]].second ] );
+        }
         registry.assign<Material>( mesh_entity, _materials[ _meshes[node->mMeshes[i]].second  ] );
+        if( !_lods[node->mMeshes[i]].levels().empty() ) {
+            registry.assign<LODGroup>( mesh_entity, _lods[node->mMeshes[i]] );
+        }
         registry.assign<Transform>( mesh_entity );
         registry.assign<Hierarchy>( mesh_entity, node_entity );
     }
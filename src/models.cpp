@@ -3,25 +3,318 @@
 #include "transform.hpp"
 #include "camera.hpp"
 #include "material.hpp"
+#include "material_buffer.hpp"
+#include "texture_residency.hpp"
+#include "lights.hpp"
+#include "depth_prepass.hpp"
+#include "occlusion.hpp"
+#include "lod.hpp"
+#include "animation.hpp"
+#include "window.hpp"
+#include "geometry/box_batch.hpp"
+
+#include "glm/glm.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <tuple>
+#include <unordered_set>
+#include <vector>
+
+// a model to draw this frame
+struct ModelDraw {
+    entt::entity entity;
+    Model* model;
+    const Mesh* mesh;
+    const Transform* transform;
+    Box bounds;
+    float distance;
+};
+
+// skinned models of a mesh, program and material drawn as one instanced draw
+struct SkinnedBatch {
+    size_t begin;
+    size_t end;
+    Box bounds;
+};
+
+// view of the current camera, identity at the origin without one
+struct ModelCamera {
+    glm::mat4 view{1.0};
+    glm::vec3 eye{0.0};
+    const Camera* camera = nullptr;
+};
+
+static ModelCamera model_camera( entt::registry& registry ) {
+    ModelCamera model_camera;
+    auto current_camera_ptr = registry.try_ctx<CurrentCamera>();
+    if( current_camera_ptr == nullptr ) {
+        return model_camera;
+    }
+    model_camera.camera = registry.try_get<Camera>( current_camera_ptr->entity );
+    auto transform_ptr = registry.try_get<Transform>( current_camera_ptr->entity );
+    if( transform_ptr != nullptr ) {
+        model_camera.eye = transform_ptr->global_affine().translation();
+        model_camera.view = transform_ptr->global_affine().inverse().to_mat4();
+    }
+    return model_camera;
+}
+
+static void set_cull_face( const Material* material_ptr ) {
+    if( material_ptr != nullptr && material_ptr->twosided() ) {
+        glDisable(GL_CULL_FACE);
+    } else {
+        glEnable(GL_CULL_FACE);
+    }
+}
+
+// mark textures of material as recently used
+static void touch_textures( TextureResidency& residency, const Material& material ) {
+    for( const auto& textures : { &material.ambient_textures(), &material.diffuse_textures(), &material.specular_textures() } ) {
+        for( const auto& texture : *textures ) {
+            if( texture ) {
+                residency.touch( *texture );
+            }
+        }
+    }
+}
+
+// material index of a draw, or a key unique to the draw without a material buffer
+static GLuint batch_material( entt::registry& registry, MaterialBuffer* material_buffer_ptr, const ModelDraw& draw ) {
+    auto material_ptr = registry.try_get<Material>( draw.entity );
+    if( material_buffer_ptr == nullptr ) {
+        return material_ptr != nullptr ? static_cast<GLuint>( draw.entity ) + 1 : 0;
+    }
+    return material_ptr != nullptr ? material_buffer_ptr->index( *material_ptr ) : 0;
+}
+
+// Skinned models sharing mesh, program and material are drawn instanced,
+// their palettes packed one after the other
+static void draw_skinned( entt::registry& registry, JointPalettes& palettes, std::vector<ModelDraw>& draws ) {
+    auto material_buffer_ptr = registry.try_ctx<MaterialBuffer>();
+    auto frame_lights_ptr = registry.try_ctx<FrameLights>();
+    auto residency_ptr = registry.try_ctx<TextureResidency>();
+
+    struct Keyed {
+        GLuint mesh;
+        const ShaderProgram* program;
+        GLuint material;
+        ModelDraw draw;
+    };
+    std::vector<Keyed> keyed;
+    keyed.reserve( draws.size() );
+    const auto& skin_palettes = palettes.palettes();
+    for( const auto& draw : draws ) {
+        // skins without a posed palette this frame aren't drawn
+        const auto& skin = registry.get<Skin>( draw.entity );
+        if( !skin.binding || skin.binding->joints.empty() || skin.palette == Skin::NO_PALETTE
+                || skin.palette + skin.binding->joints.size() > skin_palettes.size() ) {
+            continue;
+        }
+        keyed.push_back( Keyed{ draw.mesh->id(), &*draw.model->program, batch_material( registry, material_buffer_ptr, draw ), draw } );
+    }
+    std::sort( keyed.begin(), keyed.end(), []( const Keyed& a, const Keyed& b ){
+            return std::tie( a.mesh, a.program, a.material ) < std::tie( b.mesh, b.program, b.material );
+    });
+
+    // palettes in draw order, batches end where the key or joint count changes
+    std::vector<Affine> packed;
+    std::vector<SkinnedBatch> batches;
+    draws.clear();
+    for( size_t i=0; i<keyed.size(); i++ ) {
+        const auto& skin = registry.get<Skin>( keyed[i].draw.entity );
+        size_t joint_count = skin.binding->joints.size();
+        draws.push_back( keyed[i].draw );
+        auto material_ptr = registry.try_get<Material>( keyed[i].draw.entity );
+        if( residency_ptr != nullptr && material_ptr != nullptr ) {
+            touch_textures( *residency_ptr, *material_ptr );
+        }
+        bool same = !batches.empty()
+            && keyed[ batches.back().begin ].mesh == keyed[i].mesh
+            && keyed[ batches.back().begin ].program == keyed[i].program
+            && keyed[ batches.back().begin ].material == keyed[i].material
+            && registry.get<Skin>( draws[ batches.back().begin ].entity ).binding->joints.size() == joint_count;
+        if( !same ) {
+            batches.push_back( SkinnedBatch{ i, i, Box{} } );
+        }
+        batches.back().end = i + 1;
+        batches.back().bounds += keyed[i].draw.bounds;
+        packed.insert( packed.end(), skin_palettes.begin() + skin.palette, skin_palettes.begin() + skin.palette + joint_count );
+    }
+    palettes.upload( packed );
+
+    GLuint joint_offset = 0;
+    for( const auto& batch : batches ) {
+        const auto& first = draws[batch.begin];
+        auto& program = *first.model->program;
+        GLuint joint_count = registry.get<Skin>( first.entity ).binding->joints.size();
+        JointPalettes::bind( program );
+        program.uniform( "joint_offset", joint_offset );
+        program.uniform( "joint_count", joint_count );
+        if( frame_lights_ptr != nullptr && !frame_lights_ptr->ranged.empty() ) {
+            frame_lights_ptr->bind( program, batch.bounds );
+        }
+        auto material_ptr = registry.try_get<Material>( first.entity );
+        if( material_buffer_ptr != nullptr ) {
+            material_buffer_ptr->bind( program );
+            program.uniform( "material_index", material_ptr != nullptr ? material_buffer_ptr->index( *material_ptr ) : 0u );
+        }
+        set_cull_face( material_ptr );
+        first.mesh->draw_instanced( program, batch.end - batch.begin );
+        joint_offset += joint_count * ( batch.end - batch.begin );
+    }
+    glEnable(GL_CULL_FACE);
+}
 
 // model system
 void model_system( entt::registry& registry ) {
+    auto material_buffer_ptr = registry.try_ctx<MaterialBuffer>();
+    auto residency_ptr = registry.try_ctx<TextureResidency>();
+    auto frame_lights_ptr = registry.try_ctx<FrameLights>();
+    auto prepass_ptr = registry.try_ctx<DepthPrepass>();
+    auto camera = model_camera( registry );
+    auto culling_ptr = registry.try_ctx<OcclusionCulling>();
+    if( culling_ptr != nullptr ) {
+        if( camera.camera != nullptr ) {
+            culling_ptr->begin( camera.view, camera.camera->projection_matrix, camera.camera->near );
+        } else {
+            culling_ptr = nullptr;
+        }
+    }
     auto view = registry.group<Model>(entt::get<Transform>, entt::exclude<Hidden>);
-    view.each([&registry](auto entity, auto& model, const auto& transform){
-            model.program->uniform( "model_transform", transform.global_matrix() );
-            auto material_ptr = registry.try_get<Material>( entity );
-            if( material_ptr != nullptr ) {
-                model.program->uniform( "material", *material_ptr );
-                if( material_ptr->twosided() ) {
-                    glDisable(GL_CULL_FACE);
-                } else {
-                    glEnable(GL_CULL_FACE);
+
+    // world bounds of every model in one batch
+    std::vector<Affine> transforms;
+    BoxBatch local_bounds, world_bounds;
+    transforms.reserve( view.size() );
+    local_bounds.reserve( view.size() );
+    view.each([&transforms, &local_bounds](auto, auto& model, const auto& transform){
+            transforms.push_back( transform.global_affine() );
+            local_bounds.push_back( model.mesh.bounding_box() );
+    });
+    box_op::transform( transforms.data(), local_bounds, world_bounds );
+
+    // opaque models front to back so early depth testing rejects hidden fragments
+    std::vector<ModelDraw> draws, skinned_draws;
+    draws.reserve( view.size() );
+    auto palettes_ptr = registry.try_ctx<JointPalettes>();
+    size_t index = 0;
+    view.each([&registry, &draws, &skinned_draws, &camera, culling_ptr, palettes_ptr, &world_bounds, &index](auto entity, auto& model, const auto& transform){
+            auto bounds = world_bounds.get( index++ );
+            // skins are culled by the bounds of their posed joints
+            auto skin_ptr = palettes_ptr != nullptr ? registry.try_get<Skin>( entity ) : nullptr;
+            if( skin_ptr != nullptr ) {
+                if( skin_ptr->palette == Skin::NO_PALETTE
+                        || ( culling_ptr != nullptr && !culling_ptr->visible( skin_ptr->bounds ) ) ) {
+                    return;
+                }
+                skinned_draws.push_back( ModelDraw{ entity, &model, &model.mesh, &transform, skin_ptr->bounds, 0.0 } );
+                return;
+            }
+            if( culling_ptr != nullptr && !culling_ptr->visible( bounds ) ) {
+                return;
+            }
+            // coarser mesh for models covering little of the screen
+            const Mesh* mesh = &model.mesh;
+            auto lod_ptr = registry.try_get<LODGroup>( entity );
+            if( lod_ptr != nullptr && camera.camera != nullptr ) {
+                auto level = lod_ptr->select( projected_size( bounds, camera.eye, camera.camera->projection_matrix ) );
+                if( level != nullptr ) {
+                    mesh = level;
                 }
             }
-            model.mesh.draw( *model.program );
-            if( material_ptr != nullptr ) {
-                model.program->uniform( "material", Material{} );
-                glEnable(GL_CULL_FACE);
+            auto center = ( bounds.min() + bounds.max() ) * 0.5f;
+            auto offset = center - camera.eye;
+            draws.push_back( ModelDraw{ entity, &model, mesh, &transform, bounds, glm::dot( offset, offset ) } );
+    });
+    std::sort( draws.begin(), draws.end(), []( const ModelDraw& a, const ModelDraw& b ){
+            return a.distance < b.distance;
+    });
+
+    // depth only pass, the shading pass then only passes the visible surface
+    bool prepass = prepass_ptr != nullptr && prepass_ptr->enabled();
+    if( prepass ) {
+        auto& depth_program = prepass_ptr->program();
+        glColorMask( GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE );
+        for( const auto& draw : draws ) {
+            set_cull_face( registry.try_get<Material>( draw.entity ) );
+            depth_program.uniform( "model_transform", draw.transform->global_matrix() );
+            draw.mesh->draw_positions( depth_program );
+        }
+        glColorMask( GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE );
+        glDepthFunc( GL_EQUAL );
+        glDepthMask( GL_FALSE );
+    }
+    if( prepass_ptr != nullptr ) {
+        prepass_ptr->begin_count();
+    }
+
+    for( const auto& draw : draws ) {
+        auto& model = *draw.model;
+        model.program->uniform( "model_transform", draw.transform->global_matrix() );
+        // ranged lights only reach models their bounds touch
+        if( frame_lights_ptr != nullptr && !frame_lights_ptr->ranged.empty() ) {
+            frame_lights_ptr->bind( *model.program, draw.bounds );
+        }
+        auto material_ptr = registry.try_get<Material>( draw.entity );
+        // materials live in a uniform buffer, only their index changes per draw
+        if( material_buffer_ptr != nullptr ) {
+            material_buffer_ptr->bind( *model.program );
+            GLuint material_index = material_ptr != nullptr ? material_buffer_ptr->index( *material_ptr ) : 0;
+            model.program->uniform( "material_index", material_index );
+        }
+        if( material_ptr != nullptr && residency_ptr != nullptr ) {
+            touch_textures( *residency_ptr, *material_ptr );
+        }
+        set_cull_face( material_ptr );
+        draw.mesh->draw( *model.program );
+    }
+    glEnable(GL_CULL_FACE);
+
+    if( prepass_ptr != nullptr || culling_ptr != nullptr ) {
+        auto window = registry.ctx<WindowHandler>();
+        if( prepass_ptr != nullptr ) {
+            prepass_ptr->end_count( window->width(), window->height() );
+        }
+        // drawn models occlude the next frame
+        if( culling_ptr != nullptr ) {
+            culling_ptr->capture( window->width(), window->height() );
+        }
+    }
+    if( prepass ) {
+        glDepthFunc( GL_LESS );
+        glDepthMask( GL_TRUE );
+    }
+
+    if( !skinned_draws.empty() ) {
+        draw_skinned( registry, *palettes_ptr, skinned_draws );
+    }
+}
+
+MeshMemoryReport mesh_memory_report( entt::registry& registry ) {
+    MeshMemoryReport report;
+    // copies of a mesh share their buffers
+    std::unordered_set<GLuint> counted;
+    auto add_mesh = [&report, &counted]( const Mesh& mesh ) {
+        if( !counted.insert( mesh.id() ).second ) {
+            return;
+        }
+        report.meshes++;
+        report.vertex_bytes += mesh.vertex_memory();
+        report.index_bytes += mesh.index_memory();
+        report.index_bytes_32bit += mesh.index_count() * sizeof(GLuint);
+    };
+    registry.view<Model>().each([&add_mesh](auto, const auto& model){
+            add_mesh( model.mesh );
+    });
+    registry.view<LODGroup>().each([&add_mesh](auto, const auto& lod){
+            for( const auto& level : lod.levels() ) {
+                add_mesh( level.mesh );
             }
     });
+    spdlog::info("Mesh memory: {} meshes, {} KiB vertices, {} KiB indices ({} KiB saved by 16-bit indices)",
+            report.meshes, report.vertex_bytes / 1024, report.index_bytes / 1024,
+            ( report.index_bytes_32bit - report.index_bytes ) / 1024);
+    return report;
 }
@@ -0,0 +1,197 @@
+#include "occlusion.hpp"
+
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+OcclusionCulling::OcclusionCulling( unsigned int base_width, bool enabled )
+    : _base_width{std::max( base_width, 1u )}, _enabled{enabled} {
+    for( auto& readback : _readbacks ) {
+        glGenBuffers( 1, &readback.buffer );
+    }
+}
+
+OcclusionCulling::~OcclusionCulling() {
+    for( auto& readback : _readbacks ) {
+        glDeleteBuffers( 1, &readback.buffer );
+    }
+}
+
+void OcclusionCulling::begin( const glm::mat4& view, const glm::mat4& projection, float near ) {
+    _view = view;
+    _projection = projection;
+    _near = near;
+    _frustum = Frustum{ projection * view };
+    _tested = 0;
+    _frustum_culled = 0;
+    _occlusion_culled = 0;
+    if( !_enabled ) {
+        // depth read before disabling no longer matches the scene
+        _levels.clear();
+        return;
+    }
+
+    // the read back issued last frame, mapping it waits at most for that frame
+    auto& readback = _readbacks[1 - _current];
+    if( readback.pending ) {
+        glBindBuffer( GL_PIXEL_PACK_BUFFER, readback.buffer );
+        auto depth = static_cast<const float*>( glMapBuffer( GL_PIXEL_PACK_BUFFER, GL_READ_ONLY ) );
+        if( depth != nullptr ) {
+            _build( readback, depth );
+            glUnmapBuffer( GL_PIXEL_PACK_BUFFER );
+        }
+        glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+        readback.pending = false;
+    }
+}
+
+void OcclusionCulling::capture( unsigned int width, unsigned int height ) {
+    if( !_enabled || width == 0 || height == 0 ) {
+        return;
+    }
+    auto& readback = _readbacks[_current];
+    glBindBuffer( GL_PIXEL_PACK_BUFFER, readback.buffer );
+    if( readback.width != width || readback.height != height ) {
+        glBufferData( GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * sizeof(GLfloat), nullptr, GL_STREAM_READ );
+    }
+    // asynchronous, the copy goes to the pixel pack buffer
+    glReadPixels( 0, 0, width, height, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr );
+    glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+
+    readback.width = width;
+    readback.height = height;
+    readback.view = _view;
+    readback.projection = _projection;
+    readback.near = _near;
+    readback.pending = true;
+    _current = 1 - _current;
+}
+
+void OcclusionCulling::_build( const Readback& readback, const float* depth ) {
+    unsigned int width = std::min( _base_width, readback.width );
+    unsigned int height = std::max( 1u, (unsigned int)std::lround( (double)width * readback.height / readback.width ) );
+
+    _levels.clear();
+    _widths.clear();
+    _heights.clear();
+
+    // finest level, farthest depth of the pixels under each texel
+    std::vector<float> base( width * height );
+    for( unsigned int y=0; y<height; y++ ) {
+        unsigned int y0 = y * readback.height / height;
+        unsigned int y1 = std::max( y0 + 1, ( y + 1 ) * readback.height / height );
+        for( unsigned int x=0; x<width; x++ ) {
+            unsigned int x0 = x * readback.width / width;
+            unsigned int x1 = std::max( x0 + 1, ( x + 1 ) * readback.width / width );
+            float farthest = 0.0;
+            for( unsigned int py=y0; py<y1; py++ ) {
+                const float* row = depth + (size_t)py * readback.width;
+                for( unsigned int px=x0; px<x1; px++ ) {
+                    farthest = std::max( farthest, row[px] );
+                }
+            }
+            base[x + y*width] = farthest;
+        }
+    }
+    _levels.push_back( std::move( base ) );
+    _widths.push_back( width );
+    _heights.push_back( height );
+
+    // halve until a single texel, odd edges fold into the last texel
+    while( width > 1 || height > 1 ) {
+        unsigned int next_width = std::max( 1u, width / 2 );
+        unsigned int next_height = std::max( 1u, height / 2 );
+        const auto& previous = _levels.back();
+        std::vector<float> level( next_width * next_height, 0.0 );
+        for( unsigned int y=0; y<height; y++ ) {
+            unsigned int ny = std::min( y / 2, next_height - 1 );
+            for( unsigned int x=0; x<width; x++ ) {
+                unsigned int nx = std::min( x / 2, next_width - 1 );
+                auto& texel = level[nx + ny*next_width];
+                texel = std::max( texel, previous[x + y*width] );
+            }
+        }
+        _levels.push_back( std::move( level ) );
+        _widths.push_back( next_width );
+        _heights.push_back( next_height );
+        width = next_width;
+        height = next_height;
+    }
+
+    _pyramid_view = readback.view;
+    _pyramid_projection = readback.projection;
+    _pyramid_near = readback.near;
+}
+
+bool OcclusionCulling::_occluded( const Box& box ) const {
+    if( _levels.empty() ) {
+        return false;
+    }
+    // screen rectangle and nearest depth of the box in the pyramid frame
+    float min_x = std::numeric_limits<float>::infinity(), min_y = min_x;
+    float max_x = -std::numeric_limits<float>::infinity(), max_y = max_x;
+    float nearest = std::numeric_limits<float>::infinity();
+    const auto& p1 = box.min();
+    const auto& p2 = box.max();
+    for( unsigned int corner=0; corner<8; corner++ ) {
+        glm::vec4 position{ corner & 1 ? p2.x : p1.x, corner & 2 ? p2.y : p1.y, corner & 4 ? p2.z : p1.z, 1.0 };
+        auto view_position = _pyramid_view * position;
+        // crossing the near plane, can't be tested
+        if( view_position.z > _pyramid_near ) {
+            return false;
+        }
+        auto clip = _pyramid_projection * view_position;
+        glm::vec3 ndc{ clip.x / clip.w, clip.y / clip.w, clip.z / clip.w };
+        min_x = std::min( min_x, ndc.x );
+        min_y = std::min( min_y, ndc.y );
+        max_x = std::max( max_x, ndc.x );
+        max_y = std::max( max_y, ndc.y );
+        nearest = std::min( nearest, ndc.z * 0.5f + 0.5f );
+    }
+
+    // finest level texels covered
+    float base_width = _widths.front();
+    float base_height = _heights.front();
+    float x0 = std::max( ( min_x * 0.5f + 0.5f ) * base_width, 0.0f );
+    float y0 = std::max( ( min_y * 0.5f + 0.5f ) * base_height, 0.0f );
+    float x1 = std::min( ( max_x * 0.5f + 0.5f ) * base_width, base_width - 1.0f );
+    float y1 = std::min( ( max_y * 0.5f + 0.5f ) * base_height, base_height - 1.0f );
+    if( x0 > x1 || y0 > y1 ) {
+        return false;
+    }
+
+    // level where the rectangle covers at most 2x2 texels
+    float size = std::max( x1 - x0, y1 - y0 );
+    unsigned int level = size > 1.0f ? (unsigned int)std::ceil( std::log2( size ) ) : 0;
+    level = std::min( level, (unsigned int)_levels.size() - 1 );
+
+    const auto& depth = _levels[level];
+    unsigned int width = _widths[level];
+    unsigned int height = _heights[level];
+    unsigned int tx0 = std::min( (unsigned int)x0 >> level, width - 1 );
+    unsigned int ty0 = std::min( (unsigned int)y0 >> level, height - 1 );
+    unsigned int tx1 = std::min( (unsigned int)x1 >> level, width - 1 );
+    unsigned int ty1 = std::min( (unsigned int)y1 >> level, height - 1 );
+    float farthest = 0.0;
+    for( unsigned int y=ty0; y<=ty1; y++ ) {
+        for( unsigned int x=tx0; x<=tx1; x++ ) {
+            farthest = std::max( farthest, depth[x + y*width] );
+        }
+    }
+    return nearest > farthest;
+}
+
+bool OcclusionCulling::visible( const Box& box ) {
+    _tested++;
+    if( !_frustum.intersects( box ) ) {
+        _frustum_culled++;
+        return false;
+    }
+    if( _enabled && _occluded( box ) ) {
+        _occlusion_culled++;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,127 @@
+#include "program_binary_cache.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include <filesystem>
+#include <fstream>
+
+namespace {
+    // cache file header
+    constexpr char MAGIC[4] = { 'R', 'P', 'B', '1' };
+
+    // FNV-1a, stable between runs and standard library versions
+    uint64_t hash( uint64_t value, const void* data, size_t size ) {
+        auto bytes = reinterpret_cast<const unsigned char*>( data );
+        for( size_t i=0; i<size; i++ ) {
+            value ^= bytes[i];
+            value *= 0x100000001b3ull;
+        }
+        return value;
+    }
+
+    std::string gl_string( GLenum name ) {
+        auto value = glGetString( name );
+        return value != nullptr ? std::string{ reinterpret_cast<const char*>( value ) } : std::string{};
+    }
+}
+
+ProgramBinaryCache::ProgramBinaryCache( const std::string& directory ) : _directory{directory} {
+    _driver = gl_string( GL_VENDOR ) + std::string{"|"} + gl_string( GL_RENDERER ) + std::string{"|"} + gl_string( GL_VERSION );
+
+    if( gl_version_at_least( 4, 1 ) || gl_extension_supported( "GL_ARB_get_program_binary" ) ) {
+        _get_program_binary = reinterpret_cast<PFNGLGETPROGRAMBINARYPROC>( gl_extension_function( "glGetProgramBinary" ) );
+        _program_binary = reinterpret_cast<PFNGLPROGRAMBINARYPROC>( gl_extension_function( "glProgramBinary" ) );
+        GLint formats = 0;
+        glGetIntegerv( GL_NUM_PROGRAM_BINARY_FORMATS, &formats );
+        _supported = _get_program_binary != nullptr && _program_binary != nullptr && formats > 0;
+    }
+
+    if( _supported ) {
+        std::error_code error;
+        std::filesystem::create_directories( _directory, error );
+        if( error ) {
+            spdlog::warn("Could not create shader cache directory '{}': {}", _directory, error.message());
+            _supported = false;
+        }
+    }
+    spdlog::debug("Program binary cache: supported={}, driver '{}'", _supported, _driver);
+}
+
+uint64_t ProgramBinaryCache::key( const std::vector<std::pair<Shader::Type, std::string>>& sources ) const {
+    uint64_t value = 0xcbf29ce484222325ull;
+    value = hash( value, _driver.data(), _driver.size() );
+    for( const auto& source : sources ) {
+        auto type = (GLenum)source.first;
+        uint64_t size = source.second.size();
+        value = hash( value, &type, sizeof(type) );
+        value = hash( value, &size, sizeof(size) );
+        value = hash( value, source.second.data(), source.second.size() );
+    }
+    return value;
+}
+
+GLuint ProgramBinaryCache::load( uint64_t key ) {
+    if( !_supported ) {
+        _misses++;
+        return 0;
+    }
+
+    std::ifstream file( _path( key ), std::ios::binary );
+    char magic[4] = {};
+    uint64_t stored_key = 0;
+    GLenum format = 0;
+    file.read( magic, sizeof(magic) );
+    file.read( reinterpret_cast<char*>( &stored_key ), sizeof(stored_key) );
+    file.read( reinterpret_cast<char*>( &format ), sizeof(format) );
+    if( !file || std::string{ magic, 4 } != std::string{ MAGIC, 4 } || stored_key != key ) {
+        _misses++;
+        return 0;
+    }
+    std::vector<char> binary{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+
+    GLuint program_id = glCreateProgram();
+    _program_binary( program_id, format, binary.data(), binary.size() );
+
+    // drivers reject binaries of other versions, fall back to compile
+    GLint status_ok = GL_FALSE;
+    glGetProgramiv( program_id, GL_LINK_STATUS, &status_ok );
+    if( !status_ok ) {
+        glDeleteProgram( program_id );
+        std::error_code error;
+        std::filesystem::remove( _path( key ), error );
+        spdlog::debug("Driver rejected cached program binary {:016x}", key);
+        _misses++;
+        return 0;
+    }
+
+    _hits++;
+    return program_id;
+}
+
+void ProgramBinaryCache::store( uint64_t key, GLuint program ) {
+    if( !_supported ) {
+        return;
+    }
+
+    GLint length = 0;
+    glGetProgramiv( program, GL_PROGRAM_BINARY_LENGTH, &length );
+    if( length <= 0 ) {
+        return;
+    }
+    std::vector<char> binary( length );
+    GLenum format = 0;
+    _get_program_binary( program, length, nullptr, &format, binary.data() );
+
+    std::ofstream file( _path( key ), std::ios::binary | std::ios::trunc );
+    file.write( MAGIC, sizeof(MAGIC) );
+    file.write( reinterpret_cast<const char*>( &key ), sizeof(key) );
+    file.write( reinterpret_cast<const char*>( &format ), sizeof(format) );
+    file.write( binary.data(), binary.size() );
+    if( !file ) {
+        spdlog::warn("Could not write program binary '{}'", _path( key ));
+    }
+}
+
+std::string ProgramBinaryCache::_path( uint64_t key ) const {
+    return _directory + std::string{"/"} + fmt::format( "{:016x}", key ) + std::string{".bin"};
+}
@@ -0,0 +1,62 @@
+#include "raycast.hpp"
+
+#include "models.hpp"
+#include "transform.hpp"
+#include "geometry/box_batch.hpp"
+
+#include "spdlog/spdlog.h"
+
+// rays per pool task, small batches aren't worth the hand off
+static constexpr size_t RAYS_PER_TASK = 1024;
+
+void Raycaster::update( entt::registry& registry ) {
+    _entities.clear();
+    std::vector<Affine> transforms;
+    BoxBatch local_bounds, world_bounds;
+    auto view = registry.group<Model>(entt::get<Transform>, entt::exclude<Hidden>);
+    for( auto entity : view ) {
+        _entities.push_back( entity );
+        transforms.push_back( view.get<Transform>( entity ).global_affine() );
+        local_bounds.push_back( view.get<Model>( entity ).mesh.bounding_box() );
+    }
+    box_op::transform( transforms.data(), local_bounds, world_bounds );
+    _bounds.resize( _entities.size() );
+    for( size_t i=0; i<_bounds.size(); i++ ) {
+        _bounds[i] = world_bounds.get( i );
+    }
+    _bvh = BVH{ _bounds };
+    spdlog::debug("Raycaster BVH with {} nodes over {} models", _bvh.nodes().size(), _entities.size());
+}
+
+std::vector<RayHit> Raycaster::intersect( const std::vector<Ray>& rays ) const {
+    std::vector<RayHit> results( rays.size() );
+    _pool.parallel_for( 0, rays.size(), [this, &rays, &results]( size_t begin, size_t end ){
+            for( size_t first=begin; first<end; first+=PACKET_SIZE ) {
+                size_t count = std::min( PACKET_SIZE, end - first );
+                RayPacket<PACKET_SIZE> packet;
+                for( size_t lane=0; lane<count; lane++ ) {
+                    packet.set( lane, rays[first + lane] );
+                }
+                BVH::Hit hits[PACKET_SIZE];
+                _bvh.intersect( _bounds, packet, hits );
+                for( size_t lane=0; lane<count; lane++ ) {
+                    if( hits[lane].primitive != BVH::NO_HIT ) {
+                        results[first + lane] = RayHit{ _entities[ hits[lane].primitive ], hits[lane].distance,
+                            packet.point( lane, hits[lane].distance ) };
+                    }
+                }
+            }
+    }, RAYS_PER_TASK );
+    return results;
+}
+
+RayHit Raycaster::intersect( const Ray& ray ) const {
+    RayPacket<1> packet;
+    packet.set( 0, ray );
+    BVH::Hit hit;
+    _bvh.intersect( _bounds, packet, &hit );
+    if( hit.primitive == BVH::NO_HIT ) {
+        return RayHit{};
+    }
+    return RayHit{ _entities[ hit.primitive ], hit.distance, packet.point( 0, hit.distance ) };
+}
@@ -0,0 +1,91 @@
+#include "shader_preprocessor.hpp"
+
+#include "shaders.hpp"
+#include "gl_extensions.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <unordered_set>
+
+namespace {
+
+    std::string directory_of( const std::string& path ) {
+        auto separator = path.find_last_of( '/' );
+        return separator == std::string::npos ? std::string{} : path.substr( 0, separator + 1 );
+    }
+
+    // Return included file name if line is an #include directive
+    bool include_name( const std::string& line, std::string& name ) {
+        auto start = line.find_first_not_of( " \t" );
+        if( start == std::string::npos || line.compare( start, 8, "#include" ) != 0 ) {
+            return false;
+        }
+        auto open = line.find( '"', start + 8 );
+        auto close = open == std::string::npos ? std::string::npos : line.find( '"', open + 1 );
+        if( close == std::string::npos ) {
+            throw ShaderException{ std::string{"Malformed include: "} + line };
+        }
+        name = line.substr( open + 1, close - open - 1 );
+        return true;
+    }
+
+    bool is_version( const std::string& line ) {
+        auto start = line.find_first_not_of( " \t" );
+        return start != std::string::npos && line.compare( start, 8, "#version" ) == 0;
+    }
+
+    void expand( const std::string& path, std::unordered_set<std::string>& included, int& next_source, std::ostringstream& out, const std::vector<std::string>* defines ) {
+        std::ifstream file( path );
+        if( !file ) {
+            throw ShaderException{ std::string{"Could not open shader source '"} + path + std::string{"'"} };
+        }
+        included.insert( path );
+        int source = next_source++;
+        if( defines == nullptr ) {
+            out << "#line 1 " << source << '\n';
+        }
+
+        std::string line;
+        int line_number = 0;
+        while( std::getline( file, line ) ) {
+            line_number++;
+            std::string name;
+            if( is_version( line ) ) {
+                // only the top level file keeps its version, defines follow it
+                if( defines != nullptr ) {
+                    out << line << '\n';
+                    for( const auto& define : *defines ) {
+                        out << "#define " << define << '\n';
+                    }
+                    out << "#line " << line_number + 1 << ' ' << source << '\n';
+                } else {
+                    out << '\n';
+                }
+            } else if( include_name( line, name ) ) {
+                auto include_path = directory_of( path ) + name;
+                if( included.count( include_path ) == 0 ) {
+                    expand( include_path, included, next_source, out, nullptr );
+                    // keep error line numbers pointing into this file
+                    out << "#line " << line_number + 1 << ' ' << source << '\n';
+                } else {
+                    out << '\n';
+                }
+            } else {
+                out << line << '\n';
+            }
+        }
+    }
+}
+
+std::string preprocess_shader( const std::string& path, const std::vector<std::string>& defines ) {
+    std::unordered_set<std::string> included;
+    std::ostringstream out;
+    int next_source = 0;
+    // texture pools are sampled through handles exactly when TexturePools uses them
+    auto all_defines = defines;
+    if( gl_bindless_textures_supported() ) {
+        all_defines.emplace_back( "BINDLESS_TEXTURES" );
+    }
+    expand( path, included, next_source, out, &all_defines );
+    return out.str();
+}
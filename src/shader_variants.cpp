@@ -0,0 +1,185 @@
+#include "shader_variants.hpp"
+
+#include "shader_preprocessor.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+// ShaderPermutation struct
+
+ShaderPermutation ShaderPermutation::from_material( const Material& material, unsigned int max_lights ) {
+    ShaderPermutation permutation;
+    permutation.diffuse_texture = !material.diffuse_textures().empty();
+    permutation.specular_texture = !material.specular_textures().empty();
+    permutation.two_sided = material.twosided();
+    permutation.max_lights = max_lights;
+    return permutation;
+}
+
+std::vector<std::string> ShaderPermutation::defines() const {
+    // PERMUTATION disables the defaults used by programs built without a permutation
+    std::vector<std::string> defines{ "PERMUTATION" };
+    if( diffuse_texture ) {
+        defines.emplace_back( "HAS_DIFFUSE_TEX" );
+    }
+    if( specular_texture ) {
+        defines.emplace_back( "HAS_SPECULAR_TEX" );
+    }
+    if( two_sided ) {
+        defines.emplace_back( "TWO_SIDED" );
+    }
+    if( skinned ) {
+        defines.emplace_back( "SKINNED" );
+    }
+    defines.push_back( std::string{"MAX_LIGHTS "} + std::to_string( max_lights ) );
+    return defines;
+}
+
+std::string ShaderPermutation::name() const {
+    std::string name;
+    if( diffuse_texture ) {
+        name += "HAS_DIFFUSE_TEX|";
+    }
+    if( specular_texture ) {
+        name += "HAS_SPECULAR_TEX|";
+    }
+    if( two_sided ) {
+        name += "TWO_SIDED|";
+    }
+    if( skinned ) {
+        name += "SKINNED|";
+    }
+    return name + std::string{"MAX_LIGHTS="} + std::to_string( max_lights );
+}
+
+bool ShaderPermutation::operator==( const ShaderPermutation& other ) const {
+    return diffuse_texture == other.diffuse_texture
+        && specular_texture == other.specular_texture
+        && two_sided == other.two_sided
+        && skinned == other.skinned
+        && max_lights == other.max_lights;
+}
+
+// ShaderVariants class
+
+ShaderVariants::ShaderVariants( entt::resource_cache<ShaderProgram>& cache, ProgramBinaryCache* binary_cache )
+    : _cache{cache}, _binary_cache{binary_cache} {
+    PFNGLMAXSHADERCOMPILERTHREADSKHRPROC max_threads = nullptr;
+    if( gl_extension_supported( "GL_KHR_parallel_shader_compile" ) ) {
+        max_threads = reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSKHRPROC>( gl_extension_function( "glMaxShaderCompilerThreadsKHR" ) );
+    } else if( gl_extension_supported( "GL_ARB_parallel_shader_compile" ) ) {
+        max_threads = reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSKHRPROC>( gl_extension_function( "glMaxShaderCompilerThreadsARB" ) );
+    }
+    if( max_threads != nullptr ) {
+        // let the driver pick the number of threads
+        max_threads( 0xFFFFFFFF );
+        _parallel = true;
+    }
+}
+
+entt::resource_handle<ShaderProgram> ShaderVariants::get( const ShaderSources& sources, const ShaderPermutation& permutation ) {
+    auto name = _name( sources, permutation );
+    auto id = entt::hashed_string{ name.c_str() };
+    if( !_cache.contains( id ) ) {
+        prepare( sources, { permutation } );
+        if( !_cache.contains( id ) ) {
+            throw ShaderException{ std::string{"Could not build shader permutation "} + name };
+        }
+    }
+    return _cache.handle( id );
+}
+
+void ShaderVariants::prepare( const ShaderSources& sources, const std::vector<ShaderPermutation>& permutations ) {
+    struct Pending {
+        std::string name;
+        uint64_t key = 0;
+        std::vector<Shader> shaders;
+        std::shared_ptr<ShaderProgram> program;
+    };
+    std::vector<Pending> pending;
+    size_t hits = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    // start every compilation before waiting on any of them
+    for( const auto& permutation : permutations ) {
+        auto name = _name( sources, permutation );
+        auto id = entt::hashed_string{ name.c_str() };
+        bool queued = std::find_if( pending.begin(), pending.end(), [&name]( const auto& p ){ return p.name == name; } ) != pending.end();
+        if( queued || _cache.contains( id ) ) {
+            continue;
+        }
+
+        std::vector<std::pair<Shader::Type, std::string>> shader_sources;
+        try {
+            auto defines = permutation.defines();
+            for( const auto& path : sources.vertex ) {
+                shader_sources.emplace_back( Shader::Type::VERTEX, preprocess_shader( path, defines ) );
+            }
+            for( const auto& path : sources.fragment ) {
+                shader_sources.emplace_back( Shader::Type::FRAGMENT, preprocess_shader( path, defines ) );
+            }
+        } catch( ShaderException& e ) {
+            spdlog::error("Shader permutation '{}': {}", name, e.what());
+            continue;
+        }
+
+        Pending entry;
+        entry.name = name;
+        if( _binary_cache != nullptr ) {
+            entry.key = _binary_cache->key( shader_sources );
+            auto program_id = _binary_cache->load( entry.key );
+            if( program_id != 0 ) {
+                std::shared_ptr<ShaderProgram> program{ new ShaderProgram{ program_id }, ShaderProgramDeleter{} };
+                _cache.load<ShaderProgramLoader>( id, program );
+                hits++;
+                continue;
+            }
+        }
+        for( const auto& source : shader_sources ) {
+            entry.shaders.emplace_back( source.first, source.second, false );
+        }
+        pending.push_back( std::move( entry ) );
+    }
+
+    bool retrievable = _binary_cache != nullptr && _binary_cache->supported();
+    for( auto& entry : pending ) {
+        entry.program.reset( new ShaderProgram{ entry.shaders, retrievable, false }, ShaderProgramDeleter{} );
+    }
+
+    // status queries wait for each program in turn
+    for( auto& entry : pending ) {
+        try {
+            for( const auto& shader : entry.shaders ) {
+                shader.check();
+            }
+            entry.program->check();
+        } catch( ShaderException& e ) {
+            spdlog::error("Shader permutation '{}': {}", entry.name, e.what());
+            continue;
+        }
+        if( _binary_cache != nullptr ) {
+            _binary_cache->store( entry.key, *entry.program );
+        }
+        _cache.load<ShaderProgramLoader>( entt::hashed_string{ entry.name.c_str() }, entry.program );
+    }
+
+    if( !pending.empty() || hits > 0 ) {
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        spdlog::info("Built {} shader permutations ({} from binary cache) in {:.1f} ms, parallel={}",
+                pending.size() + hits, hits, elapsed.count(), _parallel);
+    }
+}
+
+std::string ShaderVariants::_name( const ShaderSources& sources, const ShaderPermutation& permutation ) {
+    std::string name;
+    for( const auto& path : sources.vertex ) {
+        name += path + std::string{";"};
+    }
+    for( const auto& path : sources.fragment ) {
+        name += path + std::string{";"};
+    }
+    return name + permutation.name();
+}
@@ -1,13 +1,16 @@
 #include "shaders.hpp"
 
 #include "matrix_op.hpp"
+#include "gl_extensions.hpp"
+#include "program_binary_cache.hpp"
+#include "shader_preprocessor.hpp"
 
 #include "spdlog/spdlog.h"
 
-#include <fstream>
+#include <chrono>
 
 // Shader class
-Shader::Shader(Shader::Type type, std::string& source) {
+Shader::Shader(Shader::Type type, const std::string& source, bool wait) {
     GLuint shader_id = glCreateShader( (GLuint)type );
     const GLchar* source_ptr = source.c_str();
 
@@ -15,7 +18,22 @@ Shader::Shader(Shader::Type type, std::string& source) {
     glShaderSource(shader_id, 1, &source_ptr, NULL);
     glCompileShader( shader_id );
 
+    _shader_id_shared.reset(new GLuint{shader_id});
+
     // check status
+    if( wait ) {
+        try {
+            check();
+        } catch( ShaderException& e ) {
+            glDeleteShader( shader_id );
+            throw;
+        }
+    }
+    spdlog::debug("Created shader, id={}", *_shader_id_shared);
+}
+
+void Shader::check() const {
+    auto shader_id = *_shader_id_shared;
     GLint status_ok;
     glGetShaderiv( shader_id, GL_COMPILE_STATUS, &status_ok );
     if( !status_ok ) {
@@ -30,12 +48,8 @@ Shader::Shader(Shader::Type type, std::string& source) {
             delete[] log_info_cstr;
         }
 
-        glDeleteShader( shader_id );
         throw ShaderException{ std::string{"Shader compilation error:\n"} + log_info };
     }
-
-    _shader_id_shared.reset(new GLuint{shader_id});
-    spdlog::debug("Created shader, id={}", *_shader_id_shared);
 }
 
 Shader::~Shader() {
@@ -47,9 +61,19 @@ Shader::~Shader() {
 
 // ShaderProgram class
 
-ShaderProgram::ShaderProgram(std::vector<Shader> shaders) {
+std::atomic<uint64_t> ShaderProgram::_next_id{1};
+
+ShaderProgram::ShaderProgram(std::vector<Shader> shaders, bool retrievable, bool wait) {
     GLuint program_id = glCreateProgram();
 
+    // hint must be set before linking for the binary to be retrievable
+    if( retrievable ) {
+        auto program_parameter = reinterpret_cast<PFNGLPROGRAMPARAMETERIPROC>( gl_extension_function( "glProgramParameteri" ) );
+        if( program_parameter != nullptr ) {
+            program_parameter( program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE );
+        }
+    }
+
     // Link program
     for( const auto& shader : shaders ) {
         glAttachShader( program_id, shader );
@@ -59,27 +83,41 @@ ShaderProgram::ShaderProgram(std::vector<Shader> shaders) {
         glDetachShader( program_id, shader );
     }
 
+    _program_id = program_id;
+
     // check status
+    if( wait ) {
+        try {
+            check();
+        } catch( ShaderException& e ) {
+            glDeleteProgram( program_id );
+            throw;
+        }
+    }
+    spdlog::debug("Created shader program, id={}", _program_id);
+}
+
+void ShaderProgram::check() const {
     GLint status_ok;
-    glGetProgramiv( program_id, GL_LINK_STATUS, &status_ok );
+    glGetProgramiv( _program_id, GL_LINK_STATUS, &status_ok );
     if( !status_ok ) {
         std::string log_info;
 
         GLint log_info_len;
-        glGetProgramiv( program_id, GL_INFO_LOG_LENGTH, &log_info_len );
+        glGetProgramiv( _program_id, GL_INFO_LOG_LENGTH, &log_info_len );
         if( log_info_len > 0 ) {
             char* log_info_cstr = new char[log_info_len];
-            glGetProgramInfoLog( program_id, log_info_len, NULL, log_info_cstr );
+            glGetProgramInfoLog( _program_id, log_info_len, NULL, log_info_cstr );
             log_info = std::string{ log_info_cstr };
             delete[] log_info_cstr;
         }
 
-        glDeleteProgram( program_id );
         throw ShaderException{ std::string{"ShaderProgram link error:\n"} + log_info };
     }
+}
 
-    _program_id = program_id;
-    spdlog::debug("Created shader program, id={}", _program_id);
+ShaderProgram::ShaderProgram(GLuint program_id) : _program_id{program_id} {
+    spdlog::debug("Created shader program from binary, id={}", _program_id);
 }
 
 /*
@@ -99,6 +137,12 @@ void ShaderProgram::use() const {
     for( auto& uniform : _uniforms_to_set_m4 ) {
         glUniformMatrix4fv( uniform.first, 1, GL_FALSE, glm::value_ptr(uniform.second) );
     }
+    // mat4 arrays
+    for( auto& uniform : _uniforms_to_set_m4v ) {
+        if( !uniform.second.empty() ) {
+            glUniformMatrix4fv( uniform.first, uniform.second.size(), GL_FALSE, glm::value_ptr(uniform.second[0]) );
+        }
+    }
     // vec3
     for( auto& uniform : _uniforms_to_set_v3 ) {
         glUniform3fv( uniform.first, 1, glm::value_ptr(uniform.second) );
@@ -107,6 +151,12 @@ void ShaderProgram::use() const {
     for( auto& uniform : _uniforms_to_set_v4 ) {
         glUniform4fv( uniform.first, 1, glm::value_ptr(uniform.second) );
     }
+    // vec4 arrays
+    for( auto& uniform : _uniforms_to_set_v4v ) {
+        if( !uniform.second.empty() ) {
+            glUniform4fv( uniform.first, uniform.second.size(), glm::value_ptr(uniform.second[0]) );
+        }
+    }
     // floats
     for( auto uniform : _uniforms_to_set_f ) {
         glUniform1f( uniform.first, uniform.second );
@@ -115,6 +165,12 @@ void ShaderProgram::use() const {
     for( auto uniform : _uniforms_to_set_u ) {
         glUniform1ui( uniform.first, uniform.second );
     }
+    // uint arrays
+    for( auto& uniform : _uniforms_to_set_uv ) {
+        if( !uniform.second.empty() ) {
+            glUniform1uiv( uniform.first, uniform.second.size(), uniform.second.data() );
+        }
+    }
     // ints
     for( auto uniform : _uniforms_to_set_i ) {
         glUniform1i( uniform.first, uniform.second );
@@ -125,10 +181,13 @@ void ShaderProgram::use() const {
         glBindTexture(GL_TEXTURE_2D, texture.second);
     }
     _uniforms_to_set_m4.clear();
+    _uniforms_to_set_m4v.clear();
     _uniforms_to_set_v4.clear();
+    _uniforms_to_set_v4v.clear();
     _uniforms_to_set_v3.clear();
     _uniforms_to_set_f.clear();
     _uniforms_to_set_u.clear();
+    _uniforms_to_set_uv.clear();
     _uniforms_to_set_i.clear();
     _textures_to_set.clear();
 }
@@ -189,38 +248,82 @@ void ShaderProgram::uniform( const std::string& name, const ShaderLight& value )
     auto color_loc = glGetUniformLocation( _program_id, (name + std::string{".color"}).c_str());
     auto outer_angle_loc = glGetUniformLocation( _program_id, (name + std::string{".outer_angle"}).c_str());
     auto inner_angle_loc = glGetUniformLocation( _program_id, (name + std::string{".inner_angle"}).c_str());
+    auto radius_loc = glGetUniformLocation( _program_id, (name + std::string{".radius"}).c_str());
     _uniforms_to_set_u[ type_loc ] = value.type;
     _uniforms_to_set_v4[ position_loc ] = value.position;
     _uniforms_to_set_v4[ direction_loc ] = value.direction;
     _uniforms_to_set_v3[ color_loc ] = value.color;
     _uniforms_to_set_f[ outer_angle_loc ] = std::cos(value.outer_angle);
     _uniforms_to_set_f[ inner_angle_loc ] = std::cos(value.inner_angle);
+    _uniforms_to_set_f[ radius_loc ] = value.radius;
 }
 
 std::shared_ptr<ShaderProgram> ShaderProgramLoader::load( const std::vector<std::string>& vs_paths, const std::vector<std::string>& fs_paths ) const {
-    std::vector<Shader> shaders{};
+    auto start = std::chrono::steady_clock::now();
+    auto program = _compile( _load_sources( vs_paths, fs_paths ), false );
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    spdlog::debug("Compiled shader program '{}' in {:.1f} ms", _program_name( vs_paths, fs_paths ), elapsed.count());
+    return program;
+}
+
+std::shared_ptr<ShaderProgram> ShaderProgramLoader::load( const std::vector<std::string>& vs_paths, const std::vector<std::string>& fs_paths, ProgramBinaryCache& cache ) const {
+    auto start = std::chrono::steady_clock::now();
+    auto sources = _load_sources( vs_paths, fs_paths );
+    auto key = cache.key( sources );
+
+    std::shared_ptr<ShaderProgram> program;
+    auto program_id = cache.load( key );
+    bool hit = program_id != 0;
+    if( hit ) {
+        program.reset( new ShaderProgram{ program_id }, ShaderProgramDeleter{} );
+    } else {
+        program = _compile( sources, cache.supported() );
+        cache.store( key, *program );
+    }
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    spdlog::info("Shader program '{}': cache {} in {:.1f} ms", _program_name( vs_paths, fs_paths ), hit ? "hit" : "miss", elapsed.count());
+    return program;
+}
+
+std::shared_ptr<ShaderProgram> ShaderProgramLoader::load( const std::vector<std::string>& vs_paths, const std::vector<std::string>& fs_paths, const std::vector<std::string>& defines ) const {
+    return _compile( _load_sources( vs_paths, fs_paths, defines ), false );
+}
+
+std::vector<std::pair<Shader::Type, std::string>> ShaderProgramLoader::_load_sources( const std::vector<std::string>& vs_paths, const std::vector<std::string>& fs_paths, const std::vector<std::string>& defines ) const {
+    std::vector<std::pair<Shader::Type, std::string>> sources{};
     for( const auto& vs_path : vs_paths ) {
-        auto vs_src = _load_file(vs_path);
-        shaders.emplace_back( Shader::Type::VERTEX, vs_src );
+        sources.emplace_back( Shader::Type::VERTEX, preprocess_shader( vs_path, defines ) );
     }
     for( const auto& fs_path : fs_paths ) {
-        auto fs_src = _load_file(fs_path);
-        shaders.emplace_back( Shader::Type::FRAGMENT, fs_src );
+        sources.emplace_back( Shader::Type::FRAGMENT, preprocess_shader( fs_path, defines ) );
+    }
+    return sources;
+}
+
+std::shared_ptr<ShaderProgram> ShaderProgramLoader::_compile( const std::vector<std::pair<Shader::Type, std::string>>& sources, bool retrievable ) const {
+    std::vector<Shader> shaders{};
+    for( auto source : sources ) {
+        shaders.emplace_back( source.first, source.second );
     }
 
     std::shared_ptr<ShaderProgram> program{ 
-        new ShaderProgram{ shaders } ,
+        new ShaderProgram{ shaders, retrievable } ,
         ShaderProgramDeleter{}
     };
 
     return program;
 }
 
-std::string ShaderProgramLoader::_load_file( const std::string& path ) const {
-    std::ifstream file( path );
-    std::string source{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
-    file.close();
-    return source;
+std::string ShaderProgramLoader::_program_name( const std::vector<std::string>& vs_paths, const std::vector<std::string>& fs_paths ) {
+    std::string name;
+    for( const auto& path : vs_paths ) {
+        name += ( name.empty() ? std::string{} : std::string{", "} ) + path;
+    }
+    for( const auto& path : fs_paths ) {
+        name += ( name.empty() ? std::string{} : std::string{", "} ) + path;
+    }
+    return name;
 }
 
 
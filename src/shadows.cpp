@@ -0,0 +1,352 @@
+#include "shadows.hpp"
+
+#include "camera.hpp"
+#include "light_buffer.hpp"
+#include "animation.hpp"
+#include "matrix_op.hpp"
+#include "geometry/frustum.hpp"
+
+#include "glm/glm.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <cmath>
+
+// near plane of spotlight shadows
+static constexpr float SPOT_NEAR = 0.05;
+// blend between logarithmic (1) and uniform (0) cascade splits
+static constexpr float SPLIT_LAMBDA = 0.75;
+
+// view matrix at position looking down direction
+static glm::mat4 look_along( const glm::vec3& position, const glm::vec3& direction ) {
+    glm::vec3 forward = glm::normalize( direction );
+    glm::vec3 up = std::fabs( forward.y ) > 0.99 ? glm::vec3{ 1.0, 0.0, 0.0 } : glm::vec3{ 0.0, 1.0, 0.0 };
+    glm::vec3 right = glm::normalize( glm::cross( forward, up ) );
+    up = glm::cross( right, forward );
+
+    glm::mat4 view{1.0};
+    view[0][0] = right.x;    view[1][0] = right.y;    view[2][0] = right.z;
+    view[0][1] = up.x;       view[1][1] = up.y;       view[2][1] = up.z;
+    view[0][2] = -forward.x; view[1][2] = -forward.y; view[2][2] = -forward.z;
+    view[3][0] = -glm::dot( right, position );
+    view[3][1] = -glm::dot( up, position );
+    view[3][2] = glm::dot( forward, position );
+    return view;
+}
+
+ShadowMaps::ShadowMaps( entt::resource_handle<ShaderProgram> depth_program, unsigned int resolution, unsigned int layers )
+    : _depth_program{depth_program}, _resolution{resolution}, _layer_count{std::clamp( layers, 1u, MAX_LAYERS )} {
+    glGenTextures( 1, &_texture );
+    glBindTexture( GL_TEXTURE_2D_ARRAY, _texture );
+    glTexImage3D( GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, _resolution, _resolution, _layer_count, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr );
+    // hardware 2x2 filtered depth comparison
+    glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+    glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+    glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+    glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+    glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE );
+    glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL );
+    glBindTexture( GL_TEXTURE_2D_ARRAY, 0 );
+
+    glGenFramebuffers( 1, &_framebuffer );
+    glBindFramebuffer( GL_FRAMEBUFFER, _framebuffer );
+    glFramebufferTextureLayer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, _texture, 0, 0 );
+    glDrawBuffer( GL_NONE );
+    glReadBuffer( GL_NONE );
+    if( glCheckFramebufferStatus( GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE ) {
+        spdlog::error("Shadow map framebuffer is incomplete");
+    }
+    glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+}
+
+ShadowMaps::~ShadowMaps() {
+    glDeleteFramebuffers( 1, &_framebuffer );
+    glDeleteTextures( 1, &_texture );
+}
+
+void ShadowMaps::update( entt::registry& registry ) {
+    _rendered = 0;
+    _cached = 0;
+    _light_indices.clear();
+    _first_layers.clear();
+    _layer_counts.clear();
+    _splits.clear();
+    _matrices.clear();
+
+    auto light_buffer_ptr = registry.try_ctx<LightBuffer>();
+    if( light_buffer_ptr == nullptr ) {
+        return;
+    }
+    const auto& lights = light_buffer_ptr->lights();
+
+    auto view = registry.view<Shadows, LightColor, Transform>();
+    for( auto entity : view ) {
+        if( _light_indices.size() == MAX_SHADOWS ) {
+            spdlog::debug("More than {} shadowed lights, the rest have no shadows", MAX_SHADOWS);
+            break;
+        }
+        auto index = light_buffer_ptr->index( entity );
+        if( index == LightBuffer::NONE ) {
+            continue;
+        }
+        const auto& light = lights[index];
+        const auto& shadows = view.get<Shadows>( entity );
+        glm::vec3 position{ light.position.x, light.position.y, light.position.z };
+        glm::vec3 direction{ light.direction.x, light.direction.y, light.direction.z };
+
+        size_t first = _matrices.size();
+        glm::vec4 splits{0.0};
+        if( light.type & ShaderLight::Type::Directional ) {
+            unsigned int count = std::clamp( shadows.cascades(), 1u, MAX_CASCADES );
+            if( first + count > _layer_count ) {
+                continue;
+            }
+            if( !_cascades( registry, direction, count, shadows.distance(), _matrices, splits ) ) {
+                continue;
+            }
+        } else if( light.type & ShaderLight::Type::Spotlight ) {
+            if( first + 1 > _layer_count ) {
+                continue;
+            }
+            float range = light.radius > 0.0 ? light.radius : _caster_distance;
+            auto projection = matrix_op::perspective( 2.f*light.outer_angle, 1.0, -SPOT_NEAR, -range );
+            _matrices.push_back( projection * look_along( position, direction ) );
+        } else {
+            continue;
+        }
+
+        _light_indices.push_back( index );
+        _first_layers.push_back( first );
+        _layer_counts.push_back( _matrices.size() - first );
+        _splits.push_back( splits );
+    }
+
+    // skins stale the layers they left and those they are posed in now
+    _changed.insert( _changed.end(), _skin_bounds.begin(), _skin_bounds.end() );
+    _skin_bounds.clear();
+    registry.view<Skin, Model, Transform>(entt::exclude<Hidden>).each([this](auto, const auto& skin, const auto&, const auto&){
+            if( skin.palette != Skin::NO_PALETTE ) {
+                _skin_bounds.push_back( skin.bounds );
+            }
+    });
+    _changed.insert( _changed.end(), _skin_bounds.begin(), _skin_bounds.end() );
+
+    // a layer is stale if its matrix changed or a caster moved inside it
+    std::vector<bool> stale( _matrices.size(), false );
+    bool any_stale = false;
+    for( size_t i=0; i<_matrices.size(); i++ ) {
+        const auto& layer = _layers[i];
+        bool layer_stale = !layer.valid || layer.matrix != _matrices[i];
+        if( !layer_stale && !_changed.empty() ) {
+            Frustum frustum{ _matrices[i] };
+            layer_stale = std::any_of( _changed.begin(), _changed.end(), [&frustum]( const Box& box ){
+                    return frustum.intersects( box );
+            });
+        }
+        stale[i] = layer_stale;
+        any_stale = any_stale || layer_stale;
+    }
+    for( size_t i=_matrices.size(); i<MAX_LAYERS; i++ ) {
+        _layers[i].valid = false;
+    }
+    _changed.clear();
+
+    if( any_stale ) {
+        _render( registry, stale );
+    }
+    _cached = _matrices.size() - _rendered;
+
+    glActiveTexture( GL_TEXTURE0 + UNIT );
+    glBindTexture( GL_TEXTURE_2D_ARRAY, _texture );
+    glActiveTexture( GL_TEXTURE0 );
+}
+
+void ShadowMaps::bind( ShaderProgram& program ) const {
+    bind_units( program );
+    program.uniform( "shadow_count", (GLuint)_light_indices.size() );
+    program.uniform( "shadow_light_index", _light_indices );
+    program.uniform( "shadow_first_layer", _first_layers );
+    program.uniform( "shadow_layer_count", _layer_counts );
+    program.uniform( "shadow_splits", _splits );
+    program.uniform( "shadow_transforms", _matrices );
+    program.uniform( "shadow_params", glm::vec4{ _bias, 0.0, 0.0, 0.0 } );
+}
+
+void ShadowMaps::bind_units( ShaderProgram& program ) {
+    program.uniform_sampler( "shadow_maps", UNIT );
+}
+
+void ShadowMaps::on_transform_replace( entt::entity entity, entt::registry& registry, Transform& transform ) {
+    auto shadow_maps_ptr = registry.try_ctx<ShadowMaps>();
+    auto model_ptr = registry.try_get<Model>( entity );
+    if( shadow_maps_ptr == nullptr || model_ptr == nullptr ) {
+        return;
+    }
+    const auto& bounds = model_ptr->mesh.bounding_box();
+    // the registry still holds the previous transform
+    shadow_maps_ptr->_changed.push_back( registry.get<Transform>( entity ).global_affine() * bounds );
+    shadow_maps_ptr->_changed.push_back( transform.global_affine() * bounds );
+}
+
+void ShadowMaps::connect( entt::registry& registry ) {
+    registry.on_replace<Transform>().connect<&ShadowMaps::on_transform_replace>();
+    registry.on_construct<Transform>().connect<&ShadowMaps::on_caster_change<Transform>>();
+    registry.on_construct<Model>().connect<&ShadowMaps::on_caster_change<Model>>();
+    registry.on_destroy<Model>().connect<&ShadowMaps::on_caster_change<Model>>();
+    registry.on_construct<Hidden>().connect<&ShadowMaps::on_caster_change<Hidden>>();
+    registry.on_destroy<Hidden>().connect<&ShadowMaps::on_caster_change<Hidden>>();
+}
+
+bool ShadowMaps::_cascades( entt::registry& registry, const glm::vec3& direction, unsigned int count, float distance,
+        std::vector<glm::mat4>& matrices, glm::vec4& splits ) const {
+    auto current_camera_ptr = registry.try_ctx<CurrentCamera>();
+    if( current_camera_ptr == nullptr ) {
+        return false;
+    }
+    auto camera_ptr = registry.try_get<Camera>( current_camera_ptr->entity );
+    if( camera_ptr == nullptr ) {
+        return false;
+    }
+    glm::mat4 camera_matrix{1.0};
+    auto camera_transform_ptr = registry.try_get<Transform>( current_camera_ptr->entity );
+    if( camera_transform_ptr != nullptr ) {
+        camera_matrix = camera_transform_ptr->global_matrix();
+    }
+
+    float near = std::fabs( camera_ptr->near );
+    float far = std::min( std::fabs( camera_ptr->far ), distance );
+    float tan_y = std::tan( camera_ptr->fov / 2.f );
+    float tan_x = tan_y * camera_ptr->aspect_ratio;
+    // rotation only, so texel snapping in light space is stable
+    auto light_view = look_along( glm::vec3{0.0}, direction );
+
+    float begin = near;
+    for( unsigned int c=0; c<count; c++ ) {
+        float t = (float)( c + 1 ) / count;
+        float end = SPLIT_LAMBDA * near * std::pow( far / near, t ) + ( 1.f - SPLIT_LAMBDA ) * ( near + ( far - near ) * t );
+
+        // bounding sphere of the camera frustum slice
+        glm::vec3 corners[8];
+        glm::vec3 center{0.0};
+        int k = 0;
+        for( float depth : { begin, end } ) {
+            for( float x : { -1.f, 1.f } ) {
+                for( float y : { -1.f, 1.f } ) {
+                    auto corner = camera_matrix * glm::vec4{ x * depth * tan_x, y * depth * tan_y, -depth, 1.0 };
+                    corners[k] = glm::vec3{ corner.x, corner.y, corner.z };
+                    center = center + corners[k] / 8.f;
+                    k++;
+                }
+            }
+        }
+        float radius = 0.0;
+        for( const auto& corner : corners ) {
+            radius = std::max( radius, glm::length( corner - center ) );
+        }
+        // rounded so small rotations keep the same extent
+        radius = std::ceil( radius * 16.f ) / 16.f;
+
+        // snap the center to whole texels
+        auto light_center = light_view * glm::vec4{ center.x, center.y, center.z, 1.0 };
+        float texel = 2.f * radius / _resolution;
+        float x = std::floor( light_center.x / texel ) * texel;
+        float y = std::floor( light_center.y / texel ) * texel;
+
+        // extended towards the light to keep casters in front of the slice
+        auto projection = matrix_op::orthographic( x - radius, x + radius, y - radius, y + radius,
+                light_center.z - radius, light_center.z + radius + _caster_distance );
+        matrices.push_back( projection * light_view );
+        splits[c] = end;
+        begin = end;
+    }
+    return true;
+}
+
+void ShadowMaps::_render( entt::registry& registry, const std::vector<bool>& stale ) {
+    GLint viewport[4];
+    glGetIntegerv( GL_VIEWPORT, viewport );
+    glBindFramebuffer( GL_FRAMEBUFFER, _framebuffer );
+    glViewport( 0, 0, _resolution, _resolution );
+    glDisable( GL_CULL_FACE );
+    glEnable( GL_POLYGON_OFFSET_FILL );
+    glPolygonOffset( 1.1, 4.0 );
+
+    // world bounds of the casters, shared by all layers, posed skins use their
+    // palettes with the skinned program and are skipped without one
+    auto palettes_ptr = registry.try_ctx<JointPalettes>();
+    bool skinned = _skinned_program && palettes_ptr != nullptr;
+    auto casters = registry.group<Model>(entt::get<Transform>, entt::exclude<Hidden>);
+    std::vector<Box> bounds;
+    std::vector<const Skin*> skins;
+    bounds.reserve( casters.size() );
+    skins.reserve( casters.size() );
+    casters.each([&registry, &bounds, &skins, skinned](auto entity, const auto& model, const auto& transform){
+            auto skin_ptr = registry.try_get<Skin>( entity );
+            if( skin_ptr != nullptr && ( !skinned || skin_ptr->palette == Skin::NO_PALETTE ) ) {
+                bounds.push_back( Box{} );
+            } else if( skin_ptr != nullptr ) {
+                bounds.push_back( skin_ptr->bounds );
+            } else {
+                bounds.push_back( transform.global_affine() * model.mesh.bounding_box() );
+            }
+            skins.push_back( skin_ptr );
+    });
+    // model_system packs its own palettes later, casters index the full ones
+    if( skinned && !_skin_bounds.empty() ) {
+        palettes_ptr->upload( palettes_ptr->palettes() );
+        JointPalettes::bind( *_skinned_program );
+    }
+
+    for( size_t i=0; i<stale.size(); i++ ) {
+        if( !stale[i] ) {
+            continue;
+        }
+        glFramebufferTextureLayer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, _texture, 0, i );
+        glClear( GL_DEPTH_BUFFER_BIT );
+
+        Frustum frustum{ _matrices[i] };
+        _depth_program->uniform( "shadow_transform", _matrices[i] );
+        if( skinned ) {
+            _skinned_program->uniform( "shadow_transform", _matrices[i] );
+        }
+        size_t j = 0;
+        casters.each([this, &frustum, &bounds, &skins, &j](const auto& model, const auto& transform){
+                auto skin_ptr = skins[j];
+                if( bounds[j].min().x > bounds[j].max().x || !frustum.intersects( bounds[j] ) ) {
+                    j++;
+                    return;
+                }
+                j++;
+                if( skin_ptr != nullptr ) {
+                    _skinned_program->uniform( "joint_offset", (GLuint)skin_ptr->palette );
+                    _skinned_program->uniform( "joint_count", (GLuint)skin_ptr->binding->joints.size() );
+                    model.mesh.draw_instanced( *_skinned_program, 1 );
+                } else {
+                    _depth_program->uniform( "model_transform", transform.global_matrix() );
+                    model.mesh.draw_positions( *_depth_program );
+                }
+        });
+
+        _layers[i].matrix = _matrices[i];
+        _layers[i].valid = true;
+        _rendered++;
+    }
+
+    glDisable( GL_POLYGON_OFFSET_FILL );
+    glEnable( GL_CULL_FACE );
+    glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+    glViewport( viewport[0], viewport[1], viewport[2], viewport[3] );
+}
+
+void shadow_system( entt::registry& registry ) {
+    auto shadow_maps_ptr = registry.try_ctx<ShadowMaps>();
+    if( shadow_maps_ptr == nullptr ) {
+        return;
+    }
+    shadow_maps_ptr->update( registry );
+    auto& program_cache = registry.ctx<entt::resource_cache<ShaderProgram>>();
+    program_cache.each([shadow_maps_ptr](ShaderProgram& program){
+            shadow_maps_ptr->bind( program );
+    });
+}
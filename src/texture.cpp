@@ -1,12 +1,31 @@
 #include "texture.hpp"
+#include "texture_streamer.hpp"
+#include "texture_residency.hpp"
+#include "compressed_image.hpp"
 
 #define STB_IMAGE_IMPLEMENTATION
 #define STBI_FAILURE_USERMSG
 #include "stb_image.h"
 
+#include <algorithm>
+#include <vector>
+
+std::atomic<uint64_t> Texture::_next_id{1};
 
 Texture::Texture( const std::string& path ) {
-    unsigned char* data = stbi_load(path.c_str(), &_width, &_height, &_channels, 3);
+    // pre-compressed containers carry their own mip chain
+    if( is_compressed_image( path ) ) {
+        _upload_compressed( load_compressed_image( path ) );
+        return;
+    }
+
+    if( stbi_info(path.c_str(), &_width, &_height, &_channels) == 0 ) {
+        throw TextureException{ stbi_failure_reason() };
+    }
+    // keep alpha channel when the image has one
+    int channels = _channels_for( _channels );
+    unsigned char* data = stbi_load(path.c_str(), &_width, &_height, &_channels, channels);
+    _channels = channels;
 
     if( data == nullptr ) {
         throw TextureException{ stbi_failure_reason() };
@@ -20,19 +39,193 @@ Texture::Texture( const std::string& path ) {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, _width, _height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+    _format = _format_for( _channels );
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, _format, _width, _height, 0, _format, GL_UNSIGNED_BYTE, data);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
     glGenerateMipmap(GL_TEXTURE_2D);
+    _levels = _mip_levels( _width, _height );
 
     stbi_image_free(data);
 }
 
+Texture::Texture( const CompressedImage& image ) {
+    _upload_compressed( image );
+}
+
+Texture::Texture( unsigned char red, unsigned char green, unsigned char blue )
+    : _width{1}, _height{1}, _channels{3} {
+    unsigned char data[] = { red, green, blue };
+
+    glGenTextures(1, &_texture_id);
+    glBindTexture(GL_TEXTURE_2D, _texture_id);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
 Texture::~Texture() {
     glDeleteTextures(1, &_texture_id);
 }
 
+void Texture::_upload_compressed( const CompressedImage& image ) {
+    if( !compressed_format_supported( image.format ) ) {
+        throw TextureException{ std::string{"Compressed texture format not supported by driver: "} + std::to_string( image.format ) };
+    }
+    if( image.levels.empty() ) {
+        throw TextureException{ "Compressed texture has no levels" };
+    }
+
+    GLuint texture_id;
+    glGenTextures(1, &texture_id);
+    glBindTexture(GL_TEXTURE_2D, texture_id);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, image.levels.size() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image.levels.size() - 1);
+
+    // upload precomputed mip chain, no runtime mip generation
+    int width = image.width, height = image.height;
+    for( size_t level=0; level<image.levels.size(); level++ ) {
+        const auto& data = image.levels[level];
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, image.format, width, height, 0, data.size(), data.data());
+        width = std::max( 1, width / 2 );
+        height = std::max( 1, height / 2 );
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // replace previous storage (placeholder when streaming)
+    if( _streaming ) {
+        glDeleteTextures(1, &_texture_id);
+    }
+    _texture_id = texture_id;
+    _width = image.width;
+    _height = image.height;
+    _channels = 0;
+    _format = image.format;
+    _levels = image.levels.size();
+}
+
+size_t Texture::memory() const {
+    return memory( _format, _width, _height, _levels );
+}
+
+size_t Texture::memory( GLenum format, int width, int height, int levels ) {
+    bool compressed = compressed_block_size( format ) != 0;
+    size_t size = 0;
+    for( int level=0; level<levels; level++ ) {
+        // drivers pad RGB8 to four bytes per texel
+        size += compressed ? compressed_level_size( format, width, height ) : (size_t)width * height * 4;
+        width = std::max( 1, width / 2 );
+        height = std::max( 1, height / 2 );
+    }
+    return size;
+}
+
+void Texture::_drop_levels( int count ) {
+    count = std::min( count, _levels - 1 );
+    // pooled textures are copied back out of their layer first
+    if( count <= 0 || _streaming || _pooled ) {
+        return;
+    }
+
+    GLuint texture_id;
+    glGenTextures(1, &texture_id);
+    glBindTexture(GL_TEXTURE_2D, texture_id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, _levels - count > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, _levels - count - 1);
+
+    // copy the smaller levels into new storage, the old one is freed below
+    bool compressed = compressed_block_size( _format ) != 0;
+    std::vector<unsigned char> data;
+    int width = std::max( 1, _width >> count ), height = std::max( 1, _height >> count );
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for( int level=count; level<_levels; level++ ) {
+        glBindTexture(GL_TEXTURE_2D, _texture_id);
+        if( compressed ) {
+            GLint size = 0;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+            data.resize( size );
+            glGetCompressedTexImage(GL_TEXTURE_2D, level, data.data());
+            glBindTexture(GL_TEXTURE_2D, texture_id);
+            glCompressedTexImage2D(GL_TEXTURE_2D, level - count, _format, width, height, 0, size, data.data());
+        } else {
+            data.resize( (size_t)width * height * 4 );
+            glGetTexImage(GL_TEXTURE_2D, level, _format, GL_UNSIGNED_BYTE, data.data());
+            glBindTexture(GL_TEXTURE_2D, texture_id);
+            glTexImage2D(GL_TEXTURE_2D, level - count, _format, width, height, 0, _format, GL_UNSIGNED_BYTE, data.data());
+        }
+        width = std::max( 1, width / 2 );
+        height = std::max( 1, height / 2 );
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glDeleteTextures(1, &_texture_id);
+    _texture_id = texture_id;
+    _width = std::max( 1, _width >> count );
+    _height = std::max( 1, _height >> count );
+    _levels -= count;
+    _dropped_levels += count;
+    _generation++;
+}
+
+void Texture::_adopt( Texture& other ) {
+    glDeleteTextures(1, &_texture_id);
+    _texture_id = other._texture_id;
+    _width = other._width;
+    _height = other._height;
+    _channels = other._channels;
+    _format = other._format;
+    _levels = other._levels;
+    _pooled = false;
+    _dropped_levels = 0;
+    _generation++;
+    other._texture_id = 0;
+}
+
+int Texture::_channels_for( int channels ) {
+    return ( channels == 2 || channels == 4 ) ? 4 : 3;
+}
+
+GLenum Texture::_format_for( int channels ) {
+    return channels == 4 ? GL_RGBA : GL_RGB;
+}
+
+int Texture::_mip_levels( int width, int height ) {
+    int levels = 1;
+    while( width > 1 || height > 1 ) {
+        width = std::max( 1, width / 2 );
+        height = std::max( 1, height / 2 );
+        levels++;
+    }
+    return levels;
+}
+
 
 std::shared_ptr<Texture> TextureLoader::load( const std::string& texture_path ) const {
     return std::shared_ptr<Texture> {
         new Texture{ texture_path }
     };
 }
+
+std::shared_ptr<Texture> TextureLoader::load( const std::string& texture_path, TextureStreamer& streamer ) const {
+    return streamer.request( texture_path );
+}
+
+std::shared_ptr<Texture> TextureLoader::load( const std::string& texture_path, TextureResidency& residency ) const {
+    return residency.load( texture_path );
+}
@@ -0,0 +1,214 @@
+#include "texture_cook.hpp"
+
+#include "texture.hpp"
+
+#include "stb_image.h"
+
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+namespace {
+
+    uint16_t to_565( const float color[3] ) {
+        auto r = (uint16_t)std::lround( std::clamp( color[0], 0.f, 255.f ) * 31.f / 255.f );
+        auto g = (uint16_t)std::lround( std::clamp( color[1], 0.f, 255.f ) * 63.f / 255.f );
+        auto b = (uint16_t)std::lround( std::clamp( color[2], 0.f, 255.f ) * 31.f / 255.f );
+        return (r << 11) | (g << 5) | b;
+    }
+
+    void from_565( uint16_t value, float color[3] ) {
+        color[0] = ((value >> 11) & 31) * 255.f / 31.f;
+        color[1] = ((value >> 5) & 63) * 255.f / 63.f;
+        color[2] = (value & 31) * 255.f / 31.f;
+    }
+
+    // BC1 color block using the inset bounding box endpoints
+    void encode_color_block( const unsigned char block[16][4], unsigned char* out ) {
+        float min[3] = { 255.f, 255.f, 255.f };
+        float max[3] = { 0.f, 0.f, 0.f };
+        for( int i=0; i<16; i++ ) {
+            for( int c=0; c<3; c++ ) {
+                min[c] = std::min( min[c], (float)block[i][c] );
+                max[c] = std::max( max[c], (float)block[i][c] );
+            }
+        }
+        for( int c=0; c<3; c++ ) {
+            auto inset = ( max[c] - min[c] ) / 16.f;
+            min[c] += inset;
+            max[c] -= inset;
+        }
+
+        uint16_t c0 = to_565( max );
+        uint16_t c1 = to_565( min );
+        // four color mode requires c0 > c1
+        if( c0 < c1 ) {
+            std::swap( c0, c1 );
+        }
+
+        float palette[4][3];
+        from_565( c0, palette[0] );
+        from_565( c1, palette[1] );
+        for( int c=0; c<3; c++ ) {
+            palette[2][c] = ( 2.f*palette[0][c] + palette[1][c] ) / 3.f;
+            palette[3][c] = ( palette[0][c] + 2.f*palette[1][c] ) / 3.f;
+        }
+
+        uint32_t indices = 0;
+        if( c0 != c1 ) {
+            for( int i=0; i<16; i++ ) {
+                uint32_t best = 0;
+                float best_distance = std::numeric_limits<float>::infinity();
+                for( uint32_t p=0; p<4; p++ ) {
+                    float distance = 0.f;
+                    for( int c=0; c<3; c++ ) {
+                        auto d = palette[p][c] - block[i][c];
+                        distance += d*d;
+                    }
+                    if( distance < best_distance ) {
+                        best_distance = distance;
+                        best = p;
+                    }
+                }
+                indices |= best << (2*i);
+            }
+        }
+
+        out[0] = c0 & 0xFF;
+        out[1] = c0 >> 8;
+        out[2] = c1 & 0xFF;
+        out[3] = c1 >> 8;
+        for( int i=0; i<4; i++ ) {
+            out[4+i] = ( indices >> (8*i) ) & 0xFF;
+        }
+    }
+
+    // BC3 alpha block in eight value mode
+    void encode_alpha_block( const unsigned char block[16][4], unsigned char* out ) {
+        unsigned char a0 = 0, a1 = 255;
+        for( int i=0; i<16; i++ ) {
+            a0 = std::max( a0, block[i][3] );
+            a1 = std::min( a1, block[i][3] );
+        }
+
+        float palette[8];
+        palette[0] = a0;
+        palette[1] = a1;
+        for( int i=2; i<8; i++ ) {
+            palette[i] = ( (8-i)*a0 + (i-1)*a1 ) / 7.f;
+        }
+
+        uint64_t indices = 0;
+        if( a0 != a1 ) {
+            for( int i=0; i<16; i++ ) {
+                uint64_t best = 0;
+                float best_distance = std::numeric_limits<float>::infinity();
+                for( uint64_t p=0; p<8; p++ ) {
+                    auto distance = std::abs( palette[p] - block[i][3] );
+                    if( distance < best_distance ) {
+                        best_distance = distance;
+                        best = p;
+                    }
+                }
+                indices |= best << (3*i);
+            }
+        }
+
+        out[0] = a0;
+        out[1] = a1;
+        for( int i=0; i<6; i++ ) {
+            out[2+i] = ( indices >> (8*i) ) & 0xFF;
+        }
+    }
+
+    std::vector<unsigned char> encode_level( const std::vector<unsigned char>& rgba, int width, int height, bool alpha ) {
+        size_t block_size = alpha ? 16 : 8;
+        int blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+        std::vector<unsigned char> data( (size_t)blocks_x * blocks_y * block_size );
+
+        unsigned char block[16][4];
+        for( int by=0; by<blocks_y; by++ ) {
+            for( int bx=0; bx<blocks_x; bx++ ) {
+                // edge blocks repeat the last row and column
+                for( int i=0; i<16; i++ ) {
+                    int x = std::min( bx*4 + i%4, width - 1 );
+                    int y = std::min( by*4 + i/4, height - 1 );
+                    for( int c=0; c<4; c++ ) {
+                        block[i][c] = rgba[ ((size_t)y*width + x)*4 + c ];
+                    }
+                }
+                auto out = data.data() + ((size_t)by*blocks_x + bx) * block_size;
+                if( alpha ) {
+                    encode_alpha_block( block, out );
+                    out += 8;
+                }
+                encode_color_block( block, out );
+            }
+        }
+        return data;
+    }
+
+    std::vector<unsigned char> downsample( const std::vector<unsigned char>& rgba, int width, int height ) {
+        int new_width = std::max( 1, width / 2 ), new_height = std::max( 1, height / 2 );
+        std::vector<unsigned char> result( (size_t)new_width * new_height * 4 );
+        for( int y=0; y<new_height; y++ ) {
+            for( int x=0; x<new_width; x++ ) {
+                for( int c=0; c<4; c++ ) {
+                    unsigned int sum = 0;
+                    for( int i=0; i<4; i++ ) {
+                        int sx = std::min( 2*x + i%2, width - 1 );
+                        int sy = std::min( 2*y + i/2, height - 1 );
+                        sum += rgba[ ((size_t)sy*width + sx)*4 + c ];
+                    }
+                    result[ ((size_t)y*new_width + x)*4 + c ] = ( sum + 2 ) / 4;
+                }
+            }
+        }
+        return result;
+    }
+}
+
+CompressedImage compress_image( const unsigned char* rgba, int width, int height, bool alpha ) {
+    CompressedImage image;
+    image.format = alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    image.width = width;
+    image.height = height;
+
+    std::vector<unsigned char> level{ rgba, rgba + (size_t)width * height * 4 };
+    while( true ) {
+        image.levels.push_back( encode_level( level, width, height, alpha ) );
+        if( width == 1 && height == 1 ) {
+            break;
+        }
+        level = downsample( level, width, height );
+        width = std::max( 1, width / 2 );
+        height = std::max( 1, height / 2 );
+    }
+    return image;
+}
+
+void cook_texture( const std::string& source_path, const std::string& dds_path ) {
+    int width, height, channels;
+    unsigned char* data = stbi_load( source_path.c_str(), &width, &height, &channels, 4 );
+    if( data == nullptr ) {
+        throw TextureException{ stbi_failure_reason() };
+    }
+
+    bool alpha = false;
+    for( size_t i=0; i<(size_t)width*height && !alpha; i++ ) {
+        alpha = data[i*4 + 3] != 255;
+    }
+
+    auto image = compress_image( data, width, height, alpha );
+    stbi_image_free( data );
+    save_dds( image, dds_path );
+
+    // uncompressed size counts the mip chain runtime generation would add
+    size_t uncompressed_size = (size_t)width * height * 4 * 4 / 3;
+    spdlog::info("Cooked '{}' -> '{}' ({}, {} levels, {:.1f}x smaller)",
+            source_path, dds_path, alpha ? "BC3" : "BC1", image.levels.size(),
+            (float)uncompressed_size / image.size());
+}
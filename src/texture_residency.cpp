@@ -0,0 +1,163 @@
+#include "texture_residency.hpp"
+
+#include "texture_streamer.hpp"
+#include "material_buffer.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <vector>
+
+TextureResidency::TextureResidency( TextureStreamer* streamer, size_t budget )
+    : _streamer{streamer}, _budget{budget} {}
+
+std::shared_ptr<Texture> TextureResidency::load( const std::string& path ) {
+    auto texture = _load( path );
+    _entries[ texture.get() ] = Entry{ texture, path, nullptr, false };
+    return texture;
+}
+
+void TextureResidency::touch( const Texture& texture ) {
+    texture._last_used = _frame;
+    if( texture._dropped_levels > 0 ) {
+        _wanted.insert( &texture );
+    }
+}
+
+void TextureResidency::update() {
+    // forget destroyed textures and swap in finished reloads
+    for( auto it = _entries.begin(); it != _entries.end(); ) {
+        auto texture = it->second.texture.lock();
+        if( !texture ) {
+            _wanted.erase( it->first );
+            it = _entries.erase( it );
+            continue;
+        }
+        auto& reload = it->second.reload;
+        if( reload && !reload->streaming() ) {
+            // a failed reload only holds the streamer's placeholder
+            if( reload->failed() ) {
+                it->second.failed = true;
+                spdlog::warn("Keeping reduced texture '{}', reload failed", it->second.path);
+            } else {
+                texture->_adopt( *reload );
+                _reloads++;
+                spdlog::debug("Restored texture '{}' ({}x{})", it->second.path, texture->width(), texture->height());
+            }
+            reload.reset();
+        }
+        ++it;
+    }
+
+    // restore reduced textures that were drawn again while the budget allows
+    auto usage = _usage();
+    for( auto texture_ptr : _wanted ) {
+        auto& entry = _entries.at( texture_ptr );
+        if( entry.reload || entry.failed ) {
+            continue;
+        }
+        // every dropped level is about three quarters of the full size
+        auto missing = ( texture_ptr->memory() << ( 2 * texture_ptr->dropped_levels() ) ) - texture_ptr->memory();
+        if( usage + missing > _budget ) {
+            continue;
+        }
+        try {
+            entry.reload = _load( entry.path );
+            usage += missing;
+        } catch( TextureException& e ) {
+            spdlog::error("Could not reload texture '{}': {}", entry.path, e.what());
+            entry.failed = true;
+        }
+    }
+    _wanted.clear();
+
+    if( usage > _budget ) {
+        _evict( usage );
+    }
+    _frame++;
+}
+
+void TextureResidency::set_pools( TexturePools* pools ) {
+    _pools = pools;
+}
+
+void TextureResidency::set_budget( size_t bytes ) {
+    _budget = bytes;
+}
+
+TextureResidencyStats TextureResidency::stats() const {
+    TextureResidencyStats stats;
+    stats.usage = _usage();
+    stats.budget = _budget;
+    stats.textures = _entries.size();
+    stats.evictions = _evictions;
+    stats.reloads = _reloads;
+    return stats;
+}
+
+std::shared_ptr<Texture> TextureResidency::_load( const std::string& path ) {
+    if( _streamer != nullptr ) {
+        return _streamer->request( path );
+    }
+    return std::make_shared<Texture>( path );
+}
+
+size_t TextureResidency::_usage() const {
+    // pooled textures only take their layer, counted with the pools
+    size_t usage = _pools != nullptr ? _pools->memory() : 0;
+    for( const auto& entry : _entries ) {
+        auto texture = entry.second.texture.lock();
+        if( texture && !texture->pooled() ) {
+            usage += texture->memory();
+        }
+        if( entry.second.reload ) {
+            usage += entry.second.reload->memory();
+        }
+    }
+    return usage;
+}
+
+void TextureResidency::_evict( size_t usage ) {
+    std::vector<std::shared_ptr<Texture>> candidates;
+    for( const auto& entry : _entries ) {
+        auto texture = entry.second.texture.lock();
+        if( texture && !entry.second.reload && !texture->streaming() && ( !texture->pooled() || _pools != nullptr )
+                && texture->_last_used + MIN_IDLE_FRAMES <= _frame
+                && std::max( texture->width(), texture->height() ) / 2 >= MIN_SIZE ) {
+            candidates.push_back( texture );
+        }
+    }
+    std::sort( candidates.begin(), candidates.end(), []( const auto& a, const auto& b ){
+            return a->_last_used < b->_last_used;
+    });
+
+    // least recently used textures are reduced first, the kept levels are
+    // read back from the GPU so this stalls the pipeline. A pooled texture
+    // is copied out of its layer, then takes a layer in a smaller pool and
+    // its memory comes back once its old pool is empty.
+    for( auto& texture : candidates ) {
+        if( usage <= _budget ) {
+            break;
+        }
+        // each level dropped leaves about a quarter of the memory
+        auto before = texture->memory();
+        int levels = 0;
+        while( usage - before + ( before >> ( 2*levels ) ) > _budget
+                && std::max( texture->width() >> levels, texture->height() >> levels ) / 2 >= MIN_SIZE ) {
+            levels++;
+        }
+        if( levels == 0 ) {
+            continue;
+        }
+        if( texture->pooled() ) {
+            _pools->restore( *texture );
+        }
+        texture->_drop_levels( levels );
+        usage -= before - texture->memory();
+        _evictions++;
+    }
+
+    if( usage > _budget ) {
+        spdlog::debug("Texture memory over budget: {} / {} bytes", usage, _budget);
+    }
+}
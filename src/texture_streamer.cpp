@@ -0,0 +1,255 @@
+#include "texture_streamer.hpp"
+
+#include "stb_image.h"
+
+#include "spdlog/spdlog.h"
+
+#include <cstring>
+
+TextureStreamer::TextureStreamer( ThreadPool& pool, size_t upload_budget, unsigned int pbo_count )
+    : _pool{pool}, _shared{ std::make_shared<Shared>() }, _upload_budget{upload_budget} {
+    _pbos.resize( std::max( 1u, pbo_count ), 0 );
+    glGenBuffers( _pbos.size(), _pbos.data() );
+    _resize_pbos( _upload_budget );
+}
+
+TextureStreamer::~TextureStreamer() {
+    for( auto& job : _uploads ) {
+        if( job->target_id != 0 ) {
+            glDeleteTextures( 1, &job->target_id );
+        }
+    }
+    glDeleteBuffers( _pbos.size(), _pbos.data() );
+}
+
+std::shared_ptr<Texture> TextureStreamer::request( const std::string& path ) {
+    // neutral grey until the placeholder mip arrives
+    auto texture = std::make_shared<Texture>( 128, 128, 128 );
+    texture->_streaming = true;
+
+    auto job = std::make_shared<Job>();
+    job->texture = texture;
+    job->path = path;
+
+    auto shared = _shared;
+    {
+        std::lock_guard<std::mutex> lock{ shared->mutex };
+        shared->in_flight++;
+    }
+    _pool.submit( [job, shared](){
+            _decode( *job );
+            std::lock_guard<std::mutex> lock{ shared->mutex };
+            shared->in_flight--;
+            shared->decoded.push_back( job );
+    });
+
+    return texture;
+}
+
+void TextureStreamer::update() {
+    size_t budget = _upload_budget;
+
+    // take decoded images, upload placeholders and allocate full resolution storage
+    {
+        std::lock_guard<std::mutex> lock{ _shared->mutex };
+        while( !_shared->decoded.empty() ) {
+            _ready.push_back( _shared->decoded.front() );
+            _shared->decoded.pop_front();
+        }
+    }
+    while( !_ready.empty() ) {
+        auto job = _ready.front();
+        auto& texture = *job->texture;
+
+        // compressed images are uploaded whole when the budget allows
+        if( !job->compressed.levels.empty() ) {
+            if( budget == 0 ) {
+                break;
+            }
+            try {
+                texture._upload_compressed( job->compressed );
+            } catch( TextureException& e ) {
+                spdlog::error("Could not load texture '{}': {}", job->path, e.what());
+                texture._failed = true;
+            }
+            texture._streaming = false;
+            budget -= std::min( budget, job->compressed.size() );
+            _ready.pop_front();
+            continue;
+        }
+        _ready.pop_front();
+
+        if( job->full.pixels.empty() ) {
+            texture._streaming = false;
+            texture._failed = true;
+            continue;
+        }
+        auto& placeholder = job->placeholder;
+        auto format = Texture::_format_for( placeholder.channels );
+        glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+        glBindTexture( GL_TEXTURE_2D, texture._texture_id );
+        glTexImage2D( GL_TEXTURE_2D, 0, format, placeholder.width, placeholder.height, 0, format, GL_UNSIGNED_BYTE, placeholder.pixels.data() );
+        glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+        texture._width = placeholder.width;
+        texture._height = placeholder.height;
+        texture._format = format;
+        budget -= std::min( budget, placeholder.pixels.size() );
+        placeholder.pixels.clear();
+        placeholder.pixels.shrink_to_fit();
+
+        format = Texture::_format_for( job->full.channels );
+        glGenTextures( 1, &job->target_id );
+        glBindTexture( GL_TEXTURE_2D, job->target_id );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+        glTexImage2D( GL_TEXTURE_2D, 0, format, job->full.width, job->full.height, 0, format, GL_UNSIGNED_BYTE, nullptr );
+
+        _uploads.push_back( job );
+    }
+    glBindTexture( GL_TEXTURE_2D, 0 );
+
+    // stream full resolution rows while the budget lasts
+    while( !_uploads.empty() && budget > 0 ) {
+        auto& job = *_uploads.front();
+        auto uploaded = _upload_rows( job, budget );
+        budget -= std::min( budget, uploaded );
+        if( job.next_row < job.full.height ) {
+            break;
+        }
+        _finish( job );
+        _uploads.pop_front();
+    }
+}
+
+void TextureStreamer::set_upload_budget( size_t bytes ) {
+    _upload_budget = bytes;
+    _resize_pbos( bytes );
+}
+
+size_t TextureStreamer::pending() const {
+    std::lock_guard<std::mutex> lock{ _shared->mutex };
+    return _shared->in_flight + _shared->decoded.size() + _ready.size() + _uploads.size();
+}
+
+void TextureStreamer::_decode( Job& job ) {
+    if( is_compressed_image( job.path ) ) {
+        try {
+            job.compressed = load_compressed_image( job.path );
+        } catch( TextureException& e ) {
+            spdlog::error("Could not load texture '{}': {}", job.path, e.what());
+        }
+        return;
+    }
+
+    auto& image = job.full;
+    int channels = 0;
+    if( stbi_info( job.path.c_str(), &image.width, &image.height, &channels ) == 0 ) {
+        spdlog::error("Could not load texture '{}': {}", job.path, stbi_failure_reason());
+        return;
+    }
+    image.channels = Texture::_channels_for( channels );
+    unsigned char* data = stbi_load( job.path.c_str(), &image.width, &image.height, &channels, image.channels );
+    if( data == nullptr ) {
+        spdlog::error("Could not load texture '{}': {}", job.path, stbi_failure_reason());
+        return;
+    }
+    image.pixels.assign( data, data + (size_t)image.width * image.height * image.channels );
+    stbi_image_free( data );
+
+    job.placeholder = _downsample( image, PLACEHOLDER_SIZE );
+}
+
+TextureStreamer::Image TextureStreamer::_downsample( const Image& image, int max_size ) {
+    // integer box filter, keeps aspect ratio
+    int factor = 1;
+    while( image.width / factor > max_size || image.height / factor > max_size ) {
+        factor *= 2;
+    }
+    Image result;
+    result.width = std::max( 1, image.width / factor );
+    result.height = std::max( 1, image.height / factor );
+    result.channels = image.channels;
+    result.pixels.resize( (size_t)result.width * result.height * result.channels );
+
+    for( int y=0; y<result.height; y++ ) {
+        for( int x=0; x<result.width; x++ ) {
+            for( int c=0; c<result.channels; c++ ) {
+                unsigned int sum = 0, count = 0;
+                for( int sy=y*factor; sy<std::min( (y+1)*factor, image.height ); sy++ ) {
+                    for( int sx=x*factor; sx<std::min( (x+1)*factor, image.width ); sx++ ) {
+                        sum += image.pixels[ ((size_t)sy*image.width + sx)*image.channels + c ];
+                        count++;
+                    }
+                }
+                result.pixels[ ((size_t)y*result.width + x)*result.channels + c ] = sum / std::max( 1u, count );
+            }
+        }
+    }
+    return result;
+}
+
+size_t TextureStreamer::_upload_rows( Job& job, size_t budget ) {
+    auto& image = job.full;
+    size_t row_size = (size_t)image.width * image.channels;
+    // always upload at least one row so big textures still progress
+    size_t rows = std::max<size_t>( 1, std::min( budget, _pbo_size ) / row_size );
+    rows = std::min<size_t>( rows, image.height - job.next_row );
+    size_t size = rows * row_size;
+
+    auto pbo = _pbos[ _next_pbo ];
+    _next_pbo = ( _next_pbo + 1 ) % _pbos.size();
+
+    glBindBuffer( GL_PIXEL_UNPACK_BUFFER, pbo );
+    // orphan previous storage so we do not wait on pending transfers
+    glBufferData( GL_PIXEL_UNPACK_BUFFER, std::max( size, _pbo_size ), nullptr, GL_STREAM_DRAW );
+    void* mapped = glMapBufferRange( GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT );
+    if( mapped == nullptr ) {
+        glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+        return 0;
+    }
+    std::memcpy( mapped, image.pixels.data() + job.next_row * row_size, size );
+    glUnmapBuffer( GL_PIXEL_UNPACK_BUFFER );
+
+    glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+    glBindTexture( GL_TEXTURE_2D, job.target_id );
+    auto format = Texture::_format_for( image.channels );
+    glTexSubImage2D( GL_TEXTURE_2D, 0, 0, job.next_row, image.width, rows, format, GL_UNSIGNED_BYTE, (GLvoid*)0 );
+    glBindTexture( GL_TEXTURE_2D, 0 );
+    glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+    glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+
+    job.next_row += rows;
+    return size;
+}
+
+void TextureStreamer::_finish( Job& job ) {
+    auto& texture = *job.texture;
+
+    glBindTexture( GL_TEXTURE_2D, job.target_id );
+    glGenerateMipmap( GL_TEXTURE_2D );
+    glBindTexture( GL_TEXTURE_2D, 0 );
+
+    // swap in full resolution texture
+    glDeleteTextures( 1, &texture._texture_id );
+    texture._texture_id = job.target_id;
+    texture._width = job.full.width;
+    texture._height = job.full.height;
+    texture._channels = job.full.channels;
+    texture._format = Texture::_format_for( job.full.channels );
+    texture._levels = Texture::_mip_levels( job.full.width, job.full.height );
+    texture._streaming = false;
+    job.target_id = 0;
+
+    spdlog::debug("Streamed texture '{}' ({}x{})", job.path, texture._width, texture._height);
+}
+
+void TextureStreamer::_resize_pbos( size_t size ) {
+    _pbo_size = std::max<size_t>( size, 1 );
+    for( auto pbo : _pbos ) {
+        glBindBuffer( GL_PIXEL_UNPACK_BUFFER, pbo );
+        glBufferData( GL_PIXEL_UNPACK_BUFFER, _pbo_size, nullptr, GL_STREAM_DRAW );
+    }
+    glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+}
@@ -0,0 +1,45 @@
+#include "thread_pool.hpp"
+
+#include "spdlog/spdlog.h"
+
+thread_local const ThreadPool* ThreadPool::_current = nullptr;
+
+ThreadPool::ThreadPool( unsigned int threads ) {
+    if( threads == 0 ) {
+        // leave one core for the render thread
+        threads = std::max( 2u, std::thread::hardware_concurrency() ) - 1;
+    }
+    for( unsigned int i=0; i<threads; i++ ) {
+        _workers.emplace_back( &ThreadPool::_work, this );
+    }
+    spdlog::debug("Created thread pool with {} workers", threads);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock{ _mutex };
+        _stopping = true;
+    }
+    _condition.notify_all();
+    for( auto& worker : _workers ) {
+        worker.join();
+    }
+}
+
+void ThreadPool::_work() {
+    _current = this;
+    while( true ) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock{ _mutex };
+            _condition.wait( lock, [this](){ return _stopping || !_tasks.empty(); } );
+            // finish pending tasks before stopping
+            if( _tasks.empty() ) {
+                return;
+            }
+            task = std::move( _tasks.front() );
+            _tasks.pop();
+        }
+        task();
+    }
+}
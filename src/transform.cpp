@@ -3,13 +3,17 @@
 #include "dirty.hpp"
 
 #include "matrix_op.hpp"
+#include "affine.hpp"
 
 #include "spdlog/spdlog.h"
 
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
 glm::mat4 Transform::local_matrix() const {
-    return matrix_op::translation( _translation.x, _translation.y, _translation.z )
-         * glm::mat4_cast( _rotation )
-         * matrix_op::scale( _scale.x, _scale.y, _scale.z );
+    return affine_op::compose( glm::vec3{_translation}, _rotation, _scale ).to_mat4();
 }
 
 Transform& Transform::rotate_x( float angle ) {
@@ -61,27 +65,91 @@ void transform_system( entt::registry& registry ) {
     registry.sort<Dirty<Transform>, Transform>();
     auto view = registry.view<Transform, Hierarchy, Dirty<Transform>>();
 
-
+    // dirty transforms as arrays for the batched kernels
+    std::vector<entt::entity> entities;
+    std::vector<glm::vec3> translations;
+    std::vector<glm::quat> rotations;
+    std::vector<glm::vec3> scales;
+    std::unordered_map<entt::entity, size_t> positions;
     for( auto entity : view ) {
-        auto& transform = registry.get<Transform>(entity);
-        auto& hierarchy = registry.get<Hierarchy>(entity);
+        const auto& transform = view.get<Transform>( entity );
+        positions.emplace( entity, entities.size() );
+        entities.push_back( entity );
+        translations.emplace_back( transform._translation );
+        rotations.push_back( transform._rotation );
+        scales.push_back( transform._scale );
+    }
+    if( entities.empty() ) {
+        return;
+    }
+    std::vector<Affine> globals( entities.size() );
+    affine_op::compose( translations.data(), rotations.data(), scales.data(), globals.data(), entities.size() );
+
+    // depth of each transform below its first clean ancestor, a parent is
+    // final once every transform of the levels above is
+    constexpr size_t NONE = std::numeric_limits<size_t>::max();
+    std::vector<size_t> dirty_parents( entities.size(), NONE );
+    std::vector<const Transform*> clean_parents( entities.size(), nullptr );
+    for( size_t i=0; i<entities.size(); i++ ) {
+        auto parent = view.get<Hierarchy>( entities[i] ).parent();
+        if( parent == entt::null ) {
+            continue;
+        }
+        auto found = positions.find( parent );
+        if( found != positions.end() ) {
+            dirty_parents[i] = found->second;
+        } else {
+            clean_parents[i] = registry.try_get<Transform>( parent );
+        }
+    }
+    std::vector<size_t> levels( entities.size(), NONE );
+    size_t max_level = 0;
+    for( size_t i=0; i<entities.size(); i++ ) {
+        size_t level = 0;
+        for( auto parent = dirty_parents[i]; parent != NONE; parent = dirty_parents[parent] ) {
+            if( levels[parent] != NONE ) {
+                level += levels[parent] + 1;
+                break;
+            }
+            level++;
+        }
+        levels[i] = level;
+        max_level = std::max( max_level, level );
+    }
 
-        if( hierarchy.parent() != entt::null ) {
-            auto parent_transform_ptr = registry.try_get<Transform>(hierarchy.parent());
-            if( parent_transform_ptr != nullptr ) {
-                auto new_transform = transform;
-                new_transform._global = parent_transform_ptr->_global * transform.local_matrix();
-                registry.replace<Transform>( entity, new_transform );
+    // parent x local for a whole level at a time
+    std::vector<size_t> batch;
+    std::vector<Affine> parents, locals;
+    for( size_t level=0; level<=max_level; level++ ) {
+        batch.clear();
+        parents.clear();
+        locals.clear();
+        for( size_t i=0; i<entities.size(); i++ ) {
+            if( levels[i] != level ) {
                 continue;
             }
+            if( dirty_parents[i] != NONE ) {
+                parents.push_back( globals[ dirty_parents[i] ] );
+            } else if( clean_parents[i] != nullptr ) {
+                parents.push_back( clean_parents[i]->_global );
+            } else {
+                continue;
+            }
+            batch.push_back( i );
+            locals.push_back( globals[i] );
+        }
+        affine_op::multiply( parents.data(), locals.data(), locals.data(), batch.size() );
+        for( size_t k=0; k<batch.size(); k++ ) {
+            globals[ batch[k] ] = locals[k];
         }
-        auto new_transform = transform;
-        new_transform._global = transform.local_matrix();
-        registry.replace<Transform>( entity, new_transform );
+    }
+
+    for( size_t i=0; i<entities.size(); i++ ) {
+        auto new_transform = registry.get<Transform>( entities[i] );
+        new_transform._global = globals[i];
+        registry.replace<Transform>( entities[i], new_transform );
     }
 
     registry.reset<Dirty<Transform>>();
 
 }
-
-
@@ -0,0 +1,196 @@
+// Clip sampling and skin packing: animated, constant and missing tracks,
+// interpolation between keys, time clamping, packed rotations and vertex
+// influences quantized to four joints.
+#include "check.hpp"
+
+#include "animation.hpp"
+#include "mesh.hpp"
+
+#include "glm/glm.hpp"
+
+#include <cmath>
+#include <random>
+#include <utility>
+#include <vector>
+
+// packed rotations and interpolated samples
+static constexpr float SAMPLE_TOLERANCE = 1e-3f;
+
+static glm::quat around_y( float degrees ) {
+    float half = glm::radians( degrees ) / 2.0f;
+    return glm::quat{ std::cos( half ), 0.0f, std::sin( half ), 0.0f };
+}
+
+// q and -q are the same rotation
+static void check_rotation( const glm::quat& a, const glm::quat& b ) {
+    CHECK_NEAR( std::abs( glm::dot( a, b ) ), 1.0f, SAMPLE_TOLERANCE );
+}
+
+static void check_vec3( const glm::vec3& a, const glm::vec3& b ) {
+    for( int k=0; k<3; k++ ) {
+        CHECK_NEAR( a[k], b[k], SAMPLE_TOLERANCE );
+    }
+}
+
+// three joints at rest one unit apart, turned 90 degrees around x
+static Skeleton skeleton() {
+    Skeleton skeleton;
+    for( uint16_t joint=0; joint<3; joint++ ) {
+        skeleton.names.push_back( "joint" + std::to_string( joint ) );
+        skeleton.parents.push_back( joint == 0 ? Skeleton::NO_PARENT : joint - 1 );
+        skeleton.translations.emplace_back( 0.0, 1.0, 0.0 );
+        skeleton.rotations.push_back( glm::quat{ std::sqrt( 0.5f ), std::sqrt( 0.5f ), 0.0f, 0.0f } );
+        skeleton.scales.emplace_back( 1.0 );
+    }
+    return skeleton;
+}
+
+// 2 seconds at 2 frames per second: joint 0 moves along x with a constant
+// scale and the rest rotation, joint 1 turns around y with the rest translation,
+// joint 2 has no channel
+static AnimationClip clip() {
+    AnimationClip clip;
+    clip.duration = 2.0;
+    clip.sample_rate = 2.0;
+    clip.frame_count = 5;
+    AnimationClip::Channel moving;
+    moving.translation = AnimationClip::Track{ 0, clip.frame_count };
+    for( uint32_t frame=0; frame<clip.frame_count; frame++ ) {
+        clip.translations.emplace_back( frame, 0.0, 0.0 );
+    }
+    moving.scale = AnimationClip::Track{ 0, 1 };
+    clip.scales.emplace_back( 2.0 );
+    AnimationClip::Channel turning;
+    turning.rotation = AnimationClip::Track{ 0, clip.frame_count };
+    for( uint32_t frame=0; frame<clip.frame_count; frame++ ) {
+        auto rotation = PackedQuat::pack( around_y( 30.0f * frame ) );
+        // every other key on the far side of the sphere, sampling takes the short arc
+        if( frame % 2 == 1 ) {
+            rotation = PackedQuat{ (int16_t)-rotation.x, (int16_t)-rotation.y, (int16_t)-rotation.z, (int16_t)-rotation.w };
+        }
+        clip.rotations.push_back( rotation );
+    }
+    clip.channels = { moving, turning };
+    return clip;
+}
+
+static void test_sample() {
+    auto rest = skeleton();
+    auto animation = clip();
+    glm::vec3 translations[3], scales[3];
+    glm::quat rotations[3];
+
+    // on a key
+    animation.sample( rest, 1.0, translations, rotations, scales );
+    check_vec3( translations[0], glm::vec3{ 2.0, 0.0, 0.0 } );
+    check_rotation( rotations[0], rest.rotations[0] );
+    check_vec3( scales[0], glm::vec3{ 2.0 } );
+    check_vec3( translations[1], rest.translations[1] );
+    check_rotation( rotations[1], around_y( 60.0 ) );
+    check_vec3( scales[1], rest.scales[1] );
+    check_vec3( translations[2], rest.translations[2] );
+    check_rotation( rotations[2], rest.rotations[2] );
+    check_vec3( scales[2], rest.scales[2] );
+
+    // halfway between keys 1 and 2, the normalized lerp midpoint is the slerp one
+    animation.sample( rest, 0.75, translations, rotations, scales );
+    check_vec3( translations[0], glm::vec3{ 1.5, 0.0, 0.0 } );
+    check_rotation( rotations[1], around_y( 45.0 ) );
+    CHECK_NEAR( glm::dot( rotations[1], rotations[1] ), 1.0f, SAMPLE_TOLERANCE );
+    // a quarter of the way, the normalized lerp stays close to the slerp angle
+    animation.sample( rest, 0.125, translations, rotations, scales );
+    check_vec3( translations[0], glm::vec3{ 0.25, 0.0, 0.0 } );
+    CHECK_NEAR( 2.0f * std::acos( std::min( std::abs( rotations[1].w ), 1.0f ) ), glm::radians( 7.5f ), 0.01f );
+
+    // clamped to the clip
+    animation.sample( rest, -3.0, translations, rotations, scales );
+    check_vec3( translations[0], glm::vec3{ 0.0 } );
+    check_rotation( rotations[1], around_y( 0.0 ) );
+    animation.sample( rest, 2.0, translations, rotations, scales );
+    check_vec3( translations[0], glm::vec3{ 4.0, 0.0, 0.0 } );
+    check_rotation( rotations[1], around_y( 120.0 ) );
+    animation.sample( rest, 100.0, translations, rotations, scales );
+    check_vec3( translations[0], glm::vec3{ 4.0, 0.0, 0.0 } );
+    check_rotation( rotations[1], around_y( 120.0 ) );
+
+    // a clip without frames keeps constant tracks and the rest pose
+    AnimationClip still;
+    AnimationClip::Channel constant;
+    constant.translation = AnimationClip::Track{ 0, 1 };
+    still.translations.emplace_back( 5.0, 6.0, 7.0 );
+    still.channels = { constant };
+    still.sample( rest, 1.0, translations, rotations, scales );
+    check_vec3( translations[0], glm::vec3{ 5.0, 6.0, 7.0 } );
+    check_rotation( rotations[0], rest.rotations[0] );
+    check_vec3( translations[1], rest.translations[1] );
+
+    CHECK( animation.memory() == 5 * sizeof(glm::vec3) + 5 * sizeof(PackedQuat) + sizeof(glm::vec3) + 2 * sizeof(AnimationClip::Channel) );
+    CHECK( rest.find( "joint2" ) == std::optional<uint16_t>{ 2 } );
+    CHECK( !rest.find( "joint3" ).has_value() );
+}
+
+static void test_packed_quat() {
+    std::mt19937 random_engine{ 9 };
+    std::uniform_real_distribution<float> component{ -1, 1 };
+    for( int i=0; i<1000; i++ ) {
+        auto rotation = glm::normalize( glm::quat{ component( random_engine ), component( random_engine ), component( random_engine ), component( random_engine ) } );
+        auto unpacked = PackedQuat::pack( rotation ).unpack();
+        // snorm16 keeps about 4 decimals per component
+        CHECK_NEAR( glm::dot( rotation, unpacked ), 1.0f, 1e-6f );
+        CHECK_NEAR( glm::dot( unpacked, unpacked ), 1.0f, 1e-6f );
+    }
+    auto identity = PackedQuat::pack( glm::quat{ 1.0, 0.0, 0.0, 0.0 } );
+    CHECK( identity.w == 32767 && identity.x == 0 && identity.y == 0 && identity.z == 0 );
+    auto negative = PackedQuat::pack( glm::quat{ -1.0, 0.0, 0.0, 0.0 } );
+    CHECK( negative.w == -32767 );
+}
+
+static int weight_sum( const VertexSkin& skin ) {
+    int sum = 0;
+    for( auto weight : skin.weights ) {
+        sum += weight;
+    }
+    return sum;
+}
+
+static void test_vertex_skin() {
+    // the four largest kept in order, renormalized
+    auto skin = VertexSkin::from_influences( { { 1, 0.1f }, { 3, 0.5f }, { 2, 0.05f }, { 7, 0.25f }, { 9, 0.1f } } );
+    CHECK( skin.joints[0] == 3 && skin.joints[1] == 7 );
+    CHECK( ( skin.joints[2] == 1 && skin.joints[3] == 9 ) || ( skin.joints[2] == 9 && skin.joints[3] == 1 ) );
+    CHECK( weight_sum( skin ) == 255 );
+    CHECK( std::abs( skin.weights[0] - 134 ) <= 1 );
+    CHECK( std::abs( skin.weights[1] - 67 ) <= 1 );
+
+    auto single = VertexSkin::from_influences( { { 42, 3.0f } } );
+    CHECK( single.joints[0] == 42 && single.weights[0] == 255 );
+    CHECK( weight_sum( single ) == 255 );
+
+    // no usable weights follow joint 0
+    for( const auto& influences : { std::vector<std::pair<unsigned int, float>>{},
+            std::vector<std::pair<unsigned int, float>>{ { 5, 0.0f }, { 6, -1.0f } } } ) {
+        auto rest = VertexSkin::from_influences( influences );
+        CHECK( rest.joints[0] == 0 && rest.weights[0] == 255 && weight_sum( rest ) == 255 );
+    }
+
+    // rounding never breaks the sum
+    std::mt19937 random_engine{ 13 };
+    std::uniform_real_distribution<float> weight{ 0, 1 };
+    for( int i=0; i<1000; i++ ) {
+        std::vector<std::pair<unsigned int, float>> influences;
+        for( unsigned int joint=0; joint<=(unsigned int)( i % 7 ); joint++ ) {
+            influences.emplace_back( joint * 37 % 256, weight( random_engine ) );
+        }
+        CHECK( weight_sum( VertexSkin::from_influences( influences ) ) == 255 );
+    }
+
+    CHECK_THROWS( VertexSkin::from_influences( { { 256, 1.0f } } ), MeshCreationException );
+    CHECK_THROWS( VertexSkin::from_influences( { { 3, 0.5f }, { 1000, 0.5f } } ), MeshCreationException );
+}
+
+int main() {
+    test_sample();
+    test_packed_quat();
+    test_vertex_skin();
+    return check_result();
+}
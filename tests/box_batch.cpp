@@ -0,0 +1,119 @@
+// BoxBatch operations against single boxes: batched transforms match the
+// bounds of the eight transformed corners, merge matches folding with +=.
+#include "check.hpp"
+#include "random.hpp"
+
+#include "geometry/box_batch.hpp"
+
+#include "glm/glm.hpp"
+
+#include <vector>
+
+static Affine random_affine() {
+    auto rotation = glm::normalize( glm::quat{ random_float( -1, 1 ), random_float( -1, 1 ), random_float( -1, 1 ), random_float( -1, 1 ) } );
+    return affine_op::compose( random_vec3( -10, 10 ), rotation, random_vec3( -2, 2 ) );
+}
+
+// every fifth box empty
+static Box random_box( size_t i ) {
+    if( i % 5 == 4 ) {
+        return Box{};
+    }
+    auto min = random_vec3( -5, 5 );
+    return Box{ min, min + random_vec3( 0, 3 ) };
+}
+
+static bool empty( const Box& box ) {
+    return box.min().x > box.max().x;
+}
+
+static Box corners( const Affine& transform, const Box& box ) {
+    if( empty( box ) ) {
+        return box;
+    }
+    Box result;
+    for( int corner=0; corner<8; corner++ ) {
+        glm::vec3 p{
+            corner & 1 ? box.max().x : box.min().x,
+            corner & 2 ? box.max().y : box.min().y,
+            corner & 4 ? box.max().z : box.min().z,
+        };
+        auto q = transform.transform_point( p );
+        result += Box{ q, q };
+    }
+    return result;
+}
+
+static void check_equal( const Box& a, const Box& b ) {
+    CHECK( empty( a ) == empty( b ) );
+    if( empty( a ) || empty( b ) ) {
+        return;
+    }
+    for( int k=0; k<3; k++ ) {
+        CHECK_NEAR( a.min()[k], b.min()[k], TOLERANCE );
+        CHECK_NEAR( a.max()[k], b.max()[k], TOLERANCE );
+    }
+}
+
+static void test_push_get() {
+    BoxBatch batch;
+    Box box{ glm::vec3{ -1, -2, -3 }, glm::vec3{ 4, 5, 6 } };
+    batch.push_back( box );
+    batch.push_back( Box{} );
+    CHECK( batch.size() == 2 );
+    check_equal( batch.get( 0 ), box );
+    CHECK( empty( batch.get( 1 ) ) );
+    batch.clear();
+    CHECK( batch.size() == 0 );
+}
+
+static void test_transform() {
+    // counts around the 4 and 8 wide kernels
+    for( size_t count=0; count<=19; count++ ) {
+        std::vector<Affine> transforms;
+        BoxBatch boxes;
+        for( size_t i=0; i<count; i++ ) {
+            transforms.push_back( random_affine() );
+            boxes.push_back( random_box( i ) );
+        }
+        // out starts larger than needed and is resized
+        BoxBatch out;
+        out.resize( count + 3 );
+        box_op::transform( transforms.data(), boxes, out );
+        CHECK( out.size() == count );
+        for( size_t i=0; i<count && i<out.size(); i++ ) {
+            auto expected = corners( transforms[i], boxes.get( i ) );
+            check_equal( out.get( i ), expected );
+            check_equal( transforms[i] * boxes.get( i ), expected );
+            check_equal( transforms[i].to_mat4() * boxes.get( i ), expected );
+        }
+    }
+}
+
+static void test_merge() {
+    CHECK( empty( box_op::merge( BoxBatch{} ) ) );
+    for( size_t count=1; count<=19; count++ ) {
+        BoxBatch boxes;
+        Box expected;
+        for( size_t i=0; i<count; i++ ) {
+            auto box = random_box( i );
+            boxes.push_back( box );
+            expected += box;
+        }
+        check_equal( box_op::merge( boxes ), expected );
+    }
+    // only empty boxes
+    BoxBatch empties;
+    for( int i=0; i<9; i++ ) {
+        empties.push_back( Box{} );
+    }
+    CHECK( empty( box_op::merge( empties ) ) );
+}
+
+int main() {
+    random_engine().seed( 7 );
+    test_push_get();
+    test_transform();
+    test_merge();
+    return check_result();
+}
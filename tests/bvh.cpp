@@ -0,0 +1,196 @@
+// Box BVH against brute force: every packet size finds the closest box each
+// ray hits, traversal reaches every hit box, and degenerate inputs still
+// build trees holding each primitive once.
+#include "check.hpp"
+#include "random.hpp"
+
+#include "geometry/bvh.hpp"
+
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+static std::vector<Box> random_boxes( size_t count ) {
+    std::vector<Box> boxes;
+    for( size_t i=0; i<count; i++ ) {
+        auto min = random_vec3( -20, 20 );
+        boxes.push_back( Box{ min, min + random_vec3( 0.1, 3 ) } );
+    }
+    return boxes;
+}
+
+// directions without zero components, some origins inside the boxes' range
+static std::vector<Ray> random_rays( size_t count ) {
+    std::vector<Ray> rays;
+    for( size_t i=0; i<count; i++ ) {
+        auto direction = random_vec3( -1, 1 );
+        for( int k=0; k<3; k++ ) {
+            direction[k] = direction[k] < 0.0f ? std::min( direction[k], -0.01f ) : std::max( direction[k], 0.01f );
+        }
+        rays.emplace_back( random_vec3( -30, 30 ), glm::normalize( direction ) );
+    }
+    return rays;
+}
+
+// slab test, entry distance clamped to the ray start
+static bool slab( const Ray& ray, const Box& box, float& distance ) {
+    float near = 0.0, far = std::numeric_limits<float>::infinity();
+    for( int axis=0; axis<3; axis++ ) {
+        float t1 = ( box.min()[axis] - ray.position()[axis] ) / ray.direction()[axis];
+        float t2 = ( box.max()[axis] - ray.position()[axis] ) / ray.direction()[axis];
+        near = std::max( near, std::min( t1, t2 ) );
+        far = std::min( far, std::max( t1, t2 ) );
+    }
+    distance = near;
+    return near <= far;
+}
+
+static BVH::Hit brute_force( const std::vector<Box>& boxes, const Ray& ray ) {
+    BVH::Hit hit;
+    for( uint32_t i=0; i<boxes.size(); i++ ) {
+        float distance;
+        if( slab( ray, boxes[i], distance ) && distance < hit.distance ) {
+            hit = BVH::Hit{ i, distance };
+        }
+    }
+    return hit;
+}
+
+// the same distance, primitives may differ between boxes hit at the same point
+static void check_hit( const std::vector<Box>& boxes, const Ray& ray, const BVH::Hit& hit, const BVH::Hit& expected ) {
+    CHECK( ( hit.primitive == BVH::NO_HIT ) == ( expected.primitive == BVH::NO_HIT ) );
+    if( hit.primitive == BVH::NO_HIT || expected.primitive == BVH::NO_HIT ) {
+        return;
+    }
+    CHECK_NEAR( hit.distance, expected.distance, TOLERANCE );
+    float distance;
+    CHECK( hit.primitive < boxes.size() && slab( ray, boxes[hit.primitive], distance ) );
+}
+
+template <size_t N>
+static void check_packets( const BVH& bvh, const std::vector<Box>& boxes, const std::vector<Ray>& rays ) {
+    // the last packet partly filled, its unused lanes must not hit
+    for( size_t first=0; first<rays.size(); first+=N ) {
+        RayPacket<N> packet;
+        BVH::Hit hits[N];
+        for( size_t lane=0; lane<N && first + lane < rays.size(); lane++ ) {
+            packet.set( lane, rays[first + lane] );
+        }
+        bvh.intersect( boxes, packet, hits );
+        for( size_t lane=0; lane<N; lane++ ) {
+            if( first + lane < rays.size() ) {
+                check_hit( boxes, rays[first + lane], hits[lane], brute_force( boxes, rays[first + lane] ) );
+            } else {
+                CHECK( hits[lane].primitive == BVH::NO_HIT );
+            }
+        }
+    }
+}
+
+// every primitive in exactly one leaf
+static void check_structure( const BVH& bvh, size_t count ) {
+    std::vector<int> seen( count, 0 );
+    for( const auto& node : bvh.nodes() ) {
+        if( !node.leaf() ) {
+            continue;
+        }
+        for( uint32_t i=node.first; i<node.first + node.count; i++ ) {
+            CHECK( i < bvh.primitives().size() );
+            if( i < bvh.primitives().size() && bvh.primitives()[i] < count ) {
+                seen[ bvh.primitives()[i] ]++;
+            }
+        }
+    }
+    CHECK( std::all_of( seen.begin(), seen.end(), []( int s ){ return s == 1; } ) );
+}
+
+// deepest node below the root
+static unsigned int max_depth( const BVH& bvh ) {
+    std::vector<unsigned int> depths( bvh.nodes().size(), 0 );
+    unsigned int deepest = 0;
+    for( size_t i=0; i<bvh.nodes().size(); i++ ) {
+        const auto& node = bvh.nodes()[i];
+        deepest = std::max( deepest, depths[i] );
+        if( !node.leaf() ) {
+            depths[node.first] = depths[node.first + 1] = depths[i] + 1;
+        }
+    }
+    return deepest;
+}
+
+static void test_intersect() {
+    auto boxes = random_boxes( 300 );
+    auto rays = random_rays( 203 );
+    for( unsigned int leaf_size : { 1u, 4u, 16u } ) {
+        BVH bvh{ boxes, leaf_size };
+        check_structure( bvh, boxes.size() );
+        Box bounds;
+        for( const auto& box : boxes ) {
+            bounds += box;
+        }
+        CHECK( bvh.bounds().min() == bounds.min() && bvh.bounds().max() == bounds.max() );
+        check_packets<1>( bvh, boxes, rays );
+        check_packets<4>( bvh, boxes, rays );
+        check_packets<8>( bvh, boxes, rays );
+        check_packets<16>( bvh, boxes, rays );
+    }
+}
+
+static void test_traverse() {
+    auto boxes = random_boxes( 200 );
+    BVH bvh{ boxes };
+    for( const auto& ray : random_rays( 50 ) ) {
+        RayPacket<1> packet;
+        packet.set( 0, ray );
+        std::vector<bool> reached( boxes.size(), false );
+        bvh.traverse( packet, [&reached]( uint32_t primitive, uint32_t mask ){
+                CHECK( mask == 1u );
+                reached[primitive] = true;
+        });
+        for( size_t i=0; i<boxes.size(); i++ ) {
+            float distance;
+            if( slab( ray, boxes[i], distance ) ) {
+                CHECK( reached[i] );
+            }
+        }
+    }
+}
+
+static void test_degenerate() {
+    BVH empty{ std::vector<Box>{} };
+    CHECK( empty.empty() );
+    RayPacket<4> packet;
+    packet.set( 0, Ray{ glm::vec3{0.0}, glm::vec3{ 1.0, 0.0, 0.0 } } );
+    BVH::Hit hits[4];
+    empty.intersect( {}, packet, hits );
+    CHECK( hits[0].primitive == BVH::NO_HIT );
+
+    // identical boxes can't be split by centroid, the tree must stay shallow
+    std::vector<Box> same( 1000, Box{ glm::vec3{ -1.0 }, glm::vec3{ 1.0 } } );
+    BVH bvh{ same, 1 };
+    check_structure( bvh, same.size() );
+    CHECK( max_depth( bvh ) <= BVH::MAX_DEPTH );
+    auto rays = random_rays( 16 );
+    check_packets<4>( bvh, same, rays );
+
+    // geometric spacing makes surface area splits peel one box at a time
+    std::vector<Box> peeled;
+    for( int i=0; i<3000; i++ ) {
+        float x = std::pow( 1.01f, (float)i );
+        peeled.push_back( Box{ glm::vec3{ x, 0.0, 0.0 }, glm::vec3{ x + 0.5f, 1.0, 1.0 } } );
+    }
+    BVH deep{ peeled, 1 };
+    check_structure( deep, peeled.size() );
+    CHECK( max_depth( deep ) <= BVH::MAX_DEPTH );
+    check_packets<8>( deep, peeled, random_rays( 16 ) );
+}
+
+int main() {
+    random_engine().seed( 11 );
+    test_intersect();
+    test_traverse();
+    test_degenerate();
+    return check_result();
+}
@@ -0,0 +1,42 @@
+#ifndef _REPLICATOR_TESTS_CHECK_H_
+#define _REPLICATOR_TESTS_CHECK_H_
+
+#include <cmath>
+#include <cstdio>
+
+// Minimal checks for the tests. Failures are printed and counted, main returns
+// check_result() so ctest reports the test as failed.
+
+inline int& check_failures() {
+    static int failures = 0;
+    return failures;
+}
+
+inline void check( bool passed, const char* expression, const char* file, int line ) {
+    if( !passed ) {
+        std::printf( "%s:%d: check failed: %s\n", file, line, expression );
+        check_failures()++;
+    }
+}
+
+// tolerance of CHECK_NEAR on float results, tests of looser results name their own
+inline constexpr float TOLERANCE = 1e-4f;
+
+#define CHECK( expression ) check( (expression), #expression, __FILE__, __LINE__ )
+#define CHECK_NEAR( a, b, tolerance ) check( std::fabs( (a) - (b) ) <= (tolerance), #a " ~= " #b, __FILE__, __LINE__ )
+// expression throws an exception of type exception
+#define CHECK_THROWS( expression, exception ) do { \
+        bool thrown = false; \
+        try { expression; } catch( const exception& ) { thrown = true; } \
+        check( thrown, #expression " throws " #exception, __FILE__, __LINE__ ); \
+    } while( false )
+
+inline int check_result() {
+    if( check_failures() > 0 ) {
+        std::printf( "%d checks failed\n", check_failures() );
+        return 1;
+    }
+    return 0;
+}
+
+#endif // _REPLICATOR_TESTS_CHECK_H_
@@ -0,0 +1,232 @@
+// DDS, KTX and KTX2 parsing: valid files load their levels, malformed headers
+// and truncated data throw TextureException instead of reading past the data.
+#include "check.hpp"
+
+#include "compressed_image.hpp"
+#include "texture.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+static const unsigned char KTX1_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+static const unsigned char KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+// VK_FORMAT_BC1_RGBA_UNORM_BLOCK
+static constexpr uint32_t VK_BC1 = 133;
+
+template <class T>
+static void put( std::vector<unsigned char>& data, size_t offset, T value ) {
+    if( data.size() < offset + sizeof(T) ) {
+        data.resize( offset + sizeof(T) );
+    }
+    std::memcpy( data.data() + offset, &value, sizeof(T) );
+}
+
+static std::vector<unsigned char> read_file( const std::string& path ) {
+    std::ifstream file( path, std::ios::binary );
+    return std::vector<unsigned char>{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+}
+
+static void write_file( const std::string& path, const std::vector<unsigned char>& data ) {
+    std::ofstream file( path, std::ios::binary );
+    file.write( reinterpret_cast<const char*>( data.data() ), data.size() );
+}
+
+// 16x16 DXT1 image with its full mip chain, each level filled with its index
+static CompressedImage dxt1_image() {
+    CompressedImage image;
+    image.format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+    image.width = 16;
+    image.height = 16;
+    for( int size=16, level=0; size>=1; size/=2, level++ ) {
+        image.levels.emplace_back( compressed_level_size( image.format, size, size ), (unsigned char)level );
+    }
+    return image;
+}
+
+// KTX2 file of a 8x8 BC1 image with 4 levels, level data after the level index
+static std::vector<unsigned char> ktx2_file() {
+    std::vector<unsigned char> data( 80 + 4*24 );
+    std::memcpy( data.data(), KTX2_IDENTIFIER, 12 );
+    put<uint32_t>( data, 12, VK_BC1 );
+    put<uint32_t>( data, 20, 8 );
+    put<uint32_t>( data, 24, 8 );
+    put<uint32_t>( data, 36, 1 );
+    put<uint32_t>( data, 40, 4 );
+    put<uint32_t>( data, 44, 0 );
+    uint64_t offset = data.size();
+    for( int level=0, size=8; level<4; level++, size=std::max( 1, size/2 ) ) {
+        uint64_t bytes = compressed_level_size( GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, size, size );
+        put<uint64_t>( data, 80 + level*24, offset );
+        put<uint64_t>( data, 80 + level*24 + 8, bytes );
+        put<uint64_t>( data, 80 + level*24 + 16, bytes );
+        data.resize( offset + bytes, (unsigned char)level );
+        offset += bytes;
+    }
+    return data;
+}
+
+// KTX file of a 4x4 BC1 image with a single level
+static std::vector<unsigned char> ktx1_file() {
+    std::vector<unsigned char> data( 64 );
+    std::memcpy( data.data(), KTX1_IDENTIFIER, 12 );
+    put<uint32_t>( data, 12, 0x04030201 );
+    put<uint32_t>( data, 16, 0 );
+    put<uint32_t>( data, 28, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT );
+    put<uint32_t>( data, 36, 4 );
+    put<uint32_t>( data, 40, 4 );
+    put<uint32_t>( data, 52, 1 );
+    put<uint32_t>( data, 56, 1 );
+    put<uint32_t>( data, 60, 0 );
+    put<uint32_t>( data, 64, 8 );
+    data.resize( 76, 0x5A );
+    return data;
+}
+
+static void test_dds() {
+    const std::string path = "compressed_image_test.dds";
+    auto image = dxt1_image();
+    save_dds( image, path );
+    auto loaded = load_compressed_image( path );
+    CHECK( loaded.format == image.format );
+    CHECK( loaded.width == 16 && loaded.height == 16 );
+    CHECK( loaded.levels == image.levels );
+    auto valid = read_file( path );
+
+    // data ends inside the last level
+    auto truncated = valid;
+    truncated.pop_back();
+    write_file( path, truncated );
+    CHECK_THROWS( load_compressed_image( path ), TextureException );
+
+    // data ends inside the header
+    truncated.resize( 64 );
+    write_file( path, truncated );
+    CHECK_THROWS( load_compressed_image( path ), TextureException );
+
+    write_file( path, {} );
+    CHECK_THROWS( load_compressed_image( path ), TextureException );
+
+    auto bad_magic = valid;
+    bad_magic[0] = 'X';
+    write_file( path, bad_magic );
+    CHECK_THROWS( load_compressed_image( path ), TextureException );
+
+    auto zero_width = valid;
+    put<uint32_t>( zero_width, 16, 0 );
+    write_file( path, zero_width );
+    CHECK_THROWS( load_compressed_image( path ), TextureException );
+
+    // dimensions beyond int, as a negative width once converted
+    auto huge_width = valid;
+    put<uint32_t>( huge_width, 16, 0x80000000u );
+    write_file( path, huge_width );
+    CHECK_THROWS( load_compressed_image( path ), TextureException );
+
+    // more levels than a 16x16 mip chain has
+    auto many_levels = valid;
+    put<uint32_t>( many_levels, 28, 0xFFFFFFFFu );
+    write_file( path, many_levels );
+    CHECK_THROWS( load_compressed_image( path ), TextureException );
+
+    auto unknown_format = valid;
+    put<uint32_t>( unknown_format, 84, 0x31323334u );
+    write_file( path, unknown_format );
+    CHECK_THROWS( load_compressed_image( path ), TextureException );
+
+    // DX10 header announced but missing
+    auto dx10 = valid;
+    dx10.resize( 128 );
+    put<uint32_t>( dx10, 84, 0x30315844u );
+    write_file( path, dx10 );
+    CHECK_THROWS( load_compressed_image( path ), TextureException );
+}
+
+static void test_ktx1() {
+    const std::string path = "compressed_image_test.ktx";
+    auto valid = ktx1_file();
+    write_file( path, valid );
+    auto loaded = load_compressed_image( path );
+    CHECK( loaded.format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT );
+    CHECK( loaded.width == 4 && loaded.height == 4 );
+    CHECK( loaded.levels.size() == 1 && loaded.levels[0].size() == 8 );
+
+    auto big_endian = valid;
+    put<uint32_t>( big_endian, 12, 0x01020304 );
+    write_file( path, big_endian );
+    CHECK_THROWS( load_compressed_image( path ), TextureException );
+
+    // key value data past the end of the file
+    auto key_values = valid;
+    put<uint32_t>( key_values, 60, 0xFFFFFFF0u );
+    write_file( path, key_values );
+    CHECK_THROWS( load_compressed_image( path ), TextureException );
+
+    // level larger than the remaining data
+    auto level_size = valid;
+    put<uint32_t>( level_size, 64, 0xFFFFFFFFu );
+    write_file( path, level_size );
+    CHECK_THROWS( load_compressed_image( path ), TextureException );
+
+    auto cube = valid;
+    put<uint32_t>( cube, 52, 6 );
+    write_file( path, cube );
+    CHECK_THROWS( load_compressed_image( path ), TextureException );
+}
+
+static void test_ktx2() {
+    const std::string path = "compressed_image_test.ktx2";
+    auto valid = ktx2_file();
+    write_file( path, valid );
+    auto loaded = load_compressed_image( path );
+    CHECK( loaded.format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT );
+    CHECK( loaded.width == 8 && loaded.height == 8 );
+    CHECK( loaded.levels.size() == 4 );
+    for( size_t level=0; level<loaded.levels.size(); level++ ) {
+        CHECK( loaded.levels[level].size() == 8 || level == 0 );
+        CHECK( !loaded.levels[level].empty() && loaded.levels[level][0] == level );
+    }
+
+    auto supercompressed = valid;
+    put<uint32_t>( supercompressed, 44, 1 );
+    write_file( path, supercompressed );
+    CHECK_THROWS( load_compressed_image( path ), TextureException );
+
+    auto unknown_format = valid;
+    put<uint32_t>( unknown_format, 12, 0 );
+    write_file( path, unknown_format );
+    CHECK_THROWS( load_compressed_image( path ), TextureException );
+
+    // offset and size wrapping around 64 bits would pass a plain sum check
+    auto wrapping = valid;
+    put<uint64_t>( wrapping, 80, 0xFFFFFFFFFFFFFF80ull );
+    put<uint64_t>( wrapping, 88, 0x100 );
+    write_file( path, wrapping );
+    CHECK_THROWS( load_compressed_image( path ), TextureException );
+
+    // level smaller than its dimensions need
+    auto short_level = valid;
+    put<uint64_t>( short_level, 88, 4 );
+    write_file( path, short_level );
+    CHECK_THROWS( load_compressed_image( path ), TextureException );
+
+    // level index past the end of the file
+    auto many_levels = valid;
+    put<uint32_t>( many_levels, 40, 1000 );
+    write_file( path, many_levels );
+    CHECK_THROWS( load_compressed_image( path ), TextureException );
+
+    auto zero_width = valid;
+    put<uint32_t>( zero_width, 20, 0 );
+    write_file( path, zero_width );
+    CHECK_THROWS( load_compressed_image( path ), TextureException );
+}
+
+int main() {
+    test_dds();
+    test_ktx1();
+    test_ktx2();
+    return check_result();
+}
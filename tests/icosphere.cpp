@@ -0,0 +1,73 @@
+// MeshBuilder::icosphere: vertex and triangle counts per division, vertices on
+// the sphere with their normals, a watertight surface with one winding, and the
+// same mesh when levels are split over a pool.
+#include "check.hpp"
+
+#include "mesh.hpp"
+#include "thread_pool.hpp"
+
+#include "glm/glm.hpp"
+
+#include <map>
+#include <utility>
+
+static void check_sphere( const MeshData& data, float radius, const glm::vec3& position, unsigned int divisions ) {
+    size_t faces = 20;
+    for( unsigned int d=0; d<divisions; d++ ) {
+        faces *= 4;
+    }
+    // Euler: V - E + F = 2 with E = 3F/2
+    CHECK( data.vertices.size() == faces / 2 + 2 );
+    CHECK( data.indices.size() == 3 * faces );
+    CHECK( data.normals.size() == data.vertices.size() );
+
+    for( size_t i=0; i<data.vertices.size(); i++ ) {
+        auto offset = glm::vec3{ data.vertices[i] } - position;
+        CHECK_NEAR( glm::length( offset ), radius, TOLERANCE );
+        auto normal = glm::vec3{ data.normals[i] };
+        CHECK_NEAR( glm::length( normal ), 1.0, TOLERANCE );
+        CHECK( glm::dot( normal, offset / radius ) > 1.0 - TOLERANCE );
+    }
+
+    // every edge is used once in each direction, triangles wind counterclockwise seen from outside
+    std::map<std::pair<GLuint, GLuint>, int> edges;
+    for( size_t t=0; t<data.indices.size() / 3; t++ ) {
+        glm::vec3 corners[3];
+        for( int k=0; k<3; k++ ) {
+            GLuint a = data.indices[3*t + k];
+            GLuint b = data.indices[3*t + (k + 1) % 3];
+            CHECK( a < data.vertices.size() );
+            CHECK( a != b );
+            edges[{ a, b }]++;
+            corners[k] = glm::vec3{ data.vertices[a] } - position;
+        }
+        CHECK( glm::dot( glm::cross( corners[1] - corners[0], corners[2] - corners[0] ), corners[0] ) > 0.0 );
+    }
+    CHECK( edges.size() == 3 * faces );
+    for( const auto& [edge, count] : edges ) {
+        CHECK( count == 1 );
+        CHECK( edges.count( { edge.second, edge.first } ) == 1 );
+    }
+}
+
+static void test_icosphere() {
+    ThreadPool pool{ 2 };
+    glm::vec3 position{ 1.0, -2.0, 0.5 };
+    for( unsigned int divisions=0; divisions<=5; divisions++ ) {
+        MeshBuilder builder;
+        builder.icosphere( 2.0, divisions, position );
+        auto data = builder.bake();
+        check_sphere( *data, 2.0, position, divisions );
+
+        MeshBuilder pooled;
+        pooled.icosphere( 2.0, divisions, position, &pool );
+        auto pooled_data = pooled.bake();
+        CHECK( pooled_data->indices == data->indices );
+        CHECK( pooled_data->vertices.size() == data->vertices.size() );
+    }
+}
+
+int main() {
+    test_icosphere();
+    return check_result();
+}
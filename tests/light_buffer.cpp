@@ -0,0 +1,113 @@
+// LightBuffer against a map of the lights set: through sets, replacements and
+// removes the packed lights, their bounds, texels and entities agree with the
+// entity index, and the dirty range covers every light that changed.
+#include "check.hpp"
+#include "random.hpp"
+
+#include "light_buffer.hpp"
+
+#include "entt/entt.hpp"
+
+#include <map>
+#include <vector>
+
+static ShaderLight random_light() {
+    ShaderLight light{};
+    int kind = random_int( 0, 2 );
+    light.type = kind == 0 ? ShaderLight::Type::Directional : kind == 1 ? ShaderLight::Type::Point : ShaderLight::Type::Spotlight;
+    light.position = glm::vec4{ random_vec3( -20, 20 ), 1.0 };
+    light.direction = glm::vec4{ glm::normalize( random_vec3( -1, 1 ) + glm::vec3{ 0.0, 0.0, 2.0 } ), 0.0 };
+    light.color = random_vec3( 0, 1 );
+    light.outer_angle = random_float( 0.3, 0.8 );
+    light.inner_angle = light.outer_angle * 0.5f;
+    light.radius = kind == 0 ? 0.0f : random_float( 1, 10 );
+    return light;
+}
+
+static void check_consistent( const LightBuffer& buffer, const std::map<entt::entity, ShaderLight>& expected,
+        const std::vector<entt::entity>& entities ) {
+    const auto& lights = buffer.lights();
+    CHECK( lights.size() == expected.size() );
+    CHECK( buffer.entities().size() == lights.size() );
+    CHECK( buffer.bounds().size() == lights.size() );
+    for( size_t i=0; i<lights.size(); i++ ) {
+        auto entity = buffer.entities()[i];
+        CHECK( buffer.index( entity ) == i );
+        auto found = expected.find( entity );
+        CHECK( found != expected.end() );
+        if( found == expected.end() ) {
+            continue;
+        }
+        const auto& light = found->second;
+        CHECK( lights[i].position == light.position );
+        CHECK( lights[i].type == light.type );
+        CHECK( lights[i].radius == light.radius );
+        auto bounds = light_bounds( light );
+        CHECK( buffer.bounds()[i].center() == bounds.center() );
+        CHECK( buffer.bounds()[i].radius() == bounds.radius() );
+        // texels follow their light when it moves into a hole
+        auto data = buffer.data( i );
+        CHECK( data[0] == glm::vec4( glm::vec3{ light.position }, light.radius ) );
+        CHECK( data[1].w == (float)light.type );
+        CHECK( glm::vec3{ data[2] } == light.color );
+    }
+    for( auto entity : entities ) {
+        if( expected.count( entity ) == 0 ) {
+            CHECK( buffer.index( entity ) == LightBuffer::NONE );
+        }
+    }
+    auto dirty = buffer.dirty();
+    CHECK( dirty.first <= dirty.second );
+    CHECK( dirty.second <= lights.size() );
+}
+
+static void test_changes() {
+    // the buffer only keys by entity, no registry needed
+    std::vector<entt::entity> entities;
+    for( uint32_t i=0; i<40; i++ ) {
+        entities.push_back( static_cast<entt::entity>( i * 3 + 1 ) );
+    }
+
+    // destroyed without ever updating, no GL objects were created
+    LightBuffer buffer;
+    std::map<entt::entity, ShaderLight> expected;
+    CHECK( buffer.dirty().first == buffer.dirty().second );
+    check_consistent( buffer, expected, entities );
+
+    for( int step=0; step<2000; step++ ) {
+        auto entity = entities[ random_int( 0, entities.size() - 1 ) ];
+        if( random_int( 0, 9 ) < 6 ) {
+            auto light = random_light();
+            buffer.set( entity, light );
+            expected[entity] = light;
+            auto dirty = buffer.dirty();
+            auto index = buffer.index( entity );
+            CHECK( dirty.first <= index && index < dirty.second );
+        } else {
+            auto index = buffer.index( entity );
+            buffer.remove( entity );
+            expected.erase( entity );
+            // the last light moved into the hole is uploaded again
+            if( index != LightBuffer::NONE && index < buffer.lights().size() ) {
+                auto dirty = buffer.dirty();
+                CHECK( dirty.first <= index && index < dirty.second );
+            }
+        }
+        check_consistent( buffer, expected, entities );
+    }
+
+    // removing everything empties the buffer, removing twice is harmless
+    for( auto entity : entities ) {
+        buffer.remove( entity );
+        buffer.remove( entity );
+        expected.erase( entity );
+    }
+    check_consistent( buffer, expected, entities );
+    CHECK( buffer.lights().empty() );
+}
+
+int main() {
+    random_engine().seed( 17 );
+    test_changes();
+    return check_result();
+}
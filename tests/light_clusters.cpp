@@ -0,0 +1,124 @@
+// LightClusters against brute force: every light binned into a cluster touches
+// its box, and every point inside a light's sphere lies in a cluster listing it.
+#include "check.hpp"
+#include "random.hpp"
+
+#include "light_clusters.hpp"
+#include "matrix_op.hpp"
+
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+static constexpr float NEAR = 0.1;
+static constexpr float FAR = 100.0;
+static constexpr unsigned int WIDTH = 1280;
+static constexpr unsigned int HEIGHT = 720;
+
+static ShaderLight point_light( const glm::vec3& position, float radius ) {
+    ShaderLight light{};
+    light.type = ShaderLight::Type::Point;
+    light.position = glm::vec4{ position, 1.0 };
+    light.radius = radius;
+    return light;
+}
+
+static float distance2( const glm::vec3& point, const Box& box ) {
+    float sum = 0.0;
+    for( int axis=0; axis<3; axis++ ) {
+        float d = std::max( { box.min()[axis] - point[axis], 0.f, point[axis] - box.max()[axis] } );
+        sum += d*d;
+    }
+    return sum;
+}
+
+// cluster of a view space point, -1 outside the view
+static int cluster_of( const glm::mat4& projection, const glm::vec3& point ) {
+    float depth = -point.z;
+    if( depth < NEAR || depth > FAR ) {
+        return -1;
+    }
+    auto clip = projection * glm::vec4{ point, 1.0 };
+    float ndc_x = clip.x / clip.w, ndc_y = clip.y / clip.w;
+    if( std::fabs( ndc_x ) > 1.0 || std::fabs( ndc_y ) > 1.0 ) {
+        return -1;
+    }
+    float tile_width = std::ceil( (float)WIDTH / LightClusters::X );
+    float tile_height = std::ceil( (float)HEIGHT / LightClusters::Y );
+    int x = std::min( (int)( ( ndc_x + 1.f ) * 0.5f * WIDTH / tile_width ), (int)LightClusters::X - 1 );
+    int y = std::min( (int)( ( ndc_y + 1.f ) * 0.5f * HEIGHT / tile_height ), (int)LightClusters::Y - 1 );
+    int z = std::clamp( (int)std::floor( std::log( depth / NEAR ) / std::log( FAR / NEAR ) * LightClusters::Z ), 0, (int)LightClusters::Z - 1 );
+    return x + LightClusters::X * ( y + LightClusters::Y * z );
+}
+
+static void test_bin() {
+    ThreadPool pool{ 4 };
+    LightClusters clusters{ pool };
+    CHECK( LightClusters::implementation() != nullptr );
+
+    auto projection = matrix_op::perspective( M_PI/3, (float)WIDTH / HEIGHT, -NEAR, -FAR );
+    auto view = matrix_op::rotate_y( 0.3 ) * matrix_op::translation( -1.0, 0.5, -2.0 );
+
+    // lights around the view, then one behind the camera
+    std::vector<ShaderLight> lights;
+    std::vector<GLuint> candidates;
+    for( GLuint i=0; i<100; i++ ) {
+        lights.push_back( point_light( random_vec3( -30, 30 ), random_float( 0.5, 8.0 ) ) );
+        candidates.push_back( i );
+    }
+    auto behind = view * glm::vec4{ 0.0, 0.0, 20.0, 1.0 };
+    auto camera = glm::inverse( view ) * glm::vec4{ 0.0, 0.0, 20.0, 1.0 };
+    CHECK( behind.z > 0.0 );
+    lights.push_back( point_light( glm::vec3{ camera.x, camera.y, camera.z }, 2.0 ) );
+    candidates.push_back( lights.size() - 1 );
+
+    clusters.bin( lights, candidates, view, projection, -NEAR, -FAR, WIDTH, HEIGHT );
+    CHECK( clusters.light_count() == candidates.size() );
+
+    // every listed light touches the cluster box, lists hold no duplicates
+    std::vector<std::vector<GLuint>> lists( LightClusters::COUNT );
+    size_t references = 0;
+    for( size_t cluster=0; cluster<LightClusters::COUNT; cluster++ ) {
+        lists[cluster] = clusters.cluster_lights( cluster );
+        references += lists[cluster].size();
+        auto bounds = clusters.cluster_bounds( cluster );
+        for( auto index : lists[cluster] ) {
+            const auto& light = lights[index];
+            auto center = view * glm::vec4{ light.position.x, light.position.y, light.position.z, 1.0 };
+            CHECK( distance2( glm::vec3{ center.x, center.y, center.z }, bounds ) <= light.radius * light.radius * 1.0001f );
+            CHECK( index != lights.size() - 1 );
+        }
+        auto sorted = lists[cluster];
+        std::sort( sorted.begin(), sorted.end() );
+        CHECK( std::adjacent_find( sorted.begin(), sorted.end() ) == sorted.end() );
+    }
+    CHECK( references == clusters.reference_count() );
+    CHECK( references > 0 );
+
+    // points inside each light's sphere lie in clusters listing the light
+    for( GLuint index=0; index<lights.size(); index++ ) {
+        const auto& light = lights[index];
+        auto center = view * glm::vec4{ light.position.x, light.position.y, light.position.z, 1.0 };
+        for( int sample=0; sample<200; sample++ ) {
+            auto offset = random_vec3( -1, 1 );
+            if( glm::dot( offset, offset ) > 1.0 ) {
+                continue;
+            }
+            auto point = glm::vec3{ center.x, center.y, center.z } + offset * ( light.radius * 0.99f );
+            int cluster = cluster_of( projection, point );
+            if( cluster < 0 ) {
+                continue;
+            }
+            const auto& list = lists[cluster];
+            CHECK( std::find( list.begin(), list.end(), index ) != list.end() );
+        }
+    }
+}
+
+int main() {
+    random_engine().seed( 13 );
+    test_bin();
+    return check_result();
+}
@@ -0,0 +1,103 @@
+// MeshBuilder::bake: 16-bit indices while every vertex fits, narrowed before
+// the upload, sequential indices for unindexed builders, the bounds of the
+// vertices, and MeshCreationException for mismatched attributes.
+#include "check.hpp"
+#include "random.hpp"
+
+#include "mesh.hpp"
+
+#include "glm/glm.hpp"
+
+#include <vector>
+
+// count vertices on a line, indexed as a strip of triangles ending on the last
+static MeshBuilder line( size_t count, bool indexed ) {
+    MeshBuilder builder;
+    for( size_t i=0; i<count; i++ ) {
+        builder.add_vertex( glm::vec3{ (float)i, 0.0, 0.0 } );
+    }
+    if( indexed ) {
+        for( size_t i=0; i+2<count; i++ ) {
+            builder.add_index( i );
+            builder.add_index( i + 1 );
+            builder.add_index( i + 2 );
+        }
+    }
+    return builder;
+}
+
+static void check_short_indices( const MeshData& data ) {
+    CHECK( data.index_type == GL_UNSIGNED_SHORT );
+    CHECK( data.short_indices.size() == data.indices.size() );
+    bool equal = data.short_indices.size() == data.indices.size();
+    for( size_t i=0; equal && i<data.indices.size(); i++ ) {
+        equal = data.short_indices[i] == data.indices[i];
+    }
+    CHECK( equal );
+}
+
+static void test_index_type() {
+    // largest index of 16-bit indices is 65535
+    auto data = line( 65536, true ).bake();
+    check_short_indices( *data );
+    CHECK( data->indices.back() == 65535 );
+    CHECK( data->short_indices.back() == 65535 );
+    CHECK( data->upload_size() == 65536 * 4 * sizeof(GLfloat) + data->indices.size() * sizeof(GLushort) );
+
+    data = line( 65537, true ).bake();
+    CHECK( data->index_type == GL_UNSIGNED_INT );
+    CHECK( data->short_indices.empty() );
+    CHECK( data->upload_size() == 65537 * 4 * sizeof(GLfloat) + data->indices.size() * sizeof(GLuint) );
+
+    // without indices every vertex is used in order
+    data = line( 300, false ).bake();
+    check_short_indices( *data );
+    CHECK( data->indices.size() == 300 );
+    bool sequential = true;
+    for( size_t i=0; i<data->indices.size(); i++ ) {
+        sequential = sequential && data->indices[i] == i;
+    }
+    CHECK( sequential );
+
+    auto empty = MeshBuilder{}.bake();
+    CHECK( empty->indices.empty() );
+    CHECK( empty->short_indices.empty() );
+}
+
+static void test_bounds() {
+    MeshBuilder builder;
+    glm::vec3 min{ 1e9 }, max{ -1e9 };
+    for( int i=0; i<100; i++ ) {
+        auto vertex = random_vec3( -50, 50 );
+        builder.add_vertex( vertex );
+        min = glm::min( min, vertex );
+        max = glm::max( max, vertex );
+    }
+    auto data = builder.bake();
+    CHECK( data->bounding_box.min() == min );
+    CHECK( data->bounding_box.max() == max );
+
+    MeshBuilder cube;
+    cube.cube( 2.0, glm::vec3{ 1.0, 2.0, 3.0 } );
+    data = cube.bake();
+    for( int k=0; k<3; k++ ) {
+        CHECK_NEAR( data->bounding_box.min()[k], k, TOLERANCE );
+        CHECK_NEAR( data->bounding_box.max()[k], k + 2.0f, TOLERANCE );
+    }
+}
+
+static void test_attributes() {
+    auto builder = line( 6, true );
+    builder.add_color( glm::vec3{ 1.0 }, 5 );
+    CHECK_THROWS( builder.bake(), MeshCreationException );
+    builder.add_color( glm::vec3{ 1.0 } );
+    CHECK( builder.bake()->colors.size() == 6 );
+}
+
+int main() {
+    random_engine().seed( 19 );
+    test_index_type();
+    test_bounds();
+    test_attributes();
+    return check_result();
+}
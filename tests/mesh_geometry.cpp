@@ -0,0 +1,253 @@
+// MeshGeometry: BVH ray queries match testing every triangle, cooked blobs
+// read back to the same geometry, and truncated or corrupt blobs throw
+// MeshCreationException instead of handing traversal a broken tree.
+#include "check.hpp"
+#include "random.hpp"
+
+#include "mesh.hpp"
+#include "mesh_geometry.hpp"
+#include "thread_pool.hpp"
+
+#include "glm/glm.hpp"
+
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// hit distances and positions over triangles up to tens of units across
+static constexpr float HIT_TOLERANCE = 1e-3f;
+
+// small random triangles, vertices shared by consecutive triangles
+static std::shared_ptr<MeshGeometry> random_geometry( size_t triangles ) {
+    std::vector<glm::vec3> positions;
+    std::vector<GLuint> indices;
+    for( size_t t=0; t<triangles; t++ ) {
+        auto center = random_vec3( -10, 10 );
+        for( int k=0; k<3; k++ ) {
+            positions.push_back( center + random_vec3( -2, 2 ) );
+        }
+        indices.push_back( 3*t );
+        indices.push_back( 3*t + 1 );
+        indices.push_back( t > 0 ? 3*t - 1 : 3*t + 2 );
+    }
+    return std::make_shared<MeshGeometry>( std::move(positions), std::move(indices) );
+}
+
+// plane distance, then the point inside all three edges of either winding
+static std::optional<float> reference( const MeshGeometry& geometry, size_t triangle, const glm::vec3& origin, const glm::vec3& direction ) {
+    const auto& a = geometry.positions()[ geometry.indices()[3*triangle] ];
+    const auto& b = geometry.positions()[ geometry.indices()[3*triangle + 1] ];
+    const auto& c = geometry.positions()[ geometry.indices()[3*triangle + 2] ];
+    auto normal = glm::cross( b - a, c - a );
+    float along = glm::dot( normal, direction );
+    if( std::abs( along ) < 1e-6f ) {
+        return {};
+    }
+    float distance = glm::dot( normal, a - origin ) / along;
+    if( distance < 0.0f ) {
+        return {};
+    }
+    auto p = origin + distance * direction;
+    float e0 = glm::dot( glm::cross( b - a, p - a ), normal );
+    float e1 = glm::dot( glm::cross( c - b, p - b ), normal );
+    float e2 = glm::dot( glm::cross( a - c, p - c ), normal );
+    if( ( e0 >= 0 && e1 >= 0 && e2 >= 0 ) || ( e0 <= 0 && e1 <= 0 && e2 <= 0 ) ) {
+        return distance;
+    }
+    return {};
+}
+
+static std::optional<float> brute_force( const MeshGeometry& geometry, const glm::vec3& origin, const glm::vec3& direction, float max_distance ) {
+    std::optional<float> closest;
+    for( size_t t=0; t<geometry.triangle_count(); t++ ) {
+        auto distance = reference( geometry, t, origin, direction );
+        if( distance && *distance <= max_distance && ( !closest || *distance < *closest ) ) {
+            closest = distance;
+        }
+    }
+    return closest;
+}
+
+static void check_queries( const MeshGeometry& geometry, unsigned int seed ) {
+    std::mt19937 rays{ seed };
+    std::uniform_real_distribution<float> coordinate{ -15, 15 };
+    for( int i=0; i<300; i++ ) {
+        glm::vec3 origin{ coordinate( rays ), coordinate( rays ), coordinate( rays ) };
+        // aimed at the cloud so most rays hit
+        glm::vec3 target{ coordinate( rays ) / 2, coordinate( rays ) / 2, coordinate( rays ) / 2 };
+        auto direction = glm::normalize( target - origin );
+        float max_distance = i % 3 == 0 ? 10.0f : std::numeric_limits<float>::infinity();
+
+        auto hit = geometry.intersect( origin, direction, max_distance );
+        auto expected = brute_force( geometry, origin, direction, max_distance );
+        CHECK( hit.has_value() == expected.has_value() );
+        if( !hit || !expected ) {
+            continue;
+        }
+        CHECK_NEAR( hit->distance, *expected, HIT_TOLERANCE );
+        CHECK( hit->triangle < geometry.triangle_count() );
+        // the weights rebuild the hit point on the reported triangle
+        glm::vec3 point{0.0};
+        for( int k=0; k<3; k++ ) {
+            CHECK( hit->barycentric[k] >= -HIT_TOLERANCE );
+            point += hit->barycentric[k] * geometry.positions()[ geometry.indices()[3*hit->triangle + k] ];
+        }
+        for( int k=0; k<3; k++ ) {
+            CHECK_NEAR( point[k], hit->position[k], HIT_TOLERANCE );
+            CHECK_NEAR( hit->position[k], origin[k] + hit->distance * direction[k], HIT_TOLERANCE );
+        }
+    }
+}
+
+static void test_intersect() {
+    auto geometry = random_geometry( 400 );
+    geometry->build_bvh();
+    CHECK( geometry->ready() );
+    check_queries( *geometry, 1 );
+
+    // built on a worker, queries wait for it
+    ThreadPool pool{ 2 };
+    auto pooled = random_geometry( 400 );
+    pooled->build_bvh( &pool );
+    check_queries( *pooled, 2 );
+    CHECK( pooled->ready() );
+
+    // on the only worker, builds queued behind the caller are taken over or dropped
+    ThreadPool single{ 1 };
+    single.submit( [&single](){
+            auto queried = random_geometry( 100 );
+            queried->build_bvh( &single );
+            check_queries( *queried, 1 );
+            CHECK( queried->ready() );
+            auto dropped = random_geometry( 100 );
+            dropped->build_bvh( &single );
+    }).get();
+
+    auto empty = std::make_shared<MeshGeometry>( std::vector<glm::vec3>{}, std::vector<GLuint>{} );
+    empty->build_bvh();
+    CHECK( !empty->intersect( glm::vec3{0.0}, glm::vec3{ 0.0, 0.0, 1.0 } ).has_value() );
+
+    CHECK_THROWS( MeshGeometry( std::vector<glm::vec3>( 3 ), std::vector<GLuint>{ 0, 1 } ), MeshCreationException );
+    CHECK_THROWS( MeshGeometry( std::vector<glm::vec3>( 3 ), std::vector<GLuint>{ 0, 1, 3 } ), MeshCreationException );
+}
+
+static std::string blob( const MeshGeometry& geometry ) {
+    std::ostringstream stream;
+    geometry.write( stream );
+    return stream.str();
+}
+
+static std::shared_ptr<MeshGeometry> read( const std::string& data ) {
+    std::istringstream stream{ data };
+    return MeshGeometry::read( stream );
+}
+
+template <class T>
+static void append_array( std::string& data, const std::vector<T>& values ) {
+    uint64_t size = values.size();
+    data.append( reinterpret_cast<const char*>( &size ), sizeof(size) );
+    data.append( reinterpret_cast<const char*>( values.data() ), sizeof(T) * values.size() );
+}
+
+// blob of the given parts, in the layout write() uses
+static std::string blob( const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices,
+        const std::vector<BVH::Node>& nodes, const std::vector<uint32_t>& primitives ) {
+    std::string data{ "RMG1" };
+    append_array( data, positions );
+    append_array( data, indices );
+    append_array( data, nodes );
+    append_array( data, primitives );
+    return data;
+}
+
+static BVH::Node leaf( uint32_t first, uint16_t count ) {
+    BVH::Node node;
+    node.min = glm::vec3{ -1.0 };
+    node.max = glm::vec3{ 1.0 };
+    node.first = first;
+    node.count = count;
+    node.axis = 0;
+    return node;
+}
+
+static BVH::Node inner( uint32_t first, uint16_t axis = 0 ) {
+    auto node = leaf( first, 0 );
+    node.axis = axis;
+    return node;
+}
+
+static void test_round_trip() {
+    auto geometry = random_geometry( 100 );
+    geometry->build_bvh();
+    auto data = blob( *geometry );
+    CHECK( data == blob( geometry->positions(), geometry->indices(), geometry->bvh().nodes(), geometry->bvh().primitives() ) );
+
+    auto copy = read( data );
+    CHECK( copy->positions() == geometry->positions() );
+    CHECK( copy->indices() == geometry->indices() );
+    CHECK( copy->bvh().primitives() == geometry->bvh().primitives() );
+    CHECK( copy->bvh().nodes().size() == geometry->bvh().nodes().size() );
+    CHECK( blob( *copy ) == data );
+    check_queries( *copy, 3 );
+}
+
+static void test_corrupt() {
+    auto geometry = random_geometry( 20 );
+    geometry->build_bvh();
+    auto valid = blob( *geometry );
+
+    // every truncation
+    for( size_t size=0; size<valid.size(); size++ ) {
+        CHECK_THROWS( read( valid.substr( 0, size ) ), MeshCreationException );
+    }
+
+    auto bad_magic = valid;
+    bad_magic[3] = '2';
+    CHECK_THROWS( read( bad_magic ), MeshCreationException );
+
+    // array size far beyond the data, must throw before allocating
+    auto huge = valid;
+    uint64_t size = 0x0FFFFFFFFFFFFFFFull;
+    std::memcpy( &huge[4], &size, sizeof(size) );
+    CHECK_THROWS( read( huge ), MeshCreationException );
+
+    std::vector<glm::vec3> positions{ glm::vec3{ -1, -1, 0 }, glm::vec3{ 1, -1, 0 }, glm::vec3{ 0, 1, 0 } };
+    std::vector<GLuint> indices{ 0, 1, 2 };
+    CHECK( read( blob( positions, indices, { leaf( 0, 1 ) }, { 0 } ) )->intersect( glm::vec3{ 0, 0, -1 }, glm::vec3{ 0, 0, 1 } ).has_value() );
+    CHECK( read( blob( positions, indices, { inner( 1 ), leaf( 0, 1 ), leaf( 0, 1 ) }, { 0 } ) )->triangle_count() == 1 );
+
+    CHECK_THROWS( read( blob( positions, { 0, 1, 3 }, { leaf( 0, 1 ) }, { 0 } ) ), MeshCreationException );
+    CHECK_THROWS( read( blob( positions, { 0, 1 }, {}, {} ) ), MeshCreationException );
+    // primitive past the triangles
+    CHECK_THROWS( read( blob( positions, indices, { leaf( 0, 1 ) }, { 1 } ) ), MeshCreationException );
+    // leaf past the primitives
+    CHECK_THROWS( read( blob( positions, indices, { leaf( 0, 2 ) }, { 0 } ) ), MeshCreationException );
+    // children before or at their parent, a cycle for traversal
+    CHECK_THROWS( read( blob( positions, indices, { inner( 0 ), leaf( 0, 1 ) }, { 0 } ) ), MeshCreationException );
+    CHECK_THROWS( read( blob( positions, indices, { leaf( 0, 1 ), inner( 0 ), leaf( 0, 1 ) }, { 0 } ) ), MeshCreationException );
+    // second child past the nodes
+    CHECK_THROWS( read( blob( positions, indices, { inner( 1 ), leaf( 0, 1 ) }, { 0 } ) ), MeshCreationException );
+    CHECK_THROWS( read( blob( positions, indices, { inner( 1, 3 ), leaf( 0, 1 ), leaf( 0, 1 ) }, { 0 } ) ), MeshCreationException );
+
+    // a left spine deeper than the traversal stack holds
+    // node 2k-1 is the inner one at depth k, its sibling 2k a leaf
+    std::vector<BVH::Node> spine{ inner( 1 ) };
+    for( uint32_t level=1; level<=BVH::MAX_DEPTH + 1; level++ ) {
+        spine.push_back( inner( spine.size() + 2 ) );
+        spine.push_back( leaf( 0, 1 ) );
+    }
+    spine[ spine.size() - 2 ] = leaf( 0, 1 );
+    CHECK_THROWS( read( blob( positions, indices, spine, { 0 } ) ), MeshCreationException );
+    spine.resize( 2 * BVH::MAX_DEPTH - 1 );
+    spine[ spine.size() - 2 ] = leaf( 0, 1 );
+    CHECK( read( blob( positions, indices, spine, { 0 } ) )->triangle_count() == 1 );
+}
+
+int main() {
+    random_engine().seed( 5 );
+    test_intersect();
+    test_round_trip();
+    test_corrupt();
+    return check_result();
+}
@@ -0,0 +1,136 @@
+// MeshBuilder::optimize: the same triangles come out with their winding, the
+// cache miss ratio does not grow, vertices are welded and ordered by first use.
+#include "check.hpp"
+
+#include "mesh.hpp"
+
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+using Triangle = std::array<float, 9>;
+
+// triangle positions starting at the smallest corner, so rotations compare equal
+static std::vector<Triangle> triangles( const MeshData& data ) {
+    std::vector<Triangle> result;
+    for( size_t t=0; t<data.indices.size()/3; t++ ) {
+        std::array<Triangle, 3> rotations;
+        for( unsigned int r=0; r<3; r++ ) {
+            for( unsigned int k=0; k<3; k++ ) {
+                const auto& vertex = data.vertices[ data.indices[3*t + (r + k) % 3] ];
+                rotations[r][3*k] = vertex.x;
+                rotations[r][3*k + 1] = vertex.y;
+                rotations[r][3*k + 2] = vertex.z;
+            }
+        }
+        result.push_back( *std::min_element( rotations.begin(), rotations.end() ) );
+    }
+    std::sort( result.begin(), result.end() );
+    return result;
+}
+
+static void add_vertex( MeshBuilder& builder, const MeshData& data, GLuint index ) {
+    builder.add_vertex( data.vertices[index] );
+    if( !data.normals.empty() ) {
+        builder.add_normal( data.normals[index] );
+    }
+    if( !data.texcoords.empty() ) {
+        builder.add_texcoord( data.texcoords[index] );
+    }
+}
+
+// unindexed copy of a mesh, every triangle with its own vertices
+static MeshBuilder soup( const MeshData& data ) {
+    MeshBuilder builder;
+    for( auto index : data.indices ) {
+        add_vertex( builder, data, index );
+    }
+    return builder;
+}
+
+// indices in range and vertices numbered in order of first use
+static void check_first_use( const MeshData& data ) {
+    GLuint next = 0;
+    for( auto index : data.indices ) {
+        CHECK( index <= next );
+        if( index == next ) {
+            next++;
+        }
+    }
+    CHECK( next == data.vertices.size() );
+}
+
+static void test_cube() {
+    MeshBuilder cube;
+    cube.cube( 2.0 );
+    auto before = cube.bake();
+    auto unindexed = soup( *before );
+    CHECK( unindexed.vertex_count() == 36 );
+
+    auto stats = unindexed.optimize();
+    auto after = unindexed.bake();
+    CHECK( stats.vertices_before == 36 );
+    // corners stay split by their face normals
+    CHECK( stats.vertices_after == 24 );
+    CHECK( unindexed.vertex_count() == 24 );
+    CHECK( unindexed.triangle_count() == 12 );
+    CHECK( stats.acmr_after <= stats.acmr_before );
+    CHECK( triangles( *after ) == triangles( *before ) );
+    check_first_use( *after );
+}
+
+static void test_sphere() {
+    MeshBuilder sphere;
+    sphere.icosphere( 1.0, 3 );
+    auto before = sphere.bake();
+
+    // the same triangles in a cache hostile order, strided over the mesh
+    MeshBuilder shuffled;
+    for( GLuint i=0; i<before->vertices.size(); i++ ) {
+        add_vertex( shuffled, *before, i );
+    }
+    size_t count = before->indices.size() / 3;
+    for( size_t i=0; i<count; i++ ) {
+        size_t t = ( i * 97 ) % count;
+        for( unsigned int k=0; k<3; k++ ) {
+            shuffled.add_index( before->indices[3*t + k] );
+        }
+    }
+    for( auto cache_size : { 8u, 16u, 32u } ) {
+        auto copy = shuffled;
+        auto stats = copy.optimize( cache_size );
+        auto after = copy.bake();
+        CHECK( stats.acmr_after <= stats.acmr_before );
+        CHECK( stats.acmr_after == copy.acmr( cache_size ) );
+        // at least one miss per vertex, at most three per triangle
+        CHECK( stats.acmr_after >= (float)after->vertices.size() / count );
+        CHECK( stats.acmr_after <= 3.0f );
+        CHECK( stats.vertices_after == before->vertices.size() );
+        CHECK( triangles( *after ) == triangles( *before ) );
+        check_first_use( *after );
+    }
+
+    // welding an unindexed sphere restores its shared vertices
+    auto unindexed = soup( *before );
+    auto stats = unindexed.optimize();
+    CHECK( stats.vertices_before == before->indices.size() );
+    CHECK( stats.vertices_after == before->vertices.size() );
+    CHECK( stats.acmr_after < stats.acmr_before );
+    CHECK( triangles( *unindexed.bake() ) == triangles( *before ) );
+}
+
+static void test_empty() {
+    MeshBuilder empty;
+    auto stats = empty.optimize();
+    CHECK( stats.vertices_before == 0 && stats.vertices_after == 0 );
+    CHECK( empty.triangle_count() == 0 );
+}
+
+int main() {
+    test_cube();
+    test_sphere();
+    test_empty();
+    return check_result();
+}
@@ -0,0 +1,147 @@
+// MeshBuilder::simplify invariants: the triangle target is met where the border
+// allows it, borders and attribute seams stay in place, no triangle degenerates
+// or flips, and collapses above max_error are not made.
+#include "check.hpp"
+
+#include "mesh.hpp"
+
+#include "glm/glm.hpp"
+
+#include <vector>
+
+static constexpr int GRID = 16;
+
+// flat grid of GRID x GRID quads on y = 0 facing +y, texture coordinates jump
+// at x = seam_x when seam_x is inside the grid, giving a seam column
+static MeshBuilder grid( int seam_x = -1 ) {
+    MeshBuilder builder;
+    auto vertex = [&builder, seam_x]( int x, int z, bool right ) {
+        builder.add_vertex( glm::vec3{ x, 0.0, z } );
+        builder.add_normal( glm::vec3{ 0.0, 1.0, 0.0 } );
+        builder.add_texcoord( glm::vec2{ right && x == seam_x ? 1.0f : x / (float)GRID, z / (float)GRID } );
+    };
+    // separate vertices per side of the seam, shared elsewhere
+    std::vector<GLuint> left( (GRID+1) * (GRID+1) ), right( (GRID+1) * (GRID+1) );
+    GLuint next = 0;
+    for( int z=0; z<=GRID; z++ ) {
+        for( int x=0; x<=GRID; x++ ) {
+            vertex( x, z, false );
+            left[ z*(GRID+1) + x ] = right[ z*(GRID+1) + x ] = next++;
+            if( x == seam_x ) {
+                vertex( x, z, true );
+                right[ z*(GRID+1) + x ] = next++;
+            }
+        }
+    }
+    for( int z=0; z<GRID; z++ ) {
+        for( int x=0; x<GRID; x++ ) {
+            // quads right of the seam use its right side vertices
+            const auto& row = x >= seam_x && seam_x >= 0 ? right : left;
+            auto corner = [&row]( int cx, int cz ) { return row[ cz*(GRID+1) + cx ]; };
+            builder.add_index( corner( x, z ) );
+            builder.add_index( corner( x, z+1 ) );
+            builder.add_index( corner( x+1, z ) );
+            builder.add_index( corner( x+1, z ) );
+            builder.add_index( corner( x, z+1 ) );
+            builder.add_index( corner( x+1, z+1 ) );
+        }
+    }
+    return builder;
+}
+
+static glm::vec3 position( const MeshData& data, GLuint index ) {
+    return glm::vec3{ data.vertices[index] };
+}
+
+// checks every triangle is valid, faces +y and lies on y = 0, returns the total area
+static float check_flat_triangles( const MeshData& data ) {
+    float area = 0.0;
+    for( size_t t=0; t<data.indices.size()/3; t++ ) {
+        GLuint a = data.indices[3*t], b = data.indices[3*t + 1], c = data.indices[3*t + 2];
+        CHECK( a < data.vertices.size() && b < data.vertices.size() && c < data.vertices.size() );
+        if( a >= data.vertices.size() || b >= data.vertices.size() || c >= data.vertices.size() ) {
+            continue;
+        }
+        CHECK( a != b && b != c && a != c );
+        auto normal = glm::cross( position( data, b ) - position( data, a ), position( data, c ) - position( data, a ) );
+        // no flipped or zero area triangles
+        CHECK( normal.y > 0.0f );
+        CHECK( position( data, a ).y == 0.0f && position( data, b ).y == 0.0f && position( data, c ).y == 0.0f );
+        area += 0.5f * normal.y;
+    }
+    return area;
+}
+
+static bool has_position( const MeshData& data, const glm::vec3& p ) {
+    for( const auto& vertex : data.vertices ) {
+        if( glm::vec3{ vertex } == p ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void test_ratio() {
+    auto builder = grid();
+    CHECK( builder.triangle_count() == 2 * GRID * GRID );
+
+    auto same = builder.simplify( 1.0 );
+    CHECK( same.triangle_count() == builder.triangle_count() );
+
+    auto simplified = builder.simplify( 0.25 );
+    auto data = simplified.bake();
+    CHECK( simplified.triangle_count() > 0 );
+    CHECK( simplified.triangle_count() <= builder.triangle_count() / 4 );
+    // every attribute stays per vertex
+    CHECK( data->normals.size() == data->vertices.size() );
+    CHECK( data->texcoords.size() == data->vertices.size() );
+    // a flat grid with a fixed border keeps its area exactly when nothing flips or overlaps
+    CHECK_NEAR( check_flat_triangles( *data ), (float)( GRID * GRID ), 1e-3f );
+    for( int i=0; i<=GRID; i++ ) {
+        CHECK( has_position( *data, glm::vec3{ i, 0, 0 } ) );
+        CHECK( has_position( *data, glm::vec3{ i, 0, GRID } ) );
+        CHECK( has_position( *data, glm::vec3{ 0, 0, i } ) );
+        CHECK( has_position( *data, glm::vec3{ GRID, 0, i } ) );
+    }
+}
+
+static void test_seam() {
+    const int seam_x = GRID / 2;
+    auto simplified = grid( seam_x ).simplify( 0.0 );
+    auto data = simplified.bake();
+    CHECK_NEAR( check_flat_triangles( *data ), (float)( GRID * GRID ), 1e-3f );
+    // both sides of every seam vertex remain
+    for( int z=0; z<=GRID; z++ ) {
+        int sides = 0;
+        for( size_t i=0; i<data->vertices.size(); i++ ) {
+            if( glm::vec3{ data->vertices[i] } == glm::vec3{ seam_x, 0, z } ) {
+                sides++;
+            }
+        }
+        CHECK( sides == 2 );
+    }
+}
+
+static void test_max_error() {
+    MeshBuilder sphere;
+    sphere.icosphere( 1.0, 3 );
+    // no collapse on a sphere is free
+    auto kept = sphere.simplify( 0.0, 0.0 );
+    CHECK( kept.triangle_count() == sphere.triangle_count() );
+
+    auto coarse = sphere.simplify( 0.5 );
+    CHECK( coarse.triangle_count() <= sphere.triangle_count() / 2 );
+    CHECK( coarse.triangle_count() > 0 );
+    // vertices are kept, never moved
+    auto data = coarse.bake();
+    for( const auto& vertex : data->vertices ) {
+        CHECK_NEAR( glm::length( glm::vec3{ vertex } ), 1.0f, 1e-5f );
+    }
+}
+
+int main() {
+    test_ratio();
+    test_seam();
+    test_max_error();
+    return check_result();
+}
@@ -0,0 +1,40 @@
+#ifndef _REPLICATOR_TESTS_RANDOM_H_
+#define _REPLICATOR_TESTS_RANDOM_H_
+
+#include "glm/vec3.hpp"
+
+#include <random>
+#include <type_traits>
+
+// Random inputs for the tests. Each test seeds the engine at the start of main
+// so every run sees the same inputs and a failure reproduces.
+
+inline std::mt19937& random_engine() {
+    static std::mt19937 engine;
+    return engine;
+}
+
+// Uniform value in [min, max]
+template <class T>
+inline T random_uniform( T min, T max ) {
+    if constexpr( std::is_integral_v<T> ) {
+        return std::uniform_int_distribution<T>{ min, max }( random_engine() );
+    } else {
+        return std::uniform_real_distribution<T>{ min, max }( random_engine() );
+    }
+}
+
+inline float random_float( float min, float max ) {
+    return random_uniform<float>( min, max );
+}
+
+inline int random_int( int min, int max ) {
+    return random_uniform<int>( min, max );
+}
+
+// Vector with each component uniform in [min, max]
+inline glm::vec3 random_vec3( float min, float max ) {
+    return glm::vec3{ random_float( min, max ), random_float( min, max ), random_float( min, max ) };
+}
+
+#endif // _REPLICATOR_TESTS_RANDOM_H_
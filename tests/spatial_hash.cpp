@@ -0,0 +1,222 @@
+// SpatialHash against brute force: after every rebuild in a run of inserts,
+// moves, far moves and removes, pairs and box and ray queries find exactly
+// the boxes testing every box finds. Rebuilds and pairs split over a pool
+// match the single threaded ones.
+#include "check.hpp"
+#include "random.hpp"
+
+#include "geometry/spatial_hash.hpp"
+#include "geometry/ray_packet.hpp"
+#include "thread_pool.hpp"
+
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// mostly small boxes, some over more than MAX_CELLS cells, some far away
+static Box random_box() {
+    int kind = random_int( 0, 19 );
+    glm::vec3 min = kind == 0 ? random_vec3( -1000, 1000 ) : random_vec3( -50, 50 );
+    glm::vec3 size = kind == 1 ? random_vec3( 20, 60 ) : random_vec3( 0, 6 );
+    return Box{ min, min + size };
+}
+
+static std::vector<uint32_t> live_ids( const std::vector<bool>& alive ) {
+    std::vector<uint32_t> ids;
+    for( uint32_t id=0; id<alive.size(); id++ ) {
+        if( alive[id] ) {
+            ids.push_back( id );
+        }
+    }
+    return ids;
+}
+
+static void check_pairs( const SpatialHash& hash, const std::vector<bool>& alive ) {
+    std::vector<std::pair<uint32_t, uint32_t>> pairs, expected;
+    hash.pairs( pairs );
+    auto ids = live_ids( alive );
+    for( size_t i=0; i<ids.size(); i++ ) {
+        for( size_t j=i+1; j<ids.size(); j++ ) {
+            if( hash.box( ids[i] ).intersects( hash.box( ids[j] ) ) ) {
+                expected.emplace_back( ids[i], ids[j] );
+            }
+        }
+    }
+    for( const auto& pair : pairs ) {
+        CHECK( pair.first < pair.second );
+    }
+    // each pair once
+    auto sorted = pairs;
+    std::sort( sorted.begin(), sorted.end() );
+    CHECK( std::adjacent_find( sorted.begin(), sorted.end() ) == sorted.end() );
+    CHECK( sorted == expected );
+}
+
+static void check_box_queries( const SpatialHash& hash, const std::vector<bool>& alive ) {
+    std::vector<uint32_t> ids;
+    for( int i=0; i<30; i++ ) {
+        auto box = random_box();
+        hash.query( box, ids );
+        std::vector<uint32_t> expected;
+        for( auto id : live_ids( alive ) ) {
+            if( hash.box( id ).intersects( box ) ) {
+                expected.push_back( id );
+            }
+        }
+        std::sort( ids.begin(), ids.end() );
+        CHECK( ids == expected );
+    }
+}
+
+static void check_ray_queries( const SpatialHash& hash, const std::vector<bool>& alive ) {
+    std::vector<std::pair<uint32_t, float>> hits;
+    for( int i=0; i<30; i++ ) {
+        auto direction = random_vec3( -1, 1 );
+        // some rays along the cell walls' normals
+        if( i % 5 == 0 ) {
+            direction = glm::vec3{0.0};
+            direction[ i % 3 ] = i % 2 ? 1.0 : -1.0;
+        }
+        Ray ray{ random_vec3( -60, 60 ), glm::normalize( direction ) };
+        float max_distance = i % 2 ? 40.0f : std::numeric_limits<float>::infinity();
+        hash.query( ray, hits, max_distance );
+
+        RayPacket<1> packet;
+        packet.set( 0, ray, max_distance );
+        std::vector<uint32_t> expected;
+        for( auto id : live_ids( alive ) ) {
+            float distance;
+            if( packet.intersects( hash.box( id ), &distance ) ) {
+                expected.push_back( id );
+            }
+        }
+        std::vector<uint32_t> ids;
+        for( size_t h=0; h<hits.size(); h++ ) {
+            ids.push_back( hits[h].first );
+            CHECK( h == 0 || hits[h - 1].second <= hits[h].second );
+            CHECK( hits[h].second >= 0.0f && hits[h].second <= max_distance );
+        }
+        std::sort( ids.begin(), ids.end() );
+        CHECK( ids == expected );
+    }
+}
+
+static void check( const SpatialHash& hash, const std::vector<bool>& alive ) {
+    CHECK( hash.size() == live_ids( alive ).size() );
+    check_pairs( hash, alive );
+    check_box_queries( hash, alive );
+    check_ray_queries( hash, alive );
+}
+
+static void test_cycles() {
+    for( float cell_size : { 1.0f, 4.0f, 16.0f } ) {
+        SpatialHash hash{ cell_size };
+        std::vector<bool> alive;
+        auto insert = [&hash, &alive](){
+            auto id = hash.insert( random_box() );
+            alive.resize( std::max<size_t>( alive.size(), id + 1 ), false );
+            CHECK( !alive[id] );
+            alive[id] = true;
+        };
+        for( int i=0; i<200; i++ ) {
+            insert();
+        }
+        hash.rebuild();
+        check( hash, alive );
+
+        for( int cycle=0; cycle<12; cycle++ ) {
+            for( auto id : live_ids( alive ) ) {
+                int action = random_int( 0, 9 );
+                if( action < 4 ) {
+                    // small moves, mostly within the same cells
+                    auto box = hash.box( id );
+                    auto offset = random_vec3( -1, 1 );
+                    hash.set( id, Box{ box.min() + offset, box.max() + offset } );
+                } else if( action == 4 ) {
+                    hash.set( id, random_box() );
+                } else if( action == 5 ) {
+                    hash.remove( id );
+                    alive[id] = false;
+                }
+            }
+            // removed ids are reused
+            for( int i=0; i<20; i++ ) {
+                insert();
+            }
+            hash.rebuild();
+            check( hash, alive );
+        }
+
+        hash.clear();
+        hash.rebuild();
+        std::fill( alive.begin(), alive.end(), false );
+        check( hash, alive );
+        CHECK( hash.entry_count() == 0 );
+    }
+}
+
+// enough boxes for several chunks, the same edits on both hashes
+static void test_pool() {
+    ThreadPool pool{ 3 };
+    SpatialHash single{ 2.0 }, parallel{ 2.0 };
+    // small boxes only, oversized ones are tested on their own against all
+    auto random_small_box = [](){
+        auto min = random_vec3( -100, 100 );
+        return Box{ min, min + random_vec3( 0, 3 ) };
+    };
+    for( int i=0; i<40000; i++ ) {
+        auto box = random_small_box();
+        CHECK( single.insert( box ) == parallel.insert( box ) );
+    }
+    std::vector<std::pair<uint32_t, uint32_t>> single_pairs, parallel_pairs;
+    for( int cycle=0; cycle<4; cycle++ ) {
+        single.rebuild();
+        parallel.rebuild( &pool );
+        CHECK( single.entry_count() == parallel.entry_count() );
+        single.pairs( single_pairs );
+        parallel.pairs( parallel_pairs, &pool );
+        CHECK( single_pairs == parallel_pairs );
+        CHECK( !single_pairs.empty() );
+        std::vector<uint32_t> single_ids, parallel_ids;
+        for( int i=0; i<20; i++ ) {
+            auto box = random_small_box();
+            single.query( box, single_ids );
+            parallel.query( box, parallel_ids );
+            std::sort( single_ids.begin(), single_ids.end() );
+            std::sort( parallel_ids.begin(), parallel_ids.end() );
+            CHECK( single_ids == parallel_ids );
+        }
+        // a third of the boxes move, some of them change cells
+        for( uint32_t id=cycle; id<40000; id+=3 ) {
+            auto box = single.box( id );
+            auto offset = random_vec3( -1, 1 );
+            box = Box{ box.min() + offset, box.max() + offset };
+            single.set( id, box );
+            parallel.set( id, box );
+        }
+    }
+}
+
+static void test_empty() {
+    SpatialHash hash;
+    hash.rebuild();
+    std::vector<uint32_t> ids{ 1 };
+    hash.query( Box{ glm::vec3{ -1.0 }, glm::vec3{ 1.0 } }, ids );
+    CHECK( ids.empty() );
+    std::vector<std::pair<uint32_t, uint32_t>> pairs{ { 0, 1 } };
+    hash.pairs( pairs );
+    CHECK( pairs.empty() );
+    std::vector<std::pair<uint32_t, float>> hits{ { 0, 0.0f } };
+    hash.query( Ray{ glm::vec3{0.0}, glm::vec3{ 1.0, 0.0, 0.0 } }, hits );
+    CHECK( hits.empty() );
+}
+
+int main() {
+    random_engine().seed( 3 );
+    test_empty();
+    test_cycles();
+    test_pool();
+    return check_result();
+}